@@ -0,0 +1,41 @@
+/**
+ * @file alloc_hooks.h
+ * Interposition of heap allocator used to detect allocations in code
+ * that must not allocate and to find allocation hot spots.
+ */
+#ifndef ALLOC_HOOKS_H
+#define ALLOC_HOOKS_H
+
+/** Start counting heap allocations made by any thread */
+void alloc_hooks_start (void);
+
+/** Stop counting heap allocations */
+void alloc_hooks_stop (void);
+
+/** Get number of heap allocations counted so far
+ * @returns number of allocations
+ */
+unsigned long alloc_hooks_count (void);
+
+/** Get number of bytes requested by counted heap allocations
+ * @returns number of bytes
+ */
+unsigned long alloc_hooks_bytes (void);
+
+/** Start attributing heap allocations to call sites and frames */
+void alloc_hooks_start_tracking (void);
+
+/** Set number of frame that subsequent allocations belong to
+ * @param frame frame number, 0 is reserved for allocations before main loop
+ */
+void alloc_hooks_set_frame (unsigned long frame);
+
+/** Stop tracking and print top call sites and frames, peak heap usage and
+ * peak resident set size
+ *
+ * Tracking can't be restarted after report.
+ * @param n_top maximum number of call sites to print
+ */
+void alloc_hooks_report (unsigned int n_top);
+
+#endif /* ALLOC_HOOKS_H */
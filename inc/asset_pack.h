@@ -0,0 +1,135 @@
+/**
+ * @file asset_pack.h
+ * Single-file archive of assets looked up by name.
+ *
+ * Pack starts with header and index of entries sorted by 64-bit hash of
+ * name. Header holds fanout table counting entries by the top byte of
+ * hash, so lookup inspects only entries that share it. Index is followed
+ * by NUL-terminated names and by payloads aligned to ASSET_PACK_ALIGNMENT.
+ * Payload is either stored as is, so it can be used straight from the
+ * mapping, or split into independent LZ4 blocks of ASSET_PACK_BLOCK_SIZE
+ * bytes that are decompressed in parallel. Compressed payload starts with
+ * table of end offsets of its blocks; block whose compressed size equals
+ * its uncompressed size is stored as is.
+ */
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+#include <stddef.h>
+#include <GL/glcorearb.h>
+
+/** Magic number of asset pack, "GBPK" in little endian */
+#define ASSET_PACK_MAGIC 0x4B504247u
+
+/** Version of asset pack layout */
+#define ASSET_PACK_VERSION 1u
+
+/** Alignment of payloads from start of file */
+#define ASSET_PACK_ALIGNMENT 64u
+
+/** Size of uncompressed data of single LZ4 block */
+#define ASSET_PACK_BLOCK_SIZE 65536u
+
+/** Flag of entry whose payload is compressed */
+#define ASSET_PACK_LZ4 1u
+
+/** Header at the start of asset pack */
+typedef struct asset_pack_header_t {
+    GLuint magic; /**< ASSET_PACK_MAGIC */
+    GLuint version; /**< ASSET_PACK_VERSION */
+    GLuint n_entries; /**< Number of entries */
+    GLuint names_size; /**< Size of names in bytes */
+    GLuint fanout[256]; /**< Number of entries with top byte of hash <= i */
+} asset_pack_header_t;
+
+/** Entry of index */
+typedef struct asset_pack_entry_t {
+    GLuint64 hash; /**< Hash of name, see asset_pack_hash() */
+    GLuint64 offset; /**< Offset of payload from start of file */
+    GLuint packed_size; /**< Size of payload in file */
+    GLuint size; /**< Size of asset */
+    GLuint name_offset; /**< Offset of name from start of names */
+    GLuint flags; /**< ASSET_PACK_LZ4 if payload is compressed */
+} asset_pack_entry_t;
+
+/** Asset pack mapped into memory */
+typedef struct asset_pack_t {
+    const asset_pack_header_t *header; /**< Header of mapped pack */
+    const asset_pack_entry_t *entries; /**< Index of mapped pack */
+    const char *names; /**< Names of entries */
+    void *mapping; /**< Start of mapping */
+    size_t size; /**< Size of mapping in bytes */
+} asset_pack_t;
+
+/** Hash name of asset
+ * @param name name of asset
+ * @returns 64-bit FNV-1a hash of name
+ */
+GLuint64 asset_pack_hash (const char *name);
+
+/** Map asset pack into memory and validate its index
+ *
+ * Safe to call from any thread, doesn't use worker threads.
+ * @param pack receives mapped pack
+ * @param path path to file
+ * @returns 0 on success, -1 if file can't be mapped or is malformed
+ */
+int asset_pack_open (asset_pack_t *pack, const char *path);
+
+/** Unmap asset pack, entries and payloads become invalid
+ * @param pack mapped pack
+ */
+void asset_pack_close (asset_pack_t *pack);
+
+/** Find asset by name
+ * @param pack mapped pack
+ * @param name name of asset
+ * @returns entry of asset, NULL if pack has no such asset
+ */
+const asset_pack_entry_t *asset_pack_find (const asset_pack_t *pack,
+        const char *name);
+
+/** Get name of entry
+ * @param pack mapped pack
+ * @param entry entry of pack
+ * @returns NUL-terminated name inside mapping
+ */
+const char *asset_pack_name (const asset_pack_t *pack,
+                             const asset_pack_entry_t *entry);
+
+/** Get payload of uncompressed entry
+ * @param pack mapped pack
+ * @param entry entry of pack
+ * @returns entry->size bytes of asset inside mapping, NULL if entry is
+ * compressed
+ */
+const void *asset_pack_stored (const asset_pack_t *pack,
+                               const asset_pack_entry_t *entry);
+
+/** Decompress or copy assets using worker threads
+ *
+ * Blocks of all entries are spread across workers, so single large asset
+ * is decompressed in parallel as well.
+ * @param pack mapped pack
+ * @param entries entries to read
+ * @param dst receives entries[i]->size bytes of each asset
+ * @param n number of entries
+ * @returns 0 on success, -1 if some payload is corrupt
+ */
+int asset_pack_read (const asset_pack_t *pack,
+                     const asset_pack_entry_t *const *entries,
+                     void *const *dst, unsigned int n);
+
+/** Write asset pack, used by asset converters
+ * @param path path to file to create or replace
+ * @param names names of assets
+ * @param data contents of assets
+ * @param sizes sizes of assets in bytes
+ * @param n number of assets
+ * @param compress non-zero to compress assets that shrink with LZ4
+ * @returns 0 on success, -1 on I/O error or if assets don't fit pack
+ */
+int asset_pack_write (const char *path, const char *const *names,
+                      const void *const *data, const size_t *sizes,
+                      unsigned int n, int compress);
+
+#endif /* ASSET_PACK_H */
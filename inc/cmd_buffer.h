@@ -0,0 +1,135 @@
+/**
+ * @file cmd_buffer.h
+ * Compact buffers of rendering commands recorded on any thread and
+ * replayed on the thread that owns OpenGL context.
+ *
+ * Each job records into its own buffer, so recording needs no locks.
+ * Memory of buffers comes from frame arena, therefore buffers must be
+ * replayed no later than in the frame after the one they were recorded in.
+ */
+#ifndef CMD_BUFFER_H
+#define CMD_BUFFER_H
+#include <stddef.h>
+#include <GL/glcorearb.h>
+#include "frame_arena.h"
+
+/** Chunk of command words allocated from frame arena */
+typedef struct cmd_chunk_t {
+    struct cmd_chunk_t *next; /**< Next chunk of the same buffer */
+    size_t n_words; /**< Number of recorded words in this chunk */
+} cmd_chunk_t;
+
+/** Buffer of recorded commands */
+typedef struct cmd_buffer_t {
+    frame_arena_t *arena; /**< Arena the chunks are allocated from */
+    cmd_chunk_t *first; /**< The first chunk, NULL if buffer is empty */
+    cmd_chunk_t *last; /**< Chunk commands are recorded into */
+    GLuint *cursor; /**< Next free word of the last chunk */
+    GLuint *end; /**< End of the last chunk */
+    unsigned long n_commands; /**< Number of recorded commands */
+    unsigned long n_dropped; /**< Number of commands that didn't fit or
+                               need base instance unsupported by context */
+} cmd_buffer_t;
+
+/** Start recording into empty buffer
+ * @param buffer buffer to initialize
+ * @param arena arena that chunks of buffer are allocated from
+ */
+void cmd_buffer_begin (cmd_buffer_t *buffer, frame_arena_t *arena);
+
+/** Record use of program
+ * @param buffer target buffer
+ * @param program program to use
+ */
+void cmd_use_program (cmd_buffer_t *buffer, GLuint program);
+
+/** Record binding of vertex array
+ * @param buffer target buffer
+ * @param vertex_array vertex array to bind
+ */
+void cmd_bind_vertex_array (cmd_buffer_t *buffer, GLuint vertex_array);
+
+/** Record binding of buffer range to indexed binding point
+ * @param buffer target buffer
+ * @param target GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER
+ * @param index index of binding point
+ * @param object buffer object to bind
+ * @param offset offset of range in bytes
+ * @param size size of range in bytes
+ */
+void cmd_bind_buffer_range (cmd_buffer_t *buffer, GLenum target, GLuint index,
+                            GLuint object, GLuint offset, GLuint size);
+
+/** Record binding of texture to texture unit
+ * @param buffer target buffer
+ * @param unit index of texture unit
+ * @param target texture target
+ * @param texture texture to bind
+ */
+void cmd_bind_texture (cmd_buffer_t *buffer, GLuint unit, GLenum target,
+                       GLuint texture);
+
+/** Record enabling or disabling capability
+ * @param buffer target buffer
+ * @param cap capability
+ * @param enabled non-zero to enable capability
+ */
+void cmd_set_enabled (cmd_buffer_t *buffer, GLenum cap, int enabled);
+
+/** Record change of blending factors
+ * @param buffer target buffer
+ * @param src_rgb source factor of color
+ * @param dst_rgb destination factor of color
+ * @param src_alpha source factor of alpha
+ * @param dst_alpha destination factor of alpha
+ */
+void cmd_blend_func (cmd_buffer_t *buffer, GLenum src_rgb, GLenum dst_rgb,
+                     GLenum src_alpha, GLenum dst_alpha);
+
+/** Record change of depth write mask
+ * @param buffer target buffer
+ * @param write non-zero to enable writing into depth buffer
+ */
+void cmd_depth_mask (cmd_buffer_t *buffer, int write);
+
+/** Record indexed draw
+ *
+ * Draw with non-zero base instance is dropped if context lacks
+ * glDrawElementsInstancedBaseVertexBaseInstance.
+ * @param buffer target buffer
+ * @param mode primitive type
+ * @param count number of indices
+ * @param type type of indices
+ * @param offset offset of the first index in element array buffer in bytes
+ * @param instances number of instances
+ * @param base_vertex value added to each index
+ * @param base_instance index of the first instance
+ */
+void cmd_draw_elements (cmd_buffer_t *buffer, GLenum mode, GLsizei count,
+                        GLenum type, GLuint offset, GLsizei instances,
+                        GLint base_vertex, GLuint base_instance);
+
+/** Record non-indexed draw
+ *
+ * Draw with non-zero base instance is dropped if context lacks
+ * glDrawArraysInstancedBaseInstance.
+ * @param buffer target buffer
+ * @param mode primitive type
+ * @param first index of the first vertex
+ * @param count number of vertices
+ * @param instances number of instances
+ * @param base_instance index of the first instance
+ */
+void cmd_draw_arrays (cmd_buffer_t *buffer, GLenum mode, GLint first,
+                      GLsizei count, GLsizei instances, GLuint base_instance);
+
+/** Execute recorded commands on the thread that owns current context
+ *
+ * State changes go through gl_state, so redundant changes between
+ * buffers recorded by different jobs are filtered.
+ * @param buffers buffers to execute, in submission order
+ * @param n_buffers number of buffers
+ */
+void cmd_replay (const cmd_buffer_t *buffers, unsigned int n_buffers);
+
+#endif /* CMD_BUFFER_H */
@@ -0,0 +1,37 @@
+/**
+ * @file cull.h
+ * Culling of bounding volumes stored as structure of arrays against view
+ * frustum, partitioned across worker threads.
+ */
+#ifndef CULL_H
+#define CULL_H
+#include <stddef.h>
+
+/** Find bounding spheres that intersect view frustum
+ * @param view_projection view-projection matrix of frame
+ * @param x x coordinates of centers
+ * @param y y coordinates of centers
+ * @param z z coordinates of centers
+ * @param radius radii of spheres
+ * @param n number of spheres
+ * @param visible receives indices of visible spheres in ascending order,
+ * must have room for n indices
+ * @returns number of visible spheres
+ */
+size_t cull_spheres (const float *view_projection, const float *x,
+                     const float *y, const float *z, const float *radius,
+                     size_t n, unsigned int *visible);
+
+/** Find axis-aligned bounding boxes that intersect view frustum
+ * @param view_projection view-projection matrix of frame
+ * @param bounds six arrays: x, y and z of centers and x, y and z of
+ * half-extents
+ * @param n number of boxes
+ * @param visible receives indices of visible boxes in ascending order,
+ * must have room for n indices
+ * @returns number of visible boxes
+ */
+size_t cull_boxes (const float *view_projection, const float *const *bounds,
+                   size_t n, unsigned int *visible);
+
+#endif /* CULL_H */
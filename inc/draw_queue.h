@@ -0,0 +1,110 @@
+/**
+ * @file draw_queue.h
+ * Queue of draws submitted in any order and executed sorted by 64-bit key.
+ *
+ * Opaque keys are ordered by pass, layer, program, material and then
+ * front-to-back depth, so draws sharing state are executed together.
+ */
+#ifndef DRAW_QUEUE_H
+#define DRAW_QUEUE_H
+#include <stddef.h>
+#include <GL/glcorearb.h>
+#include "frame_arena.h"
+
+/** Binding point of GL_UNIFORM_BUFFER that receives uniforms of draw */
+#define DRAW_UNIFORM_BINDING 0
+
+/** Draw and state it needs */
+typedef struct draw_t {
+    GLuint program; /**< Program to use */
+    GLuint vertex_array; /**< Vertex array to bind */
+    GLuint texture; /**< GL_TEXTURE_2D bound to unit 0, 0 if none */
+    GLuint uniform_buffer; /**< Buffer of uniforms, 0 if none */
+    GLuint uniform_offset; /**< Offset of uniforms in buffer in bytes */
+    GLuint uniform_size; /**< Size of uniforms in bytes */
+    GLenum mode; /**< Primitive type */
+    GLenum index_type; /**< Type of indices, 0 for non-indexed draw */
+    GLuint first; /**< Offset of the first index in bytes, or the first
+                    vertex of non-indexed draw */
+    GLsizei count; /**< Number of indices or vertices */
+    GLsizei instances; /**< Number of instances */
+    GLint base_vertex; /**< Value added to each index */
+    GLuint base_instance; /**< Index of the first instance */
+    int is_blended; /**< Non-zero to blend over destination without writing
+                      depth */
+} draw_t;
+
+/** Submitted draw */
+typedef struct draw_item_t {
+    GLuint64 key; /**< Sort key */
+    const draw_t *draw; /**< Draw to execute */
+} draw_item_t;
+
+/** Queue of draws of single frame */
+typedef struct draw_queue_t {
+    frame_arena_t *arena; /**< Arena items are allocated from */
+    draw_item_t *items; /**< Submitted draws */
+    size_t capacity; /**< Maximum number of draws */
+    size_t n_items; /**< Number of submitted draws */
+    unsigned long n_frames; /**< Number of frames since previous report */
+    unsigned long n_draws; /**< Number of draws since previous report */
+    unsigned long n_dropped; /**< Number of draws or their commands that
+                               didn't fit */
+    unsigned long n_rejected; /**< Number of draws with base instance
+                                unsupported by context */
+    double sort_ms; /**< Time spent sorting since previous report */
+} draw_queue_t;
+
+/** Build key of opaque draw
+ * @param pass render pass, 0-15
+ * @param layer layer inside of pass, 0-15
+ * @param program program identifier, 0-4095
+ * @param material material identifier, 0-1048575
+ * @param depth view depth normalized to [0, 1]
+ * @returns sort key
+ */
+GLuint64 draw_key_opaque (unsigned int pass, unsigned int layer,
+                          unsigned int program, unsigned int material,
+                          float depth);
+
+/** Start collecting draws of new frame
+ * @param queue queue to reset
+ * @param arena arena that items and sort memory are allocated from
+ * @param capacity maximum number of draws in frame
+ */
+void draw_queue_begin (draw_queue_t *queue, frame_arena_t *arena,
+                       size_t capacity);
+
+/** Submit draw
+ *
+ * It is safe to call this function from several threads at once.
+ * @param queue target queue
+ * @param key sort key of draw
+ * @param draw draw to execute, must stay valid until draw_queue_execute()
+ * @returns 0 on success, -1 if queue is full or draw has non-zero base
+ * instance and context lacks glDraw*BaseInstance (OpenGL 4.2); such draws
+ * are counted and reported by draw_queue_print_stats()
+ */
+int draw_queue_submit (draw_queue_t *queue, GLuint64 key,
+                       const draw_t *draw);
+
+/** Sort submitted draws by key
+ * @param queue queue to sort
+ */
+void draw_queue_sort (draw_queue_t *queue);
+
+/** Execute draws in queue order on the thread that owns current context
+ *
+ * Slices of sorted draws are recorded into command buffers on worker
+ * threads, then buffers are replayed in order on the calling thread.
+ * @param queue queue to execute
+ */
+void draw_queue_execute (draw_queue_t *queue);
+
+/** Print number of draws and time of sorting since previous call and
+ * reset counters
+ * @param queue queue to report
+ */
+void draw_queue_print_stats (draw_queue_t *queue);
+
+#endif /* DRAW_QUEUE_H */
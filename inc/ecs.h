@@ -0,0 +1,163 @@
+/**
+ * @file ecs.h
+ * Entity-component store grouped by archetype.
+ *
+ * Entities with the same set of components share an archetype whose
+ * components are kept in fixed size chunks, one contiguous array per
+ * component, so systems iterate each component linearly. Archetypes stay
+ * dense: entity whose components change moves to another archetype and the
+ * last entity of the old one takes its place.
+ *
+ * Systems declare components they read and write. ecs_run() executes
+ * systems that don't conflict in parallel on worker threads, chunk by
+ * chunk, and preserves order of systems that do.
+ */
+#ifndef ECS_H
+#define ECS_H
+#include <stddef.h>
+
+/** Maximum number of registered components */
+#define ECS_MAX_COMPONENTS 32
+
+/** Maximum number of systems passed to single ecs_run() */
+#define ECS_MAX_SYSTEMS 64
+
+/** Handle that refers to no entity */
+#define ECS_NULL_ENTITY 0u
+
+/** Mask of component with given identifier */
+#define ECS_COMPONENT(id) (1ul << (id))
+
+/** Set of components, bit N stands for component with identifier N */
+typedef unsigned long ecs_mask_t;
+
+/** Handle of entity, index in low bits and generation in high bits */
+typedef unsigned int ecs_entity_t;
+
+/** Chunk of entities of single archetype */
+typedef struct ecs_chunk_t ecs_chunk_t;
+
+/** Set of entities with the same components */
+typedef struct ecs_archetype_t ecs_archetype_t;
+
+/** Location of entity */
+typedef struct ecs_record_t {
+    ecs_chunk_t *chunk; /**< Chunk entity lives in, NULL if it is free */
+    unsigned int row; /**< Index of entity in chunk */
+    unsigned int generation; /**< Generation of the handle of entity */
+} ecs_record_t;
+
+/** Pair of system and chunk it is executed on */
+typedef struct ecs_work_t {
+    ecs_chunk_t *chunk; /**< Chunk to process */
+    unsigned int system; /**< Index of system */
+    char padding[4];
+} ecs_work_t;
+
+/** Storage of all entities and their components */
+typedef struct ecs_world_t {
+    size_t sizes[ECS_MAX_COMPONENTS]; /**< Size of each component */
+    ecs_archetype_t *archetypes; /**< Archetypes created so far */
+    ecs_record_t *records; /**< Location of each entity */
+    unsigned int *free_entities; /**< Stack of free entity indices */
+    ecs_work_t *work; /**< Scratch list of work of ecs_run() */
+    size_t work_capacity; /**< Capacity of work list */
+    unsigned int n_components; /**< Number of registered components */
+    unsigned int n_archetypes; /**< Number of archetypes */
+    unsigned int max_archetypes; /**< Capacity of archetypes */
+    unsigned int max_entities; /**< Maximum number of live entities */
+    unsigned int n_free; /**< Number of free entity indices */
+    unsigned int n_entities; /**< Number of live entities */
+} ecs_world_t;
+
+/** View of components of entities of single chunk */
+typedef struct ecs_view_t {
+    const ecs_entity_t *entities; /**< Entities of chunk */
+    unsigned char *base; /**< Start of component arrays */
+    const size_t *offsets; /**< Offset of each component array */
+    unsigned int n_entities; /**< Number of entities in chunk */
+    char padding[4];
+} ecs_view_t;
+
+/** System function, called once per chunk of each matching archetype
+ * @param arg user data of system
+ * @param view components of chunk
+ */
+typedef void (*ecs_system_fn) (void *arg, const ecs_view_t *view);
+
+/** System that processes entities having all components it accesses */
+typedef struct ecs_system_t {
+    ecs_system_fn fn; /**< Function called for each chunk */
+    void *arg; /**< User data passed to fn */
+    ecs_mask_t reads; /**< Components that are only read */
+    ecs_mask_t writes; /**< Components that are written */
+} ecs_system_t;
+
+/** Allocate storage of world
+ * @param world world to initialize
+ * @param max_entities maximum number of live entities
+ * @returns 0 on success, -1 if out of memory
+ */
+int ecs_init (ecs_world_t *world, unsigned int max_entities);
+
+/** Free all entities and storage of world
+ * @param world world to destroy
+ */
+void ecs_destroy (ecs_world_t *world);
+
+/** Register component type
+ * @param world target world
+ * @param size size of component in bytes
+ * @returns identifier of component, -1 if too many components registered
+ */
+int ecs_register_component (ecs_world_t *world, size_t size);
+
+/** Create entity with zero-filled components
+ * @param world target world
+ * @param components set of components of entity
+ * @returns handle of entity, ECS_NULL_ENTITY if out of memory or entities
+ */
+ecs_entity_t ecs_create (ecs_world_t *world, ecs_mask_t components);
+
+/** Change set of components of entity
+ *
+ * Components that entity keeps are preserved, new ones are zero-filled.
+ * @param world target world
+ * @param entity entity to change
+ * @param components new set of components
+ * @returns 0 on success, -1 if entity is invalid or out of memory
+ */
+int ecs_set_components (ecs_world_t *world, ecs_entity_t entity,
+                        ecs_mask_t components);
+
+/** Get component of entity
+ *
+ * Pointer is invalidated by creation or change of any entity.
+ * @param world target world
+ * @param entity entity to query
+ * @param component identifier of component
+ * @returns component, NULL if entity is invalid or doesn't have component
+ */
+void *ecs_get (ecs_world_t *world, ecs_entity_t entity,
+               unsigned int component);
+
+/** Get array of component in view
+ * @param view view passed to system
+ * @param component identifier of component accessed by system
+ * @returns array of n_entities components
+ */
+void *ecs_view_column (const ecs_view_t *view, unsigned int component);
+
+/** Execute systems on all matching entities
+ *
+ * Each system is ordered after all previous systems that write what it
+ * accesses or access what it writes. Systems must not create, remove or
+ * change entities.
+ * @param world target world
+ * @param systems systems in order of execution
+ * @param n_systems number of systems, at most ECS_MAX_SYSTEMS
+ */
+void ecs_run (ecs_world_t *world, const ecs_system_t *systems,
+              unsigned int n_systems);
+
+#endif /* ECS_H */
@@ -0,0 +1,54 @@
+/**
+ * @file frame_arena.h
+ * Linear allocator for memory that lives no longer than two frames.
+ */
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+#include <stddef.h>
+
+/** Double-buffered bump allocator
+ *
+ * Memory allocated during frame N stays valid until frame_arena_swap() is
+ * called at the end of frame N + 1, so data produced in one frame may be
+ * consumed in the next one without copying.
+ */
+typedef struct frame_arena_t {
+    unsigned char *blocks[2]; /**< Memory of even and odd frames */
+    size_t capacity; /**< Size of each block in bytes */
+    size_t offset; /**< Number of bytes allocated from current block */
+    size_t peak; /**< Largest number of bytes used by single frame */
+    size_t n_failed; /**< Number of allocations that didn't fit */
+    unsigned int current; /**< Index of block used by current frame */
+    char padding[4];
+} frame_arena_t;
+
+/** Allocate memory blocks of arena
+ * @param arena arena to initialize
+ * @param capacity number of bytes available to each frame
+ * @returns 0 on success, -1 if out of memory
+ */
+int frame_arena_init (frame_arena_t *arena, size_t capacity);
+
+/** Free memory blocks of arena
+ * @param arena arena to destroy
+ */
+void frame_arena_destroy (frame_arena_t *arena);
+
+/** Allocate memory for current frame
+ *
+ * It is safe to call this function from several threads at once.
+ * @param arena arena to allocate from
+ * @param size number of bytes to allocate
+ * @returns pointer aligned to 16 bytes, NULL if frame budget is exhausted
+ */
+void *frame_arena_alloc (frame_arena_t *arena, size_t size);
+
+/** Finish current frame
+ *
+ * Memory allocated in previous frame is reclaimed, memory allocated in
+ * current frame stays valid during the next one.
+ * @param arena arena to swap
+ */
+void frame_arena_swap (frame_arena_t *arena);
+
+#endif /* FRAME_ARENA_H */
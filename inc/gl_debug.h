@@ -0,0 +1,22 @@
+/**
+ * @file gl_debug.h
+ * Capture of KHR_debug messages reported by OpenGL driver.
+ *
+ * Driver callback only copies message into lock-free ring. Background
+ * thread prints messages, collapsing repeated ones and limiting the rate
+ * of output, so enabled capture costs almost nothing on render thread.
+ */
+#ifndef GL_DEBUG_H
+#define GL_DEBUG_H
+
+/** Install debug message callback in current context and start logger
+ * @param with_notifications non-zero to capture messages of
+ * GL_DEBUG_SEVERITY_NOTIFICATION severity as well
+ * @returns 0 on success, -1 if context doesn't support KHR_debug
+ */
+int gl_debug_start (int with_notifications);
+
+/** Remove debug message callback, print remaining messages and summary */
+void gl_debug_stop (void);
+
+#endif /* GL_DEBUG_H */
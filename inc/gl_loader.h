@@ -0,0 +1,61 @@
+/**
+ * @file gl_loader.h
+ * Creation of OpenGL objects on loader thread with its own context.
+ *
+ * Loader context is created in share group of render context and made
+ * current on loader thread without window surface, so buffers, textures
+ * and programs created there are visible to render context. Loader thread
+ * issues fence after each job and render thread finishes the job only once
+ * the fence is signaled, so objects are complete before their first use
+ * and neither thread ever waits for the other. Container objects such as
+ * vertex arrays and framebuffers aren't shared and must be created by
+ * render thread in finishing callback.
+ */
+#ifndef GL_LOADER_H
+#define GL_LOADER_H
+#include <EGL/egl.h>
+
+/** Callback of job
+ * @param user user data passed to gl_loader_submit()
+ */
+typedef void (*gl_loader_fn) (void *user);
+
+/** Create loader context and start loader thread
+ *
+ * Must be called on render thread after OpenGL entry points are loaded.
+ * If loader context can't be made current, jobs are created on render
+ * thread instead.
+ * @param display display of render context
+ * @param config configuration of render context
+ * @param share_context render context
+ * @param max_jobs maximum number of jobs in flight
+ * @returns 0 if loader thread runs, -1 otherwise
+ */
+int gl_loader_init (EGLDisplay display, EGLConfig config,
+                    EGLContext share_context, unsigned int max_jobs);
+
+/** Stop loader thread and destroy loader context, jobs in flight are
+ * dropped without finishing callbacks; must be called before render
+ * context is destroyed */
+void gl_loader_shutdown (void);
+
+/** Queue job
+ * @param create callback called with loader context current, it must not
+ * go through gl_state
+ * @param finish callback called on render thread from gl_loader_poll()
+ * once commands of create are complete on GPU, may be NULL
+ * @param user user data passed to callbacks
+ * @returns 0 on success, -1 if too many jobs are in flight
+ */
+int gl_loader_submit (gl_loader_fn create, gl_loader_fn finish, void *user);
+
+/** Finish jobs whose fences are signaled, called by render thread once
+ * per frame */
+void gl_loader_poll (void);
+
+/** Check whether jobs run on loader thread
+ * @returns non-zero if loader thread runs
+ */
+int gl_loader_is_threaded (void);
+
+#endif /* GL_LOADER_H */
@@ -0,0 +1,131 @@
+/**
+ * @file gl_procs.h
+ * OpenGL entry points: 1.0 and 1.1 ones are linked from OpenGL library,
+ * newer ones are resolved at run-time through EGL.
+ */
+#ifndef GL_PROCS_H
+#define GL_PROCS_H
+#include <GL/glcorearb.h>
+
+/** List of OpenGL 1.0 and 1.1 entry points linked directly, as (type, name
+ * without "gl" prefix) */
+#define GL_PROCS_LINKED(X) \
+    X (PFNGLGETSTRINGPROC, GetString) \
+    X (PFNGLGETINTEGERVPROC, GetIntegerv) \
+    X (PFNGLENABLEPROC, Enable) \
+    X (PFNGLDISABLEPROC, Disable) \
+    X (PFNGLVIEWPORTPROC, Viewport) \
+    X (PFNGLCLEARCOLORPROC, ClearColor) \
+    X (PFNGLCLEARPROC, Clear) \
+    X (PFNGLFLUSHPROC, Flush) \
+    X (PFNGLCULLFACEPROC, CullFace) \
+    X (PFNGLDEPTHFUNCPROC, DepthFunc) \
+    X (PFNGLDEPTHMASKPROC, DepthMask) \
+    X (PFNGLBINDTEXTUREPROC, BindTexture) \
+    X (PFNGLPIXELSTOREIPROC, PixelStorei) \
+    X (PFNGLTEXSUBIMAGE2DPROC, TexSubImage2D) \
+    X (PFNGLGENTEXTURESPROC, GenTextures) \
+    X (PFNGLDELETETEXTURESPROC, DeleteTextures) \
+    X (PFNGLTEXPARAMETERIPROC, TexParameteri) \
+    X (PFNGLDRAWARRAYSPROC, DrawArrays)
+
+/** List of other used OpenGL entry points resolved through
+ * eglGetProcAddress, as (type, name without "gl" prefix) */
+#define GL_PROCS(X) \
+    X (PFNGLGETSTRINGIPROC, GetStringi) \
+    X (PFNGLBLENDFUNCSEPARATEPROC, BlendFuncSeparate) \
+    X (PFNGLACTIVETEXTUREPROC, ActiveTexture) \
+    X (PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC, CompressedTexSubImage2D) \
+    X (PFNGLTEXSTORAGE2DPROC, TexStorage2D) \
+    X (PFNGLCOPYIMAGESUBDATAPROC, CopyImageSubData) \
+    X (PFNGLBINDBUFFERPROC, BindBuffer) \
+    X (PFNGLBINDBUFFERBASEPROC, BindBufferBase) \
+    X (PFNGLBINDBUFFERRANGEPROC, BindBufferRange) \
+    X (PFNGLBINDVERTEXARRAYPROC, BindVertexArray) \
+    X (PFNGLGENVERTEXARRAYSPROC, GenVertexArrays) \
+    X (PFNGLDELETEVERTEXARRAYSPROC, DeleteVertexArrays) \
+    X (PFNGLENABLEVERTEXATTRIBARRAYPROC, EnableVertexAttribArray) \
+    X (PFNGLVERTEXATTRIBPOINTERPROC, VertexAttribPointer) \
+    X (PFNGLVERTEXATTRIBIPOINTERPROC, VertexAttribIPointer) \
+    X (PFNGLVERTEXATTRIBDIVISORPROC, VertexAttribDivisor) \
+    X (PFNGLGENBUFFERSPROC, GenBuffers) \
+    X (PFNGLDELETEBUFFERSPROC, DeleteBuffers) \
+    X (PFNGLBUFFERDATAPROC, BufferData) \
+    X (PFNGLBUFFERSUBDATAPROC, BufferSubData) \
+    X (PFNGLBUFFERSTORAGEPROC, BufferStorage) \
+    X (PFNGLMAPBUFFERRANGEPROC, MapBufferRange) \
+    X (PFNGLFENCESYNCPROC, FenceSync) \
+    X (PFNGLCLIENTWAITSYNCPROC, ClientWaitSync) \
+    X (PFNGLDELETESYNCPROC, DeleteSync) \
+    X (PFNGLUSEPROGRAMPROC, UseProgram) \
+    X (PFNGLCREATESHADERPROC, CreateShader) \
+    X (PFNGLSHADERSOURCEPROC, ShaderSource) \
+    X (PFNGLCOMPILESHADERPROC, CompileShader) \
+    X (PFNGLGETSHADERIVPROC, GetShaderiv) \
+    X (PFNGLGETSHADERINFOLOGPROC, GetShaderInfoLog) \
+    X (PFNGLDELETESHADERPROC, DeleteShader) \
+    X (PFNGLCREATEPROGRAMPROC, CreateProgram) \
+    X (PFNGLATTACHSHADERPROC, AttachShader) \
+    X (PFNGLLINKPROGRAMPROC, LinkProgram) \
+    X (PFNGLGETPROGRAMIVPROC, GetProgramiv) \
+    X (PFNGLGETPROGRAMINFOLOGPROC, GetProgramInfoLog) \
+    X (PFNGLDELETEPROGRAMPROC, DeleteProgram) \
+    X (PFNGLGETUNIFORMLOCATIONPROC, GetUniformLocation) \
+    X (PFNGLUNIFORM1IPROC, Uniform1i) \
+    X (PFNGLUNIFORM1FPROC, Uniform1f) \
+    X (PFNGLUNIFORM4FVPROC, Uniform4fv) \
+    X (PFNGLUNIFORMMATRIX4FVPROC, UniformMatrix4fv) \
+    X (PFNGLDRAWARRAYSINSTANCEDPROC, DrawArraysInstanced) \
+    X (PFNGLDRAWARRAYSINSTANCEDBASEINSTANCEPROC, \
+       DrawArraysInstancedBaseInstance) \
+    X (PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXPROC, \
+       DrawElementsInstancedBaseVertex) \
+    X (PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXBASEINSTANCEPROC, \
+       DrawElementsInstancedBaseVertexBaseInstance) \
+    X (PFNGLMULTIDRAWELEMENTSINDIRECTPROC, MultiDrawElementsIndirect) \
+    X (PFNGLDRAWARRAYSINDIRECTPROC, DrawArraysIndirect) \
+    X (PFNGLDISPATCHCOMPUTEPROC, DispatchCompute) \
+    X (PFNGLMEMORYBARRIERPROC, MemoryBarrier) \
+    X (PFNGLGENQUERIESPROC, GenQueries) \
+    X (PFNGLDELETEQUERIESPROC, DeleteQueries) \
+    X (PFNGLBEGINQUERYPROC, BeginQuery) \
+    X (PFNGLENDQUERYPROC, EndQuery) \
+    X (PFNGLQUERYCOUNTERPROC, QueryCounter) \
+    X (PFNGLGETQUERYOBJECTIVPROC, GetQueryObjectiv) \
+    X (PFNGLGETQUERYOBJECTUI64VPROC, GetQueryObjectui64v) \
+    X (PFNGLDEBUGMESSAGECALLBACKPROC, DebugMessageCallback) \
+    X (PFNGLDEBUGMESSAGECONTROLPROC, DebugMessageControl)
+
+/** Declare member of gl_procs_t */
+#define GL_PROCS_MEMBER(type, name) type name;
+
+/** Table of OpenGL entry points, missing ones are NULL */
+typedef struct gl_procs_t {
+    GL_PROCS_LINKED (GL_PROCS_MEMBER)
+    GL_PROCS (GL_PROCS_MEMBER)
+} gl_procs_t;
+
+/** OpenGL entry points of current context */
+extern gl_procs_t gl;
+
+/** Resolve OpenGL entry points
+ *
+ * Must be called after context is made current.
+ * @returns 0 on success, -1 if version of context can't be determined
+ */
+int gl_procs_load (void);
+
+/** Check version of current context
+ * @param major required major version
+ * @param minor required minor version
+ * @returns non-zero if context version is at least major.minor
+ */
+int gl_version_at_least (int major, int minor);
+
+/** Check if current context supports extension
+ * @param name name of extension, e.g. "GL_ARB_timer_query"
+ * @returns non-zero if extension is supported
+ */
+int gl_has_extension (const char *name);
+
+#endif /* GL_PROCS_H */
@@ -0,0 +1,141 @@
+/**
+ * @file gl_state.h
+ * Shadow copy of OpenGL state that drops redundant state changes before
+ * they reach the driver.
+ *
+ * All state changes covered here must go through these functions, or
+ * gl_state_reset() must be called after changing state directly. Objects
+ * must be forgotten when they are deleted, because driver resets bindings
+ * of deleted objects to zero.
+ */
+#ifndef GL_STATE_H
+#define GL_STATE_H
+#include <GL/glcorearb.h>
+
+/** Forget all cached state, next change of each state is always issued */
+void gl_state_reset (void);
+
+/** Bind program object
+ * @param program program to use
+ */
+void gl_state_use_program (GLuint program);
+
+/** Bind vertex array object
+ * @param vertex_array vertex array to bind
+ */
+void gl_state_bind_vertex_array (GLuint vertex_array);
+
+/** Bind buffer object to generic binding point
+ * @param target binding point, e.g. GL_ARRAY_BUFFER
+ * @param buffer buffer to bind
+ */
+void gl_state_bind_buffer (GLenum target, GLuint buffer);
+
+/** Bind buffer object to indexed and generic binding points
+ * @param target GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER or
+ * GL_ATOMIC_COUNTER_BUFFER
+ * @param index index of binding point
+ * @param buffer buffer to bind
+ */
+void gl_state_bind_buffer_base (GLenum target, GLuint index, GLuint buffer);
+
+/** Bind range of buffer object to indexed and generic binding points
+ * @param target GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER or
+ * GL_ATOMIC_COUNTER_BUFFER
+ * @param index index of binding point
+ * @param buffer buffer to bind
+ * @param offset offset of range in bytes
+ * @param size size of range in bytes
+ */
+void gl_state_bind_buffer_range (GLenum target, GLuint index, GLuint buffer,
+                                 GLintptr offset, GLsizeiptr size);
+
+/** Bind texture to texture unit
+ * @param unit index of texture unit, starting from 0
+ * @param target texture target, e.g. GL_TEXTURE_2D
+ * @param texture texture to bind
+ */
+void gl_state_bind_texture (GLuint unit, GLenum target, GLuint texture);
+
+/** Enable or disable capability
+ * @param cap capability, e.g. GL_BLEND
+ * @param enabled non-zero to enable capability
+ */
+void gl_state_set_enabled (GLenum cap, int enabled);
+
+/** Set blending factors
+ * @param src_rgb source factor of color components
+ * @param dst_rgb destination factor of color components
+ * @param src_alpha source factor of alpha component
+ * @param dst_alpha destination factor of alpha component
+ */
+void gl_state_blend_func (GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha,
+                          GLenum dst_alpha);
+
+/** Set depth comparison function
+ * @param func comparison function
+ */
+void gl_state_depth_func (GLenum func);
+
+/** Enable or disable writing into depth buffer
+ * @param enabled non-zero to enable writing
+ */
+void gl_state_depth_mask (int enabled);
+
+/** Select culled faces
+ * @param mode GL_FRONT, GL_BACK or GL_FRONT_AND_BACK
+ */
+void gl_state_cull_face (GLenum mode);
+
+/** Set viewport
+ * @param x left edge of viewport
+ * @param y bottom edge of viewport
+ * @param width width of viewport
+ * @param height height of viewport
+ */
+void gl_state_viewport (GLint x, GLint y, GLsizei width, GLsizei height);
+
+/** Set integer uniform of current program
+ * @param location location of uniform
+ * @param value new value
+ */
+void gl_state_uniform1i (GLint location, GLint value);
+
+/** Set float uniform of current program
+ * @param location location of uniform
+ * @param value new value
+ */
+void gl_state_uniform1f (GLint location, GLfloat value);
+
+/** Set mat4 uniform of current program
+ * @param location location of uniform
+ * @param value sixteen elements of new value in column-major order
+ */
+void gl_state_uniform_matrix4fv (GLint location, const GLfloat *value);
+
+/** Forget program that is about to be deleted or relinked
+ * @param program program object
+ */
+void gl_state_forget_program (GLuint program);
+
+/** Forget vertex array that is about to be deleted
+ * @param vertex_array vertex array object
+ */
+void gl_state_forget_vertex_array (GLuint vertex_array);
+
+/** Forget buffer that is about to be deleted
+ * @param buffer buffer object
+ */
+void gl_state_forget_buffer (GLuint buffer);
+
+/** Forget texture that is about to be deleted
+ * @param texture texture object
+ */
+void gl_state_forget_texture (GLuint texture);
+
+/** Print number of issued and filtered state changes since previous call
+ * and reset counters
+ */
+void gl_state_print_stats (void);
+
+#endif /* GL_STATE_H */
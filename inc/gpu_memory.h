@@ -0,0 +1,89 @@
+/**
+ * @file gpu_memory.h
+ * Accounting of memory of buffer and texture objects against budget.
+ *
+ * Every module that allocates storage of buffer or texture reports its
+ * size here. Once the total would exceed budget, allocations that can be
+ * re-created later, such as fine levels of streamed textures, are evicted
+ * in least recently used order. Allocations that can't be evicted are
+ * always granted and only counted, so usage may still go over budget. On
+ * software rasterizers GPU memory is process memory, and budget caps it.
+ *
+ * All functions must be called on render thread.
+ */
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+#include <stddef.h>
+#include <GL/glcorearb.h>
+
+/** Kinds of tracked objects */
+typedef enum gpu_memory_kind_t {
+    GPU_MEMORY_BUFFER, /**< Storage of buffer object */
+    GPU_MEMORY_TEXTURE /**< Storage of texture object */
+} gpu_memory_kind_t;
+
+/** Release storage of allocation, possibly keeping smaller part of it
+ *
+ * Callback must report new size with gpu_memory_resize() or release
+ * allocation with gpu_memory_release().
+ * @param user user data passed to gpu_memory_track()
+ * @returns 0 if storage was reduced, -1 if it can't be reduced now
+ */
+typedef int (*gpu_memory_evict_fn) (void *user);
+
+/** Start accounting
+ * @param budget_bytes maximum size of all allocations, 0 for unlimited
+ * @param max_allocations maximum number of tracked allocations
+ * @returns 0 on success, -1 if memory is exhausted
+ */
+int gpu_memory_init (size_t budget_bytes, unsigned int max_allocations);
+
+/** Stop accounting, allocations still tracked are forgotten */
+void gpu_memory_shutdown (void);
+
+/** Track new allocation, evicting others if it doesn't fit into budget
+ * @param kind kind of object
+ * @param format internal format of texture or target of buffer
+ * @param size size of storage in bytes
+ * @param evict callback that reduces storage, NULL if allocation can't be
+ * evicted
+ * @param user user data passed to evict
+ * @returns handle of allocation, -1 if accounting isn't started or there
+ * are too many allocations; other functions ignore handle -1 and handles
+ * of allocations tracked before shutdown
+ */
+int gpu_memory_track (gpu_memory_kind_t kind, GLenum format, size_t size,
+                      gpu_memory_evict_fn evict, void *user);
+
+/** Change size of allocation, evicting others if it grows past budget
+ * @param handle handle of allocation
+ * @param size new size of storage in bytes
+ */
+void gpu_memory_resize (int handle, size_t size);
+
+/** Stop tracking allocation whose storage is deleted
+ * @param handle handle of allocation
+ */
+void gpu_memory_release (int handle);
+
+/** Mark allocation as used in current frame, allocations used in current
+ * or previous frame are never evicted
+ * @param handle handle of allocation
+ */
+void gpu_memory_use (int handle);
+
+/** Evict least recently used allocations until given size fits into
+ * budget
+ * @param size number of bytes that are about to be allocated
+ * @returns 0 if size fits, -1 otherwise
+ */
+int gpu_memory_reserve (size_t size);
+
+/** Advance to next frame, called once per frame */
+void gpu_memory_end_frame (void);
+
+/** Print current and peak usage by kind of object and number of
+ * evictions */
+void gpu_memory_print_stats (void);
+
+#endif /* GPU_MEMORY_H */
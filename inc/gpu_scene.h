@@ -0,0 +1,72 @@
+/**
+ * @file gpu_scene.h
+ * Rendering of static meshes driven by GPU.
+ *
+ * All meshes share one vertex and one index buffer. Compute shader culls
+ * objects against view frustum and writes one indirect command per object,
+ * then all objects are drawn with single glMultiDrawElementsIndirect call.
+ * Buffers are created and meshes are uploaded by gl_loader, so nothing is
+ * drawn until its jobs are finished. Requires OpenGL 4.3.
+ */
+#ifndef GPU_SCENE_H
+#define GPU_SCENE_H
+#include <GL/glcorearb.h>
+
+/** Number of floats per vertex: position xyz followed by normal xyz */
+#define GPU_SCENE_VERTEX_FLOATS 6
+
+/** Create programs of scene and queue creation of its buffers
+ * @param max_vertices capacity of shared vertex buffer
+ * @param max_indices capacity of shared index buffer
+ * @param max_meshes maximum number of meshes
+ * @param max_objects maximum number of objects
+ * @returns 0 on success, -1 if context doesn't support GPU driven rendering
+ * or loader has too many jobs in flight
+ */
+int gpu_scene_init (GLuint max_vertices, GLuint max_indices,
+                    GLuint max_meshes, GLuint max_objects);
+
+/** Delete buffers and programs of scene, called after gl_loader_shutdown()
+ * if jobs of scene may be in flight */
+void gpu_scene_shutdown (void);
+
+/** Queue upload of mesh into shared buffers
+ * @param vertices GPU_SCENE_VERTEX_FLOATS floats per vertex, vertices and
+ * indices must stay valid while gpu_scene_is_loading() returns non-zero
+ * @param n_vertices number of vertices
+ * @param indices triangle list of GLuint indices relative to the first
+ * vertex of mesh
+ * @param n_indices number of indices
+ * @returns index of mesh, -1 if buffers are full or loader has too many
+ * jobs in flight
+ */
+int gpu_scene_add_mesh (const GLfloat *vertices, GLuint n_vertices,
+                        const GLuint *indices, GLuint n_indices);
+
+/** Add instance of mesh
+ *
+ * Objects are kept in system memory and changed ones are uploaded with
+ * single call by the next gpu_scene_draw().
+ * @param mesh index of mesh
+ * @param transform model matrix in column-major order
+ * @returns index of object, -1 if scene is full
+ */
+int gpu_scene_add_object (GLuint mesh, const GLfloat *transform);
+
+/** Change model matrix of object, uploaded by the next gpu_scene_draw()
+ * @param object index of object
+ * @param transform model matrix in column-major order
+ */
+void gpu_scene_set_transform (GLuint object, const GLfloat *transform);
+
+/** Check whether loader still creates buffers or uploads meshes
+ * @returns non-zero until all jobs of scene are finished
+ */
+int gpu_scene_is_loading (void);
+
+/** Cull and draw all objects, does nothing while scene is loading
+ * @param view_projection view-projection matrix in column-major order
+ */
+void gpu_scene_draw (const GLfloat *view_projection);
+
+#endif /* GPU_SCENE_H */
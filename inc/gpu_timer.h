@@ -0,0 +1,46 @@
+/**
+ * @file gpu_timer.h
+ * GPU time measurement of frames and render passes with timer queries.
+ *
+ * Results are read back GPU_TIMER_LATENCY frames later, so measurement
+ * never waits for GPU. Frames whose results are still not available by
+ * then are dropped.
+ */
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+/** Number of frames in flight before results are read back */
+#define GPU_TIMER_LATENCY 4
+
+/** Maximum number of measured passes per frame */
+#define GPU_TIMER_MAX_PASSES 8
+
+/** Create query objects, current context must support timer queries
+ * @returns 0 on success, -1 if timer queries are not supported
+ */
+int gpu_timer_init (void);
+
+/** Delete query objects */
+void gpu_timer_shutdown (void);
+
+/** Mark beginning of frame and collect results of earlier frames */
+void gpu_timer_begin_frame (void);
+
+/** Mark end of frame
+ * @param cpu_ms CPU time spent on the frame, used to tell whether frame
+ * is CPU-bound or GPU-bound
+ */
+void gpu_timer_end_frame (double cpu_ms);
+
+/** Start measuring render pass, passes can't be nested
+ * @param name name of pass, must stay valid during program lifetime
+ */
+void gpu_timer_begin_pass (const char *name);
+
+/** Stop measuring current render pass */
+void gpu_timer_end_pass (void);
+
+/** Print statistics collected since previous call and reset them */
+void gpu_timer_print_stats (void);
+
+#endif /* GPU_TIMER_H */
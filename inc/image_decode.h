@@ -0,0 +1,67 @@
+/**
+ * @file image_decode.h
+ * Decoding of uncompressed PPM, TGA and BMP images into mipmapped RGBA8
+ * textures on worker threads.
+ *
+ * Each image is split into bands of rows decoded by separate jobs. A band
+ * converts its rows to RGBA or BGRA, premultiplies alpha and box-filters
+ * the rows of several mipmap levels it covers on its own; the last band to
+ * finish builds the remaining small levels. Conversion and filtering use
+ * SSE2, SSSE3 or AVX2 kernels selected at run-time.
+ *
+ * Decoding is started before the OpenGL context exists and collected
+ * after it is created, so it overlaps EGL bootstrap.
+ */
+#ifndef IMAGE_DECODE_H
+#define IMAGE_DECODE_H
+#include "texture_residency.h"
+
+/** Store pixels in BGRA order, uploaded as GL_BGRA */
+#define IMAGE_DECODE_BGRA 0x1u
+
+/** Premultiply color by alpha */
+#define IMAGE_DECODE_PREMULTIPLY 0x2u
+
+/** Treat color as sRGB: premultiply and filter it in linear space and
+ * store it in GL_SRGB8_ALPHA8 */
+#define IMAGE_DECODE_SRGB 0x4u
+
+/** Generate full mipmap chain */
+#define IMAGE_DECODE_MIPMAPS 0x8u
+
+/** Start decoding images on worker threads
+ *
+ * Files are mapped and their headers are parsed on the calling thread.
+ * @param paths paths to image files, must stay valid until
+ * image_decode_wait() returns
+ * @param n_images number of images
+ * @param flags combination of IMAGE_DECODE_* flags
+ * @returns 0 on success, -1 if decoding is already started or memory is
+ * exhausted; images that can't be read or parsed are reported by
+ * image_decode_get()
+ */
+int image_decode_start (const char *const *paths, unsigned int n_images,
+                        unsigned int flags);
+
+/** Wait until all images are decoded and unmap their files
+ *
+ * Jobs not taken by workers yet are executed by the calling thread.
+ */
+void image_decode_wait (void);
+
+/** Get decoded image
+ * @param index index of image passed to image_decode_start()
+ * @returns levels of image, valid until image_decode_shutdown(); NULL if
+ * image can't be decoded or decoding isn't finished
+ */
+const texture_source_t *image_decode_get (unsigned int index);
+
+/** Free decoded images, called after texture_residency_shutdown() */
+void image_decode_shutdown (void);
+
+/** Get name of instruction set used by selected kernels
+ * @returns "avx2", "ssse3", "sse2" or "scalar"
+ */
+const char *image_decode_isa (void);
+
+#endif /* IMAGE_DECODE_H */
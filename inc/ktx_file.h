@@ -0,0 +1,55 @@
+/**
+ * @file ktx_file.h
+ * KTX2 texture container holding levels in formats sampled by GPU as is.
+ *
+ * File is mapped into memory and its levels are passed to
+ * glCompressedTexSubImage2D as stored: coarse levels are uploaded from the
+ * mapping directly, fine levels are copied through the pixel buffer ring
+ * of texture_stream. Block-compressed textures (RGTC, BPTC, ETC2/EAC)
+ * never get decoded on CPU and take 4-8 times less memory than RGBA. Only
+ * 2D textures without supercompression are accepted.
+ */
+#ifndef KTX_FILE_H
+#define KTX_FILE_H
+#include <stddef.h>
+#include "texture_residency.h"
+
+/** KTX2 file mapped into memory */
+typedef struct ktx_file_t {
+    texture_source_t source; /**< Levels inside mapping */
+    const char *format_name; /**< Name of format for messages */
+    void *mapping; /**< Start of mapping, NULL if file isn't mapped */
+    size_t size; /**< Size of file in bytes */
+} ktx_file_t;
+
+/** Map KTX2 file into memory and validate it
+ * @param file receives mapped file
+ * @param path path to file
+ * @returns 0 on success, -1 if file can't be mapped, is malformed or its
+ * format isn't supported
+ */
+int ktx_file_open (ktx_file_t *file, const char *path);
+
+/** Use KTX2 file already present in memory, e.g. asset of asset pack
+ * @param file receives file that refers to data
+ * @param data contents of file, must stay valid while file is used
+ * @param size size of data in bytes
+ * @returns 0 on success, -1 if data is malformed or its format isn't
+ * supported
+ */
+int ktx_file_from_memory (ktx_file_t *file, const void *data, size_t size);
+
+/** Unmap KTX2 file, levels become invalid
+ * @param file mapped file or file that refers to memory
+ */
+void ktx_file_close (ktx_file_t *file);
+
+/** Check whether current context can sample format of file
+ *
+ * Must be called on the thread that owns current context.
+ * @param file opened file
+ * @returns non-zero if format is supported
+ */
+int ktx_file_is_supported (const ktx_file_t *file);
+
+#endif /* KTX_FILE_H */
@@ -0,0 +1,40 @@
+/**
+ * @file lz4.h
+ * Compression and decompression of raw LZ4 blocks.
+ *
+ * Blocks follow LZ4 block format, so they can be produced or checked by any
+ * LZ4 implementation. Decoder is bounds checked and safe to run on
+ * untrusted input; encoder is a fast greedy one for offline asset packing.
+ */
+#ifndef LZ4_H
+#define LZ4_H
+#include <stddef.h>
+
+/** Get size of buffer that fits compressed block in the worst case
+ * @param size size of uncompressed data
+ * @returns maximum size of compressed block
+ */
+size_t lz4_bound (size_t size);
+
+/** Compress data into single block
+ * @param src uncompressed data
+ * @param src_size size of uncompressed data
+ * @param dst receives compressed block
+ * @param dst_capacity size of dst, at least lz4_bound(src_size)
+ * @returns size of compressed block, 0 if dst is too small
+ */
+size_t lz4_compress (const void *src, size_t src_size, void *dst,
+                     size_t dst_capacity);
+
+/** Decompress single block
+ * @param src compressed block
+ * @param src_size size of compressed block
+ * @param dst receives uncompressed data
+ * @param dst_size exact size of uncompressed data
+ * @returns 0 on success, -1 if block is malformed or doesn't decode into
+ * exactly dst_size bytes
+ */
+int lz4_decompress (const void *src, size_t src_size, void *dst,
+                    size_t dst_size);
+
+#endif /* LZ4_H */
@@ -0,0 +1,114 @@
+/**
+ * @file math3d.h
+ * Vector, matrix and quaternion math with SIMD kernels selected at
+ * run-time.
+ *
+ * Matrices are arrays of 16 floats in column-major order, quaternions are
+ * arrays of 4 floats in x, y, z, w order. Results are written through
+ * output pointers, which may not alias inputs unless stated otherwise.
+ */
+#ifndef MATH3D_H
+#define MATH3D_H
+#include <stddef.h>
+
+/** Select the fastest kernels supported by CPU, must be called before
+ * other threads use this module; scalar kernels are used until then */
+void math3d_init (void);
+
+/** Get name of instruction set used by selected kernels
+ * @returns "avx2", "sse2" or "scalar"
+ */
+const char *math3d_isa (void);
+
+/** Build perspective projection matrix
+ * @param fovy vertical field of view in radians
+ * @param aspect width divided by height
+ * @param near_plane distance to near clipping plane
+ * @param far_plane distance to far clipping plane
+ * @param result receives matrix
+ */
+void mat4_perspective (float fovy, float aspect, float near_plane,
+                       float far_plane, float *result);
+
+/** Build view matrix of camera
+ * @param eye position of camera
+ * @param center point camera looks at
+ * @param up approximate up direction
+ * @param result receives matrix
+ */
+void mat4_look_at (const float *eye, const float *center, const float *up,
+                   float *result);
+
+/** Build matrix of translation, rotation and uniform scale
+ * @param translation xyz translation
+ * @param rotation unit quaternion
+ * @param scale uniform scale
+ * @param result receives matrix
+ */
+void mat4_from_trs (const float *translation, const float *rotation,
+                    float scale, float *result);
+
+/** Multiply matrices
+ * @param a left matrix
+ * @param b right matrix
+ * @param result receives a * b
+ */
+void mat4_multiply (const float *a, const float *b, float *result);
+
+/** Build quaternion of rotation around axis
+ * @param axis unit axis
+ * @param angle angle in radians
+ * @param result receives quaternion
+ */
+void quat_from_axis_angle (const float *axis, float angle, float *result);
+
+/** Transform axis-aligned bounding boxes by affine matrix and compute
+ * boxes enclosing the results
+ * @param m affine matrix
+ * @param mins array of n xyz minimum corners
+ * @param maxs array of n xyz maximum corners
+ * @param out_mins receives n xyz minimum corners
+ * @param out_maxs receives n xyz maximum corners
+ * @param n number of boxes
+ */
+void aabb_transform (const float *m, const float *mins, const float *maxs,
+                     float *out_mins, float *out_maxs, size_t n);
+
+/** Extract planes of view frustum from view-projection matrix
+ * @param m view-projection matrix
+ * @param planes receives six normalized planes as xyzw with normals
+ * pointing inside: left, right, bottom, top, near and far
+ */
+void frustum_from_matrix (const float *m, float *planes);
+
+/** Find bounding spheres that intersect view frustum
+ * @param planes six planes from frustum_from_matrix()
+ * @param x x coordinates of centers
+ * @param y y coordinates of centers
+ * @param z z coordinates of centers
+ * @param radius radii of spheres
+ * @param first index of the first tested sphere
+ * @param n number of tested spheres
+ * @param visible receives indices of visible spheres in ascending order,
+ * must have room for n indices
+ * @returns number of visible spheres
+ */
+size_t frustum_cull_spheres (const float *planes, const float *x,
+                             const float *y, const float *z,
+                             const float *radius, size_t first, size_t n,
+                             unsigned int *visible);
+
+/** Find axis-aligned bounding boxes that intersect view frustum
+ * @param planes six planes from frustum_from_matrix()
+ * @param bounds six arrays: x, y and z of centers and x, y and z of
+ * half-extents
+ * @param first index of the first tested box
+ * @param n number of tested boxes
+ * @param visible receives indices of visible boxes in ascending order,
+ * must have room for n indices
+ * @returns number of visible boxes
+ */
+size_t frustum_cull_boxes (const float *planes, const float *const *bounds,
+                           size_t first, size_t n, unsigned int *visible);
+
+#endif /* MATH3D_H */
@@ -0,0 +1,82 @@
+/**
+ * @file mesh_file.h
+ * Binary mesh container whose payloads are laid out exactly as vertex and
+ * index buffers expect them.
+ *
+ * File is mapped into memory and payloads are passed to OpenGL straight
+ * from the mapping, so loading involves neither parsing nor intermediate
+ * copies. Multi-byte values are stored in byte order of the machine that
+ * wrote the file; files of the other byte order are rejected by magic.
+ */
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+#include <stddef.h>
+#include <GL/glcorearb.h>
+
+/** Magic number of mesh file, "GBMS" in little endian */
+#define MESH_FILE_MAGIC 0x534D4247u
+
+/** Version of mesh file layout */
+#define MESH_FILE_VERSION 1u
+
+/** Alignment of payloads from start of file */
+#define MESH_FILE_ALIGNMENT 64u
+
+/** Header at the start of mesh file */
+typedef struct mesh_file_header_t {
+    GLuint magic; /**< MESH_FILE_MAGIC */
+    GLuint version; /**< MESH_FILE_VERSION */
+    GLuint vertex_size; /**< Size of vertex in bytes */
+    GLuint index_size; /**< Size of index in bytes, 2 or 4 */
+    GLuint n_vertices; /**< Number of vertices */
+    GLuint n_indices; /**< Number of indices */
+    GLuint64 vertex_offset; /**< Offset of vertices from start of file */
+    GLuint64 index_offset; /**< Offset of indices from start of file */
+} mesh_file_header_t;
+
+/** Mesh file mapped into memory */
+typedef struct mesh_file_t {
+    const mesh_file_header_t *header; /**< Header of mapped file */
+    const void *vertices; /**< Vertices inside mapping */
+    const void *indices; /**< Indices inside mapping */
+    void *mapping; /**< Start of mapping, NULL if mesh isn't mapped */
+    size_t size; /**< Size of mesh file in bytes */
+} mesh_file_t;
+
+/** Map mesh file into memory and validate its header and indices
+ * @param mesh receives mapped file
+ * @param path path to file
+ * @returns 0 on success, -1 if file can't be mapped or is malformed
+ */
+int mesh_file_open (mesh_file_t *mesh, const char *path);
+
+/** Use mesh file already present in memory, e.g. asset of asset pack
+ * @param mesh receives mesh that refers to data
+ * @param data contents of mesh file aligned at least as its header, must
+ * stay valid while mesh is used
+ * @param size size of data in bytes
+ * @returns 0 on success, -1 if data is malformed
+ */
+int mesh_file_from_memory (mesh_file_t *mesh, const void *data, size_t size);
+
+/** Unmap mesh file, payloads become invalid
+ * @param mesh mapped file or mesh that refers to memory
+ */
+void mesh_file_close (mesh_file_t *mesh);
+
+/** Write mesh file, used by asset converters
+ * @param path path to file to create or replace
+ * @param vertices vertices as they should appear in vertex buffer
+ * @param vertex_size size of vertex in bytes
+ * @param n_vertices number of vertices
+ * @param indices indices as they should appear in index buffer
+ * @param index_size size of index in bytes, 2 or 4
+ * @param n_indices number of indices
+ * @returns 0 on success, -1 on I/O error
+ */
+int mesh_file_write (const char *path, const void *vertices,
+                     GLuint vertex_size, GLuint n_vertices,
+                     const void *indices, GLuint index_size,
+                     GLuint n_indices);
+
+#endif /* MESH_FILE_H */
@@ -0,0 +1,13 @@
+/**
+ * @file monotonic.h
+ * Monotonic clock for measuring intervals.
+ */
+#ifndef MONOTONIC_H
+#define MONOTONIC_H
+
+/** Get current time of monotonic clock
+ * @returns milliseconds since unspecified point in the past
+ */
+double monotonic_ms (void);
+
+#endif /* MONOTONIC_H */
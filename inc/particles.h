@@ -0,0 +1,47 @@
+/**
+ * @file particles.h
+ * Particle fountain simulated either on GPU or on worker threads.
+ *
+ * With OpenGL 4.3 particles live only in shader storage buffers: compute
+ * shader integrates live particles, spawns new ones and compacts survivors
+ * into the other buffer of a pair, counting them directly into indirect
+ * draw command, so CPU never touches individual particles. Without compute
+ * shaders the same simulation runs on worker threads with SIMD, each
+ * thread owning a fixed slice of particles drawn with its own draw call.
+ */
+#ifndef PARTICLES_H
+#define PARTICLES_H
+#include <GL/glcorearb.h>
+
+/** Create buffers and programs of particle system
+ * @param capacity maximum number of live particles
+ * @param allow_compute zero to simulate on CPU even if compute shaders
+ * are supported
+ * @returns 0 on success, -1 if context can't draw particles; if compute
+ * setup fails particles are simulated on CPU
+ */
+int particles_init (GLuint capacity, int allow_compute);
+
+/** Delete buffers and programs of particle system */
+void particles_shutdown (void);
+
+/** Advance simulation and draw particles
+ * @param dt time since previous update in seconds
+ * @param view_projection view-projection matrix of frame
+ */
+void particles_update (float dt, const GLfloat *view_projection);
+
+/** Finish frame after particles were drawn */
+void particles_end_frame (void);
+
+/** Check where particles are simulated
+ * @returns non-zero if particles are simulated by compute shaders
+ */
+int particles_use_compute (void);
+
+/** Get number of live particles
+ * @returns number of particles simulated on CPU, 0 if they are on GPU
+ */
+unsigned long particles_count (void);
+
+#endif /* PARTICLES_H */
@@ -0,0 +1,89 @@
+/**
+ * @file scene.h
+ * Built-in animated scenes used as scalable rendering workloads.
+ *
+ * "cubes" animates every cube on CPU each frame and draws them with
+ * instanced draws reading per-instance data from streaming buffer. If
+ * textures are set, consecutive ranges of cubes sample them on their
+ * faces, and size of the nearest cube of each range on screen is reported
+ * to texture residency.
+ * "static" places cubes once and draws them with GPU culling and
+ * multi-draw indirect, using mesh loaded from file instead of cube if one
+ * is set; rows of cubes take turns spinning, so only objects of one row
+ * are uploaded each frame. "hierarchy" spins grid of cubes with satellites attached to them
+ * as children in transform graph; entities of component store animate
+ * local transforms and world matrices of cubes whose bounding boxes pass
+ * culling are drawn as instances. "particles" runs particle fountain with objects as its
+ * capacity, simulated by compute shaders when supported, and
+ * "particles-cpu" forces simulation on worker threads.
+ */
+#ifndef SCENE_H
+#define SCENE_H
+#include "frame_arena.h"
+#include "draw_queue.h"
+#include "mesh_file.h"
+
+/** Create resources of scene
+ *
+ * Must be called on the thread that owns current context, after worker
+ * threads are started.
+ * @param name name of scene: "cubes", "static", "hierarchy", "particles"
+ * or "particles-cpu"
+ * @param n_objects number of animated objects
+ * @returns 0 on success, -1 if scene is unknown or unsupported by context
+ */
+int scene_init (const char *name, unsigned long n_objects);
+
+/** Set mesh of objects of static scene
+ *
+ * Must be called before scene_init, which queues upload of mesh, so it may
+ * be closed once scene_is_loading() returns zero.
+ * @param mesh mapped mesh file of GPU_SCENE_VERTEX_FLOATS floats per
+ * vertex and GLuint triangle list indices, NULL to draw cubes
+ * @returns 0 on success, -1 if layout of mesh can't be drawn by scene
+ */
+int scene_set_mesh (const mesh_file_t *mesh);
+
+/** Set textures sampled by cubes of "cubes" scene
+ *
+ * Must be called before scene_init, which selects program of cubes.
+ * @param handles handles of textures in texture residency, must stay
+ * valid until scene_shutdown()
+ * @param n number of textures, 0 for untextured cubes
+ */
+void scene_set_textures (const int *handles, unsigned int n);
+
+/** Check whether loader still creates objects of scene, which isn't drawn
+ * until they are complete
+ * @returns non-zero while objects of scene are being created
+ */
+int scene_is_loading (void);
+
+/** Free resources of scene, called after gl_loader_shutdown(); does
+ * nothing if scene wasn't created */
+void scene_shutdown (void);
+
+/** Advance simulation of scene, called once per frame before
+ * scene_update()
+ * @param time_ms time since start of animation
+ */
+void scene_tick (double time_ms);
+
+/** Animate scene and submit its draws, does nothing if scene wasn't
+ * created
+ * @param queue queue of draws of current frame
+ * @param arena arena of current frame
+ * @param time_ms time since start of animation
+ * @param width width of window
+ * @param height height of window
+ */
+void scene_update (draw_queue_t *queue, frame_arena_t *arena, double time_ms,
+                   int width, int height);
+
+/** Finish frame after draws of scene were executed */
+void scene_end_frame (void);
+
+/** Print time of scene update since previous call and reset counters */
+void scene_print_stats (void);
+
+#endif /* SCENE_H */
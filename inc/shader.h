@@ -0,0 +1,39 @@
+/**
+ * @file shader.h
+ * Compilation and linking of GLSL programs.
+ *
+ * Sources are passed as NULL-terminated lists of pieces that are
+ * concatenated, because C89 limits length of single string literal.
+ */
+#ifndef SHADER_H
+#define SHADER_H
+#include <GL/glcorearb.h>
+
+/** Create program of vertex and fragment shaders
+ *
+ * Compilation and link errors are printed to stderr.
+ * @param name name of program used in error messages
+ * @param vertex_source pieces of vertex shader source
+ * @param fragment_source pieces of fragment shader source
+ * @returns program object, 0 on failure
+ */
+GLuint shader_program_create (const char *name,
+                              const char *const *vertex_source,
+                              const char *const *fragment_source);
+
+/** Create program of compute shader
+ *
+ * Compilation and link errors are printed to stderr.
+ * @param name name of program used in error messages
+ * @param compute_source pieces of compute shader source
+ * @returns program object, 0 on failure
+ */
+GLuint shader_program_create_compute (const char *name,
+                                      const char *const *compute_source);
+
+/** Delete program and forget its cached state
+ * @param program program object, 0 is ignored
+ */
+void shader_program_destroy (GLuint program);
+
+#endif /* SHADER_H */
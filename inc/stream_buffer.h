@@ -0,0 +1,87 @@
+/**
+ * @file stream_buffer.h
+ * Ring of buffer memory for data that is written by CPU once per frame,
+ * such as uniforms and dynamic geometry.
+ *
+ * With ARB_buffer_storage the buffer is mapped persistently and split into
+ * regions of STREAM_BUFFER_FRAMES frames, each region is protected by a
+ * fence until GPU finishes reading it. Older contexts write into staging
+ * memory that is uploaded into orphaned buffer once per frame. Either way
+ * allocation is a pointer bump.
+ */
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+#include <stddef.h>
+#include <GL/glcorearb.h>
+
+/** Number of frames whose data may be in flight at once */
+#define STREAM_BUFFER_FRAMES 3
+
+/** Streaming buffer */
+typedef struct stream_buffer_t {
+    GLsync fences[STREAM_BUFFER_FRAMES]; /**< Fences of regions in flight */
+    unsigned char *memory; /**< Persistent mapping or staging memory */
+    size_t frame_size; /**< Size of region of single frame in bytes */
+    size_t region; /**< Offset of current region in buffer */
+    size_t offset; /**< Number of bytes allocated from current region */
+    size_t peak; /**< Largest number of bytes used by single frame */
+    size_t n_failed; /**< Number of allocations that didn't fit */
+    unsigned long n_stalls; /**< Number of frames that waited for GPU */
+    GLuint buffer; /**< Buffer object */
+    GLuint uniform_alignment; /**< Required alignment of uniform ranges */
+    unsigned int current; /**< Index of current region */
+    int is_persistent; /**< Non-zero if buffer is mapped persistently */
+    int allocation; /**< Handle of tracked storage of buffer */
+    char padding[4];
+} stream_buffer_t;
+
+/** Create buffer object of streaming buffer
+ *
+ * Must be called on the thread that owns current context.
+ * @param stream streaming buffer to initialize
+ * @param frame_size number of bytes available to each frame
+ * @returns 0 on success, -1 on failure
+ */
+int stream_buffer_init (stream_buffer_t *stream, size_t frame_size);
+
+/** Delete buffer object of streaming buffer
+ * @param stream streaming buffer to destroy
+ */
+void stream_buffer_destroy (stream_buffer_t *stream);
+
+/** Start writing data of new frame
+ *
+ * Waits until GPU finishes reading the region that is about to be reused,
+ * this only happens when GPU is more than STREAM_BUFFER_FRAMES - 1 frames
+ * behind.
+ * @param stream streaming buffer
+ */
+void stream_buffer_begin_frame (stream_buffer_t *stream);
+
+/** Allocate memory for data of current frame
+ *
+ * It is safe to call this function from several threads at once.
+ * Returned memory is write-only and must be filled before
+ * stream_buffer_commit() is called.
+ * @param stream streaming buffer
+ * @param size number of bytes to allocate
+ * @param alignment required alignment of offset, power of two
+ * @param offset receives offset of allocation in buffer object
+ * @returns pointer to write data into, NULL if frame budget is exhausted
+ */
+void *stream_buffer_alloc (stream_buffer_t *stream, size_t size,
+                           size_t alignment, GLuint *offset);
+
+/** Make data of current frame visible to GPU, must be called before draws
+ * that read it
+ * @param stream streaming buffer
+ */
+void stream_buffer_commit (stream_buffer_t *stream);
+
+/** Finish writing data of current frame, must be called after the last
+ * draw that reads it
+ * @param stream streaming buffer
+ */
+void stream_buffer_end_frame (stream_buffer_t *stream);
+
+#endif /* STREAM_BUFFER_H */
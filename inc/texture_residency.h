@@ -0,0 +1,87 @@
+/**
+ * @file texture_residency.h
+ * Residency of mipmap levels of textures driven by their size on screen.
+ *
+ * Textures start with only their coarse levels resident. Renderer reports
+ * how large each texture appears on screen, and finer levels are streamed
+ * in through texture_stream only once they would actually be sampled.
+ * Storage for finer levels is created by gl_loader, and streaming into it
+ * starts once its fence is signaled.
+ * Storage of each texture holds just its resident levels, so memory grows
+ * with screen size rather than with content. When storage is replaced,
+ * levels that stay resident are copied on GPU where OpenGL 4.3 or
+ * ARB_copy_image allows it. When budget is exceeded,
+ * textures that weren't used for the longest time drop back to their
+ * coarse levels.
+ */
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+#include <stddef.h>
+#include <GL/glcorearb.h>
+
+/** Maximum number of mipmap levels of texture */
+#define TEXTURE_MAX_LEVELS 16
+
+/** Levels no larger than this on both sides are always resident */
+#define TEXTURE_MIN_RESIDENT_SIZE 64
+
+/** Source of all levels of texture kept in memory */
+typedef struct texture_source_t {
+    const void *levels[TEXTURE_MAX_LEVELS]; /**< Tightly packed rows */
+    GLsizei width; /**< Width of level 0 */
+    GLsizei height; /**< Height of level 0 */
+    GLenum internal_format; /**< Sized format of storage, e.g. GL_RGBA8 */
+    GLenum format; /**< Format of pixels, e.g. GL_RGBA, unused if
+                        compressed */
+    GLenum type; /**< Type of pixel components, e.g. GL_UNSIGNED_BYTE,
+                      unused if compressed */
+    unsigned int n_levels; /**< Number of levels, each half of previous */
+    unsigned int pixel_size; /**< Size of pixel in bytes, unused if
+                                  compressed */
+    unsigned int block_size; /**< Size of 4x4 block in bytes if
+                                  internal_format is compressed, else 0 */
+} texture_source_t;
+
+/** Start texture residency
+ *
+ * Must be called on the thread that owns current context.
+ * @param budget_bytes maximum size of resident levels of all textures
+ * @param max_textures maximum number of textures
+ * @returns 0 on success, -1 if immutable texture storage isn't supported
+ * or memory is exhausted
+ */
+int texture_residency_init (size_t budget_bytes, unsigned int max_textures);
+
+/** Delete all textures, called after gl_loader_shutdown() and
+ * texture_stream_shutdown() so that no job or queued upload targets
+ * deleted storage */
+void texture_residency_shutdown (void);
+
+/** Add texture with its coarse levels resident
+ * @param source levels of texture, must stay valid until shutdown
+ * @returns handle of texture, -1 if there are too many textures
+ */
+int texture_residency_add (const texture_source_t *source);
+
+/** Report that texture is drawn in current frame
+ * @param handle handle of texture
+ * @param screen_size estimated size of texture on screen in pixels along
+ * its larger side
+ */
+void texture_residency_use (int handle, float screen_size);
+
+/** Get texture to bind for drawing
+ * @param handle handle of texture
+ * @returns texture with currently resident levels
+ */
+GLuint texture_residency_get (int handle);
+
+/** Stream levels needed by textures used in previous frame and evict
+ * least recently used ones over budget, called by render thread once per
+ * frame before texture_stream_update() */
+void texture_residency_update (void);
+
+/** Print residency since previous call and reset counters */
+void texture_residency_print_stats (void);
+
+#endif /* TEXTURE_RESIDENCY_H */
@@ -0,0 +1,86 @@
+/**
+ * @file texture_stream.h
+ * Uploads of texture images spread over frames within a budget.
+ *
+ * Queued images are copied slice by slice of rows into a streaming buffer
+ * that is bound as pixel unpack buffer, and glTexSubImage2D is sourced
+ * from it, so driver copies on GPU timeline instead of blocking render
+ * thread. Each frame stages no more than its byte budget and stops once
+ * its time budget is spent; the rest of queue waits for later frames.
+ */
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+#include <stddef.h>
+#include <GL/glcorearb.h>
+
+/** Called when all rows of image are staged and source may be released
+ * @param user user data passed to texture_stream_upload()
+ */
+typedef void (*texture_stream_done_fn) (void *user);
+
+/** Create staging buffer of texture stream
+ *
+ * Must be called on the thread that owns current context.
+ * @param budget_bytes maximum number of bytes staged per frame
+ * @param budget_ms maximum time spent staging per frame in milliseconds
+ * @param max_uploads maximum number of queued images
+ * @returns 0 on success, -1 on failure
+ */
+int texture_stream_init (size_t budget_bytes, double budget_ms,
+                         unsigned int max_uploads);
+
+/** Delete staging buffer, queued images are dropped without callbacks */
+void texture_stream_shutdown (void);
+
+/** Queue upload of whole level of 2D texture
+ * @param texture texture with storage of level already allocated
+ * @param level mipmap level
+ * @param width width of level
+ * @param height height of level
+ * @param format format of pixels, e.g. GL_RGBA
+ * @param type type of pixel components, e.g. GL_UNSIGNED_BYTE
+ * @param pixel_size size of pixel in bytes
+ * @param pixels tightly packed rows, must stay valid until done is called
+ * @param done callback called once pixels aren't needed anymore, may be
+ * NULL
+ * @param user user data passed to done
+ * @returns 0 on success, -1 if queue is full or single row exceeds budget
+ */
+int texture_stream_upload (GLuint texture, GLint level, GLsizei width,
+                           GLsizei height, GLenum format, GLenum type,
+                           size_t pixel_size, const void *pixels,
+                           texture_stream_done_fn done, void *user);
+
+/** Queue upload of whole level of 2D texture in block-compressed format
+ *
+ * Data is staged by rows of 4x4 blocks and passed to driver as is.
+ * @param texture texture with storage of level already allocated
+ * @param level mipmap level
+ * @param width width of level in texels
+ * @param height height of level in texels
+ * @param internal_format compressed format of storage, e.g.
+ * GL_COMPRESSED_RGBA_BPTC_UNORM
+ * @param block_size size of block in bytes, 8 or 16
+ * @param data tightly packed rows of blocks, must stay valid until done is
+ * called
+ * @param done callback called once data isn't needed anymore, may be NULL
+ * @param user user data passed to done
+ * @returns 0 on success, -1 if queue is full or single row of blocks
+ * exceeds budget
+ */
+int texture_stream_upload_compressed (GLuint texture, GLint level,
+                                      GLsizei width, GLsizei height,
+                                      GLenum internal_format,
+                                      unsigned int block_size,
+                                      const void *data,
+                                      texture_stream_done_fn done, void *user);
+
+/** Stage and issue uploads of current frame within budget, called by
+ * render thread once per frame before draws that may sample uploaded
+ * textures */
+void texture_stream_update (void);
+
+/** Print amount of uploaded data since previous call and reset counters */
+void texture_stream_print_stats (void);
+
+#endif /* TEXTURE_STREAM_H */
@@ -0,0 +1,66 @@
+/**
+ * @file thread_policy.h
+ * CPU affinity and scheduling policy control for application threads.
+ */
+#ifndef THREAD_POLICY_H
+#define THREAD_POLICY_H
+#include <sched.h>
+#include <pthread.h>
+
+/** Parse list of CPUs in "0,2-5" form
+ * @param list textual list of CPU numbers and ranges
+ * @param set receives parsed set of CPUs
+ * @returns 0 on success, -1 if list is malformed or empty
+ */
+int thread_policy_parse_cpus (const char *list, cpu_set_t *set);
+
+/** Parse real-time scheduling request in "fifo[:PRIORITY]" form
+ * @param spec textual policy name ("fifo" or "rr") and optional priority
+ * @param policy receives SCHED_FIFO or SCHED_RR
+ * @param priority receives requested priority, 0 if it wasn't specified
+ * @returns 0 on success, -1 if spec is malformed
+ */
+int thread_policy_parse_realtime (const char *spec, int *policy,
+                                  int *priority);
+
+/** Remember affinity of the process before any thread is pinned
+ *
+ * Must be called once at startup, before thread_policy_pin() is applied
+ * to the calling thread.
+ */
+void thread_policy_save_default (void);
+
+/** Initialize attributes for helper threads
+ *
+ * Threads created with these attributes run with SCHED_OTHER on all CPUs
+ * the process was allowed to use at startup, instead of inheriting
+ * real-time policy and affinity of the render thread.
+ * @param attr attributes to initialize
+ * @returns 0 on success, error number otherwise
+ */
+int thread_policy_init_attr (pthread_attr_t *attr);
+
+/** Restrict thread to set of CPUs
+ * @param thread thread to pin
+ * @param set CPUs the thread is allowed to run on
+ * @returns 0 on success, error number otherwise
+ */
+int thread_policy_pin (pthread_t thread, const cpu_set_t *set);
+
+/** Switch calling thread to real-time scheduling policy
+ *
+ * Priority is clamped to the range supported by policy. If it is still
+ * not permitted, it is lowered to RLIMIT_RTPRIO. If real-time scheduling
+ * is not permitted at all, thread keeps its current policy.
+ * @param policy SCHED_FIFO or SCHED_RR
+ * @param priority requested priority, 0 to use the lowest one
+ * @returns effective priority on success, -1 otherwise
+ */
+int thread_policy_set_realtime (int policy, int priority);
+
+/** Print effective scheduling policy and affinity of calling thread
+ * @param name human readable name of the thread
+ */
+void thread_policy_report (const char *name);
+
+#endif /* THREAD_POLICY_H */
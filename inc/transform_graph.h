@@ -0,0 +1,84 @@
+/**
+ * @file transform_graph.h
+ * Hierarchy of transforms stored as structure of arrays.
+ *
+ * After transform_graph_sort() nodes are in depth-first order, so every
+ * parent precedes its children and every root subtree occupies contiguous
+ * range of nodes. World matrices are updated in a single forward pass per
+ * subtree, subtrees are updated in parallel and subtrees without changed
+ * nodes are skipped.
+ */
+#ifndef TRANSFORM_GRAPH_H
+#define TRANSFORM_GRAPH_H
+#include <stddef.h>
+
+/** Parent of root nodes, also returned when graph is full */
+#define TRANSFORM_ROOT ((unsigned int)-1)
+
+/** Hierarchy of transforms */
+typedef struct transform_graph_t {
+    unsigned int *parents; /**< Parent of each node or TRANSFORM_ROOT */
+    unsigned int *root_of; /**< Index in roots of subtree of each node */
+    unsigned int *roots; /**< The first node of each root subtree */
+    unsigned char *dirty; /**< Non-zero if local transform changed */
+    unsigned char *subtree_dirty; /**< Non-zero if root subtree changed */
+    float *positions; /**< Local translation, 3 floats per node */
+    float *rotations; /**< Local rotation quaternion, 4 floats per node */
+    float *scales; /**< Local uniform scale */
+    float *world; /**< World matrix, 16 floats per node */
+    unsigned int capacity; /**< Maximum number of nodes */
+    unsigned int n_nodes; /**< Number of nodes */
+    unsigned int n_roots; /**< Number of root subtrees */
+    unsigned int n_updated; /**< Number of nodes updated by last update */
+    int is_sorted; /**< Non-zero if root subtrees are contiguous */
+    char padding[4];
+} transform_graph_t;
+
+/** Allocate storage of graph
+ * @param graph graph to initialize
+ * @param capacity maximum number of nodes
+ * @returns 0 on success, -1 if out of memory
+ */
+int transform_graph_init (transform_graph_t *graph, unsigned int capacity);
+
+/** Free storage of graph
+ * @param graph graph to destroy
+ */
+void transform_graph_destroy (transform_graph_t *graph);
+
+/** Add node with identity local transform
+ * @param graph target graph
+ * @param parent index of existing parent node or TRANSFORM_ROOT
+ * @returns index of new node, TRANSFORM_ROOT if graph is full
+ */
+unsigned int transform_graph_add (transform_graph_t *graph,
+                                  unsigned int parent);
+
+/** Reorder nodes depth-first so that root subtrees are contiguous
+ * @param graph graph to sort
+ * @param remap if not NULL, receives new index of each old index
+ * @returns 0 on success, -1 if out of memory
+ */
+int transform_graph_sort (transform_graph_t *graph, unsigned int *remap);
+
+/** Change local transform of node and mark it dirty
+ *
+ * It is safe to call this function from several threads at once for
+ * different nodes.
+ * @param graph target graph
+ * @param node index of node
+ * @param position xyz translation relative to parent
+ * @param rotation unit quaternion relative to parent
+ * @param scale uniform scale relative to parent
+ */
+void transform_graph_set_local (transform_graph_t *graph, unsigned int node,
+                                const float *position, const float *rotation,
+                                float scale);
+
+/** Recompute world matrices of dirty nodes and their descendants on
+ * worker threads
+ * @param graph graph to update
+ */
+void transform_graph_update (transform_graph_t *graph);
+
+#endif /* TRANSFORM_GRAPH_H */
@@ -0,0 +1,65 @@
+/**
+ * @file workers.h
+ * Pool of worker threads executing batches of independent jobs.
+ */
+#ifndef WORKERS_H
+#define WORKERS_H
+#include <sched.h>
+
+/** Job function
+ * @param arg user data passed to workers_begin()
+ * @param index index of job in the batch
+ */
+typedef void (*workers_job_fn) (void *arg, unsigned int index);
+
+/** Batch of jobs, owned by caller until workers_wait() returns */
+typedef struct workers_batch_t {
+    workers_job_fn fn; /**< Function that executes each job */
+    void *arg; /**< User data passed to fn */
+    struct workers_batch_t *next; /**< Next batch in the queue */
+    unsigned int n_jobs; /**< Number of jobs in the batch */
+    unsigned int n_claimed; /**< Number of jobs taken for execution */
+    unsigned int n_done; /**< Number of finished jobs */
+    char padding[4];
+} workers_batch_t;
+
+/** Start worker threads
+ * @param n_threads number of threads, 0 to run all jobs on caller thread
+ * @param cpus if not NULL, each worker is pinned to one of these CPUs
+ * @returns 0 on success, error number otherwise
+ */
+int workers_init (unsigned int n_threads, const cpu_set_t *cpus);
+
+/** Stop all worker threads, queued batches are completed first */
+void workers_shutdown (void);
+
+/** Get number of running worker threads
+ * @returns number of worker threads
+ */
+unsigned int workers_count (void);
+
+/** Queue batch of jobs for asynchronous execution
+ * @param batch batch to queue, must stay valid until workers_wait()
+ * @param fn function that executes each job
+ * @param arg user data passed to fn
+ * @param n_jobs number of jobs in the batch
+ */
+void workers_begin (workers_batch_t *batch, workers_job_fn fn, void *arg,
+                    unsigned int n_jobs);
+
+/** Wait for completion of all jobs of batch
+ *
+ * Caller thread executes jobs of this batch that are not taken by workers
+ * yet instead of sleeping.
+ * @param batch batch queued by workers_begin()
+ */
+void workers_wait (workers_batch_t *batch);
+
+/** Execute batch of jobs and wait for completion
+ * @param fn function that executes each job
+ * @param arg user data passed to fn
+ * @param n_jobs number of jobs
+ */
+void workers_run (workers_job_fn fn, void *arg, unsigned int n_jobs);
+
+#endif /* WORKERS_H */
@@ -0,0 +1,393 @@
+/**
+ * @file alloc_hooks.c
+ * This module contains interposition of heap allocator used to detect
+ * allocations in code that must not allocate and to find allocation hot
+ * spots.
+ *
+ * Functions defined here take precedence over ones of C library for the
+ * whole process, including drivers and eglproxy, and forward to glibc
+ * allocator entry points.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <dlfcn.h>
+#include <sys/resource.h>
+#include "alloc_hooks.h"
+
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *ptr, size_t size);
+extern void *__libc_memalign (size_t alignment, size_t size);
+extern void __libc_free (void *ptr);
+
+/** Maximum number of distinct call sites, must be power of two */
+#define MAX_CALLSITES 4096
+
+/** Number of frames with the most allocations remembered for report */
+#define MAX_TOP_FRAMES 8
+
+/** Statistics of single call site */
+typedef struct callsite_t {
+    void *address; /**< Return address of allocator call, NULL if unused */
+    unsigned long n_allocations; /**< Number of allocations */
+    unsigned long n_bytes; /**< Number of requested bytes */
+    unsigned long n_frames; /**< Number of frames with allocations */
+    unsigned long last_frame; /**< Last frame with allocations */
+} callsite_t;
+
+/** Statistics of single frame */
+typedef struct frame_stats_t {
+    unsigned long frame; /**< Frame number */
+    unsigned long n_allocations; /**< Number of allocations */
+    unsigned long n_bytes; /**< Number of requested bytes */
+} frame_stats_t;
+
+/** Non-zero if allocations are counted */
+static int is_counting = 0;
+
+/** Number of counted allocations */
+static unsigned long n_allocations = 0;
+
+/** Number of bytes requested by counted allocations */
+static unsigned long n_bytes = 0;
+
+/** Non-zero if allocations are attributed to call sites and frames */
+static int is_tracking = 0;
+
+/** Guards all tracking state below */
+static int tracking_lock = 0;
+
+/** Call sites hashed by return address */
+static callsite_t callsites[MAX_CALLSITES];
+
+/** Statistics of call sites that didn't fit into table */
+static callsite_t overflow_site;
+
+/** Current frame number, 0 before main loop */
+static unsigned long current_frame = 0;
+
+/** Statistics of current frame */
+static frame_stats_t frame_stats;
+
+/** Frames with the most allocated bytes, sorted in descending order */
+static frame_stats_t top_frames[MAX_TOP_FRAMES];
+
+/** Number of tracked allocations */
+static unsigned long n_tracked = 0;
+
+/** Number of bytes requested by tracked allocations */
+static unsigned long n_tracked_bytes = 0;
+
+/** Number of bytes in heap blocks allocated while tracking, may be
+ * negative if blocks allocated before tracking are freed */
+static long live_bytes = 0;
+
+/** Maximum of live_bytes */
+static long peak_live_bytes = 0;
+
+/** Acquire tracking_lock */
+static void lock_tracking (void)
+{
+    while (__atomic_exchange_n (&tracking_lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n (&tracking_lock, __ATOMIC_RELAXED)) {
+        }
+    }
+}
+
+/** Release tracking_lock */
+static void unlock_tracking (void)
+{
+    __atomic_store_n (&tracking_lock, 0, __ATOMIC_RELEASE);
+}
+
+/** Find or insert call site, must be called with tracking_lock held
+ * @param address return address of allocator call
+ * @returns statistics of call site
+ */
+static callsite_t *find_callsite (void *address)
+{
+    size_t hash = ((size_t)address >> 4) * (size_t)2654435761u;
+    size_t i, n;
+    for (n = 0; n < MAX_CALLSITES; n++) {
+        i = (hash + n) & (MAX_CALLSITES - 1);
+        if (callsites[i].address == address) {
+            return &callsites[i];
+        }
+        if (callsites[i].address == NULL) {
+            callsites[i].address = address;
+            return &callsites[i];
+        }
+    }
+    return &overflow_site;
+}
+
+/** Move statistics of current frame into the list of top frames, must be
+ * called with tracking_lock held
+ */
+static void retire_frame (void)
+{
+    size_t i = MAX_TOP_FRAMES;
+    if ((frame_stats.frame == 0)
+            || (frame_stats.n_bytes <= top_frames[MAX_TOP_FRAMES - 1].n_bytes)) {
+        return;
+    }
+    while ((i > 0) && (top_frames[i - 1].n_bytes < frame_stats.n_bytes)) {
+        if (i < MAX_TOP_FRAMES) {
+            top_frames[i] = top_frames[i - 1];
+        }
+        i--;
+    }
+    top_frames[i] = frame_stats;
+}
+
+/** Account single allocation
+ * @param ptr allocated block, NULL if allocation failed
+ * @param size number of requested bytes
+ * @param address return address of allocator call
+ */
+static void count_allocation (void *ptr, size_t size, void *address)
+{
+    callsite_t *site;
+    if (__atomic_load_n (&is_counting, __ATOMIC_RELAXED)) {
+        __atomic_fetch_add (&n_allocations, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add (&n_bytes, size, __ATOMIC_RELAXED);
+    }
+    if (!__atomic_load_n (&is_tracking, __ATOMIC_RELAXED)) {
+        return;
+    }
+    lock_tracking ();
+    site = find_callsite (address);
+    site->n_allocations++;
+    site->n_bytes += size;
+    if ((site->n_frames == 0) || (site->last_frame != current_frame)) {
+        site->n_frames++;
+        site->last_frame = current_frame;
+    }
+    frame_stats.n_allocations++;
+    frame_stats.n_bytes += size;
+    n_tracked++;
+    n_tracked_bytes += size;
+    if (ptr != NULL) {
+        live_bytes += (long)malloc_usable_size (ptr);
+        if (live_bytes > peak_live_bytes) {
+            peak_live_bytes = live_bytes;
+        }
+    }
+    unlock_tracking ();
+}
+
+/** Get size of heap block if allocations are tracked
+ * @param ptr heap block, may be NULL
+ * @returns usable size of block, 0 if ptr is NULL or tracking is disabled
+ */
+static size_t tracked_size (void *ptr)
+{
+    if ((ptr == NULL) || !__atomic_load_n (&is_tracking, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    return malloc_usable_size (ptr);
+}
+
+/** Account release of heap block
+ * @param size size of released block returned by tracked_size()
+ */
+static void count_free (size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+    lock_tracking ();
+    live_bytes -= (long)size;
+    unlock_tracking ();
+}
+
+void alloc_hooks_start (void)
+{
+    __atomic_store_n (&is_counting, 1, __ATOMIC_SEQ_CST);
+}
+
+void alloc_hooks_stop (void)
+{
+    __atomic_store_n (&is_counting, 0, __ATOMIC_SEQ_CST);
+}
+
+unsigned long alloc_hooks_count (void)
+{
+    return __atomic_load_n (&n_allocations, __ATOMIC_RELAXED);
+}
+
+unsigned long alloc_hooks_bytes (void)
+{
+    return __atomic_load_n (&n_bytes, __ATOMIC_RELAXED);
+}
+
+void alloc_hooks_start_tracking (void)
+{
+    __atomic_store_n (&is_tracking, 1, __ATOMIC_SEQ_CST);
+}
+
+void alloc_hooks_set_frame (unsigned long frame)
+{
+    if (!__atomic_load_n (&is_tracking, __ATOMIC_RELAXED)) {
+        return;
+    }
+    lock_tracking ();
+    retire_frame ();
+    current_frame = frame;
+    frame_stats.frame = frame;
+    frame_stats.n_allocations = 0;
+    frame_stats.n_bytes = 0;
+    unlock_tracking ();
+}
+
+/** Compare call sites by number of requested bytes in descending order
+ * @param a first call site
+ * @param b second call site
+ * @returns negative if a should be reported before b
+ */
+static int compare_callsites (const void *a, const void *b)
+{
+    const callsite_t *site_a = (const callsite_t *)a;
+    const callsite_t *site_b = (const callsite_t *)b;
+    if (site_a->n_bytes != site_b->n_bytes) {
+        return site_a->n_bytes > site_b->n_bytes ? -1 : 1;
+    }
+    if (site_a->n_allocations != site_b->n_allocations) {
+        return site_a->n_allocations > site_b->n_allocations ? -1 : 1;
+    }
+    return 0;
+}
+
+/** Print location of call site
+ * @param address return address of allocator call
+ */
+static void print_callsite (void *address)
+{
+    Dl_info info;
+    const char *module;
+    memset (&info, 0, sizeof (info));
+    if ((address == NULL) || (dladdr (address, &info) == 0)) {
+        printf ("%p\n", address);
+        return;
+    }
+    module = info.dli_fname != NULL ? strrchr (info.dli_fname, '/') : NULL;
+    module = module != NULL ? module + 1 : info.dli_fname;
+    if (info.dli_sname != NULL) {
+        printf ("%s(%s+0x%lx)\n", module, info.dli_sname,
+                (unsigned long)((char *)address - (char *)info.dli_saddr));
+    } else {
+        printf ("%s(+0x%lx)\n", module,
+                (unsigned long)((char *)address - (char *)info.dli_fbase));
+    }
+}
+
+void alloc_hooks_report (unsigned int n_top)
+{
+    struct rusage usage;
+    size_t i, n_sites = 0;
+    __atomic_store_n (&is_tracking, 0, __ATOMIC_SEQ_CST);
+    lock_tracking ();
+    retire_frame ();
+    unlock_tracking ();
+    for (i = 0; i < MAX_CALLSITES; i++) {
+        if (callsites[i].address != NULL) {
+            callsites[n_sites++] = callsites[i];
+        }
+    }
+    qsort (callsites, n_sites, sizeof (callsite_t), compare_callsites);
+    memset (&usage, 0, sizeof (usage));
+    getrusage (RUSAGE_SELF, &usage);
+    printf ("Heap allocations: %lu (%lu bytes) from %lu call sites\n",
+            n_tracked, n_tracked_bytes, (unsigned long)n_sites);
+    printf ("Peak heap usage: %ld bytes, peak RSS: %ld KiB\n",
+            peak_live_bytes, usage.ru_maxrss);
+    printf ("Top call sites by bytes:\n");
+    printf ("     count        bytes   frames  call site\n");
+    for (i = 0; (i < n_sites) && (i < n_top); i++) {
+        printf ("%10lu %12lu %8lu  ", callsites[i].n_allocations,
+                callsites[i].n_bytes, callsites[i].n_frames);
+        print_callsite (callsites[i].address);
+    }
+    if (overflow_site.n_allocations != 0) {
+        printf ("%10lu %12lu %8s  other call sites\n",
+                overflow_site.n_allocations, overflow_site.n_bytes, "-");
+    }
+    if (top_frames[0].n_allocations != 0) {
+        printf ("Top frames by bytes:\n");
+        for (i = 0; (i < MAX_TOP_FRAMES) && (top_frames[i].n_allocations != 0);
+                i++) {
+            printf ("  frame %lu: %lu allocations, %lu bytes\n",
+                    top_frames[i].frame, top_frames[i].n_allocations,
+                    top_frames[i].n_bytes);
+        }
+    }
+}
+
+void *malloc (size_t size)
+{
+    void *ptr = __libc_malloc (size);
+    count_allocation (ptr, size, __builtin_return_address (0));
+    return ptr;
+}
+
+void *calloc (size_t n, size_t size)
+{
+    void *ptr = __libc_calloc (n, size);
+    count_allocation (ptr, n * size, __builtin_return_address (0));
+    return ptr;
+}
+
+void *realloc (void *ptr, size_t size)
+{
+    size_t old_size = tracked_size (ptr);
+    void *new_ptr = __libc_realloc (ptr, size);
+    if ((new_ptr != NULL) || (size == 0)) {
+        count_free (old_size);
+    }
+    if (new_ptr != NULL) {
+        count_allocation (new_ptr, size, __builtin_return_address (0));
+    }
+    return new_ptr;
+}
+
+void *memalign (size_t alignment, size_t size)
+{
+    void *ptr = __libc_memalign (alignment, size);
+    count_allocation (ptr, size, __builtin_return_address (0));
+    return ptr;
+}
+
+void *aligned_alloc (size_t alignment, size_t size)
+{
+    void *ptr = __libc_memalign (alignment, size);
+    count_allocation (ptr, size, __builtin_return_address (0));
+    return ptr;
+}
+
+int posix_memalign (void **ptr, size_t alignment, size_t size)
+{
+    void *mem;
+    if ((alignment % sizeof (void *) != 0)
+            || ((alignment & (alignment - 1)) != 0) || (alignment == 0)) {
+        return EINVAL;
+    }
+    mem = __libc_memalign (alignment, size);
+    count_allocation (mem, size, __builtin_return_address (0));
+    if (mem == NULL) {
+        return ENOMEM;
+    }
+    *ptr = mem;
+    return 0;
+}
+
+void free (void *ptr)
+{
+    count_free (tracked_size (ptr));
+    __libc_free (ptr);
+}
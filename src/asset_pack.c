@@ -0,0 +1,474 @@
+/**
+ * @file asset_pack.c
+ * This module contains lookup and parallel decompression of assets of
+ * memory-mapped asset packs.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "lz4.h"
+#include "workers.h"
+#include "asset_pack.h"
+
+/** Largest size of asset and of names of pack */
+#define MAX_SIZE 0xFFFFFFFFul
+
+/** Offset basis of 64-bit FNV-1a hash */
+#define FNV_OFFSET_BASIS (((GLuint64)0xCBF29CE4ul << 32) | 0x84222325ul)
+
+/** Prime of 64-bit FNV-1a hash */
+#define FNV_PRIME (((GLuint64)0x100ul << 32) | 0x1B3ul)
+
+/** Reading of blocks of several entries run by workers */
+typedef struct read_job_t {
+    const asset_pack_t *pack; /**< Mapped pack */
+    const asset_pack_entry_t *const *entries; /**< Entries to read */
+    void *const *dst; /**< Destination of each entry */
+    unsigned int *first_block; /**< Index of the first job of each entry */
+    unsigned int n_entries; /**< Number of entries */
+    int is_corrupt; /**< Non-zero if some block failed to decode */
+} read_job_t;
+
+/** Asset being packed, ordered by hash of name */
+typedef struct pack_item_t {
+    GLuint64 hash; /**< Hash of name */
+    unsigned int index; /**< Index of asset in arguments of writer */
+    char padding[4];
+} pack_item_t;
+
+/** Get number of blocks of asset
+ * @param size size of asset
+ * @returns number of blocks of ASSET_PACK_BLOCK_SIZE bytes
+ */
+static unsigned int count_blocks (GLuint size)
+{
+    return size / ASSET_PACK_BLOCK_SIZE + (size % ASSET_PACK_BLOCK_SIZE != 0);
+}
+
+GLuint64 asset_pack_hash (const char *name)
+{
+    GLuint64 hash = FNV_OFFSET_BASIS;
+    const unsigned char *p = (const unsigned char *)name;
+    while (*p != '\0') {
+        hash = (hash ^ *p++) * FNV_PRIME;
+    }
+    return hash;
+}
+
+/** Check that entry lies inside pack and is sorted into its bucket
+ * @param pack pack with header, entries and names set
+ * @param index index of entry
+ * @returns non-zero if entry is valid
+ */
+static int is_valid_entry (const asset_pack_t *pack, unsigned int index)
+{
+    const asset_pack_entry_t *entry = &pack->entries[index];
+    unsigned int top = (unsigned int) (entry->hash >> 56);
+    GLuint bucket_start = top == 0 ? 0 : pack->header->fanout[top - 1];
+    GLuint64 table_size = (GLuint64)count_blocks (entry->size) * sizeof (GLuint);
+    if ((index < bucket_start) || (index >= pack->header->fanout[top])
+            || ((index > 0) && (pack->entries[index - 1].hash > entry->hash))
+            || (entry->name_offset >= pack->header->names_size)
+            || (entry->offset % ASSET_PACK_ALIGNMENT != 0)
+            || (entry->offset > pack->size)
+            || (entry->packed_size > pack->size - entry->offset)) {
+        return 0;
+    }
+    if (entry->flags == ASSET_PACK_LZ4) {
+        return table_size <= entry->packed_size;
+    }
+    return (entry->flags == 0) && (entry->packed_size == entry->size);
+}
+
+/** Check that header and index of mapped pack are consistent
+ * @param pack pack with mapping and size set
+ * @returns non-zero if pack is valid
+ */
+static int is_valid_pack (asset_pack_t *pack)
+{
+    const asset_pack_header_t *header;
+    GLuint64 index_size;
+    unsigned int i;
+    if (pack->size < sizeof (asset_pack_header_t)) {
+        return 0;
+    }
+    header = (const asset_pack_header_t *)pack->mapping;
+    index_size = (GLuint64)header->n_entries * sizeof (asset_pack_entry_t);
+    if ((header->magic != ASSET_PACK_MAGIC)
+            || (header->version != ASSET_PACK_VERSION)
+            || (header->fanout[255] != header->n_entries)
+            || (sizeof (*header) + index_size + header->names_size > pack->size)) {
+        return 0;
+    }
+    pack->header = header;
+    pack->entries = (const asset_pack_entry_t *) (header + 1);
+    pack->names = (const char *) (pack->entries + header->n_entries);
+    if ((header->names_size != 0)
+            && (pack->names[header->names_size - 1] != '\0')) {
+        return 0;
+    }
+    for (i = 1; i < 256; i++) {
+        if (header->fanout[i] < header->fanout[i - 1]) {
+            return 0;
+        }
+    }
+    for (i = 0; i < header->n_entries; i++) {
+        if (!is_valid_entry (pack, i)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int asset_pack_open (asset_pack_t *pack, const char *path)
+{
+    struct stat status;
+    void *mapping;
+    int fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if ((fstat (fd, &status) != 0) || (status.st_size <= 0)) {
+        close (fd);
+        return -1;
+    }
+    mapping = mmap (NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd,
+                    0);
+    close (fd);
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+    /* Assets are looked up sparsely, let them fault in on demand */
+    madvise (mapping, (size_t)status.st_size, MADV_RANDOM);
+    memset (pack, 0, sizeof (*pack));
+    pack->mapping = mapping;
+    pack->size = (size_t)status.st_size;
+    if (!is_valid_pack (pack)) {
+        asset_pack_close (pack);
+        return -1;
+    }
+    return 0;
+}
+
+void asset_pack_close (asset_pack_t *pack)
+{
+    if (pack->mapping != NULL) {
+        munmap (pack->mapping, pack->size);
+    }
+    memset (pack, 0, sizeof (*pack));
+}
+
+const asset_pack_entry_t *asset_pack_find (const asset_pack_t *pack,
+        const char *name)
+{
+    GLuint64 hash = asset_pack_hash (name);
+    unsigned int top = (unsigned int) (hash >> 56);
+    GLuint low = top == 0 ? 0 : pack->header->fanout[top - 1];
+    GLuint high = pack->header->fanout[top];
+    GLuint end = high;
+    while (low < high) {
+        GLuint middle = low + (high - low) / 2;
+        if (pack->entries[middle].hash < hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    for (; (low < end) && (pack->entries[low].hash == hash); low++) {
+        if (strcmp (asset_pack_name (pack, &pack->entries[low]), name) == 0) {
+            return &pack->entries[low];
+        }
+    }
+    return NULL;
+}
+
+const char *asset_pack_name (const asset_pack_t *pack,
+                             const asset_pack_entry_t *entry)
+{
+    return pack->names + entry->name_offset;
+}
+
+/** Get payload of entry as stored in file
+ * @param pack mapped pack
+ * @param entry entry of pack
+ * @returns payload inside mapping
+ */
+static const void *payload (const asset_pack_t *pack,
+                            const asset_pack_entry_t *entry)
+{
+    return (const unsigned char *)pack->mapping + entry->offset;
+}
+
+const void *asset_pack_stored (const asset_pack_t *pack,
+                               const asset_pack_entry_t *entry)
+{
+    return (entry->flags & ASSET_PACK_LZ4) ? NULL : payload (pack, entry);
+}
+
+/** Decompress or copy single block of some entry
+ * @param arg read_job_t of call
+ * @param index index of block among blocks of all entries
+ */
+static void read_block (void *arg, unsigned int index)
+{
+    read_job_t *job = (read_job_t *)arg;
+    const asset_pack_entry_t *entry;
+    const unsigned char *src;
+    const GLuint *ends;
+    unsigned char *dst;
+    GLuint block, start, size, table_size, begin, end;
+    unsigned int low = 0, high = job->n_entries;
+    while (high - low > 1) {
+        unsigned int middle = low + (high - low) / 2;
+        if (job->first_block[middle] <= index) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    entry = job->entries[low];
+    block = index - job->first_block[low];
+    start = block * ASSET_PACK_BLOCK_SIZE;
+    size = entry->size - start;
+    size = size < ASSET_PACK_BLOCK_SIZE ? size : ASSET_PACK_BLOCK_SIZE;
+    src = (const unsigned char *)payload (job->pack, entry);
+    dst = (unsigned char *)job->dst[low] + start;
+    if (!(entry->flags & ASSET_PACK_LZ4)) {
+        memcpy (dst, src + start, size);
+        return;
+    }
+    ends = (const GLuint *)payload (job->pack, entry);
+    table_size = count_blocks (entry->size) * (GLuint)sizeof (GLuint);
+    begin = block == 0 ? 0 : ends[block - 1];
+    end = ends[block];
+    src += table_size;
+    if ((begin > end) || (end > entry->packed_size - table_size)) {
+        __atomic_store_n (&job->is_corrupt, 1, __ATOMIC_RELAXED);
+    } else if (end - begin == size) {
+        memcpy (dst, src + begin, size);
+    } else if (lz4_decompress (src + begin, end - begin, dst, size) != 0) {
+        __atomic_store_n (&job->is_corrupt, 1, __ATOMIC_RELAXED);
+    }
+}
+
+int asset_pack_read (const asset_pack_t *pack,
+                     const asset_pack_entry_t *const *entries,
+                     void *const *dst, unsigned int n)
+{
+    read_job_t job;
+    unsigned int i, n_blocks = 0;
+    if (n == 0) {
+        return 0;
+    }
+    job.first_block = (unsigned int *)malloc (n * sizeof (unsigned int));
+    if (job.first_block == NULL) {
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        job.first_block[i] = n_blocks;
+        n_blocks += count_blocks (entries[i]->size);
+    }
+    job.pack = pack;
+    job.entries = entries;
+    job.dst = dst;
+    job.n_entries = n;
+    job.is_corrupt = 0;
+    workers_run (read_block, &job, n_blocks);
+    free (job.first_block);
+    return job.is_corrupt ? -1 : 0;
+}
+
+/** Order assets by hash of name, then by position in arguments
+ * @param a the first pack_item_t
+ * @param b the second pack_item_t
+ * @returns negative, zero or positive like strcmp()
+ */
+static int compare_items (const void *a, const void *b)
+{
+    const pack_item_t *item_a = (const pack_item_t *)a;
+    const pack_item_t *item_b = (const pack_item_t *)b;
+    if (item_a->hash != item_b->hash) {
+        return item_a->hash < item_b->hash ? -1 : 1;
+    }
+    return item_a->index < item_b->index ? -1 : item_a->index > item_b->index;
+}
+
+/** Round offset up to alignment of payloads
+ * @param offset offset in bytes
+ * @returns aligned offset
+ */
+static GLuint64 align_payload (GLuint64 offset)
+{
+    return (offset + ASSET_PACK_ALIGNMENT - 1)
+           & ~(GLuint64) (ASSET_PACK_ALIGNMENT - 1);
+}
+
+/** Write payload of asset, compressed if that makes it smaller
+ * @param file target file
+ * @param data contents of asset
+ * @param size size of asset
+ * @param compress non-zero to try compression
+ * @param entry receives size and flags of payload
+ * @returns 0 on success, -1 on I/O error or if memory is exhausted
+ */
+static int write_payload (FILE *file, const unsigned char *data, GLuint size,
+                          int compress, asset_pack_entry_t *entry)
+{
+    unsigned int n_blocks = count_blocks (size), i;
+    size_t table_size = n_blocks * sizeof (GLuint);
+    size_t block_capacity = lz4_bound (ASSET_PACK_BLOCK_SIZE);
+    size_t end = 0;
+    unsigned char *blocks;
+    GLuint *ends;
+    void *buffer;
+    int err = 0;
+    entry->size = size;
+    entry->packed_size = size;
+    entry->flags = 0;
+    if (compress && (size > 0)) {
+        buffer = malloc (table_size + n_blocks * block_capacity);
+        if (buffer == NULL) {
+            return -1;
+        }
+        ends = (GLuint *)buffer;
+        blocks = (unsigned char *)buffer + table_size;
+        for (i = 0; i < n_blocks; i++) {
+            GLuint start = i * ASSET_PACK_BLOCK_SIZE;
+            GLuint block_size = size - start < ASSET_PACK_BLOCK_SIZE ?
+                                size - start : ASSET_PACK_BLOCK_SIZE;
+            size_t length = lz4_compress (data + start, block_size,
+                                          blocks + end, block_capacity);
+            if (length >= block_size) {
+                memcpy (blocks + end, data + start, block_size);
+                length = block_size;
+            }
+            end += length;
+            ends[i] = (GLuint)end;
+        }
+        if (table_size + end < size) {
+            entry->packed_size = (GLuint) (table_size + end);
+            entry->flags = ASSET_PACK_LZ4;
+            err = fwrite (buffer, 1, entry->packed_size, file)
+                  == entry->packed_size ? 0 : -1;
+        }
+        free (buffer);
+        if (entry->flags != 0) {
+            return err;
+        }
+    }
+    return fwrite (data, 1, size, file) == size ? 0 : -1;
+}
+
+/** Write header, index and names of pack
+ * @param file target file positioned at its start
+ * @param header header of pack
+ * @param entries index of pack
+ * @param items assets in order of index
+ * @param names names of assets in order of arguments of writer
+ * @returns 0 on success, -1 on I/O error
+ */
+static int write_index (FILE *file, const asset_pack_header_t *header,
+                        const asset_pack_entry_t *entries,
+                        const pack_item_t *items, const char *const *names)
+{
+    unsigned int i;
+    if ((fwrite (header, sizeof (*header), 1, file) != 1)
+            || (fwrite (entries, sizeof (*entries), header->n_entries, file)
+                != header->n_entries)) {
+        return -1;
+    }
+    for (i = 0; i < header->n_entries; i++) {
+        const char *name = names[items[i].index];
+        if (fwrite (name, 1, strlen (name) + 1, file) != strlen (name) + 1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int asset_pack_write (const char *path, const char *const *names,
+                      const void *const *data, const size_t *sizes,
+                      unsigned int n, int compress)
+{
+    asset_pack_header_t header;
+    asset_pack_entry_t *entries;
+    pack_item_t *items;
+    GLuint64 position;
+    size_t names_size = 0;
+    unsigned int i;
+    FILE *file;
+    int err = 0;
+    memset (&header, 0, sizeof (header));
+    header.magic = ASSET_PACK_MAGIC;
+    header.version = ASSET_PACK_VERSION;
+    header.n_entries = n;
+    for (i = 0; i < n; i++) {
+        names_size += strlen (names[i]) + 1;
+        if ((sizes[i] > MAX_SIZE) || (names_size > MAX_SIZE)) {
+            return -1;
+        }
+    }
+    header.names_size = (GLuint)names_size;
+    items = (pack_item_t *)malloc (n * sizeof (pack_item_t) + 1);
+    entries = (asset_pack_entry_t *)calloc (n + 1, sizeof (asset_pack_entry_t));
+    file = fopen (path, "wb");
+    if ((items == NULL) || (entries == NULL) || (file == NULL)) {
+        free (items);
+        free (entries);
+        if (file != NULL) {
+            fclose (file);
+        }
+        return -1;
+    }
+    for (i = 0; i < n; i++) {
+        items[i].hash = asset_pack_hash (names[i]);
+        items[i].index = i;
+        header.fanout[items[i].hash >> 56]++;
+    }
+    for (i = 1; i < 256; i++) {
+        header.fanout[i] += header.fanout[i - 1];
+    }
+    qsort (items, n, sizeof (pack_item_t), compare_items);
+    /* Payloads go first, gaps before them are left as holes of zeros and
+     * index is written into space reserved at start of file last */
+    position = sizeof (header) + n * sizeof (asset_pack_entry_t) + names_size;
+    for (i = 0; (i < n) && (err == 0); i++) {
+        unsigned int index = items[i].index;
+        /* Empty payload at the end would point past the end of file */
+        GLuint64 offset = sizes[index] > 0 ? align_payload (position) : 0;
+        err = fseeko (file, (off_t)offset, SEEK_SET);
+        entries[i].hash = items[i].hash;
+        entries[i].offset = offset;
+        err = err != 0 ? err : write_payload (file,
+                                              (const unsigned char *)data[index],
+                                              (GLuint)sizes[index], compress,
+                                              &entries[i]);
+        position = sizes[index] > 0 ? offset + entries[i].packed_size :
+                   position;
+    }
+    /* Names are laid out in order of index */
+    names_size = 0;
+    for (i = 0; i < n; i++) {
+        entries[i].name_offset = (GLuint)names_size;
+        names_size += strlen (names[items[i].index]) + 1;
+    }
+    if ((err == 0) && (fseeko (file, 0, SEEK_SET) == 0)) {
+        err = write_index (file, &header, entries, items, names);
+    } else {
+        err = -1;
+    }
+    if (fclose (file) != 0) {
+        err = -1;
+    }
+    free (items);
+    free (entries);
+    return err;
+}
@@ -0,0 +1,591 @@
+/**
+ * @file asset_tool.c
+ * This module contains entry point of tool that converts assets into
+ * files loaded by application and packs them into asset packs.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "workers.h"
+#include "gpu_scene.h"
+#include "mesh_file.h"
+#include "asset_pack.h"
+
+/** Initial number of slots of vertex lookup table, power of two */
+#define MIN_TABLE_SIZE 1024u
+
+/** Corner of face: indices of position and normal */
+typedef struct obj_corner_t {
+    GLuint position; /**< Index of position */
+    GLuint normal; /**< Index of normal */
+} obj_corner_t;
+
+/** Mesh being converted from Wavefront OBJ */
+typedef struct obj_mesh_t {
+    float *positions; /**< xyz of each position of file */
+    float *normals; /**< xyz of each normal of file and of flat faces */
+    obj_corner_t *corners; /**< Corners of face being parsed */
+    obj_corner_t *keys; /**< Corner each vertex was built from */
+    GLuint *table; /**< Vertex index plus one by hash of corner, 0 if free */
+    GLfloat *vertices; /**< GPU_SCENE_VERTEX_FLOATS floats per vertex */
+    GLuint *indices; /**< Triangle list */
+    size_t n_positions; /**< Number of positions */
+    size_t max_positions; /**< Capacity of positions */
+    size_t n_normals; /**< Number of normals */
+    size_t max_normals; /**< Capacity of normals */
+    size_t n_corners; /**< Number of corners of face being parsed */
+    size_t max_corners; /**< Capacity of corners */
+    size_t n_vertices; /**< Number of vertices */
+    size_t max_vertices; /**< Capacity of vertices and keys */
+    size_t n_indices; /**< Number of indices */
+    size_t max_indices; /**< Capacity of indices */
+    size_t table_size; /**< Number of slots of table, power of two */
+} obj_mesh_t;
+
+/** Name of program used in messages */
+static const char *program_name;
+
+/** Print usage of tool */
+static void print_usage (void)
+{
+    printf ("Usage: %s mesh OBJ MESH\n"
+            "       %s pack [--compress] PACK FILE...\n"
+            "Convert assets into files loaded by glbootstrap.\n\n",
+            program_name, program_name);
+    printf ("  mesh OBJ MESH             convert Wavefront OBJ file into mesh\n"
+            "                            file for --mesh, faces without normals\n"
+            "                            are shaded flat\n"
+            "  pack PACK FILE...         pack files into asset pack for --assets,\n"
+            "                            each named by its path as given\n"
+            "  --compress                compress files that shrink with LZ4\n");
+}
+
+/** Make room for more items of growing array
+ * @param array array allocated with malloc(), may be NULL
+ * @param capacity capacity of array in items, updated on growth
+ * @param needed number of items array has to hold
+ * @param item_size size of item in bytes
+ * @returns array that holds at least needed items, NULL if out of memory,
+ * array is left intact then
+ */
+static void *reserve (void *array, size_t *capacity, size_t needed,
+                      size_t item_size)
+{
+    size_t new_capacity = *capacity > 0 ? *capacity : 64;
+    void *grown;
+    if (needed <= *capacity) {
+        return array;
+    }
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    grown = realloc (array, new_capacity * item_size);
+    if (grown != NULL) {
+        *capacity = new_capacity;
+    }
+    return grown;
+}
+
+/** Read whole file into memory
+ * @param path path to file
+ * @param file_size receives size of file in bytes
+ * @returns contents followed by NUL to free(), NULL on failure
+ */
+static char *read_file (const char *path, size_t *file_size)
+{
+    FILE *file = fopen (path, "rb");
+    char *text = NULL;
+    long size;
+    if (file == NULL) {
+        return NULL;
+    }
+    if ((fseek (file, 0, SEEK_END) == 0) && ((size = ftell (file)) >= 0)
+            && (fseek (file, 0, SEEK_SET) == 0)) {
+        text = (char *)malloc ((size_t)size + 1);
+    }
+    if ((text != NULL)
+            && (fread (text, 1, (size_t)size, file) != (size_t)size)) {
+        free (text);
+        text = NULL;
+    }
+    if (text != NULL) {
+        text[size] = '\0';
+        *file_size = (size_t)size;
+    }
+    fclose (file);
+    return text;
+}
+
+/** Free arrays of mesh
+ * @param mesh mesh to free
+ */
+static void free_mesh (obj_mesh_t *mesh)
+{
+    free (mesh->positions);
+    free (mesh->normals);
+    free (mesh->corners);
+    free (mesh->keys);
+    free (mesh->table);
+    free (mesh->vertices);
+    free (mesh->indices);
+    memset (mesh, 0, sizeof (*mesh));
+}
+
+/** Parse three floats of position or normal
+ * @param text text after keyword
+ * @param array array of xyz triples
+ * @param count number of triples, incremented
+ * @param capacity capacity of array in triples
+ * @returns array holding parsed triple, NULL on parse error or if out of
+ * memory
+ */
+static float *parse_vector (const char *text, float *array, size_t *count,
+                            size_t *capacity)
+{
+    char *end;
+    float vector[3];
+    unsigned int k;
+    for (k = 0; k < 3; k++) {
+        vector[k] = (float)strtod (text, &end);
+        if (end == text) {
+            return NULL;
+        }
+        text = end;
+    }
+    array = (float *)reserve (array, capacity, *count + 1, 3 * sizeof (float));
+    if (array != NULL) {
+        memcpy (array + *count * 3, vector, sizeof (vector));
+        (*count)++;
+    }
+    return array;
+}
+
+/** Convert index of OBJ file, which counts from one or from the end
+ * @param value index as written in file
+ * @param count number of items defined so far
+ * @param index receives zero-based index
+ * @returns 0 on success, -1 if index is out of range
+ */
+static int resolve_index (long value, size_t count, GLuint *index)
+{
+    if ((value > 0) && ((unsigned long)value <= count)) {
+        *index = (GLuint) (value - 1);
+        return 0;
+    }
+    if ((value < 0) && ((unsigned long) (-value) <= count)) {
+        *index = (GLuint) ((long)count + value);
+        return 0;
+    }
+    return -1;
+}
+
+/** Hash corner for vertex lookup
+ * @param corner corner of face
+ * @returns hash of corner
+ */
+static size_t hash_corner (const obj_corner_t *corner)
+{
+    return (size_t) ((corner->position * 2654435761u)
+                     ^ (corner->normal * 40503u));
+}
+
+/** Double vertex lookup table and insert all vertices again
+ * @param mesh mesh being converted
+ * @returns 0 on success, -1 if out of memory
+ */
+static int grow_table (obj_mesh_t *mesh)
+{
+    size_t size = mesh->table_size > 0 ? mesh->table_size * 2 :
+                  MIN_TABLE_SIZE;
+    GLuint *table = (GLuint *)calloc (size, sizeof (GLuint));
+    size_t i, slot;
+    if (table == NULL) {
+        return -1;
+    }
+    for (i = 0; i < mesh->n_vertices; i++) {
+        slot = hash_corner (mesh->keys + i) & (size - 1);
+        while (table[slot] != 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        table[slot] = (GLuint) (i + 1);
+    }
+    free (mesh->table);
+    mesh->table = table;
+    mesh->table_size = size;
+    return 0;
+}
+
+/** Find vertex built from corner, add it if there is none
+ * @param mesh mesh being converted
+ * @param corner corner of face
+ * @param index receives index of vertex
+ * @returns 0 on success, -1 if out of memory
+ */
+static int find_vertex (obj_mesh_t *mesh, const obj_corner_t *corner,
+                        GLuint *index)
+{
+    size_t slot, capacity = mesh->max_vertices;
+    GLfloat *vertex;
+    void *grown;
+    if (((mesh->n_vertices + 1) * 2 > mesh->table_size)
+            && (grow_table (mesh) != 0)) {
+        return -1;
+    }
+    slot = hash_corner (corner) & (mesh->table_size - 1);
+    while (mesh->table[slot] != 0) {
+        const obj_corner_t *key = mesh->keys + mesh->table[slot] - 1;
+        if ((key->position == corner->position)
+                && (key->normal == corner->normal)) {
+            *index = mesh->table[slot] - 1;
+            return 0;
+        }
+        slot = (slot + 1) & (mesh->table_size - 1);
+    }
+    grown = reserve (mesh->keys, &mesh->max_vertices, mesh->n_vertices + 1,
+                     sizeof (obj_corner_t));
+    if (grown == NULL) {
+        return -1;
+    }
+    mesh->keys = (obj_corner_t *)grown;
+    if (mesh->max_vertices != capacity) {
+        /* Vertices follow capacity of keys */
+        grown = realloc (mesh->vertices, mesh->max_vertices *
+                         GPU_SCENE_VERTEX_FLOATS * sizeof (GLfloat));
+        if (grown == NULL) {
+            return -1;
+        }
+        mesh->vertices = (GLfloat *)grown;
+    }
+    vertex = mesh->vertices + mesh->n_vertices * GPU_SCENE_VERTEX_FLOATS;
+    memcpy (vertex, mesh->positions + corner->position * 3,
+            3 * sizeof (GLfloat));
+    memcpy (vertex + 3, mesh->normals + corner->normal * 3,
+            3 * sizeof (GLfloat));
+    mesh->keys[mesh->n_vertices] = *corner;
+    *index = (GLuint)mesh->n_vertices;
+    mesh->table[slot] = (GLuint)++mesh->n_vertices;
+    return 0;
+}
+
+/** Add flat normal of face to mesh
+ * @param mesh mesh being converted, its first three corners define face
+ * @param index receives index of normal
+ * @returns 0 on success, -1 if out of memory
+ */
+static int add_face_normal (obj_mesh_t *mesh, GLuint *index)
+{
+    const float *a = mesh->positions + mesh->corners[0].position * 3;
+    const float *b = mesh->positions + mesh->corners[1].position * 3;
+    const float *c = mesh->positions + mesh->corners[2].position * 3;
+    float u[3], v[3], normal[3], length;
+    unsigned int k;
+    void *grown;
+    for (k = 0; k < 3; k++) {
+        u[k] = b[k] - a[k];
+        v[k] = c[k] - a[k];
+    }
+    normal[0] = u[1] * v[2] - u[2] * v[1];
+    normal[1] = u[2] * v[0] - u[0] * v[2];
+    normal[2] = u[0] * v[1] - u[1] * v[0];
+    length = sqrtf (normal[0] * normal[0] + normal[1] * normal[1] +
+                    normal[2] * normal[2]);
+    for (k = 0; k < 3; k++) {
+        normal[k] = length > 0.0f ? normal[k] / length : 0.0f;
+    }
+    grown = reserve (mesh->normals, &mesh->max_normals, mesh->n_normals + 1,
+                     3 * sizeof (float));
+    if (grown == NULL) {
+        return -1;
+    }
+    mesh->normals = (float *)grown;
+    memcpy (mesh->normals + mesh->n_normals * 3, normal, sizeof (normal));
+    *index = (GLuint)mesh->n_normals++;
+    return 0;
+}
+
+/** Parse face and add it to mesh as triangle fan
+ * @param mesh mesh being converted
+ * @param text text after keyword
+ * @returns 0 on success, -1 on parse error or if out of memory
+ */
+static int parse_face (obj_mesh_t *mesh, const char *text)
+{
+    const GLuint no_normal = ~(GLuint)0;
+    GLuint face_normal = no_normal, first = 0, previous = 0, vertex;
+    char *end;
+    size_t i;
+    void *grown;
+    mesh->n_corners = 0;
+    for (;;) {
+        obj_corner_t corner;
+        long value = strtol (text, &end, 10);
+        if (end == text) {
+            break;
+        }
+        if (resolve_index (value, mesh->n_positions, &corner.position) != 0) {
+            return -1;
+        }
+        corner.normal = no_normal;
+        if (*end == '/') {
+            /* Texture coordinates are skipped, mesh file has none */
+            text = end + 1;
+            strtol (text, &end, 10);
+            if (*end == '/') {
+                text = end + 1;
+                value = strtol (text, &end, 10);
+                if ((end != text) && (resolve_index (value, mesh->n_normals,
+                                      &corner.normal) != 0)) {
+                    return -1;
+                }
+            }
+        }
+        text = end;
+        grown = reserve (mesh->corners, &mesh->max_corners,
+                         mesh->n_corners + 1, sizeof (obj_corner_t));
+        if (grown == NULL) {
+            return -1;
+        }
+        mesh->corners = (obj_corner_t *)grown;
+        mesh->corners[mesh->n_corners++] = corner;
+    }
+    if (mesh->n_corners < 3) {
+        return -1;
+    }
+    for (i = 0; i < mesh->n_corners; i++) {
+        if (mesh->corners[i].normal == no_normal) {
+            if ((face_normal == no_normal)
+                    && (add_face_normal (mesh, &face_normal) != 0)) {
+                return -1;
+            }
+            mesh->corners[i].normal = face_normal;
+        }
+        if (find_vertex (mesh, mesh->corners + i, &vertex) != 0) {
+            return -1;
+        }
+        if (i == 0) {
+            first = vertex;
+        } else if (i >= 2) {
+            grown = reserve (mesh->indices, &mesh->max_indices,
+                             mesh->n_indices + 3, sizeof (GLuint));
+            if (grown == NULL) {
+                return -1;
+            }
+            mesh->indices = (GLuint *)grown;
+            mesh->indices[mesh->n_indices++] = first;
+            mesh->indices[mesh->n_indices++] = previous;
+            mesh->indices[mesh->n_indices++] = vertex;
+        }
+        previous = vertex;
+    }
+    return 0;
+}
+
+/** Parse Wavefront OBJ file, only positions, normals and faces are used
+ * @param mesh receives converted mesh, freed on failure
+ * @param text NUL-terminated contents of file, modified
+ * @returns 0 on success, number of line that can't be parsed otherwise
+ */
+static unsigned long parse_obj (obj_mesh_t *mesh, char *text)
+{
+    unsigned long line = 0;
+    while (*text != '\0') {
+        char *next = strchr (text, '\n');
+        int err = 0;
+        line++;
+        if (next != NULL) {
+            *next++ = '\0';
+        } else {
+            next = text + strlen (text);
+        }
+        text += strspn (text, " \t");
+        if ((strncmp (text, "v ", 2) == 0) || (strncmp (text, "v\t", 2) == 0)) {
+            float *positions = parse_vector (text + 2, mesh->positions,
+                                             &mesh->n_positions,
+                                             &mesh->max_positions);
+            err = positions == NULL;
+            mesh->positions = positions != NULL ? positions : mesh->positions;
+        } else if ((strncmp (text, "vn ", 3) == 0)
+                   || (strncmp (text, "vn\t", 3) == 0)) {
+            float *normals = parse_vector (text + 3, mesh->normals,
+                                           &mesh->n_normals,
+                                           &mesh->max_normals);
+            err = normals == NULL;
+            mesh->normals = normals != NULL ? normals : mesh->normals;
+        } else if ((strncmp (text, "f ", 2) == 0)
+                   || (strncmp (text, "f\t", 2) == 0)) {
+            err = parse_face (mesh, text + 2);
+        }
+        if (err != 0) {
+            free_mesh (mesh);
+            return line;
+        }
+        text = next;
+    }
+    return 0;
+}
+
+/** Convert Wavefront OBJ file into mesh file and check that it opens
+ * @param obj_path path to OBJ file
+ * @param mesh_path path to mesh file to create or replace
+ * @returns EXIT_SUCCESS or EXIT_FAILURE with message printed
+ */
+static int convert_mesh (const char *obj_path, const char *mesh_path)
+{
+    obj_mesh_t mesh;
+    mesh_file_t written;
+    unsigned long line;
+    size_t size;
+    char *text = read_file (obj_path, &size);
+    if (text == NULL) {
+        fprintf (stderr, "%s: can't read '%s'\n", program_name, obj_path);
+        return EXIT_FAILURE;
+    }
+    memset (&mesh, 0, sizeof (mesh));
+    line = parse_obj (&mesh, text);
+    free (text);
+    if (line != 0) {
+        fprintf (stderr, "%s: %s:%lu: malformed line or out of memory\n",
+                 program_name, obj_path, line);
+        return EXIT_FAILURE;
+    }
+    if (mesh.n_indices == 0) {
+        fprintf (stderr, "%s: '%s' has no faces\n", program_name, obj_path);
+        free_mesh (&mesh);
+        return EXIT_FAILURE;
+    }
+    if (mesh_file_write (mesh_path, mesh.vertices,
+                         GPU_SCENE_VERTEX_FLOATS * sizeof (GLfloat),
+                         (GLuint)mesh.n_vertices, mesh.indices,
+                         sizeof (GLuint), (GLuint)mesh.n_indices) != 0) {
+        fprintf (stderr, "%s: can't write '%s'\n", program_name, mesh_path);
+        free_mesh (&mesh);
+        return EXIT_FAILURE;
+    }
+    free_mesh (&mesh);
+    if (mesh_file_open (&written, mesh_path) != 0) {
+        fprintf (stderr, "%s: '%s' doesn't open after writing\n",
+                 program_name, mesh_path);
+        return EXIT_FAILURE;
+    }
+    printf ("%s: %u vertices, %u triangles\n", mesh_path,
+            written.header->n_vertices, written.header->n_indices / 3);
+    mesh_file_close (&written);
+    return EXIT_SUCCESS;
+}
+
+/** Check that every file reads back from pack unchanged
+ * @param pack_path path to written pack
+ * @param paths paths of packed files, also their names
+ * @param data contents of files
+ * @param sizes sizes of files in bytes
+ * @param n number of files
+ * @returns EXIT_SUCCESS or EXIT_FAILURE with message printed
+ */
+static int verify_pack (const char *pack_path, char *const *paths,
+                        void *const *data, const size_t *sizes,
+                        unsigned int n)
+{
+    asset_pack_t pack;
+    unsigned long packed = 0, total = 0;
+    unsigned int i;
+    int err = 0;
+    if (asset_pack_open (&pack, pack_path) != 0) {
+        fprintf (stderr, "%s: '%s' doesn't open after writing\n",
+                 program_name, pack_path);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; (i < n) && (err == 0); i++) {
+        const asset_pack_entry_t *entry = asset_pack_find (&pack, paths[i]);
+        void *copy = malloc (sizes[i] + 1);
+        err = (entry == NULL) || (entry->size != sizes[i]) || (copy == NULL)
+              || (asset_pack_read (&pack, &entry, &copy, 1) != 0)
+              || (memcmp (copy, data[i], sizes[i]) != 0) ? -1 : 0;
+        if (err != 0) {
+            fprintf (stderr, "%s: '%s' doesn't read back from '%s'\n",
+                     program_name, paths[i], pack_path);
+        } else {
+            packed += entry->packed_size;
+            total += entry->size;
+        }
+        free (copy);
+    }
+    if (err == 0) {
+        printf ("%s: %u assets, %lu bytes packed into %lu\n", pack_path, n,
+                total, packed);
+    }
+    asset_pack_close (&pack);
+    return err == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/** Pack files into asset pack and check that they read back
+ * @param pack_path path to pack to create or replace
+ * @param paths paths of files, also names of assets
+ * @param n number of files
+ * @param compress non-zero to compress files that shrink with LZ4
+ * @returns EXIT_SUCCESS or EXIT_FAILURE with message printed
+ */
+static int pack_files (const char *pack_path, char *const *paths,
+                       unsigned int n, int compress)
+{
+    void **data = (void **)calloc (n, sizeof (void *));
+    size_t *sizes = (size_t *)calloc (n, sizeof (size_t));
+    unsigned int i;
+    int status = data != NULL && sizes != NULL ? EXIT_SUCCESS : EXIT_FAILURE;
+    for (i = 0; (i < n) && (status == EXIT_SUCCESS); i++) {
+        data[i] = read_file (paths[i], sizes + i);
+        if (data[i] == NULL) {
+            fprintf (stderr, "%s: can't read '%s'\n", program_name, paths[i]);
+            status = EXIT_FAILURE;
+        }
+    }
+    if ((status == EXIT_SUCCESS)
+            && (asset_pack_write (pack_path, (const char *const *)paths,
+                                  (const void *const *)data, sizes, n,
+                                  compress) != 0)) {
+        fprintf (stderr, "%s: can't write '%s'\n", program_name, pack_path);
+        status = EXIT_FAILURE;
+    }
+    if (status == EXIT_SUCCESS) {
+        status = verify_pack (pack_path, paths, data, sizes, n);
+    }
+    for (i = 0; (data != NULL) && (i < n); i++) {
+        free (data[i]);
+    }
+    free (data);
+    free (sizes);
+    return status;
+}
+
+int main (int argc, char *argv[])
+{
+    long n_workers = sysconf (_SC_NPROCESSORS_ONLN) - 1;
+    int compress, first, status;
+    program_name = argv[0];
+    if ((argc == 4) && (strcmp (argv[1], "mesh") == 0)) {
+        return convert_mesh (argv[2], argv[3]);
+    }
+    if ((argc >= 2) && (strcmp (argv[1], "pack") == 0)) {
+        compress = (argc >= 3) && (strcmp (argv[2], "--compress") == 0);
+        first = compress ? 3 : 2;
+        if (argc - first > 1) {
+            /* Pack is read back with decompression spread across workers */
+            workers_init (n_workers > 0 ? (unsigned int)n_workers : 0, NULL);
+            status = pack_files (argv[first], argv + first + 1,
+                                 (unsigned int) (argc - first - 1), compress);
+            workers_shutdown ();
+            return status;
+        }
+    }
+    if ((argc == 2) && ((strcmp (argv[1], "-h") == 0)
+                        || (strcmp (argv[1], "--help") == 0))) {
+        print_usage ();
+        return EXIT_SUCCESS;
+    }
+    print_usage ();
+    return EXIT_FAILURE;
+}
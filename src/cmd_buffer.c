@@ -0,0 +1,279 @@
+/**
+ * @file cmd_buffer.c
+ * This module contains compact buffers of rendering commands recorded on
+ * any thread and replayed on the thread that owns OpenGL context.
+ *
+ * Command is a header word holding opcode in low 16 bits and total number
+ * of words in high 16 bits, followed by 32-bit arguments.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include "gl_procs.h"
+#include "gl_state.h"
+#include "cmd_buffer.h"
+
+/** Size of chunk allocated from frame arena in bytes */
+#define CHUNK_SIZE 16384
+
+/** Number of command words in single chunk */
+#define CHUNK_WORDS ((CHUNK_SIZE - sizeof (cmd_chunk_t)) / sizeof (GLuint))
+
+/** Command opcodes */
+enum {
+    CMD_USE_PROGRAM = 1,
+    CMD_BIND_VERTEX_ARRAY,
+    CMD_BIND_BUFFER_RANGE,
+    CMD_BIND_TEXTURE,
+    CMD_SET_ENABLED,
+    CMD_BLEND_FUNC,
+    CMD_DEPTH_MASK,
+    CMD_DRAW_ELEMENTS,
+    CMD_DRAW_ARRAYS
+};
+
+/** Get command words of chunk
+ * @param chunk chunk of buffer
+ * @returns the first word
+ */
+static GLuint *chunk_words (cmd_chunk_t *chunk)
+{
+    return (GLuint *) (chunk + 1);
+}
+
+void cmd_buffer_begin (cmd_buffer_t *buffer, frame_arena_t *arena)
+{
+    buffer->arena = arena;
+    buffer->first = NULL;
+    buffer->last = NULL;
+    buffer->cursor = NULL;
+    buffer->end = NULL;
+    buffer->n_commands = 0;
+    buffer->n_dropped = 0;
+}
+
+/** Reserve space for command
+ * @param buffer target buffer
+ * @param opcode opcode of command
+ * @param n_arguments number of argument words
+ * @returns argument words of command, NULL if frame arena is exhausted
+ */
+static GLuint *reserve (cmd_buffer_t *buffer, GLuint opcode,
+                        GLuint n_arguments)
+{
+    GLuint *words;
+    GLuint n_words = n_arguments + 1;
+    if ((buffer->cursor == NULL)
+            || ((size_t) (buffer->end - buffer->cursor) < n_words)) {
+        cmd_chunk_t *chunk = (cmd_chunk_t *)frame_arena_alloc (buffer->arena,
+                             CHUNK_SIZE);
+        if (chunk == NULL) {
+            buffer->n_dropped++;
+            return NULL;
+        }
+        chunk->next = NULL;
+        chunk->n_words = 0;
+        if (buffer->last != NULL) {
+            buffer->last->n_words = (size_t) (buffer->cursor -
+                                              chunk_words (buffer->last));
+            buffer->last->next = chunk;
+        } else {
+            buffer->first = chunk;
+        }
+        buffer->last = chunk;
+        buffer->cursor = chunk_words (chunk);
+        buffer->end = buffer->cursor + CHUNK_WORDS;
+    }
+    words = buffer->cursor;
+    buffer->cursor += n_words;
+    buffer->n_commands++;
+    words[0] = opcode | (n_words << 16);
+    return words + 1;
+}
+
+void cmd_use_program (cmd_buffer_t *buffer, GLuint program)
+{
+    GLuint *args = reserve (buffer, CMD_USE_PROGRAM, 1);
+    if (args != NULL) {
+        args[0] = program;
+    }
+}
+
+void cmd_bind_vertex_array (cmd_buffer_t *buffer, GLuint vertex_array)
+{
+    GLuint *args = reserve (buffer, CMD_BIND_VERTEX_ARRAY, 1);
+    if (args != NULL) {
+        args[0] = vertex_array;
+    }
+}
+
+void cmd_bind_buffer_range (cmd_buffer_t *buffer, GLenum target, GLuint index,
+                            GLuint object, GLuint offset, GLuint size)
+{
+    GLuint *args = reserve (buffer, CMD_BIND_BUFFER_RANGE, 5);
+    if (args != NULL) {
+        args[0] = target;
+        args[1] = index;
+        args[2] = object;
+        args[3] = offset;
+        args[4] = size;
+    }
+}
+
+void cmd_bind_texture (cmd_buffer_t *buffer, GLuint unit, GLenum target,
+                       GLuint texture)
+{
+    GLuint *args = reserve (buffer, CMD_BIND_TEXTURE, 3);
+    if (args != NULL) {
+        args[0] = unit;
+        args[1] = target;
+        args[2] = texture;
+    }
+}
+
+void cmd_set_enabled (cmd_buffer_t *buffer, GLenum cap, int enabled)
+{
+    GLuint *args = reserve (buffer, CMD_SET_ENABLED, 2);
+    if (args != NULL) {
+        args[0] = cap;
+        args[1] = enabled != 0;
+    }
+}
+
+void cmd_blend_func (cmd_buffer_t *buffer, GLenum src_rgb, GLenum dst_rgb,
+                     GLenum src_alpha, GLenum dst_alpha)
+{
+    GLuint *args = reserve (buffer, CMD_BLEND_FUNC, 4);
+    if (args != NULL) {
+        args[0] = src_rgb;
+        args[1] = dst_rgb;
+        args[2] = src_alpha;
+        args[3] = dst_alpha;
+    }
+}
+
+void cmd_depth_mask (cmd_buffer_t *buffer, int write)
+{
+    GLuint *args = reserve (buffer, CMD_DEPTH_MASK, 1);
+    if (args != NULL) {
+        args[0] = write != 0;
+    }
+}
+
+void cmd_draw_elements (cmd_buffer_t *buffer, GLenum mode, GLsizei count,
+                        GLenum type, GLuint offset, GLsizei instances,
+                        GLint base_vertex, GLuint base_instance)
+{
+    GLuint *args;
+    if ((base_instance != 0)
+            && (gl.DrawElementsInstancedBaseVertexBaseInstance == NULL)) {
+        buffer->n_dropped++;
+        return;
+    }
+    args = reserve (buffer, CMD_DRAW_ELEMENTS, 7);
+    if (args != NULL) {
+        args[0] = mode;
+        args[1] = (GLuint)count;
+        args[2] = type;
+        args[3] = offset;
+        args[4] = (GLuint)instances;
+        args[5] = (GLuint)base_vertex;
+        args[6] = base_instance;
+    }
+}
+
+void cmd_draw_arrays (cmd_buffer_t *buffer, GLenum mode, GLint first,
+                      GLsizei count, GLsizei instances, GLuint base_instance)
+{
+    GLuint *args;
+    if ((base_instance != 0) && (gl.DrawArraysInstancedBaseInstance == NULL)) {
+        buffer->n_dropped++;
+        return;
+    }
+    args = reserve (buffer, CMD_DRAW_ARRAYS, 5);
+    if (args != NULL) {
+        args[0] = mode;
+        args[1] = (GLuint)first;
+        args[2] = (GLuint)count;
+        args[3] = (GLuint)instances;
+        args[4] = base_instance;
+    }
+}
+
+/** Execute single command
+ * @param opcode opcode of command
+ * @param args argument words of command
+ */
+static void execute (GLuint opcode, const GLuint *args)
+{
+    const void *indices;
+    switch (opcode) {
+        case CMD_USE_PROGRAM:
+            gl_state_use_program (args[0]);
+            break;
+        case CMD_BIND_VERTEX_ARRAY:
+            gl_state_bind_vertex_array (args[0]);
+            break;
+        case CMD_BIND_BUFFER_RANGE:
+            gl_state_bind_buffer_range (args[0], args[1], args[2],
+                                        (GLintptr)args[3], (GLsizeiptr)args[4]);
+            break;
+        case CMD_BIND_TEXTURE:
+            gl_state_bind_texture (args[0], args[1], args[2]);
+            break;
+        case CMD_SET_ENABLED:
+            gl_state_set_enabled (args[0], (int)args[1]);
+            break;
+        case CMD_BLEND_FUNC:
+            gl_state_blend_func (args[0], args[1], args[2], args[3]);
+            break;
+        case CMD_DEPTH_MASK:
+            gl_state_depth_mask ((int)args[0]);
+            break;
+        case CMD_DRAW_ELEMENTS:
+            /* Draws with base instance are recorded only if supported */
+            indices = (const void *) (size_t)args[3];
+            if (args[6] != 0) {
+                gl.DrawElementsInstancedBaseVertexBaseInstance (args[0],
+                        (GLsizei)args[1], args[2], indices, (GLsizei)args[4],
+                        (GLint)args[5], args[6]);
+            } else {
+                gl.DrawElementsInstancedBaseVertex (args[0], (GLsizei)args[1],
+                                                    args[2], indices,
+                                                    (GLsizei)args[4],
+                                                    (GLint)args[5]);
+            }
+            break;
+        case CMD_DRAW_ARRAYS:
+            if (args[4] != 0) {
+                gl.DrawArraysInstancedBaseInstance (args[0], (GLint)args[1],
+                                                    (GLsizei)args[2],
+                                                    (GLsizei)args[3], args[4]);
+            } else {
+                gl.DrawArraysInstanced (args[0], (GLint)args[1],
+                                        (GLsizei)args[2], (GLsizei)args[3]);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void cmd_replay (const cmd_buffer_t *buffers, unsigned int n_buffers)
+{
+    unsigned int i;
+    for (i = 0; i < n_buffers; i++) {
+        const cmd_chunk_t *chunk;
+        for (chunk = buffers[i].first; chunk != NULL; chunk = chunk->next) {
+            const GLuint *word = (const GLuint *) (chunk + 1);
+            const GLuint *end = word + chunk->n_words;
+            if (chunk == buffers[i].last) {
+                end = buffers[i].cursor;
+            }
+            while (word < end) {
+                execute (*word & 0xFFFFu, word + 1);
+                word += *word >> 16;
+            }
+        }
+    }
+}
@@ -0,0 +1,122 @@
+/**
+ * @file cull.c
+ * This module contains frustum culling of bounding volumes partitioned
+ * across worker threads.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include "math3d.h"
+#include "workers.h"
+#include "cull.h"
+
+/** Minimum number of objects worth separate job */
+#define MIN_OBJECTS_PER_JOB 8192
+
+/** Maximum number of jobs of single call */
+#define MAX_JOBS 64
+
+/** Culling of slices of objects run by workers */
+typedef struct cull_job_t {
+    float planes[24]; /**< Planes of view frustum */
+    const float *const *bounds; /**< Arrays of bounds */
+    unsigned int *visible; /**< Indices of visible objects */
+    size_t n_objects; /**< Number of objects */
+    size_t n_visible[MAX_JOBS]; /**< Number of visible objects of each slice */
+    unsigned int n_jobs; /**< Number of slices */
+    int is_box; /**< Non-zero if bounds are boxes, spheres otherwise */
+} cull_job_t;
+
+/** Get the first object of slice
+ * @param job culling job
+ * @param index index of slice
+ * @returns index of the first object
+ */
+static size_t slice_start (const cull_job_t *job, unsigned int index)
+{
+    /* Slices are multiples of eight objects so kernels run at full width */
+    size_t n_groups = (job->n_objects + 7) / 8;
+    size_t start = n_groups * index / job->n_jobs * 8;
+    return start < job->n_objects ? start : job->n_objects;
+}
+
+/** Cull slice of objects into its part of visible indices
+ * @param arg cull_job_t of call
+ * @param index index of slice
+ */
+static void cull_slice (void *arg, unsigned int index)
+{
+    cull_job_t *job = (cull_job_t *)arg;
+    size_t first = slice_start (job, index);
+    size_t n = slice_start (job, index + 1) - first;
+    const float *const *bounds = job->bounds;
+    if (job->is_box) {
+        job->n_visible[index] = frustum_cull_boxes (job->planes, bounds,
+                                first, n, job->visible + first);
+    } else {
+        job->n_visible[index] = frustum_cull_spheres (job->planes, bounds[0],
+                                bounds[1], bounds[2], bounds[3], first, n,
+                                job->visible + first);
+    }
+}
+
+/** Cull objects on worker threads and pack visible indices together
+ * @param job culling job with planes and bounds set
+ * @returns number of visible objects
+ */
+static size_t run (cull_job_t *job)
+{
+    size_t n_visible;
+    unsigned int i;
+    job->n_jobs = (unsigned int) (job->n_objects / MIN_OBJECTS_PER_JOB);
+    if (job->n_jobs > workers_count () + 1) {
+        job->n_jobs = workers_count () + 1;
+    }
+    if (job->n_jobs > MAX_JOBS) {
+        job->n_jobs = MAX_JOBS;
+    }
+    if (job->n_jobs <= 1) {
+        job->n_jobs = 1;
+        cull_slice (job, 0);
+        return job->n_visible[0];
+    }
+    workers_run (cull_slice, job, job->n_jobs);
+    n_visible = job->n_visible[0];
+    for (i = 1; i < job->n_jobs; i++) {
+        memmove (job->visible + n_visible, job->visible + slice_start (job, i),
+                 job->n_visible[i] * sizeof (unsigned int));
+        n_visible += job->n_visible[i];
+    }
+    return n_visible;
+}
+
+size_t cull_spheres (const float *view_projection, const float *x,
+                     const float *y, const float *z, const float *radius,
+                     size_t n, unsigned int *visible)
+{
+    cull_job_t job;
+    const float *bounds[4];
+    bounds[0] = x;
+    bounds[1] = y;
+    bounds[2] = z;
+    bounds[3] = radius;
+    frustum_from_matrix (view_projection, job.planes);
+    job.bounds = bounds;
+    job.visible = visible;
+    job.n_objects = n;
+    job.is_box = 0;
+    return run (&job);
+}
+
+size_t cull_boxes (const float *view_projection, const float *const *bounds,
+                   size_t n, unsigned int *visible)
+{
+    cull_job_t job;
+    frustum_from_matrix (view_projection, job.planes);
+    job.bounds = bounds;
+    job.visible = visible;
+    job.n_objects = n;
+    job.is_box = 1;
+    return run (&job);
+}
@@ -0,0 +1,305 @@
+/**
+ * @file draw_queue.c
+ * This module contains queue of draws executed sorted by 64-bit key.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gl_procs.h"
+#include "monotonic.h"
+#include "workers.h"
+#include "cmd_buffer.h"
+#include "draw_queue.h"
+
+/** Number of bits of key sorted by single radix pass */
+#define RADIX_BITS 8
+
+/** Number of buckets of single radix pass */
+#define RADIX_SIZE (1 << RADIX_BITS)
+
+/** Number of radix passes over 64-bit key */
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+/** Largest value of 24-bit quantized depth */
+#define DEPTH_MAX 0xFFFFFFu
+
+/** Minimum number of draws worth separate recording job */
+#define MIN_DRAWS_PER_JOB 512
+
+/** Maximum number of recording jobs */
+#define MAX_RECORD_JOBS 16
+
+/** Recording of sorted draws into command buffers run by workers */
+typedef struct record_job_t {
+    const draw_item_t *items; /**< Sorted draws */
+    cmd_buffer_t *buffers; /**< Command buffer of each slice */
+    size_t n_items; /**< Number of draws */
+    unsigned int n_jobs; /**< Number of slices */
+    char padding[4];
+} record_job_t;
+
+/** Quantize depth into 24 bits
+ * @param depth view depth normalized to [0, 1]
+ * @returns quantized depth
+ */
+static GLuint64 quantize_depth (float depth)
+{
+    if (!(depth > 0.0f)) {
+        return 0;
+    }
+    if (depth >= 1.0f) {
+        return DEPTH_MAX;
+    }
+    return (GLuint64) (depth * (float)DEPTH_MAX);
+}
+
+GLuint64 draw_key_opaque (unsigned int pass, unsigned int layer,
+                          unsigned int program, unsigned int material,
+                          float depth)
+{
+    return ((GLuint64) (pass & 0xFu) << 60) | ((GLuint64) (layer & 0xFu) << 56)
+           | ((GLuint64) (program & 0xFFFu) << 44)
+           | ((GLuint64) (material & 0xFFFFFu) << 24) | quantize_depth (depth);
+}
+
+void draw_queue_begin (draw_queue_t *queue, frame_arena_t *arena,
+                       size_t capacity)
+{
+    queue->arena = arena;
+    queue->items = (draw_item_t *)frame_arena_alloc (arena,
+                   capacity * sizeof (draw_item_t));
+    queue->capacity = queue->items != NULL ? capacity : 0;
+    queue->n_items = 0;
+}
+
+/** Check if context can execute draw
+ * @param draw submitted draw
+ * @returns zero if draw needs base instance and context lacks it
+ */
+static int is_supported (const draw_t *draw)
+{
+    if (draw->base_instance == 0) {
+        return 1;
+    }
+    if (draw->index_type == 0) {
+        return gl.DrawArraysInstancedBaseInstance != NULL;
+    }
+    return gl.DrawElementsInstancedBaseVertexBaseInstance != NULL;
+}
+
+int draw_queue_submit (draw_queue_t *queue, GLuint64 key,
+                       const draw_t *draw)
+{
+    size_t i;
+    if (!is_supported (draw)) {
+        __atomic_fetch_add (&queue->n_rejected, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    i = __atomic_fetch_add (&queue->n_items, 1, __ATOMIC_RELAXED);
+    if (i >= queue->capacity) {
+        __atomic_fetch_add (&queue->n_dropped, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    queue->items[i].key = key;
+    queue->items[i].draw = draw;
+    return 0;
+}
+
+/** Compare items by key
+ * @param a the first item
+ * @param b the second item
+ * @returns negative, zero or positive like strcmp()
+ */
+static int compare_items (const void *a, const void *b)
+{
+    GLuint64 key_a = ((const draw_item_t *)a)->key;
+    GLuint64 key_b = ((const draw_item_t *)b)->key;
+    return (key_a > key_b) - (key_a < key_b);
+}
+
+/** Sort items by key with least significant digit radix sort
+ * @param items items to sort
+ * @param scratch memory for the same number of items
+ * @param n_items number of items
+ */
+static void radix_sort (draw_item_t *items, draw_item_t *scratch,
+                        size_t n_items)
+{
+    size_t counts[RADIX_PASSES][RADIX_SIZE];
+    draw_item_t *src = items;
+    draw_item_t *dst = scratch;
+    size_t i;
+    unsigned int pass;
+    memset (counts, 0, sizeof (counts));
+    for (i = 0; i < n_items; i++) {
+        GLuint64 key = items[i].key;
+        for (pass = 0; pass < RADIX_PASSES; pass++) {
+            counts[pass][(key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1)]++;
+        }
+    }
+    for (pass = 0; pass < RADIX_PASSES; pass++) {
+        unsigned int shift = pass * RADIX_BITS;
+        size_t *count = counts[pass];
+        size_t offset = 0;
+        draw_item_t *swap;
+        /* Digits shared by all keys, e.g. unused passes, need no scatter */
+        if (count[(src[0].key >> shift) & (RADIX_SIZE - 1)] == n_items) {
+            continue;
+        }
+        for (i = 0; i < RADIX_SIZE; i++) {
+            size_t n = count[i];
+            count[i] = offset;
+            offset += n;
+        }
+        for (i = 0; i < n_items; i++) {
+            dst[count[(src[i].key >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+        }
+        swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != items) {
+        memcpy (items, src, n_items * sizeof (draw_item_t));
+    }
+}
+
+void draw_queue_sort (draw_queue_t *queue)
+{
+    double start = monotonic_ms ();
+    size_t n_items = queue->n_items;
+    draw_item_t *scratch;
+    if (n_items > queue->capacity) {
+        n_items = queue->capacity;
+    }
+    if (n_items > 1) {
+        scratch = (draw_item_t *)frame_arena_alloc (queue->arena,
+                  n_items * sizeof (draw_item_t));
+        if (scratch != NULL) {
+            radix_sort (queue->items, scratch, n_items);
+        } else {
+            qsort (queue->items, n_items, sizeof (draw_item_t), compare_items);
+        }
+    }
+    queue->n_frames++;
+    queue->n_draws += n_items;
+    queue->sort_ms += monotonic_ms () - start;
+}
+
+/** Record state of draw that differs from previous draw, and the draw
+ * @param buffer target buffer
+ * @param draw draw to record
+ * @param previous previous draw of the same buffer, NULL for the first
+ */
+static void record_draw (cmd_buffer_t *buffer, const draw_t *draw,
+                         const draw_t *previous)
+{
+    /* gl_state filters the rest, this only keeps buffers compact */
+    if ((previous == NULL) || (previous->program != draw->program)) {
+        cmd_use_program (buffer, draw->program);
+    }
+    if ((previous == NULL) || (previous->vertex_array != draw->vertex_array)) {
+        cmd_bind_vertex_array (buffer, draw->vertex_array);
+    }
+    if ((draw->texture != 0)
+            && ((previous == NULL) || (previous->texture != draw->texture))) {
+        cmd_bind_texture (buffer, 0, GL_TEXTURE_2D, draw->texture);
+    }
+    if ((draw->uniform_buffer != 0)
+            && ((previous == NULL)
+                || (previous->uniform_buffer != draw->uniform_buffer)
+                || (previous->uniform_offset != draw->uniform_offset)
+                || (previous->uniform_size != draw->uniform_size))) {
+        cmd_bind_buffer_range (buffer, GL_UNIFORM_BUFFER,
+                               DRAW_UNIFORM_BINDING, draw->uniform_buffer,
+                               draw->uniform_offset, draw->uniform_size);
+    }
+    if ((previous == NULL) || (previous->is_blended != draw->is_blended)) {
+        cmd_set_enabled (buffer, GL_BLEND, draw->is_blended);
+        if (draw->is_blended) {
+            cmd_blend_func (buffer, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA,
+                            GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        }
+        cmd_depth_mask (buffer, !draw->is_blended);
+    }
+    if (draw->index_type == 0) {
+        cmd_draw_arrays (buffer, draw->mode, (GLint)draw->first, draw->count,
+                         draw->instances, draw->base_instance);
+    } else {
+        cmd_draw_elements (buffer, draw->mode, draw->count, draw->index_type,
+                           draw->first, draw->instances, draw->base_vertex,
+                           draw->base_instance);
+    }
+}
+
+/** Record slice of sorted draws into its command buffer
+ * @param arg record_job_t of frame
+ * @param index index of slice
+ */
+static void record_slice (void *arg, unsigned int index)
+{
+    const record_job_t *job = (const record_job_t *)arg;
+    size_t first = job->n_items * index / job->n_jobs;
+    size_t last = job->n_items * (index + 1) / job->n_jobs;
+    const draw_t *previous = NULL;
+    size_t i;
+    for (i = first; i < last; i++) {
+        record_draw (&job->buffers[index], job->items[i].draw, previous);
+        previous = job->items[i].draw;
+    }
+}
+
+void draw_queue_execute (draw_queue_t *queue)
+{
+    cmd_buffer_t buffers[MAX_RECORD_JOBS];
+    record_job_t job;
+    unsigned int i;
+    job.items = queue->items;
+    job.buffers = buffers;
+    job.n_items = queue->n_items;
+    if (job.n_items > queue->capacity) {
+        job.n_items = queue->capacity;
+    }
+    if (job.n_items == 0) {
+        return;
+    }
+    job.n_jobs = (unsigned int) ((job.n_items + MIN_DRAWS_PER_JOB - 1) /
+                                 MIN_DRAWS_PER_JOB);
+    if (job.n_jobs > workers_count () + 1) {
+        job.n_jobs = workers_count () + 1;
+    }
+    if (job.n_jobs > MAX_RECORD_JOBS) {
+        job.n_jobs = MAX_RECORD_JOBS;
+    }
+    for (i = 0; i < job.n_jobs; i++) {
+        cmd_buffer_begin (&buffers[i], queue->arena);
+    }
+    if (job.n_jobs == 1) {
+        record_slice (&job, 0);
+    } else {
+        workers_run (record_slice, &job, job.n_jobs);
+    }
+    cmd_replay (buffers, job.n_jobs);
+    for (i = 0; i < job.n_jobs; i++) {
+        queue->n_dropped += buffers[i].n_dropped;
+    }
+}
+
+void draw_queue_print_stats (draw_queue_t *queue)
+{
+    if (queue->n_frames == 0) {
+        return;
+    }
+    printf ("Draws: %.0f per frame, sorted in %.3f ms/frame, %lu dropped, "
+            "%lu rejected for lack of base instance\n",
+            (double)queue->n_draws / (double)queue->n_frames,
+            queue->sort_ms / (double)queue->n_frames, queue->n_dropped,
+            queue->n_rejected);
+    queue->n_frames = 0;
+    queue->n_draws = 0;
+    queue->n_dropped = 0;
+    queue->n_rejected = 0;
+    queue->sort_ms = 0.0;
+}
@@ -0,0 +1,493 @@
+/**
+ * @file ecs.c
+ * This module contains entity-component store grouped by archetype and
+ * parallel scheduler of systems.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include "workers.h"
+#include "ecs.h"
+
+/** Size of chunk including its header in bytes */
+#define CHUNK_SIZE 16384
+
+/** Alignment of component arrays in chunk */
+#define COLUMN_ALIGNMENT 16
+
+/** Number of bits of entity handle that hold index */
+#define INDEX_BITS 20
+
+/** Mask of index bits of entity handle */
+#define INDEX_MASK ((1u << INDEX_BITS) - 1)
+
+/** Header of chunk, followed by entities and component arrays */
+struct ecs_chunk_t {
+    ecs_archetype_t *archetype; /**< Archetype of all entities of chunk */
+    unsigned int n_entities; /**< Number of entities in chunk */
+    char padding[COLUMN_ALIGNMENT - sizeof (void *) - sizeof (int)];
+};
+
+/** Set of entities with the same components */
+struct ecs_archetype_t {
+    size_t offsets[ECS_MAX_COMPONENTS]; /**< Offset of component arrays */
+    ecs_chunk_t **chunks; /**< Chunks, all full except the last one,
+                            followed by emptied ones or NULL */
+    ecs_mask_t components; /**< Components of entities */
+    unsigned int n_chunks; /**< Number of chunks holding entities */
+    unsigned int max_chunks; /**< Capacity of chunks */
+    unsigned int chunk_capacity; /**< Number of entities per chunk */
+    char padding[4];
+};
+
+/** Parallel execution of one phase of systems */
+typedef struct run_job_t {
+    const ecs_system_t *systems; /**< Systems of world */
+    const ecs_work_t *work; /**< Work of the phase */
+    size_t n_work; /**< Number of work items */
+    size_t next; /**< Index of the next unclaimed work item */
+} run_job_t;
+
+int ecs_init (ecs_world_t *world, unsigned int max_entities)
+{
+    unsigned int i;
+    if (max_entities > INDEX_MASK) {
+        max_entities = INDEX_MASK;
+    }
+    memset (world, 0, sizeof (*world));
+    world->records = (ecs_record_t *)malloc (max_entities *
+                     sizeof (ecs_record_t));
+    world->free_entities = (unsigned int *)malloc (max_entities *
+                           sizeof (unsigned int));
+    if ((world->records == NULL) || (world->free_entities == NULL)) {
+        ecs_destroy (world);
+        return -1;
+    }
+    world->max_entities = max_entities;
+    for (i = 0; i < max_entities; i++) {
+        world->records[i].chunk = NULL;
+        world->records[i].row = 0;
+        world->records[i].generation = 1;
+        world->free_entities[i] = max_entities - 1 - i;
+    }
+    world->n_free = max_entities;
+    return 0;
+}
+
+void ecs_destroy (ecs_world_t *world)
+{
+    unsigned int i, c;
+    for (i = 0; i < world->n_archetypes; i++) {
+        ecs_archetype_t *archetype = &world->archetypes[i];
+        for (c = 0; c < archetype->max_chunks; c++) {
+            free (archetype->chunks[c]);
+        }
+        free (archetype->chunks);
+    }
+    free (world->archetypes);
+    free (world->records);
+    free (world->free_entities);
+    free (world->work);
+    memset (world, 0, sizeof (*world));
+}
+
+int ecs_register_component (ecs_world_t *world, size_t size)
+{
+    if (world->n_components == ECS_MAX_COMPONENTS) {
+        return -1;
+    }
+    world->sizes[world->n_components] = size;
+    return (int)world->n_components++;
+}
+
+/** Round size up to alignment of component arrays
+ * @param size size in bytes
+ * @returns aligned size
+ */
+static size_t align_column (size_t size)
+{
+    return (size + COLUMN_ALIGNMENT - 1) & ~(size_t) (COLUMN_ALIGNMENT - 1);
+}
+
+/** Find archetype with given components or create it
+ * @param world target world
+ * @param components set of components
+ * @returns archetype, NULL if out of memory or components don't fit chunk
+ */
+static ecs_archetype_t *get_archetype (ecs_world_t *world,
+                                       ecs_mask_t components)
+{
+    ecs_archetype_t *archetype;
+    size_t row_size = sizeof (ecs_entity_t);
+    size_t space = CHUNK_SIZE - sizeof (ecs_chunk_t);
+    size_t offset, capacity;
+    unsigned int i;
+    for (i = 0; i < world->n_archetypes; i++) {
+        if (world->archetypes[i].components == components) {
+            return &world->archetypes[i];
+        }
+    }
+    if (world->n_archetypes == world->max_archetypes) {
+        unsigned int n = world->max_archetypes != 0 ?
+                         world->max_archetypes * 2 : 16;
+        ecs_archetype_t *grown = (ecs_archetype_t *)realloc (
+                                     world->archetypes,
+                                     n * sizeof (ecs_archetype_t));
+        if (grown == NULL) {
+            return NULL;
+        }
+        /* Chunks point to their archetypes, so they follow the move */
+        for (i = 0; i < world->n_archetypes; i++) {
+            unsigned int c;
+            for (c = 0; c < grown[i].n_chunks; c++) {
+                grown[i].chunks[c]->archetype = &grown[i];
+            }
+        }
+        world->archetypes = grown;
+        world->max_archetypes = n;
+    }
+    for (i = 0; i < world->n_components; i++) {
+        if ((components & ECS_COMPONENT (i)) != 0) {
+            row_size += world->sizes[i];
+            space -= COLUMN_ALIGNMENT;
+        }
+    }
+    capacity = space / row_size;
+    if ((capacity == 0) || (space > CHUNK_SIZE)) {
+        return NULL;
+    }
+    archetype = &world->archetypes[world->n_archetypes];
+    memset (archetype, 0, sizeof (*archetype));
+    archetype->components = components;
+    archetype->chunk_capacity = (unsigned int)capacity;
+    offset = align_column (capacity * sizeof (ecs_entity_t));
+    for (i = 0; i < world->n_components; i++) {
+        if ((components & ECS_COMPONENT (i)) != 0) {
+            archetype->offsets[i] = offset;
+            offset += align_column (capacity * world->sizes[i]);
+        }
+    }
+    world->n_archetypes++;
+    return archetype;
+}
+
+/** Get entities of chunk
+ * @param chunk chunk
+ * @returns array of entities
+ */
+static ecs_entity_t *chunk_entities (ecs_chunk_t *chunk)
+{
+    return (ecs_entity_t *) (void *) (chunk + 1);
+}
+
+/** Get component of entity in chunk
+ * @param chunk chunk
+ * @param row index of entity in chunk
+ * @param component identifier of component
+ * @param size size of component
+ * @returns component
+ */
+static unsigned char *chunk_component (ecs_chunk_t *chunk, unsigned int row,
+                                       unsigned int component, size_t size)
+{
+    return (unsigned char *) (chunk + 1) +
+           chunk->archetype->offsets[component] + row * size;
+}
+
+/** Append zero-filled row to archetype
+ * @param world target world
+ * @param archetype target archetype
+ * @param entity entity stored in row
+ * @param record receives location of row
+ * @returns 0 on success, -1 if out of memory
+ */
+static int push_row (ecs_world_t *world, ecs_archetype_t *archetype,
+                     ecs_entity_t entity, ecs_record_t *record)
+{
+    ecs_chunk_t *chunk = NULL;
+    unsigned int i;
+    if (archetype->n_chunks != 0) {
+        chunk = archetype->chunks[archetype->n_chunks - 1];
+    }
+    if ((chunk == NULL) || (chunk->n_entities == archetype->chunk_capacity)) {
+        if (archetype->n_chunks == archetype->max_chunks) {
+            unsigned int n = archetype->max_chunks != 0 ?
+                             archetype->max_chunks * 2 : 4;
+            ecs_chunk_t **grown = (ecs_chunk_t **)realloc (archetype->chunks,
+                                  n * sizeof (ecs_chunk_t *));
+            if (grown == NULL) {
+                return -1;
+            }
+            for (i = archetype->max_chunks; i < n; i++) {
+                grown[i] = NULL;
+            }
+            archetype->chunks = grown;
+            archetype->max_chunks = n;
+        }
+        chunk = archetype->chunks[archetype->n_chunks];
+        if (chunk == NULL) {
+            chunk = (ecs_chunk_t *)malloc (CHUNK_SIZE);
+        }
+        if (chunk == NULL) {
+            return -1;
+        }
+        chunk->archetype = archetype;
+        chunk->n_entities = 0;
+        archetype->chunks[archetype->n_chunks++] = chunk;
+    }
+    for (i = 0; i < world->n_components; i++) {
+        if ((archetype->components & ECS_COMPONENT (i)) != 0) {
+            memset (chunk_component (chunk, chunk->n_entities, i,
+                                     world->sizes[i]), 0, world->sizes[i]);
+        }
+    }
+    chunk_entities (chunk)[chunk->n_entities] = entity;
+    record->chunk = chunk;
+    record->row = chunk->n_entities++;
+    return 0;
+}
+
+/** Remove row from archetype, the last row of archetype takes its place
+ * @param world target world
+ * @param chunk chunk of row
+ * @param row index of row in chunk
+ */
+static void pop_row (ecs_world_t *world, ecs_chunk_t *chunk, unsigned int row)
+{
+    ecs_archetype_t *archetype = chunk->archetype;
+    ecs_chunk_t *last = archetype->chunks[archetype->n_chunks - 1];
+    unsigned int last_row = last->n_entities - 1;
+    unsigned int i;
+    if ((last != chunk) || (last_row != row)) {
+        ecs_entity_t moved = chunk_entities (last)[last_row];
+        for (i = 0; i < world->n_components; i++) {
+            if ((archetype->components & ECS_COMPONENT (i)) != 0) {
+                memcpy (chunk_component (chunk, row, i, world->sizes[i]),
+                        chunk_component (last, last_row, i, world->sizes[i]),
+                        world->sizes[i]);
+            }
+        }
+        chunk_entities (chunk)[row] = moved;
+        world->records[moved & INDEX_MASK].chunk = chunk;
+        world->records[moved & INDEX_MASK].row = row;
+    }
+    last->n_entities--;
+    if (last->n_entities == 0) {
+        /* Kept for reuse, entities moving back and forth don't allocate */
+        archetype->n_chunks--;
+    }
+}
+
+/** Find record of live entity
+ * @param world target world
+ * @param entity handle of entity
+ * @returns record, NULL if handle is stale or invalid
+ */
+static ecs_record_t *find_record (ecs_world_t *world, ecs_entity_t entity)
+{
+    unsigned int index = entity & INDEX_MASK;
+    ecs_record_t *record;
+    if (index >= world->max_entities) {
+        return NULL;
+    }
+    record = &world->records[index];
+    if ((record->chunk == NULL)
+            || (record->generation != entity >> INDEX_BITS)) {
+        return NULL;
+    }
+    return record;
+}
+
+ecs_entity_t ecs_create (ecs_world_t *world, ecs_mask_t components)
+{
+    ecs_archetype_t *archetype;
+    ecs_record_t *record;
+    ecs_entity_t entity;
+    unsigned int index;
+    if (world->n_free == 0) {
+        return ECS_NULL_ENTITY;
+    }
+    archetype = get_archetype (world, components);
+    if (archetype == NULL) {
+        return ECS_NULL_ENTITY;
+    }
+    index = world->free_entities[world->n_free - 1];
+    record = &world->records[index];
+    entity = index | (record->generation << INDEX_BITS);
+    if (push_row (world, archetype, entity, record) != 0) {
+        return ECS_NULL_ENTITY;
+    }
+    world->n_free--;
+    world->n_entities++;
+    return entity;
+}
+
+int ecs_set_components (ecs_world_t *world, ecs_entity_t entity,
+                        ecs_mask_t components)
+{
+    ecs_record_t *record = find_record (world, entity);
+    ecs_archetype_t *archetype;
+    ecs_record_t moved;
+    ecs_mask_t kept;
+    unsigned int i;
+    if (record == NULL) {
+        return -1;
+    }
+    if (record->chunk->archetype->components == components) {
+        return 0;
+    }
+    /* Looking up archetype may move archetypes, so chunk is read after */
+    archetype = get_archetype (world, components);
+    if ((archetype == NULL)
+            || (push_row (world, archetype, entity, &moved) != 0)) {
+        return -1;
+    }
+    kept = record->chunk->archetype->components & components;
+    for (i = 0; i < world->n_components; i++) {
+        if ((kept & ECS_COMPONENT (i)) != 0) {
+            memcpy (chunk_component (moved.chunk, moved.row, i,
+                                     world->sizes[i]),
+                    chunk_component (record->chunk, record->row, i,
+                                     world->sizes[i]), world->sizes[i]);
+        }
+    }
+    pop_row (world, record->chunk, record->row);
+    record->chunk = moved.chunk;
+    record->row = moved.row;
+    return 0;
+}
+
+void *ecs_get (ecs_world_t *world, ecs_entity_t entity,
+               unsigned int component)
+{
+    ecs_record_t *record = find_record (world, entity);
+    if ((record == NULL) || (component >= world->n_components)
+            || ((record->chunk->archetype->components
+                 & ECS_COMPONENT (component)) == 0)) {
+        return NULL;
+    }
+    return chunk_component (record->chunk, record->row, component,
+                            world->sizes[component]);
+}
+
+void *ecs_view_column (const ecs_view_t *view, unsigned int component)
+{
+    return view->base + view->offsets[component];
+}
+
+/** Execute system on single chunk
+ * @param systems systems of ecs_run()
+ * @param work system and chunk
+ */
+static void run_work (const ecs_system_t *systems, const ecs_work_t *work)
+{
+    const ecs_system_t *system = &systems[work->system];
+    ecs_view_t view;
+    view.entities = chunk_entities (work->chunk);
+    view.base = (unsigned char *) (work->chunk + 1);
+    view.offsets = work->chunk->archetype->offsets;
+    view.n_entities = work->chunk->n_entities;
+    system->fn (system->arg, &view);
+}
+
+/** Execute work items of phase until all of them are claimed
+ * @param arg run_job_t of phase
+ * @param index unused
+ */
+static void run_phase (void *arg, unsigned int index)
+{
+    run_job_t *job = (run_job_t *)arg;
+    (void)index;
+    for (;;) {
+        size_t i = __atomic_fetch_add (&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->n_work) {
+            break;
+        }
+        run_work (job->systems, &job->work[i]);
+    }
+}
+
+/** Check whether two systems may not run concurrently
+ * @param a the first system
+ * @param b the second system
+ * @returns non-zero if one system writes component accessed by other
+ */
+static int is_conflict (const ecs_system_t *a, const ecs_system_t *b)
+{
+    return ((a->writes & (b->reads | b->writes)) != 0)
+           || ((b->writes & a->reads) != 0);
+}
+
+void ecs_run (ecs_world_t *world, const ecs_system_t *systems,
+              unsigned int n_systems)
+{
+    unsigned int phases[ECS_MAX_SYSTEMS];
+    unsigned int n_phases = 0;
+    unsigned int phase, s, i, a, c;
+    if (n_systems > ECS_MAX_SYSTEMS) {
+        n_systems = ECS_MAX_SYSTEMS;
+    }
+    /* System runs in the phase after the last conflicting earlier system */
+    for (s = 0; s < n_systems; s++) {
+        phases[s] = 0;
+        for (i = 0; i < s; i++) {
+            if (is_conflict (&systems[s], &systems[i])
+                    && (phases[i] + 1 > phases[s])) {
+                phases[s] = phases[i] + 1;
+            }
+        }
+        if (phases[s] + 1 > n_phases) {
+            n_phases = phases[s] + 1;
+        }
+    }
+    for (phase = 0; phase < n_phases; phase++) {
+        run_job_t job;
+        size_t n_work = 0;
+        for (s = 0; s < n_systems; s++) {
+            ecs_mask_t needed = systems[s].reads | systems[s].writes;
+            if (phases[s] != phase) {
+                continue;
+            }
+            for (a = 0; a < world->n_archetypes; a++) {
+                ecs_archetype_t *archetype = &world->archetypes[a];
+                if ((archetype->components & needed) != needed) {
+                    continue;
+                }
+                for (c = 0; c < archetype->n_chunks; c++) {
+                    ecs_work_t work;
+                    work.chunk = archetype->chunks[c];
+                    work.system = s;
+                    if (n_work == world->work_capacity) {
+                        size_t n = n_work != 0 ? n_work * 2 : 64;
+                        ecs_work_t *grown = (ecs_work_t *)realloc (world->work,
+                                            n * sizeof (ecs_work_t));
+                        if (grown == NULL) {
+                            /* Run what doesn't fit on this thread */
+                            run_work (systems, &work);
+                            continue;
+                        }
+                        world->work = grown;
+                        world->work_capacity = n;
+                    }
+                    world->work[n_work++] = work;
+                }
+            }
+        }
+        if (n_work == 0) {
+            continue;
+        }
+        job.systems = systems;
+        job.work = world->work;
+        job.n_work = n_work;
+        job.next = 0;
+        if (n_work == 1) {
+            run_phase (&job, 0);
+        } else {
+            unsigned int n_jobs = workers_count () + 1;
+            workers_run (run_phase, &job,
+                         n_work < n_jobs ? (unsigned int)n_work : n_jobs);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+/**
+ * @file frame_arena.c
+ * This module contains linear allocator for memory that lives no longer
+ * than two frames.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include "frame_arena.h"
+
+/** Alignment of every allocation, enough for any SIMD vector type */
+#define FRAME_ARENA_ALIGNMENT ((size_t)16)
+
+int frame_arena_init (frame_arena_t *arena, size_t capacity)
+{
+    capacity = (capacity + FRAME_ARENA_ALIGNMENT - 1) &
+               ~(FRAME_ARENA_ALIGNMENT - 1);
+    arena->blocks[0] = (unsigned char *)malloc (capacity);
+    arena->blocks[1] = (unsigned char *)malloc (capacity);
+    arena->capacity = capacity;
+    arena->offset = 0;
+    arena->peak = 0;
+    arena->n_failed = 0;
+    arena->current = 0;
+    if ((arena->blocks[0] == NULL) || (arena->blocks[1] == NULL)) {
+        frame_arena_destroy (arena);
+        return -1;
+    }
+    return 0;
+}
+
+void frame_arena_destroy (frame_arena_t *arena)
+{
+    free (arena->blocks[0]);
+    free (arena->blocks[1]);
+    arena->blocks[0] = NULL;
+    arena->blocks[1] = NULL;
+    arena->capacity = 0;
+    arena->offset = 0;
+}
+
+void *frame_arena_alloc (frame_arena_t *arena, size_t size)
+{
+    size_t offset;
+    size = (size + FRAME_ARENA_ALIGNMENT - 1) & ~(FRAME_ARENA_ALIGNMENT - 1);
+    offset = __atomic_fetch_add (&arena->offset, size, __ATOMIC_RELAXED);
+    if ((offset > arena->capacity) || (size > arena->capacity - offset)) {
+        __atomic_fetch_add (&arena->n_failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    return arena->blocks[arena->current] + offset;
+}
+
+void frame_arena_swap (frame_arena_t *arena)
+{
+    size_t used = arena->offset;
+    if (used > arena->capacity) {
+        used = arena->capacity;
+    }
+    if (used > arena->peak) {
+        arena->peak = used;
+    }
+    arena->current ^= 1u;
+    arena->offset = 0;
+}
@@ -0,0 +1,380 @@
+/**
+ * @file gl_debug.c
+ * This module contains capture of KHR_debug messages reported by OpenGL
+ * driver.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "gl_procs.h"
+#include "thread_policy.h"
+#include "monotonic.h"
+#include "gl_debug.h"
+
+/** Number of messages the ring can hold, must be power of two */
+#define RING_SIZE 256
+
+/** Maximum length of captured message text, longer ones are truncated */
+#define MAX_MESSAGE_LENGTH 248
+
+/** Number of distinct messages remembered for deduplication, must be
+ * power of two */
+#define MAX_KNOWN_MESSAGES 512
+
+/** Interval between polls of the ring by logger thread in milliseconds */
+#define POLL_INTERVAL_MS 50
+
+/** Maximum number of messages printed per second */
+#define MAX_MESSAGES_PER_SECOND 10.0
+
+/** Interval between reports of repeated messages in milliseconds */
+#define REPEAT_REPORT_INTERVAL_MS 5000.0
+
+/** Message captured from driver */
+typedef struct debug_message_t {
+    GLenum source; /**< Source of message */
+    GLenum type; /**< Type of message */
+    GLuint id; /**< Driver specific message identifier */
+    GLenum severity; /**< Severity of message */
+    char text[MAX_MESSAGE_LENGTH]; /**< Zero terminated text of message */
+} debug_message_t;
+
+/** Slot of the ring */
+typedef struct ring_slot_t {
+    unsigned long sequence; /**< Position this slot is ready for */
+    debug_message_t message; /**< Captured message */
+} ring_slot_t;
+
+/** Message seen by logger thread */
+typedef struct known_message_t {
+    unsigned long hash; /**< Hash of message, 0 if entry is unused */
+    unsigned long n_repeats; /**< Number of unreported repetitions */
+    debug_message_t message; /**< The first occurrence of message */
+} known_message_t;
+
+/** Ring of messages written by driver threads and read by logger */
+static ring_slot_t ring[RING_SIZE];
+
+/** Position of the next message to write */
+static unsigned long ring_tail = 0;
+
+/** Position of the next message to read */
+static unsigned long ring_head = 0;
+
+/** Number of messages dropped because ring was full */
+static unsigned long n_overflows = 0;
+
+/** Messages seen by logger thread */
+static known_message_t known_messages[MAX_KNOWN_MESSAGES];
+
+/** Number of messages not printed because of rate limit */
+static unsigned long n_rate_limited = 0;
+
+/** Number of messages that may be printed right now */
+static double print_tokens = MAX_MESSAGES_PER_SECOND;
+
+/** Time when print_tokens were last replenished */
+static double tokens_time = 0.0;
+
+/** Logger thread */
+static pthread_t logger;
+
+/** Non-zero if logger thread is running */
+static int is_running = 0;
+
+/** Non-zero if logger thread should exit */
+static int is_quitting = 0;
+
+/** Push message into the ring, called by driver on any thread
+ * @param source source of message
+ * @param type type of message
+ * @param id driver specific message identifier
+ * @param severity severity of message
+ * @param length length of message
+ * @param text text of message
+ * @param user unused
+ */
+static void APIENTRY on_message (GLenum source, GLenum type, GLuint id,
+                                 GLenum severity, GLsizei length,
+                                 const GLchar *text, const void *user)
+{
+    unsigned long position = __atomic_load_n (&ring_tail, __ATOMIC_RELAXED);
+    ring_slot_t *slot;
+    size_t size;
+    (void)user;
+    for (;;) {
+        unsigned long sequence;
+        long difference;
+        slot = &ring[position & (RING_SIZE - 1)];
+        sequence = __atomic_load_n (&slot->sequence, __ATOMIC_ACQUIRE);
+        difference = (long)(sequence - position);
+        if (difference == 0) {
+            if (__atomic_compare_exchange_n (&ring_tail, &position,
+                                             position + 1, 1, __ATOMIC_RELAXED,
+                                             __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (difference < 0) {
+            __atomic_fetch_add (&n_overflows, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            position = __atomic_load_n (&ring_tail, __ATOMIC_RELAXED);
+        }
+    }
+    size = length >= 0 ? (size_t)length : strlen (text);
+    if (size >= MAX_MESSAGE_LENGTH) {
+        size = MAX_MESSAGE_LENGTH - 1;
+    }
+    slot->message.source = source;
+    slot->message.type = type;
+    slot->message.id = id;
+    slot->message.severity = severity;
+    memcpy (slot->message.text, text, size);
+    slot->message.text[size] = '\0';
+    __atomic_store_n (&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
+
+/** Pop message from the ring, called by logger thread only
+ * @param message receives popped message
+ * @returns non-zero if message was popped, 0 if ring is empty
+ */
+static int pop_message (debug_message_t *message)
+{
+    ring_slot_t *slot = &ring[ring_head & (RING_SIZE - 1)];
+    if (__atomic_load_n (&slot->sequence, __ATOMIC_ACQUIRE) != ring_head + 1) {
+        return 0;
+    }
+    *message = slot->message;
+    __atomic_store_n (&slot->sequence, ring_head + RING_SIZE,
+                      __ATOMIC_RELEASE);
+    ring_head++;
+    return 1;
+}
+
+/** Get name of message source
+ * @param source source of message
+ * @returns name of source
+ */
+static const char *source_name (GLenum source)
+{
+    switch (source) {
+        case GL_DEBUG_SOURCE_API:
+            return "api";
+        case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+            return "window system";
+        case GL_DEBUG_SOURCE_SHADER_COMPILER:
+            return "shader compiler";
+        case GL_DEBUG_SOURCE_THIRD_PARTY:
+            return "third party";
+        case GL_DEBUG_SOURCE_APPLICATION:
+            return "application";
+        default:
+            return "other";
+    }
+}
+
+/** Get name of message type
+ * @param type type of message
+ * @returns name of type
+ */
+static const char *type_name (GLenum type)
+{
+    switch (type) {
+        case GL_DEBUG_TYPE_ERROR:
+            return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+            return "deprecated";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+            return "undefined behavior";
+        case GL_DEBUG_TYPE_PORTABILITY:
+            return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE:
+            return "performance";
+        case GL_DEBUG_TYPE_MARKER:
+            return "marker";
+        default:
+            return "other";
+    }
+}
+
+/** Get name of message severity
+ * @param severity severity of message
+ * @returns name of severity
+ */
+static const char *severity_name (GLenum severity)
+{
+    switch (severity) {
+        case GL_DEBUG_SEVERITY_HIGH:
+            return "high";
+        case GL_DEBUG_SEVERITY_MEDIUM:
+            return "medium";
+        case GL_DEBUG_SEVERITY_LOW:
+            return "low";
+        default:
+            return "notification";
+    }
+}
+
+/** Print message
+ * @param message message to print
+ */
+static void print_message (const debug_message_t *message)
+{
+    fprintf (stderr, "GL %s %s (%s, id %u): %s\n", source_name (message->source),
+             type_name (message->type), severity_name (message->severity),
+             message->id, message->text);
+}
+
+/** Compute hash of message
+ * @param message message to hash
+ * @returns non-zero hash
+ */
+static unsigned long hash_message (const debug_message_t *message)
+{
+    unsigned long hash = 2166136261ul;
+    const unsigned char *c = (const unsigned char *)message->text;
+    hash = (hash ^ message->source) * 16777619ul;
+    hash = (hash ^ message->type) * 16777619ul;
+    hash = (hash ^ message->id) * 16777619ul;
+    hash = (hash ^ message->severity) * 16777619ul;
+    while (*c != '\0') {
+        hash = (hash ^ *c++) * 16777619ul;
+    }
+    return hash != 0 ? hash : 1;
+}
+
+/** Print message unless it is a repetition or rate limit is exceeded
+ * @param message message to report
+ * @param now current time
+ */
+static void report_message (const debug_message_t *message, double now)
+{
+    unsigned long hash = hash_message (message);
+    size_t i, n;
+    for (n = 0; n < MAX_KNOWN_MESSAGES; n++) {
+        known_message_t *known;
+        i = (hash + n) & (MAX_KNOWN_MESSAGES - 1);
+        known = &known_messages[i];
+        if (known->hash == hash) {
+            known->n_repeats++;
+            return;
+        }
+        if (known->hash == 0) {
+            known->hash = hash;
+            known->message = *message;
+            break;
+        }
+    }
+    print_tokens += (now - tokens_time) * MAX_MESSAGES_PER_SECOND / 1000.0;
+    if (print_tokens > MAX_MESSAGES_PER_SECOND) {
+        print_tokens = MAX_MESSAGES_PER_SECOND;
+    }
+    tokens_time = now;
+    if (print_tokens < 1.0) {
+        n_rate_limited++;
+        return;
+    }
+    print_tokens -= 1.0;
+    print_message (message);
+}
+
+/** Print how many times known messages were repeated since last report */
+static void report_repeats (void)
+{
+    size_t i;
+    for (i = 0; i < MAX_KNOWN_MESSAGES; i++) {
+        known_message_t *known = &known_messages[i];
+        if (known->n_repeats != 0) {
+            fprintf (stderr, "GL message repeated %lu times: %.60s\n",
+                     known->n_repeats, known->message.text);
+            known->n_repeats = 0;
+        }
+    }
+    if (n_rate_limited != 0) {
+        fprintf (stderr, "GL %lu messages suppressed by rate limit\n",
+                 n_rate_limited);
+        n_rate_limited = 0;
+    }
+}
+
+/** Entry point of logger thread
+ * @param arg unused
+ * @returns NULL
+ */
+static void *logger_main (void *arg)
+{
+    struct timespec interval;
+    debug_message_t message;
+    double last_repeat_report = monotonic_ms ();
+    (void)arg;
+    interval.tv_sec = 0;
+    interval.tv_nsec = POLL_INTERVAL_MS * 1000000L;
+    tokens_time = last_repeat_report;
+    while (!__atomic_load_n (&is_quitting, __ATOMIC_ACQUIRE)) {
+        double now = monotonic_ms ();
+        while (pop_message (&message)) {
+            report_message (&message, now);
+        }
+        if (now - last_repeat_report >= REPEAT_REPORT_INTERVAL_MS) {
+            report_repeats ();
+            last_repeat_report = now;
+        }
+        nanosleep (&interval, NULL);
+    }
+    while (pop_message (&message)) {
+        report_message (&message, monotonic_ms ());
+    }
+    report_repeats ();
+    return NULL;
+}
+
+int gl_debug_start (int with_notifications)
+{
+    pthread_attr_t attr;
+    unsigned long i;
+    if ((gl.DebugMessageCallback == NULL) || (gl.DebugMessageControl == NULL)
+            || (!gl_version_at_least (4, 3)
+                && !gl_has_extension ("GL_KHR_debug"))) {
+        return -1;
+    }
+    for (i = 0; i < RING_SIZE; i++) {
+        ring[i].sequence = i;
+    }
+    ring_head = 0;
+    ring_tail = 0;
+    is_quitting = 0;
+    if (thread_policy_init_attr (&attr) != 0) {
+        return -1;
+    }
+    is_running = pthread_create (&logger, &attr, logger_main, NULL) == 0;
+    pthread_attr_destroy (&attr);
+    if (!is_running) {
+        return -1;
+    }
+    gl.DebugMessageControl (GL_DONT_CARE, GL_DONT_CARE,
+                            GL_DEBUG_SEVERITY_NOTIFICATION, 0, NULL,
+                            with_notifications ? GL_TRUE : GL_FALSE);
+    gl.DebugMessageCallback (on_message, NULL);
+    gl.Enable (GL_DEBUG_OUTPUT);
+    return 0;
+}
+
+void gl_debug_stop (void)
+{
+    if (!is_running) {
+        return;
+    }
+    gl.Disable (GL_DEBUG_OUTPUT);
+    gl.DebugMessageCallback (NULL, NULL);
+    __atomic_store_n (&is_quitting, 1, __ATOMIC_RELEASE);
+    pthread_join (logger, NULL);
+    is_running = 0;
+    if (n_overflows != 0) {
+        fprintf (stderr, "GL %lu messages lost because of ring overflow\n",
+                 n_overflows);
+    }
+}
@@ -0,0 +1,324 @@
+/**
+ * @file gl_loader.c
+ * This module contains loader thread that creates OpenGL objects in
+ * context shared with render context.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "gl_procs.h"
+#include "gl_state.h"
+#include "thread_policy.h"
+#include "gl_loader.h"
+
+/** States of job */
+typedef enum gl_job_state_t {
+    JOB_FREE, /**< Slot is unused */
+    JOB_QUEUED, /**< Job waits for loader thread */
+    JOB_CREATED /**< Creating callback has returned and fence is issued */
+} gl_job_state_t;
+
+/** Job of loader thread */
+typedef struct gl_job_t {
+    gl_loader_fn create; /**< Callback called on loader thread */
+    gl_loader_fn finish; /**< Callback called on render thread */
+    void *user; /**< User data of callbacks */
+    GLsync fence; /**< Fence issued after creating callback, may be NULL */
+    struct gl_job_t *next; /**< Next job queued for loader thread */
+    int state; /**< Value of gl_job_state_t */
+    char padding[4];
+} gl_job_t;
+
+/** Slots of jobs */
+static gl_job_t *jobs = NULL;
+
+/** Number of slots of jobs */
+static unsigned int max_job_count = 0;
+
+/** Number of jobs in flight */
+static unsigned int n_pending = 0;
+
+/** Lock of queue of loader thread */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Signals that queue isn't empty, thread must quit or thread has started */
+static pthread_cond_t queue_changed = PTHREAD_COND_INITIALIZER;
+
+/** The oldest job waiting for loader thread */
+static gl_job_t *queue_head = NULL;
+
+/** The newest job waiting for loader thread */
+static gl_job_t *queue_tail = NULL;
+
+/** Loader thread */
+static pthread_t loader_thread;
+
+/** Non-zero if loader thread runs */
+static int is_running = 0;
+
+/** Non-zero if loader thread must quit */
+static int is_quitting = 0;
+
+/** 1 once loader context is current on loader thread, -1 if it can't be */
+static int start_status = 0;
+
+/** Display of contexts */
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+
+/** Context of loader thread */
+static EGLContext loader_context = EGL_NO_CONTEXT;
+
+/** Pbuffer of loader context, no surface if surfaceless contexts work */
+static EGLSurface loader_surface = EGL_NO_SURFACE;
+
+/** Check whether EGL display supports extension
+ * @param display EGL display
+ * @param name name of extension
+ * @returns non-zero if extension is supported
+ */
+static int has_egl_extension (EGLDisplay display, const char *name)
+{
+    const char *all = eglQueryString (display, EGL_EXTENSIONS);
+    const char *extension = all;
+    size_t length = strlen (name);
+    while ((extension != NULL)
+            && ((extension = strstr (extension, name)) != NULL)) {
+        if (((extension == all) || (extension[-1] == ' '))
+                && ((extension[length] == ' ') || (extension[length] == '\0'))) {
+            return 1;
+        }
+        extension += length;
+    }
+    return 0;
+}
+
+/** Main function of loader thread
+ * @param arg unused
+ * @returns NULL
+ */
+static void *loader_thread_main (void *arg)
+{
+    int is_current;
+    (void)arg;
+    /* Rendering API is bound per thread */
+    is_current = (eglBindAPI (EGL_OPENGL_API) == EGL_TRUE)
+                 && (eglMakeCurrent (egl_display, loader_surface, loader_surface,
+                                     loader_context) == EGL_TRUE);
+    pthread_mutex_lock (&queue_lock);
+    start_status = is_current ? 1 : -1;
+    pthread_cond_broadcast (&queue_changed);
+    while (is_current) {
+        gl_job_t *job;
+        while ((queue_head == NULL) && !is_quitting) {
+            pthread_cond_wait (&queue_changed, &queue_lock);
+        }
+        if (is_quitting) {
+            break;
+        }
+        job = queue_head;
+        queue_head = job->next;
+        if (queue_head == NULL) {
+            queue_tail = NULL;
+        }
+        pthread_mutex_unlock (&queue_lock);
+        job->create (job->user);
+        job->fence = gl.FenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        /* Fence of unflushed context is never signaled for other contexts */
+        gl.Flush ();
+        __atomic_store_n (&job->state, JOB_CREATED, __ATOMIC_RELEASE);
+        pthread_mutex_lock (&queue_lock);
+    }
+    pthread_mutex_unlock (&queue_lock);
+    if (is_current) {
+        eglMakeCurrent (egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        EGL_NO_CONTEXT);
+    }
+    return NULL;
+}
+
+/** Start loader thread and wait until loader context is current on it
+ * @returns 0 on success, -1 on failure
+ */
+static int start_loader_thread (void)
+{
+    pthread_attr_t attr;
+    int status;
+    is_quitting = 0;
+    start_status = 0;
+    if (thread_policy_init_attr (&attr) != 0) {
+        return -1;
+    }
+    status = pthread_create (&loader_thread, &attr, loader_thread_main, NULL);
+    pthread_attr_destroy (&attr);
+    if (status != 0) {
+        return -1;
+    }
+    pthread_mutex_lock (&queue_lock);
+    while (start_status == 0) {
+        pthread_cond_wait (&queue_changed, &queue_lock);
+    }
+    status = start_status;
+    pthread_mutex_unlock (&queue_lock);
+    if (status < 0) {
+        pthread_join (loader_thread, NULL);
+        return -1;
+    }
+    is_running = 1;
+    return 0;
+}
+
+/** Destroy loader context and its surface */
+static void destroy_loader_context (void)
+{
+    if (loader_surface != EGL_NO_SURFACE) {
+        eglDestroySurface (egl_display, loader_surface);
+        loader_surface = EGL_NO_SURFACE;
+    }
+    if (loader_context != EGL_NO_CONTEXT) {
+        eglDestroyContext (egl_display, loader_context);
+        loader_context = EGL_NO_CONTEXT;
+    }
+}
+
+int gl_loader_init (EGLDisplay display, EGLConfig config,
+                    EGLContext share_context, unsigned int max_jobs)
+{
+    static const EGLint pbuffer_attributes[] = {
+        EGL_WIDTH, 1,
+        EGL_HEIGHT, 1,
+        EGL_NONE
+    };
+    jobs = (gl_job_t *)calloc (max_jobs, sizeof (gl_job_t));
+    if (jobs == NULL) {
+        return -1;
+    }
+    max_job_count = max_jobs;
+    n_pending = 0;
+    queue_head = NULL;
+    queue_tail = NULL;
+    if ((gl.FenceSync == NULL) || (gl.ClientWaitSync == NULL)
+            || (gl.DeleteSync == NULL) || (gl.Flush == NULL)
+            || !gl_version_at_least (3, 2)) {
+        return -1;
+    }
+    egl_display = display;
+    loader_context = eglCreateContext (display, config, share_context, NULL);
+    if (loader_context == EGL_NO_CONTEXT) {
+        return -1;
+    }
+    if (!has_egl_extension (display, "EGL_KHR_surfaceless_context")) {
+        loader_surface = eglCreatePbufferSurface (display, config,
+                         pbuffer_attributes);
+        if (loader_surface == EGL_NO_SURFACE) {
+            destroy_loader_context ();
+            return -1;
+        }
+    }
+    if (start_loader_thread () != 0) {
+        destroy_loader_context ();
+        return -1;
+    }
+    return 0;
+}
+
+void gl_loader_shutdown (void)
+{
+    unsigned int i;
+    if (jobs == NULL) {
+        return;
+    }
+    if (is_running) {
+        /* Job being created is completed, queued ones are dropped */
+        pthread_mutex_lock (&queue_lock);
+        is_quitting = 1;
+        pthread_cond_broadcast (&queue_changed);
+        pthread_mutex_unlock (&queue_lock);
+        pthread_join (loader_thread, NULL);
+        is_running = 0;
+    }
+    for (i = 0; i < max_job_count; i++) {
+        if (jobs[i].fence != NULL) {
+            gl.DeleteSync (jobs[i].fence);
+        }
+    }
+    destroy_loader_context ();
+    free (jobs);
+    jobs = NULL;
+    max_job_count = 0;
+    n_pending = 0;
+    queue_head = NULL;
+    queue_tail = NULL;
+}
+
+int gl_loader_submit (gl_loader_fn create, gl_loader_fn finish, void *user)
+{
+    gl_job_t *job = NULL;
+    unsigned int i;
+    for (i = 0; (i < max_job_count) && (job == NULL); i++) {
+        if (jobs[i].state == JOB_FREE) {
+            job = &jobs[i];
+        }
+    }
+    if (job == NULL) {
+        return -1;
+    }
+    job->create = create;
+    job->finish = finish;
+    job->user = user;
+    job->fence = NULL;
+    job->next = NULL;
+    n_pending++;
+    if (!is_running) {
+        create (user);
+        /* Callback has changed state behind the cache of render context */
+        gl_state_reset ();
+        job->state = JOB_CREATED;
+        return 0;
+    }
+    job->state = JOB_QUEUED;
+    pthread_mutex_lock (&queue_lock);
+    if (queue_tail != NULL) {
+        queue_tail->next = job;
+    } else {
+        queue_head = job;
+    }
+    queue_tail = job;
+    pthread_cond_signal (&queue_changed);
+    pthread_mutex_unlock (&queue_lock);
+    return 0;
+}
+
+void gl_loader_poll (void)
+{
+    unsigned int i;
+    if (n_pending == 0) {
+        return;
+    }
+    for (i = 0; i < max_job_count; i++) {
+        gl_job_t *job = &jobs[i];
+        if (__atomic_load_n (&job->state, __ATOMIC_ACQUIRE) != JOB_CREATED) {
+            continue;
+        }
+        if (job->fence != NULL) {
+            /* Render thread never waits, unfinished jobs are polled again */
+            if (gl.ClientWaitSync (job->fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                continue;
+            }
+            gl.DeleteSync (job->fence);
+            job->fence = NULL;
+        }
+        if (job->finish != NULL) {
+            job->finish (job->user);
+        }
+        job->state = JOB_FREE;
+        n_pending--;
+    }
+}
+
+int gl_loader_is_threaded (void)
+{
+    return is_running;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file gl_procs.c
+ * This module contains OpenGL entry points linked from OpenGL library or
+ * resolved at run-time through EGL.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+/* Declare prototypes of entry points linked directly */
+#define GL_GLEXT_PROTOTYPES
+#include <stdio.h>
+#include <string.h>
+#include <EGL/egl.h>
+#include "gl_procs.h"
+
+gl_procs_t gl;
+
+/** Major version of current context */
+static int version_major = 0;
+
+/** Minor version of current context */
+static int version_minor = 0;
+
+/** Set member of gl_procs_t to function of OpenGL library; EGL before
+ * 1.5 doesn't have to return core 1.x functions */
+#define GL_PROCS_LINK(type, name) \
+    gl.name = gl ## name;
+
+/** Resolve member of gl_procs_t */
+#define GL_PROCS_LOAD(type, name) \
+    proc = eglGetProcAddress ("gl" #name); \
+    gl.name = (type)proc;
+
+int gl_procs_load (void)
+{
+    __eglMustCastToProperFunctionPointerType proc;
+    const char *version;
+    GL_PROCS_LINKED (GL_PROCS_LINK)
+    GL_PROCS (GL_PROCS_LOAD)
+    version = (const char *)gl.GetString (GL_VERSION);
+    if ((version == NULL)
+            || (sscanf (version, "%d.%d", &version_major, &version_minor) != 2)) {
+        return -1;
+    }
+    return 0;
+}
+
+int gl_version_at_least (int major, int minor)
+{
+    return (version_major > major)
+           || ((version_major == major) && (version_minor >= minor));
+}
+
+int gl_has_extension (const char *name)
+{
+    size_t length = strlen (name);
+    if (gl_version_at_least (3, 0) && (gl.GetStringi != NULL)) {
+        GLint n_extensions = 0;
+        GLuint i;
+        gl.GetIntegerv (GL_NUM_EXTENSIONS, &n_extensions);
+        for (i = 0; i < (GLuint)n_extensions; i++) {
+            const char *extension = (const char *)gl.GetStringi (GL_EXTENSIONS,
+                                    i);
+            if ((extension != NULL) && (strcmp (extension, name) == 0)) {
+                return 1;
+            }
+        }
+    } else {
+        const char *all = (const char *)gl.GetString (GL_EXTENSIONS);
+        const char *extension = all;
+        while ((extension != NULL)
+                && ((extension = strstr (extension, name)) != NULL)) {
+            if (((extension == all) || (extension[-1] == ' '))
+                    && ((extension[length] == ' ')
+                        || (extension[length] == '\0'))) {
+                return 1;
+            }
+            extension += length;
+        }
+    }
+    return 0;
+}
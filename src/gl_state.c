@@ -0,0 +1,400 @@
+/**
+ * @file gl_state.c
+ * This module contains shadow copy of OpenGL state that drops redundant
+ * state changes before they reach the driver.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "gl_procs.h"
+#include "gl_state.h"
+
+/** Value of object name or enum that is not known */
+#define UNKNOWN 0xFFFFFFFFu
+
+/** Number of texture units tracked */
+#define MAX_TEXTURE_UNITS 32
+
+/** Number of indexed buffer binding points tracked per target */
+#define MAX_INDEXED_BINDINGS 16
+
+/** Number of cached uniform values, must be power of two */
+#define UNIFORM_CACHE_SIZE 256
+
+/** Number of elements in array */
+#define COUNT_OF(array) (sizeof (array) / sizeof ((array)[0]))
+
+/** Index of GL_ELEMENT_ARRAY_BUFFER in buffer_targets */
+#define ELEMENT_ARRAY_INDEX 1
+
+/** Tracked generic buffer binding points */
+static const GLenum buffer_targets[] = {
+    GL_ARRAY_BUFFER, GL_ELEMENT_ARRAY_BUFFER, GL_UNIFORM_BUFFER,
+    GL_SHADER_STORAGE_BUFFER, GL_ATOMIC_COUNTER_BUFFER,
+    GL_DRAW_INDIRECT_BUFFER, GL_DISPATCH_INDIRECT_BUFFER,
+    GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_PACK_BUFFER, GL_COPY_READ_BUFFER,
+    GL_COPY_WRITE_BUFFER, GL_TEXTURE_BUFFER
+};
+
+/** Tracked indexed buffer binding points */
+static const GLenum indexed_targets[] = {
+    GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER, GL_ATOMIC_COUNTER_BUFFER
+};
+
+/** Tracked texture targets */
+static const GLenum texture_targets[] = {
+    GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_CUBE_MAP, GL_TEXTURE_3D,
+    GL_TEXTURE_BUFFER
+};
+
+/** Tracked capabilities */
+static const GLenum capabilities[] = {
+    GL_BLEND, GL_DEPTH_TEST, GL_STENCIL_TEST, GL_CULL_FACE, GL_SCISSOR_TEST,
+    GL_POLYGON_OFFSET_FILL, GL_PROGRAM_POINT_SIZE, GL_RASTERIZER_DISCARD,
+    GL_PRIMITIVE_RESTART_FIXED_INDEX, GL_FRAMEBUFFER_SRGB, GL_MULTISAMPLE
+};
+
+/** Cached value of uniform */
+typedef struct uniform_entry_t {
+    GLuint program; /**< Program the uniform belongs to */
+    GLint location; /**< Location of uniform */
+    GLfloat value[16]; /**< Bit pattern of value */
+    GLuint size; /**< Size of value in bytes */
+} uniform_entry_t;
+
+/** Shadow copy of tracked state, UNKNOWN or -1 where it isn't known */
+typedef struct gl_state_t {
+    GLuint program; /**< Current program */
+    GLuint vertex_array; /**< Current vertex array */
+    GLuint buffers[COUNT_OF (buffer_targets)]; /**< Generic bindings */
+    GLuint indexed[COUNT_OF (indexed_targets)][MAX_INDEXED_BINDINGS];
+    /**< Indexed bindings */
+    GLuint active_texture; /**< Index of active texture unit */
+    GLuint textures[MAX_TEXTURE_UNITS][COUNT_OF (texture_targets)];
+    /**< Texture bindings */
+    int enabled[COUNT_OF (capabilities)]; /**< State of capabilities */
+    GLenum blend_func[4]; /**< Blending factors */
+    GLenum depth_func; /**< Depth comparison function */
+    int depth_mask; /**< Depth write mask */
+    GLenum cull_face; /**< Culled faces */
+    GLint viewport[4]; /**< Viewport rectangle */
+} gl_state_t;
+
+/** Current state of context */
+static gl_state_t state;
+
+/** Cached uniform values hashed by program and location */
+static uniform_entry_t uniforms[UNIFORM_CACHE_SIZE];
+
+/** Number of state changes passed to driver */
+static unsigned long n_issued = 0;
+
+/** Number of redundant state changes dropped */
+static unsigned long n_filtered = 0;
+
+/** Find value in list
+ * @param list list of values
+ * @param n number of values in list
+ * @param value value to find
+ * @returns index of value, -1 if not found
+ */
+static int index_of (const GLenum *list, size_t n, GLenum value)
+{
+    size_t i;
+    for (i = 0; i < n; i++) {
+        if (list[i] == value) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+/** Update cached value and count the change
+ * @param cached cached value
+ * @param value new value
+ * @returns non-zero if change should be issued
+ */
+static int update (GLuint *cached, GLuint value)
+{
+    if (*cached == value) {
+        n_filtered++;
+        return 0;
+    }
+    *cached = value;
+    n_issued++;
+    return 1;
+}
+
+void gl_state_reset (void)
+{
+    memset (&state, 0xff, sizeof (state));
+    memset (uniforms, 0xff, sizeof (uniforms));
+}
+
+void gl_state_use_program (GLuint program)
+{
+    if (update (&state.program, program)) {
+        gl.UseProgram (program);
+    }
+}
+
+void gl_state_bind_vertex_array (GLuint vertex_array)
+{
+    if (update (&state.vertex_array, vertex_array)) {
+        gl.BindVertexArray (vertex_array);
+        /* Element array binding is part of vertex array state */
+        state.buffers[ELEMENT_ARRAY_INDEX] = UNKNOWN;
+    }
+}
+
+void gl_state_bind_buffer (GLenum target, GLuint buffer)
+{
+    int i = index_of (buffer_targets, COUNT_OF (buffer_targets), target);
+    if (i < 0) {
+        n_issued++;
+        gl.BindBuffer (target, buffer);
+    } else if (update (&state.buffers[i], buffer)) {
+        gl.BindBuffer (target, buffer);
+    }
+}
+
+void gl_state_bind_buffer_base (GLenum target, GLuint index, GLuint buffer)
+{
+    int i = index_of (indexed_targets, COUNT_OF (indexed_targets), target);
+    int generic = index_of (buffer_targets, COUNT_OF (buffer_targets), target);
+    if ((i < 0) || (index >= MAX_INDEXED_BINDINGS)) {
+        n_issued++;
+        gl.BindBufferBase (target, index, buffer);
+    } else if (update (&state.indexed[i][index], buffer)) {
+        gl.BindBufferBase (target, index, buffer);
+    } else {
+        return;
+    }
+    if (generic >= 0) {
+        state.buffers[generic] = buffer;
+    }
+}
+
+void gl_state_bind_buffer_range (GLenum target, GLuint index, GLuint buffer,
+                                 GLintptr offset, GLsizeiptr size)
+{
+    int i = index_of (indexed_targets, COUNT_OF (indexed_targets), target);
+    int generic = index_of (buffer_targets, COUNT_OF (buffer_targets), target);
+    n_issued++;
+    gl.BindBufferRange (target, index, buffer, offset, size);
+    if ((i >= 0) && (index < MAX_INDEXED_BINDINGS)) {
+        state.indexed[i][index] = UNKNOWN;
+    }
+    if (generic >= 0) {
+        state.buffers[generic] = buffer;
+    }
+}
+
+void gl_state_bind_texture (GLuint unit, GLenum target, GLuint texture)
+{
+    int i = index_of (texture_targets, COUNT_OF (texture_targets), target);
+    if ((i >= 0) && (unit < MAX_TEXTURE_UNITS)
+            && (state.textures[unit][i] == texture)) {
+        n_filtered++;
+        return;
+    }
+    if (state.active_texture != unit) {
+        n_issued++;
+        gl.ActiveTexture (GL_TEXTURE0 + unit);
+        state.active_texture = unit;
+    }
+    n_issued++;
+    gl.BindTexture (target, texture);
+    if ((i >= 0) && (unit < MAX_TEXTURE_UNITS)) {
+        state.textures[unit][i] = texture;
+    }
+}
+
+void gl_state_set_enabled (GLenum cap, int enabled)
+{
+    int i = index_of (capabilities, COUNT_OF (capabilities), cap);
+    enabled = enabled != 0;
+    if ((i >= 0) && (state.enabled[i] == enabled)) {
+        n_filtered++;
+        return;
+    }
+    n_issued++;
+    if (enabled) {
+        gl.Enable (cap);
+    } else {
+        gl.Disable (cap);
+    }
+    if (i >= 0) {
+        state.enabled[i] = enabled;
+    }
+}
+
+void gl_state_blend_func (GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha,
+                          GLenum dst_alpha)
+{
+    if ((state.blend_func[0] == src_rgb) && (state.blend_func[1] == dst_rgb)
+            && (state.blend_func[2] == src_alpha)
+            && (state.blend_func[3] == dst_alpha)) {
+        n_filtered++;
+        return;
+    }
+    n_issued++;
+    gl.BlendFuncSeparate (src_rgb, dst_rgb, src_alpha, dst_alpha);
+    state.blend_func[0] = src_rgb;
+    state.blend_func[1] = dst_rgb;
+    state.blend_func[2] = src_alpha;
+    state.blend_func[3] = dst_alpha;
+}
+
+void gl_state_depth_func (GLenum func)
+{
+    if (update (&state.depth_func, func)) {
+        gl.DepthFunc (func);
+    }
+}
+
+void gl_state_depth_mask (int enabled)
+{
+    enabled = enabled != 0;
+    if (state.depth_mask == enabled) {
+        n_filtered++;
+        return;
+    }
+    n_issued++;
+    gl.DepthMask (enabled ? GL_TRUE : GL_FALSE);
+    state.depth_mask = enabled;
+}
+
+void gl_state_cull_face (GLenum mode)
+{
+    if (update (&state.cull_face, mode)) {
+        gl.CullFace (mode);
+    }
+}
+
+void gl_state_viewport (GLint x, GLint y, GLsizei width, GLsizei height)
+{
+    if ((state.viewport[0] == x) && (state.viewport[1] == y)
+            && (state.viewport[2] == width) && (state.viewport[3] == height)) {
+        n_filtered++;
+        return;
+    }
+    n_issued++;
+    gl.Viewport (x, y, width, height);
+    state.viewport[0] = x;
+    state.viewport[1] = y;
+    state.viewport[2] = width;
+    state.viewport[3] = height;
+}
+
+/** Update cached value of uniform of current program
+ * @param location location of uniform
+ * @param value bit pattern of new value
+ * @param size size of value in bytes
+ * @returns non-zero if change should be issued
+ */
+static int update_uniform (GLint location, const void *value, size_t size)
+{
+    size_t hash = ((size_t)state.program * 31u + (size_t)location) *
+                  (size_t)2654435761u;
+    uniform_entry_t *entry = &uniforms[(hash >> 8) & (UNIFORM_CACHE_SIZE - 1)];
+    if ((state.program == UNKNOWN) || (location < 0)) {
+        n_issued++;
+        return 1;
+    }
+    if ((entry->program == state.program) && (entry->location == location)
+            && (entry->size == (GLuint)size)
+            && (memcmp (entry->value, value, size) == 0)) {
+        n_filtered++;
+        return 0;
+    }
+    entry->program = state.program;
+    entry->location = location;
+    entry->size = (GLuint)size;
+    memcpy (entry->value, value, size);
+    n_issued++;
+    return 1;
+}
+
+void gl_state_uniform1i (GLint location, GLint value)
+{
+    if (update_uniform (location, &value, sizeof (value))) {
+        gl.Uniform1i (location, value);
+    }
+}
+
+void gl_state_uniform1f (GLint location, GLfloat value)
+{
+    if (update_uniform (location, &value, sizeof (value))) {
+        gl.Uniform1f (location, value);
+    }
+}
+
+void gl_state_uniform_matrix4fv (GLint location, const GLfloat *value)
+{
+    if (update_uniform (location, value, 16 * sizeof (GLfloat))) {
+        gl.UniformMatrix4fv (location, 1, GL_FALSE, value);
+    }
+}
+
+void gl_state_forget_program (GLuint program)
+{
+    size_t i;
+    for (i = 0; i < UNIFORM_CACHE_SIZE; i++) {
+        if (uniforms[i].program == program) {
+            uniforms[i].program = UNKNOWN;
+        }
+    }
+    if (state.program == program) {
+        state.program = UNKNOWN;
+    }
+}
+
+void gl_state_forget_vertex_array (GLuint vertex_array)
+{
+    if (state.vertex_array == vertex_array) {
+        state.vertex_array = 0;
+        state.buffers[ELEMENT_ARRAY_INDEX] = UNKNOWN;
+    }
+}
+
+void gl_state_forget_buffer (GLuint buffer)
+{
+    size_t i, j;
+    for (i = 0; i < COUNT_OF (buffer_targets); i++) {
+        if (state.buffers[i] == buffer) {
+            state.buffers[i] = 0;
+        }
+    }
+    for (i = 0; i < COUNT_OF (indexed_targets); i++) {
+        for (j = 0; j < MAX_INDEXED_BINDINGS; j++) {
+            if (state.indexed[i][j] == buffer) {
+                state.indexed[i][j] = 0;
+            }
+        }
+    }
+}
+
+void gl_state_forget_texture (GLuint texture)
+{
+    size_t i, j;
+    for (i = 0; i < MAX_TEXTURE_UNITS; i++) {
+        for (j = 0; j < COUNT_OF (texture_targets); j++) {
+            if (state.textures[i][j] == texture) {
+                state.textures[i][j] = 0;
+            }
+        }
+    }
+}
+
+void gl_state_print_stats (void)
+{
+    unsigned long total = n_issued + n_filtered;
+    printf ("GL state: %lu changes issued, %lu redundant filtered (%.1f%%)\n",
+            n_issued, n_filtered,
+            total != 0 ? (double)n_filtered * 100.0 / (double)total : 0.0);
+    n_issued = 0;
+    n_filtered = 0;
+}
@@ -0,0 +1,226 @@
+/**
+ * @file gpu_memory.c
+ * This module contains accounting of buffer and texture memory with
+ * eviction of least recently used allocations.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include "gpu_memory.h"
+
+/** Number of kinds of tracked objects */
+#define N_KINDS 2
+
+/** Tracked allocation */
+typedef struct gpu_allocation_t {
+    gpu_memory_evict_fn evict; /**< Callback reducing storage, may be NULL */
+    void *user; /**< User data of callback */
+    size_t size; /**< Size of storage in bytes */
+    unsigned long last_used; /**< Frame when allocation was used last time */
+    GLenum format; /**< Internal format of texture or target of buffer */
+    int kind; /**< Value of gpu_memory_kind_t */
+    int next_free; /**< Index of next free slot, -1 for the last one */
+    int is_free; /**< Non-zero if slot is unused */
+} gpu_allocation_t;
+
+/** Slots of allocations */
+static gpu_allocation_t *allocations = NULL;
+
+/** Number of slots of allocations */
+static unsigned int max_allocation_count = 0;
+
+/** Index of the first free slot, -1 if all are used */
+static int first_free = -1;
+
+/** Maximum size of all allocations, 0 for unlimited */
+static size_t budget = 0;
+
+/** Size of all allocations */
+static size_t n_bytes_total = 0;
+
+/** Largest size of all allocations so far */
+static size_t n_bytes_peak = 0;
+
+/** Size of allocations by kind */
+static size_t n_bytes_by_kind[N_KINDS];
+
+/** Number of tracked allocations */
+static unsigned int n_allocations = 0;
+
+/** Number of evictions since start */
+static unsigned long n_evictions = 0;
+
+/** Current frame */
+static unsigned long frame = 0;
+
+/** Names of kinds of tracked objects */
+static const char *const kind_names[N_KINDS] = {
+    "buffers",
+    "textures"
+};
+
+/** Change size of allocation and totals
+ * @param allocation tracked allocation
+ * @param size new size of storage in bytes
+ */
+static void set_size (gpu_allocation_t *allocation, size_t size)
+{
+    n_bytes_total = n_bytes_total - allocation->size + size;
+    n_bytes_by_kind[allocation->kind] = n_bytes_by_kind[allocation->kind]
+                                        - allocation->size + size;
+    allocation->size = size;
+    if (n_bytes_total > n_bytes_peak) {
+        n_bytes_peak = n_bytes_total;
+    }
+}
+
+int gpu_memory_init (size_t budget_bytes, unsigned int max_allocations)
+{
+    unsigned int i;
+    allocations = (gpu_allocation_t *)calloc (max_allocations,
+                  sizeof (gpu_allocation_t));
+    if (allocations == NULL) {
+        return -1;
+    }
+    for (i = 0; i < max_allocations; i++) {
+        allocations[i].is_free = 1;
+        allocations[i].next_free = i + 1 < max_allocations ? (int) (i + 1) : -1;
+    }
+    max_allocation_count = max_allocations;
+    first_free = max_allocations != 0 ? 0 : -1;
+    budget = budget_bytes;
+    n_bytes_total = 0;
+    n_bytes_peak = 0;
+    for (i = 0; i < N_KINDS; i++) {
+        n_bytes_by_kind[i] = 0;
+    }
+    n_allocations = 0;
+    n_evictions = 0;
+    return 0;
+}
+
+void gpu_memory_shutdown (void)
+{
+    free (allocations);
+    allocations = NULL;
+    max_allocation_count = 0;
+    first_free = -1;
+}
+
+int gpu_memory_track (gpu_memory_kind_t kind, GLenum format, size_t size,
+                      gpu_memory_evict_fn evict, void *user)
+{
+    gpu_allocation_t *allocation;
+    int handle;
+    /* Evicted allocations may take and return slots, so slot is picked
+     * afterwards */
+    gpu_memory_reserve (size);
+    handle = first_free;
+    if (handle < 0) {
+        return -1;
+    }
+    allocation = &allocations[handle];
+    first_free = allocation->next_free;
+    allocation->evict = evict;
+    allocation->user = user;
+    allocation->size = 0;
+    allocation->last_used = frame;
+    allocation->format = format;
+    allocation->kind = (int)kind;
+    allocation->is_free = 0;
+    set_size (allocation, size);
+    n_allocations++;
+    return handle;
+}
+
+void gpu_memory_resize (int handle, size_t size)
+{
+    if ((handle < 0) || (allocations == NULL)) {
+        return;
+    }
+    if (size > allocations[handle].size) {
+        /* Allocation itself may be evicted while room is made */
+        allocations[handle].last_used = frame;
+        gpu_memory_reserve (size - allocations[handle].size);
+    }
+    set_size (&allocations[handle], size);
+}
+
+void gpu_memory_release (int handle)
+{
+    gpu_allocation_t *allocation;
+    if ((handle < 0) || (allocations == NULL)) {
+        return;
+    }
+    allocation = &allocations[handle];
+    set_size (allocation, 0);
+    allocation->is_free = 1;
+    allocation->next_free = first_free;
+    first_free = handle;
+    n_allocations--;
+}
+
+void gpu_memory_use (int handle)
+{
+    if ((handle >= 0) && (allocations != NULL)) {
+        allocations[handle].last_used = frame;
+    }
+}
+
+int gpu_memory_reserve (size_t size)
+{
+    if (budget == 0) {
+        return 0;
+    }
+    while (n_bytes_total + size > budget) {
+        gpu_allocation_t *victim = NULL;
+        unsigned int i;
+        for (i = 0; i < max_allocation_count; i++) {
+            gpu_allocation_t *allocation = &allocations[i];
+            if (!allocation->is_free && (allocation->evict != NULL)
+                    && (frame - allocation->last_used > 1)
+                    && ((victim == NULL)
+                        || (allocation->last_used < victim->last_used))) {
+                victim = allocation;
+            }
+        }
+        if (victim == NULL) {
+            return -1;
+        }
+        /* Victim isn't picked again in this frame whether or not it was
+         * reduced */
+        victim->last_used = frame;
+        if (victim->evict (victim->user) == 0) {
+            n_evictions++;
+        }
+    }
+    return 0;
+}
+
+void gpu_memory_end_frame (void)
+{
+    frame++;
+}
+
+void gpu_memory_print_stats (void)
+{
+    unsigned int i;
+    if (allocations == NULL) {
+        return;
+    }
+    printf ("GPU memory: %.2f MiB in %u allocations (",
+            (double)n_bytes_total / (1024.0 * 1024.0), n_allocations);
+    for (i = 0; i < N_KINDS; i++) {
+        printf ("%s%s %.2f MiB", i != 0 ? ", " : "", kind_names[i],
+                (double)n_bytes_by_kind[i] / (1024.0 * 1024.0));
+    }
+    if (budget != 0) {
+        printf ("), budget %.2f MiB", (double)budget / (1024.0 * 1024.0));
+    } else {
+        printf ("), no budget");
+    }
+    printf (", peak %.2f MiB, %lu evictions\n",
+            (double)n_bytes_peak / (1024.0 * 1024.0), n_evictions);
+}
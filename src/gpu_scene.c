@@ -0,0 +1,528 @@
+/**
+ * @file gpu_scene.c
+ * This module contains rendering of static meshes driven by GPU with
+ * compute culling and multi-draw indirect.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stddef.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gl_procs.h"
+#include "gl_state.h"
+#include "shader.h"
+#include "gpu_memory.h"
+#include "gl_loader.h"
+#include "math3d.h"
+#include "gpu_scene.h"
+
+/** Number of objects culled by single compute work group */
+#define CULL_GROUP_SIZE 64
+
+/** Size of vertex in bytes */
+#define VERTEX_SIZE (GPU_SCENE_VERTEX_FLOATS * sizeof (GLfloat))
+
+/** Binding point used to upload data into buffers */
+#define UPLOAD_TARGET GL_COPY_WRITE_BUFFER
+
+/** Mesh as seen by culling shader, std430 layout */
+typedef struct gpu_mesh_t {
+    GLfloat sphere[4]; /**< Bounding sphere center xyz and radius */
+    GLuint count; /**< Number of indices */
+    GLuint first_index; /**< Index of the first index in index buffer */
+    GLint base_vertex; /**< Index of the first vertex in vertex buffer */
+    GLuint padding;
+} gpu_mesh_t;
+
+/** Object as seen by shaders, std430 layout and per-instance attributes */
+typedef struct gpu_object_t {
+    GLfloat transform[16]; /**< Model matrix */
+    GLuint mesh; /**< Index of mesh */
+    GLuint id; /**< Index of object */
+    GLuint padding[2];
+} gpu_object_t;
+
+/** Layout of DrawElementsIndirectCommand */
+typedef struct indirect_command_t {
+    GLuint count; /**< Number of indices */
+    GLuint instance_count; /**< 1 if object is visible, 0 if culled */
+    GLuint first_index; /**< Index of the first index */
+    GLint base_vertex; /**< Value added to each index */
+    GLuint base_instance; /**< Index of object */
+} indirect_command_t;
+
+/** Upload of mesh done by loader */
+typedef struct mesh_upload_t {
+    const GLfloat *vertices; /**< Vertices of mesh */
+    const GLuint *indices; /**< Indices of mesh */
+    gpu_mesh_t mesh; /**< Mesh as seen by culling shader */
+    GLuint vertex_count; /**< Number of vertices */
+    GLuint index; /**< Index of mesh */
+} mesh_upload_t;
+
+/** Names of buffer objects */
+enum {
+    VERTEX_BUFFER,
+    INDEX_BUFFER,
+    MESH_BUFFER,
+    OBJECT_BUFFER,
+    COMMAND_BUFFER,
+    N_BUFFERS
+};
+
+/** Culling shader, writes command of each object */
+static const char *const cull_source[] = {
+    "#version 430\n"
+    "layout (local_size_x = 64) in;\n"
+    "struct Mesh { vec4 sphere; uint count; uint first_index;\n"
+    "    int base_vertex; uint padding; };\n"
+    "struct Object { mat4 transform; uint mesh; uint id; uvec2 padding; };\n"
+    "struct Command { uint count; uint instance_count; uint first_index;\n"
+    "    int base_vertex; uint base_instance; };\n",
+    "layout (std430, binding = 0) readonly buffer Meshes { Mesh meshes[]; };\n"
+    "layout (std430, binding = 1) readonly buffer Objects\n"
+    "    { Object objects[]; };\n"
+    "layout (std430, binding = 2) writeonly buffer Commands\n"
+    "    { Command commands[]; };\n"
+    "uniform vec4 planes[6];\n"
+    "uniform int object_count;\n",
+    "void main () {\n"
+    "    uint i = gl_GlobalInvocationID.x;\n"
+    "    if (i >= uint (object_count)) return;\n"
+    "    mat4 m = objects[i].transform;\n"
+    "    Mesh mesh = meshes[objects[i].mesh];\n"
+    "    vec3 center = (m * vec4 (mesh.sphere.xyz, 1.0)).xyz;\n"
+    "    float radius = mesh.sphere.w * sqrt (max (dot (m[0].xyz, m[0].xyz),\n"
+    "        max (dot (m[1].xyz, m[1].xyz), dot (m[2].xyz, m[2].xyz))));\n",
+    "    bool visible = true;\n"
+    "    for (int p = 0; p < 6; p++)\n"
+    "        visible = visible && dot (planes[p].xyz, center) + planes[p].w\n"
+    "            >= -radius;\n"
+    "    commands[i].count = mesh.count;\n"
+    "    commands[i].instance_count = visible ? 1u : 0u;\n"
+    "    commands[i].first_index = mesh.first_index;\n"
+    "    commands[i].base_vertex = mesh.base_vertex;\n"
+    "    commands[i].base_instance = i;\n"
+    "}\n",
+    NULL
+};
+
+/** Vertex shader, model matrix and id come from per-instance attributes
+ * selected by base instance of command */
+static const char *const vertex_source[] = {
+    "#version 430\n"
+    "layout (location = 0) in vec3 position;\n"
+    "layout (location = 1) in vec3 normal;\n"
+    "layout (location = 2) in mat4 transform;\n"
+    "layout (location = 6) in uint id;\n"
+    "uniform mat4 view_projection;\n"
+    "out vec3 world_normal;\n"
+    "flat out uint object_id;\n",
+    "void main () {\n"
+    "    world_normal = mat3 (transform) * normal;\n"
+    "    object_id = id;\n"
+    "    gl_Position = view_projection * transform * vec4 (position, 1.0);\n"
+    "}\n",
+    NULL
+};
+
+/** Fragment shader, color of object is derived from its id */
+static const char *const fragment_source[] = {
+    "#version 430\n"
+    "in vec3 world_normal;\n"
+    "flat in uint object_id;\n"
+    "out vec4 color;\n"
+    "void main () {\n"
+    "    uvec3 bits = (uvec3 (object_id * 2654435761u) >> uvec3 (0, 8, 16))\n"
+    "        & 255u;\n"
+    "    vec3 albedo = 0.35 + 0.65 * vec3 (bits) / 255.0;\n"
+    "    float light = max (dot (normalize (world_normal),\n"
+    "        vec3 (0.40, 0.80, 0.45)), 0.0);\n"
+    "    color = vec4 (albedo * (0.2 + 0.8 * light), 1.0);\n"
+    "}\n",
+    NULL
+};
+
+/** Buffer objects, created by loader */
+static GLuint buffers[N_BUFFERS];
+
+/** Sizes of buffers in bytes */
+static size_t buffer_sizes[N_BUFFERS];
+
+/** Uploads of meshes, one per mesh */
+static mesh_upload_t *uploads = NULL;
+
+/** Number of loader jobs of scene that aren't finished */
+static unsigned int n_loading = 0;
+
+/** Tracked storage of all buffers */
+static int buffers_allocation = -1;
+
+/** Vertex array of all meshes and objects */
+static GLuint vertex_array = 0;
+
+/** Culling program */
+static GLuint cull_program = 0;
+
+/** Drawing program */
+static GLuint draw_program = 0;
+
+/** Location of frustum planes uniform of culling program */
+static GLint planes_location = -1;
+
+/** Location of object count uniform of culling program */
+static GLint object_count_location = -1;
+
+/** Location of view-projection uniform of drawing program */
+static GLint view_projection_location = -1;
+
+/** Capacities of buffers */
+static GLuint max_vertex_count = 0, max_index_count = 0, max_mesh_count = 0,
+              max_object_count = 0;
+
+/** Used parts of buffers */
+static GLuint n_vertices = 0, n_indices = 0, n_meshes = 0, n_objects = 0;
+
+/** Copy of object buffer, changes are uploaded once per frame */
+static gpu_object_t *objects = NULL;
+
+/** Range of objects changed since previous upload */
+static GLuint dirty_first = 0, dirty_end = 0;
+
+/** Check if context supports everything scene needs
+ * @returns non-zero if GPU driven rendering is supported
+ */
+static int is_supported (void)
+{
+    return gl_version_at_least (4, 3) && (gl.DispatchCompute != NULL)
+           && (gl.MemoryBarrier != NULL)
+           && (gl.MultiDrawElementsIndirect != NULL)
+           && (gl.BufferData != NULL) && (gl.BufferSubData != NULL)
+           && (gl.GenVertexArrays != NULL) && (gl.CreateShader != NULL);
+}
+
+/** Create buffers, called by loader
+ * @param user unused
+ */
+static void create_buffers (void *user)
+{
+    static const GLenum usages[N_BUFFERS] = {
+        GL_STATIC_DRAW, GL_STATIC_DRAW, GL_STATIC_DRAW, GL_DYNAMIC_DRAW,
+        GL_DYNAMIC_COPY
+    };
+    unsigned int i;
+    (void)user;
+    gl.GenBuffers (N_BUFFERS, buffers);
+    for (i = 0; i < N_BUFFERS; i++) {
+        gl.BindBuffer (UPLOAD_TARGET, buffers[i]);
+        gl.BufferData (UPLOAD_TARGET, (GLsizeiptr)buffer_sizes[i], NULL,
+                       usages[i]);
+    }
+    gl.BindBuffer (UPLOAD_TARGET, 0);
+}
+
+/** Copy mesh into shared buffers, called by loader
+ * @param user mesh_upload_t of mesh
+ */
+static void upload_mesh (void *user)
+{
+    const mesh_upload_t *upload = (const mesh_upload_t *)user;
+    gl.BindBuffer (UPLOAD_TARGET, buffers[VERTEX_BUFFER]);
+    gl.BufferSubData (UPLOAD_TARGET,
+                      (GLintptr) ((GLuint)upload->mesh.base_vertex
+                                  * VERTEX_SIZE),
+                      (GLsizeiptr) (upload->vertex_count * VERTEX_SIZE),
+                      upload->vertices);
+    gl.BindBuffer (UPLOAD_TARGET, buffers[INDEX_BUFFER]);
+    gl.BufferSubData (UPLOAD_TARGET,
+                      (GLintptr) (upload->mesh.first_index * sizeof (GLuint)),
+                      (GLsizeiptr) (upload->mesh.count * sizeof (GLuint)),
+                      upload->indices);
+    gl.BindBuffer (UPLOAD_TARGET, buffers[MESH_BUFFER]);
+    gl.BufferSubData (UPLOAD_TARGET,
+                      (GLintptr) (upload->index * sizeof (gpu_mesh_t)),
+                      (GLsizeiptr)sizeof (gpu_mesh_t), &upload->mesh);
+    gl.BindBuffer (UPLOAD_TARGET, 0);
+}
+
+/** Copy data into buffer
+ * @param buffer buffer object
+ * @param offset offset in bytes
+ * @param size size of data in bytes
+ * @param data data to copy
+ */
+static void upload (GLuint buffer, size_t offset, size_t size,
+                    const void *data)
+{
+    gl_state_bind_buffer (UPLOAD_TARGET, buffer);
+    gl.BufferSubData (UPLOAD_TARGET, (GLintptr)offset, (GLsizeiptr)size, data);
+}
+
+/** Set up vertex array of meshes and per-instance object attributes */
+static void setup_vertex_array (void)
+{
+    GLuint i;
+    gl.GenVertexArrays (1, &vertex_array);
+    gl_state_bind_vertex_array (vertex_array);
+    gl_state_bind_buffer (GL_ELEMENT_ARRAY_BUFFER, buffers[INDEX_BUFFER]);
+    gl_state_bind_buffer (GL_ARRAY_BUFFER, buffers[VERTEX_BUFFER]);
+    gl.EnableVertexAttribArray (0);
+    gl.VertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, (GLsizei)VERTEX_SIZE,
+                            NULL);
+    gl.EnableVertexAttribArray (1);
+    gl.VertexAttribPointer (1, 3, GL_FLOAT, GL_FALSE, (GLsizei)VERTEX_SIZE,
+                            (const void *) (3 * sizeof (GLfloat)));
+    gl_state_bind_buffer (GL_ARRAY_BUFFER, buffers[OBJECT_BUFFER]);
+    for (i = 0; i < 4; i++) {
+        gl.EnableVertexAttribArray (2 + i);
+        gl.VertexAttribPointer (2 + i, 4, GL_FLOAT, GL_FALSE,
+                                (GLsizei)sizeof (gpu_object_t),
+                                (const void *) (i * 4 * sizeof (GLfloat)));
+        gl.VertexAttribDivisor (2 + i, 1);
+    }
+    gl.EnableVertexAttribArray (6);
+    gl.VertexAttribIPointer (6, 1, GL_UNSIGNED_INT,
+                             (GLsizei)sizeof (gpu_object_t),
+                             (const void *)offsetof (gpu_object_t, id));
+    gl.VertexAttribDivisor (6, 1);
+}
+
+/** Count finished job of loader, vertex array is set up once buffers and
+ * meshes are complete since it isn't shared with loader context
+ * @param user unused
+ */
+static void finish_job (void *user)
+{
+    (void)user;
+    n_loading--;
+    if ((n_loading == 0) && (vertex_array == 0)) {
+        setup_vertex_array ();
+    }
+}
+
+int gpu_scene_init (GLuint max_vertices, GLuint max_indices,
+                    GLuint max_meshes, GLuint max_objects)
+{
+    if (!is_supported ()) {
+        return -1;
+    }
+    objects = (gpu_object_t *)malloc (max_objects * sizeof (gpu_object_t));
+    uploads = (mesh_upload_t *)malloc (max_meshes * sizeof (mesh_upload_t));
+    if ((objects == NULL) || (uploads == NULL)) {
+        gpu_scene_shutdown ();
+        return -1;
+    }
+    cull_program = shader_program_create_compute ("gpu scene culling",
+                   cull_source);
+    draw_program = shader_program_create ("gpu scene", vertex_source,
+                                          fragment_source);
+    if ((cull_program == 0) || (draw_program == 0)) {
+        gpu_scene_shutdown ();
+        return -1;
+    }
+    planes_location = gl.GetUniformLocation (cull_program, "planes");
+    object_count_location = gl.GetUniformLocation (cull_program,
+                            "object_count");
+    view_projection_location = gl.GetUniformLocation (draw_program,
+                               "view_projection");
+    buffer_sizes[VERTEX_BUFFER] = max_vertices * VERTEX_SIZE;
+    buffer_sizes[INDEX_BUFFER] = max_indices * sizeof (GLuint);
+    buffer_sizes[MESH_BUFFER] = max_meshes * sizeof (gpu_mesh_t);
+    buffer_sizes[OBJECT_BUFFER] = max_objects * sizeof (gpu_object_t);
+    buffer_sizes[COMMAND_BUFFER] = max_objects * sizeof (indirect_command_t);
+    if (gl_loader_submit (create_buffers, finish_job, NULL) != 0) {
+        gpu_scene_shutdown ();
+        return -1;
+    }
+    n_loading = 1;
+    buffers_allocation = gpu_memory_track (GPU_MEMORY_BUFFER, UPLOAD_TARGET,
+                                           buffer_sizes[VERTEX_BUFFER]
+                                           + buffer_sizes[INDEX_BUFFER]
+                                           + buffer_sizes[MESH_BUFFER]
+                                           + buffer_sizes[OBJECT_BUFFER]
+                                           + buffer_sizes[COMMAND_BUFFER],
+                                           NULL, NULL);
+    max_vertex_count = max_vertices;
+    max_index_count = max_indices;
+    max_mesh_count = max_meshes;
+    max_object_count = max_objects;
+    n_vertices = 0;
+    n_indices = 0;
+    n_meshes = 0;
+    n_objects = 0;
+    dirty_first = 0;
+    dirty_end = 0;
+    return 0;
+}
+
+void gpu_scene_shutdown (void)
+{
+    unsigned int i;
+    if (vertex_array != 0) {
+        gl_state_forget_vertex_array (vertex_array);
+        gl.DeleteVertexArrays (1, &vertex_array);
+        vertex_array = 0;
+    }
+    if (buffers[0] != 0) {
+        for (i = 0; i < N_BUFFERS; i++) {
+            gl_state_forget_buffer (buffers[i]);
+        }
+        gl.DeleteBuffers (N_BUFFERS, buffers);
+        memset (buffers, 0, sizeof (buffers));
+        gpu_memory_release (buffers_allocation);
+        buffers_allocation = -1;
+    }
+    shader_program_destroy (cull_program);
+    shader_program_destroy (draw_program);
+    cull_program = 0;
+    draw_program = 0;
+    free (objects);
+    free (uploads);
+    objects = NULL;
+    uploads = NULL;
+    n_loading = 0;
+    max_object_count = 0;
+    n_objects = 0;
+    dirty_end = 0;
+}
+
+/** Compute bounding sphere of vertices
+ * @param vertices GPU_SCENE_VERTEX_FLOATS floats per vertex
+ * @param count number of vertices
+ * @param sphere receives center xyz and radius
+ */
+static void bounding_sphere (const GLfloat *vertices, GLuint count,
+                             GLfloat *sphere)
+{
+    GLfloat lower[3], upper[3];
+    GLfloat radius = 0.0f;
+    GLuint i, j;
+    memcpy (lower, vertices, sizeof (lower));
+    memcpy (upper, vertices, sizeof (upper));
+    for (i = 1; i < count; i++) {
+        const GLfloat *position = vertices + i * GPU_SCENE_VERTEX_FLOATS;
+        for (j = 0; j < 3; j++) {
+            lower[j] = position[j] < lower[j] ? position[j] : lower[j];
+            upper[j] = position[j] > upper[j] ? position[j] : upper[j];
+        }
+    }
+    for (j = 0; j < 3; j++) {
+        sphere[j] = (lower[j] + upper[j]) * 0.5f;
+    }
+    for (i = 0; i < count; i++) {
+        const GLfloat *position = vertices + i * GPU_SCENE_VERTEX_FLOATS;
+        GLfloat squared = 0.0f;
+        for (j = 0; j < 3; j++) {
+            squared += (position[j] - sphere[j]) * (position[j] - sphere[j]);
+        }
+        radius = squared > radius ? squared : radius;
+    }
+    sphere[3] = sqrtf (radius);
+}
+
+int gpu_scene_add_mesh (const GLfloat *vertices, GLuint vertex_count,
+                        const GLuint *indices, GLuint index_count)
+{
+    mesh_upload_t *upload;
+    if ((vertex_count == 0) || (n_meshes >= max_mesh_count)
+            || (vertex_count > max_vertex_count - n_vertices)
+            || (index_count > max_index_count - n_indices)) {
+        return -1;
+    }
+    upload = &uploads[n_meshes];
+    bounding_sphere (vertices, vertex_count, upload->mesh.sphere);
+    upload->mesh.count = index_count;
+    upload->mesh.first_index = n_indices;
+    upload->mesh.base_vertex = (GLint)n_vertices;
+    upload->mesh.padding = 0;
+    upload->vertices = vertices;
+    upload->indices = indices;
+    upload->vertex_count = vertex_count;
+    upload->index = n_meshes;
+    if (gl_loader_submit (upload_mesh, finish_job, upload) != 0) {
+        return -1;
+    }
+    n_loading++;
+    n_vertices += vertex_count;
+    n_indices += index_count;
+    return (int)n_meshes++;
+}
+
+/** Extend range of objects uploaded by the next draw
+ * @param object index of changed object
+ */
+static void mark_dirty (GLuint object)
+{
+    if (dirty_first >= dirty_end) {
+        dirty_first = object;
+        dirty_end = object + 1;
+    } else {
+        dirty_first = object < dirty_first ? object : dirty_first;
+        dirty_end = object + 1 > dirty_end ? object + 1 : dirty_end;
+    }
+}
+
+int gpu_scene_add_object (GLuint mesh, const GLfloat *transform)
+{
+    gpu_object_t *object = objects + n_objects;
+    if ((mesh >= n_meshes) || (n_objects >= max_object_count)) {
+        return -1;
+    }
+    memcpy (object->transform, transform, sizeof (object->transform));
+    object->mesh = mesh;
+    object->id = n_objects;
+    object->padding[0] = 0;
+    object->padding[1] = 0;
+    mark_dirty (n_objects);
+    return (int)n_objects++;
+}
+
+void gpu_scene_set_transform (GLuint object, const GLfloat *transform)
+{
+    if (object < n_objects) {
+        memcpy (objects[object].transform, transform,
+                sizeof (objects[object].transform));
+        mark_dirty (object);
+    }
+}
+
+int gpu_scene_is_loading (void)
+{
+    return n_loading != 0;
+}
+
+void gpu_scene_draw (const GLfloat *view_projection)
+{
+    GLfloat planes[6 * 4];
+    if ((n_objects == 0) || (n_loading != 0)) {
+        return;
+    }
+    if (dirty_first < dirty_end) {
+        upload (buffers[OBJECT_BUFFER], dirty_first * sizeof (gpu_object_t),
+                (dirty_end - dirty_first) * sizeof (gpu_object_t),
+                objects + dirty_first);
+        dirty_first = 0;
+        dirty_end = 0;
+    }
+    frustum_from_matrix (view_projection, planes);
+    gl_state_use_program (cull_program);
+    gl.Uniform4fv (planes_location, 6, planes);
+    gl_state_uniform1i (object_count_location, (GLint)n_objects);
+    gl_state_bind_buffer_base (GL_SHADER_STORAGE_BUFFER, 0,
+                               buffers[MESH_BUFFER]);
+    gl_state_bind_buffer_base (GL_SHADER_STORAGE_BUFFER, 1,
+                               buffers[OBJECT_BUFFER]);
+    gl_state_bind_buffer_base (GL_SHADER_STORAGE_BUFFER, 2,
+                               buffers[COMMAND_BUFFER]);
+    gl.DispatchCompute ((n_objects + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE,
+                        1, 1);
+    gl.MemoryBarrier (GL_COMMAND_BARRIER_BIT);
+    gl_state_use_program (draw_program);
+    gl_state_uniform_matrix4fv (view_projection_location, view_projection);
+    gl_state_bind_vertex_array (vertex_array);
+    gl_state_bind_buffer (GL_DRAW_INDIRECT_BUFFER, buffers[COMMAND_BUFFER]);
+    gl.MultiDrawElementsIndirect (GL_TRIANGLES, GL_UNSIGNED_INT, NULL,
+                                  (GLsizei)n_objects, 0);
+}
@@ -0,0 +1,272 @@
+/**
+ * @file gpu_timer.c
+ * This module contains GPU time measurement of frames and render passes
+ * with timer queries.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <string.h>
+#include "gl_procs.h"
+#include "gpu_timer.h"
+
+/** Maximum number of distinct pass names in statistics */
+#define MAX_PASS_STATS 16
+
+/** Queries of single frame in flight */
+typedef struct frame_queries_t {
+    GLuint timestamps[2]; /**< GL_TIMESTAMP at beginning and end of frame */
+    GLuint passes[GPU_TIMER_MAX_PASSES]; /**< GL_TIME_ELAPSED of passes */
+    const char *pass_names[GPU_TIMER_MAX_PASSES]; /**< Names of passes */
+    double cpu_ms; /**< CPU time of frame */
+    unsigned int n_passes; /**< Number of measured passes */
+    int is_pending; /**< Non-zero if results weren't collected yet */
+} frame_queries_t;
+
+/** Accumulated time of passes with the same name */
+typedef struct pass_stats_t {
+    const char *name; /**< Name of pass */
+    double total_ms; /**< Sum of GPU time */
+    unsigned long n_samples; /**< Number of measurements */
+} pass_stats_t;
+
+/** Ring of frames in flight */
+static frame_queries_t frames[GPU_TIMER_LATENCY];
+
+/** Index of current frame in ring */
+static unsigned int current = 0;
+
+/** Non-zero if query objects are created */
+static int is_initialized = 0;
+
+/** Non-zero if GL_TIME_ELAPSED query is active */
+static int is_pass_active = 0;
+
+/** Number of measured frames since last report */
+static unsigned long n_frames = 0;
+
+/** Number of frames whose results weren't ready in time */
+static unsigned long n_dropped = 0;
+
+/** Number of frames where GPU time exceeded CPU time */
+static unsigned long n_gpu_bound = 0;
+
+/** Sum of CPU time of measured frames */
+static double cpu_total_ms = 0.0;
+
+/** Sum of GPU time of measured frames, from beginning to end of frame */
+static double gpu_total_ms = 0.0;
+
+/** Sum of GPU time of passes of measured frames */
+static double passes_total_ms = 0.0;
+
+/** Number of measured frames that had passes */
+static unsigned long n_frames_with_passes = 0;
+
+/** Maximum GPU time of single frame */
+static double gpu_max_ms = 0.0;
+
+/** Accumulated time of passes */
+static pass_stats_t pass_stats[MAX_PASS_STATS];
+
+int gpu_timer_init (void)
+{
+    unsigned int i;
+    if ((gl.GenQueries == NULL) || (gl.QueryCounter == NULL)
+            || (gl.GetQueryObjectiv == NULL)
+            || (gl.GetQueryObjectui64v == NULL)
+            || (gl.BeginQuery == NULL) || (gl.EndQuery == NULL)
+            || (!gl_version_at_least (3, 3)
+                && !gl_has_extension ("GL_ARB_timer_query"))) {
+        return -1;
+    }
+    memset (frames, 0, sizeof (frames));
+    for (i = 0; i < GPU_TIMER_LATENCY; i++) {
+        gl.GenQueries (2, frames[i].timestamps);
+        gl.GenQueries (GPU_TIMER_MAX_PASSES, frames[i].passes);
+    }
+    current = 0;
+    is_initialized = 1;
+    return 0;
+}
+
+void gpu_timer_shutdown (void)
+{
+    unsigned int i;
+    if (!is_initialized) {
+        return;
+    }
+    for (i = 0; i < GPU_TIMER_LATENCY; i++) {
+        gl.DeleteQueries (2, frames[i].timestamps);
+        gl.DeleteQueries (GPU_TIMER_MAX_PASSES, frames[i].passes);
+    }
+    is_initialized = 0;
+}
+
+/** Check if result of query is available without waiting
+ * @param query query object
+ * @returns non-zero if result is available
+ */
+static int is_available (GLuint query)
+{
+    GLint available = 0;
+    gl.GetQueryObjectiv (query, GL_QUERY_RESULT_AVAILABLE, &available);
+    return available != 0;
+}
+
+/** Get result of query in milliseconds
+ * @param query query object whose result is available
+ * @returns result converted from nanoseconds
+ */
+static double query_ms (GLuint query)
+{
+    GLuint64 ns = 0;
+    gl.GetQueryObjectui64v (query, GL_QUERY_RESULT, &ns);
+    return (double)ns / 1000000.0;
+}
+
+/** Account time of pass
+ * @param name name of pass
+ * @param ms GPU time of pass
+ */
+static void add_pass_sample (const char *name, double ms)
+{
+    unsigned int i;
+    for (i = 0; i < MAX_PASS_STATS; i++) {
+        if ((pass_stats[i].name == name) || (pass_stats[i].name == NULL)) {
+            pass_stats[i].name = name;
+            pass_stats[i].total_ms += ms;
+            pass_stats[i].n_samples++;
+            return;
+        }
+    }
+}
+
+/** Collect results of frame in flight, or drop them if they aren't ready
+ * @param frame frame in flight
+ */
+static void collect_frame (frame_queries_t *frame)
+{
+    GLuint64 begin = 0, end = 0;
+    double gpu_ms, passes_ms = 0.0;
+    unsigned int i;
+    frame->is_pending = 0;
+    if (!is_available (frame->timestamps[1]) || ((frame->n_passes > 0)
+            && !is_available (frame->passes[frame->n_passes - 1]))) {
+        n_dropped++;
+        return;
+    }
+    gl.GetQueryObjectui64v (frame->timestamps[0], GL_QUERY_RESULT, &begin);
+    gl.GetQueryObjectui64v (frame->timestamps[1], GL_QUERY_RESULT, &end);
+    gpu_ms = end > begin ? (double)(end - begin) / 1000000.0 : 0.0;
+    for (i = 0; i < frame->n_passes; i++) {
+        double ms = query_ms (frame->passes[i]);
+        add_pass_sample (frame->pass_names[i], ms);
+        passes_ms += ms;
+    }
+    /* GPU may idle between passes waiting for commands, so the sum of
+     * passes is reported next to the whole frame rather than instead */
+    if (frame->n_passes > 0) {
+        passes_total_ms += passes_ms;
+        n_frames_with_passes++;
+    }
+    if (gpu_ms > frame->cpu_ms) {
+        n_gpu_bound++;
+    }
+    if (gpu_ms > gpu_max_ms) {
+        gpu_max_ms = gpu_ms;
+    }
+    cpu_total_ms += frame->cpu_ms;
+    gpu_total_ms += gpu_ms;
+    n_frames++;
+}
+
+void gpu_timer_begin_frame (void)
+{
+    frame_queries_t *frame;
+    if (!is_initialized) {
+        return;
+    }
+    frame = &frames[current];
+    if (frame->is_pending) {
+        collect_frame (frame);
+    }
+    frame->n_passes = 0;
+    gl.QueryCounter (frame->timestamps[0], GL_TIMESTAMP);
+}
+
+void gpu_timer_end_frame (double cpu_ms)
+{
+    frame_queries_t *frame;
+    if (!is_initialized) {
+        return;
+    }
+    if (is_pass_active) {
+        gpu_timer_end_pass ();
+    }
+    frame = &frames[current];
+    gl.QueryCounter (frame->timestamps[1], GL_TIMESTAMP);
+    frame->cpu_ms = cpu_ms;
+    frame->is_pending = 1;
+    current = (current + 1) % GPU_TIMER_LATENCY;
+}
+
+void gpu_timer_begin_pass (const char *name)
+{
+    frame_queries_t *frame = &frames[current];
+    if (!is_initialized || (frame->n_passes == GPU_TIMER_MAX_PASSES)) {
+        return;
+    }
+    if (is_pass_active) {
+        gpu_timer_end_pass ();
+    }
+    frame->pass_names[frame->n_passes] = name;
+    gl.BeginQuery (GL_TIME_ELAPSED, frame->passes[frame->n_passes]);
+    is_pass_active = 1;
+}
+
+void gpu_timer_end_pass (void)
+{
+    if (!is_pass_active) {
+        return;
+    }
+    gl.EndQuery (GL_TIME_ELAPSED);
+    frames[current].n_passes++;
+    is_pass_active = 0;
+}
+
+void gpu_timer_print_stats (void)
+{
+    unsigned int i;
+    if (!is_initialized) {
+        return;
+    }
+    if (n_frames == 0) {
+        printf ("GPU: no results, %lu frames dropped\n", n_dropped);
+        n_dropped = 0;
+        return;
+    }
+    printf ("GPU: %.2f ms/frame (max %.2f), CPU: %.2f ms/frame, "
+            "%lu of %lu frames GPU-bound, %lu dropped\n",
+            gpu_total_ms / (double)n_frames, gpu_max_ms,
+            cpu_total_ms / (double)n_frames, n_gpu_bound, n_frames,
+            n_dropped);
+    if (n_frames_with_passes > 0) {
+        printf ("  passes: %.2f ms/frame\n",
+                passes_total_ms / (double)n_frames_with_passes);
+    }
+    for (i = 0; (i < MAX_PASS_STATS) && (pass_stats[i].name != NULL); i++) {
+        printf ("  pass %s: %.2f ms\n", pass_stats[i].name,
+                pass_stats[i].total_ms / (double)pass_stats[i].n_samples);
+    }
+    memset (pass_stats, 0, sizeof (pass_stats));
+    n_frames = 0;
+    n_dropped = 0;
+    n_gpu_bound = 0;
+    cpu_total_ms = 0.0;
+    gpu_total_ms = 0.0;
+    passes_total_ms = 0.0;
+    n_frames_with_passes = 0;
+    gpu_max_ms = 0.0;
+}
@@ -0,0 +1,1116 @@
+/**
+ * @file image_decode.c
+ * This module contains decoding of PPM, TGA and BMP images with format
+ * conversion and mipmap generation split into jobs of worker threads.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <ctype.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "workers.h"
+#include "image_decode.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+/** Compile function for SSE2 regardless of target of the whole build */
+#define TARGET_SSE2 __attribute__ ((target ("sse2")))
+/** Compile function for SSSE3 regardless of target of the whole build */
+#define TARGET_SSSE3 __attribute__ ((target ("ssse3")))
+/** Compile function for AVX2 regardless of target of the whole build */
+#define TARGET_AVX2 __attribute__ ((target ("avx2")))
+#endif
+
+/** Largest accepted width or height */
+#define MAX_EXTENT 16384
+
+/** Log2 of number of rows decoded by single job; job also builds this
+ * many mipmap levels from its rows */
+#define BAND_SHIFT 6
+
+/** Number of rows decoded by single job */
+#define BAND_ROWS (1u << BAND_SHIFT)
+
+/** Number of entries of table encoding linear values to sRGB, fine enough
+ * to keep every 8-bit value reachable near black */
+#define LINEAR_STEPS 16384
+
+/** Size of TGA header */
+#define TGA_HEADER_SIZE 18
+
+/** Size of BMP file header and BITMAPINFOHEADER */
+#define BMP_HEADER_SIZE 54
+
+/** BMP compression of pixels described by channel masks */
+#define BMP_BITFIELDS 3
+
+/** Layouts of pixels in files */
+typedef enum pixel_layout_t {
+    LAYOUT_RGB24, /**< R, G, B */
+    LAYOUT_BGR24, /**< B, G, R */
+    LAYOUT_BGRA32, /**< B, G, R, A */
+    LAYOUT_BGRX32 /**< B, G, R, unused */
+} pixel_layout_t;
+
+/** Image being decoded */
+typedef struct decode_image_t {
+    texture_source_t source; /**< Levels inside pixels */
+    size_t level_offsets[TEXTURE_MAX_LEVELS]; /**< Offsets of levels */
+    const unsigned char *data; /**< First byte of pixel data in mapping */
+    void *mapping; /**< Mapped file, NULL if it isn't mapped */
+    unsigned char *pixels; /**< All levels of decoded image */
+    size_t mapping_size; /**< Size of mapped file */
+    size_t data_size; /**< Size from data to the end of file */
+    size_t stride; /**< Distance between rows of data */
+    unsigned char shuffle[16]; /**< Byte shuffle converting 4 pixels */
+    unsigned int pixel_size; /**< Size of pixel of data, 3 or 4 */
+    unsigned int n_bands; /**< Number of jobs, 0 if image isn't decoded */
+    unsigned int n_bands_left; /**< Unfinished jobs, updated atomically */
+    int is_opaque; /**< Non-zero if alpha of data is ignored */
+    int is_top_down; /**< Non-zero if the first row of data is the top */
+    int is_rle; /**< Non-zero if data is run-length encoded TGA */
+    int status; /**< 0 if image is decoded, -1 on failure */
+    char padding[4];
+} decode_image_t;
+
+/** Band of rows decoded by single job */
+typedef struct decode_job_t {
+    unsigned int image; /**< Index of image */
+    unsigned int first_row; /**< The first row counted from bottom */
+    unsigned int n_rows; /**< Number of rows */
+    char padding[4];
+} decode_job_t;
+
+/** Table of kernels of selected instruction set, rows are 4 bytes per
+ * pixel unless stated otherwise */
+typedef struct image_kernels_t {
+    void (*convert_row) (const unsigned char *src, unsigned char *dst,
+                         size_t n, unsigned int pixel_size,
+                         const unsigned char *shuffle, int is_opaque);
+    void (*premultiply_row) (unsigned char *row, size_t n);
+    void (*premultiply_srgb_row) (unsigned char *row, size_t n);
+    void (*downsample_row) (const unsigned char *src0,
+                            const unsigned char *src1, size_t src_width,
+                            unsigned char *dst, size_t n);
+    void (*downsample_srgb_row) (const unsigned char *src0,
+                                 const unsigned char *src1,
+                                 size_t src_width, unsigned char *dst,
+                                 size_t n);
+} image_kernels_t;
+
+/** Images passed to image_decode_start() */
+static decode_image_t *images = NULL;
+
+/** Number of images */
+static unsigned int n_image_count = 0;
+
+/** Jobs of all images */
+static decode_job_t *jobs = NULL;
+
+/** Batch executing jobs */
+static workers_batch_t batch;
+
+/** Flags passed to image_decode_start() */
+static unsigned int decode_flags = 0;
+
+/** Non-zero while batch has to be waited for */
+static int is_decoding = 0;
+
+/** Linear values of 8-bit sRGB values */
+static float srgb_to_linear[256];
+
+/** 8-bit sRGB values of linear values scaled to LINEAR_STEPS - 1 */
+static int linear_to_srgb[LINEAR_STEPS];
+
+/** Non-zero once sRGB tables are built */
+static int has_srgb_tables = 0;
+
+/** Offsets of red, green, blue and alpha in pixels of each layout, -1 if
+ * absent */
+static const int layout_offsets[4][4] = {
+    {0, 1, 2, -1},
+    {2, 1, 0, -1},
+    {2, 1, 0, 3},
+    {2, 1, 0, -1}
+};
+
+/** Read little endian 16-bit value
+ * @param data first byte of value
+ * @returns value
+ */
+static unsigned int read_u16 (const unsigned char *data)
+{
+    return (unsigned int)data[0] | ((unsigned int)data[1] << 8);
+}
+
+/** Read little endian 32-bit value
+ * @param data first byte of value
+ * @returns value
+ */
+static unsigned int read_u32 (const unsigned char *data)
+{
+    return read_u16 (data) | (read_u16 (data + 2) << 16);
+}
+
+/** Encode linear value to 8-bit sRGB
+ * @param value linear value in [0, 1]
+ * @returns sRGB value
+ */
+static unsigned char encode_srgb (float value)
+{
+    return (unsigned char)linear_to_srgb[(int) (value * (LINEAR_STEPS - 1)
+                                          + 0.5f)];
+}
+
+/** Build tables converting between sRGB and linear values */
+static void build_srgb_tables (void)
+{
+    int i;
+    for (i = 0; i < 256; i++) {
+        float value = (float)i / 255.0f;
+        srgb_to_linear[i] = value <= 0.04045f ? value / 12.92f
+                            : powf ((value + 0.055f) / 1.055f, 2.4f);
+    }
+    for (i = 0; i < LINEAR_STEPS; i++) {
+        float value = (float)i / (LINEAR_STEPS - 1);
+        float encoded = value <= 0.0031308f ? value * 12.92f
+                        : 1.055f * powf (value, 1.0f / 2.4f) - 0.055f;
+        linear_to_srgb[i] = (int) (encoded * 255.0f + 0.5f);
+    }
+    has_srgb_tables = 1;
+}
+
+/** Convert pixels of file to RGBA or BGRA with scalar code
+ * @param src pixels of file, may be the same as dst if pixel_size is 4
+ * @param dst receives pixels
+ * @param n number of pixels
+ * @param pixel_size size of pixel of src, 3 or 4
+ * @param shuffle byte shuffle of 4 pixels, only the first one is used;
+ * entries with high bit set produce zero
+ * @param is_opaque non-zero if alpha is set to 255
+ */
+static void convert_row_scalar (const unsigned char *src, unsigned char *dst,
+                                size_t n, unsigned int pixel_size,
+                                const unsigned char *shuffle, int is_opaque)
+{
+    size_t i;
+    for (i = 0; i < n; i++) {
+        const unsigned char *from = src + i * pixel_size;
+        unsigned char pixel[4];
+        unsigned int c;
+        for (c = 0; c < 4; c++) {
+            pixel[c] = (shuffle[c] & 0x80) != 0 ? 0 : from[shuffle[c]];
+        }
+        if (is_opaque) {
+            pixel[3] = 0xFF;
+        }
+        memcpy (dst + i * 4, pixel, 4);
+    }
+}
+
+/** Premultiply color by alpha with scalar code
+ * @param row pixels, premultiplied in place
+ * @param n number of pixels
+ */
+static void premultiply_row_scalar (unsigned char *row, size_t n)
+{
+    size_t i;
+    for (i = 0; i < n; i++) {
+        unsigned char *pixel = row + i * 4;
+        unsigned int c;
+        for (c = 0; c < 3; c++) {
+            /* Rounded division by 255 */
+            unsigned int t = (unsigned int)pixel[c] * pixel[3] + 128;
+            pixel[c] = (unsigned char)((t + (t >> 8)) >> 8);
+        }
+    }
+}
+
+/** Premultiply sRGB color by alpha in linear space with scalar code
+ * @param row pixels, premultiplied in place
+ * @param n number of pixels
+ */
+static void premultiply_srgb_row_scalar (unsigned char *row, size_t n)
+{
+    size_t i;
+    for (i = 0; i < n; i++) {
+        unsigned char *pixel = row + i * 4;
+        float alpha = (float)pixel[3] / 255.0f;
+        unsigned int c;
+        for (c = 0; c < 3; c++) {
+            pixel[c] = encode_srgb (srgb_to_linear[pixel[c]] * alpha);
+        }
+    }
+}
+
+/** Average 2x2 blocks of pixels with scalar code
+ * @param src0 the first source row
+ * @param src1 the second source row, same as src0 for 1-pixel high level
+ * @param src_width number of pixels in source rows
+ * @param dst receives destination row
+ * @param n number of pixels in destination row
+ */
+static void downsample_row_scalar (const unsigned char *src0,
+                                   const unsigned char *src1,
+                                   size_t src_width, unsigned char *dst,
+                                   size_t n)
+{
+    size_t x;
+    for (x = 0; x < n; x++) {
+        size_t left = x * 8;
+        size_t right = (2 * x + 1 < src_width ? 2 * x + 1 : src_width - 1) * 4;
+        unsigned int c;
+        for (c = 0; c < 4; c++) {
+            unsigned int sum = (unsigned int)src0[left + c] + src0[right + c]
+                               + src1[left + c] + src1[right + c];
+            dst[x * 4 + c] = (unsigned char)((sum + 2) >> 2);
+        }
+    }
+}
+
+/** Average 2x2 blocks of sRGB pixels in linear space with scalar code,
+ * see downsample_row_scalar() */
+static void downsample_srgb_row_scalar (const unsigned char *src0,
+                                        const unsigned char *src1,
+                                        size_t src_width, unsigned char *dst,
+                                        size_t n)
+{
+    size_t x;
+    for (x = 0; x < n; x++) {
+        size_t left = x * 8;
+        size_t right = (2 * x + 1 < src_width ? 2 * x + 1 : src_width - 1) * 4;
+        unsigned int c, sum;
+        for (c = 0; c < 3; c++) {
+            float linear = srgb_to_linear[src0[left + c]]
+                           + srgb_to_linear[src0[right + c]]
+                           + srgb_to_linear[src1[left + c]]
+                           + srgb_to_linear[src1[right + c]];
+            dst[x * 4 + c] = encode_srgb (linear * 0.25f);
+        }
+        sum = (unsigned int)src0[left + 3] + src0[right + 3] + src1[left + 3]
+              + src1[right + 3];
+        dst[x * 4 + 3] = (unsigned char)((sum + 2) >> 2);
+    }
+}
+
+#ifdef HAVE_X86_KERNELS
+/** Premultiply two pixels widened to 16 bits with SSE2
+ * @param wide pixels
+ * @param keep mask keeping color lanes
+ * @param one 255 in alpha lanes
+ * @param half 128 in all lanes
+ * @returns premultiplied pixels
+ */
+TARGET_SSE2 static __m128i premultiply2_sse2 (__m128i wide, __m128i keep,
+        __m128i one, __m128i half)
+{
+    __m128i alpha = _mm_shufflehi_epi16 (_mm_shufflelo_epi16 (wide, 0xFF),
+                                         0xFF);
+    __m128i t = _mm_add_epi16 (_mm_mullo_epi16 (wide,
+                               _mm_or_si128 (_mm_and_si128 (alpha, keep), one)),
+                               half);
+    return _mm_srli_epi16 (_mm_add_epi16 (t, _mm_srli_epi16 (t, 8)), 8);
+}
+
+/** Premultiply color by alpha with SSE2, see premultiply_row_scalar() */
+TARGET_SSE2 static void premultiply_row_sse2 (unsigned char *row, size_t n)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    __m128i keep = _mm_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1);
+    __m128i one = _mm_set_epi16 (255, 0, 0, 0, 255, 0, 0, 0);
+    __m128i half = _mm_set1_epi16 (128);
+    size_t i;
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i *pixels = (__m128i *) (row + i * 4);
+        __m128i packed = _mm_loadu_si128 (pixels);
+        __m128i lo = premultiply2_sse2 (_mm_unpacklo_epi8 (packed, zero), keep,
+                                        one, half);
+        __m128i hi = premultiply2_sse2 (_mm_unpackhi_epi8 (packed, zero), keep,
+                                        one, half);
+        _mm_storeu_si128 (pixels, _mm_packus_epi16 (lo, hi));
+    }
+    premultiply_row_scalar (row + i * 4, n - i);
+}
+
+/** Average 2x2 blocks of pixels with SSE2, see downsample_row_scalar() */
+TARGET_SSE2 static void downsample_row_sse2 (const unsigned char *src0,
+        const unsigned char *src1, size_t src_width, unsigned char *dst,
+        size_t n)
+{
+    __m128i zero = _mm_setzero_si128 ();
+    __m128i two = _mm_set1_epi16 (2);
+    size_t x;
+    for (x = 0; x + 2 <= n; x += 2) {
+        __m128i a = _mm_loadu_si128 ((const __m128i *) (src0 + x * 8));
+        __m128i b = _mm_loadu_si128 ((const __m128i *) (src1 + x * 8));
+        __m128i lo = _mm_add_epi16 (_mm_unpacklo_epi8 (a, zero),
+                                    _mm_unpacklo_epi8 (b, zero));
+        __m128i hi = _mm_add_epi16 (_mm_unpackhi_epi8 (a, zero),
+                                    _mm_unpackhi_epi8 (b, zero));
+        /* Left pixels of both blocks plus right ones */
+        __m128i sum = _mm_add_epi16 (_mm_unpacklo_epi64 (lo, hi),
+                                     _mm_unpackhi_epi64 (lo, hi));
+        sum = _mm_srli_epi16 (_mm_add_epi16 (sum, two), 2);
+        _mm_storel_epi64 ((__m128i *) (dst + x * 4),
+                          _mm_packus_epi16 (sum, sum));
+    }
+    downsample_row_scalar (src0 + x * 8, src1 + x * 8, src_width - x * 2,
+                           dst + x * 4, n - x);
+}
+
+/** Convert pixels of file with SSSE3, see convert_row_scalar() */
+TARGET_SSSE3 static void convert_row_ssse3 (const unsigned char *src,
+        unsigned char *dst, size_t n, unsigned int pixel_size,
+        const unsigned char *shuffle, int is_opaque)
+{
+    __m128i mask = _mm_loadu_si128 ((const __m128i *)shuffle);
+    __m128i alpha = is_opaque ? _mm_set1_epi32 (~0x00FFFFFF)
+                    : _mm_setzero_si128 ();
+    /* 16 bytes are loaded per 4 pixels, 24-bit rows stop 2 pixels early */
+    size_t margin = pixel_size == 3 ? 2 : 0;
+    size_t i;
+    for (i = 0; i + 4 + margin <= n; i += 4) {
+        __m128i pixels = _mm_loadu_si128 ((const __m128i *) (src + i *
+                                          pixel_size));
+        _mm_storeu_si128 ((__m128i *) (dst + i * 4),
+                          _mm_or_si128 (_mm_shuffle_epi8 (pixels, mask),
+                                        alpha));
+    }
+    convert_row_scalar (src + i * pixel_size, dst + i * 4, n - i, pixel_size,
+                        shuffle, is_opaque);
+}
+
+/** Convert pixels of file with AVX2, see convert_row_scalar() */
+TARGET_AVX2 static void convert_row_avx2 (const unsigned char *src,
+        unsigned char *dst, size_t n, unsigned int pixel_size,
+        const unsigned char *shuffle, int is_opaque)
+{
+    __m256i mask = _mm256_broadcastsi128_si256 (_mm_loadu_si128 (
+                       (const __m128i *)shuffle));
+    __m256i alpha = is_opaque ? _mm256_set1_epi32 (~0x00FFFFFF)
+                    : _mm256_setzero_si256 ();
+    size_t i = 0;
+    if (pixel_size == 4) {
+        for (; i + 8 <= n; i += 8) {
+            __m256i pixels = _mm256_loadu_si256 ((const __m256i *) (src + i *
+                                                 4));
+            _mm256_storeu_si256 ((__m256i *) (dst + i * 4),
+                                 _mm256_or_si256 (_mm256_shuffle_epi8 (pixels,
+                                                  mask), alpha));
+        }
+    } else {
+        /* Each lane gets 4 pixels, the second load ends 4 bytes past
+         * them */
+        for (; i + 10 <= n; i += 8) {
+            const unsigned char *from = src + i * 3;
+            __m256i pixels = _mm256_inserti128_si256 (_mm256_castsi128_si256 (
+                                 _mm_loadu_si128 ((const __m128i *)from)),
+                             _mm_loadu_si128 ((const __m128i *) (from + 12)), 1);
+            _mm256_storeu_si256 ((__m256i *) (dst + i * 4),
+                                 _mm256_or_si256 (_mm256_shuffle_epi8 (pixels,
+                                                  mask), alpha));
+        }
+    }
+    convert_row_ssse3 (src + i * pixel_size, dst + i * 4, n - i, pixel_size,
+                       shuffle, is_opaque);
+}
+
+/** Premultiply four pixels widened to 16 bits with AVX2, see
+ * premultiply2_sse2() */
+TARGET_AVX2 static __m256i premultiply4_avx2 (__m256i wide, __m256i keep,
+        __m256i one, __m256i half)
+{
+    __m256i alpha = _mm256_shufflehi_epi16 (_mm256_shufflelo_epi16 (wide,
+                                            0xFF), 0xFF);
+    __m256i t = _mm256_add_epi16 (_mm256_mullo_epi16 (wide,
+                                  _mm256_or_si256 (_mm256_and_si256 (alpha, keep),
+                                          one)), half);
+    return _mm256_srli_epi16 (_mm256_add_epi16 (t, _mm256_srli_epi16 (t, 8)),
+                              8);
+}
+
+/** Premultiply color by alpha with AVX2, see premultiply_row_scalar() */
+TARGET_AVX2 static void premultiply_row_avx2 (unsigned char *row, size_t n)
+{
+    __m256i zero = _mm256_setzero_si256 ();
+    __m256i keep = _mm256_set_epi16 (0, -1, -1, -1, 0, -1, -1, -1,
+                                     0, -1, -1, -1, 0, -1, -1, -1);
+    __m256i one = _mm256_set_epi16 (255, 0, 0, 0, 255, 0, 0, 0,
+                                    255, 0, 0, 0, 255, 0, 0, 0);
+    __m256i half = _mm256_set1_epi16 (128);
+    size_t i;
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i *pixels = (__m256i *) (row + i * 4);
+        __m256i packed = _mm256_loadu_si256 (pixels);
+        __m256i lo = premultiply4_avx2 (_mm256_unpacklo_epi8 (packed, zero),
+                                        keep, one, half);
+        __m256i hi = premultiply4_avx2 (_mm256_unpackhi_epi8 (packed, zero),
+                                        keep, one, half);
+        _mm256_storeu_si256 (pixels, _mm256_packus_epi16 (lo, hi));
+    }
+    premultiply_row_sse2 (row + i * 4, n - i);
+}
+
+/** Premultiply sRGB color by alpha in linear space with AVX2 gathers, see
+ * premultiply_srgb_row_scalar() */
+TARGET_AVX2 static void premultiply_srgb_row_avx2 (unsigned char *row,
+        size_t n)
+{
+    __m256 to_unit = _mm256_set1_ps (1.0f / 255.0f);
+    __m256 steps = _mm256_set1_ps ((float) (LINEAR_STEPS - 1));
+    size_t i;
+    for (i = 0; i + 2 <= n; i += 2) {
+        __m256i bytes = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 (
+                (const __m128i *) (row + i * 4)));
+        __m256 linear = _mm256_i32gather_ps (srgb_to_linear, bytes, 4);
+        __m256 alpha = _mm256_mul_ps (_mm256_cvtepi32_ps (
+                                          _mm256_shuffle_epi32 (bytes, 0xFF)), to_unit);
+        __m256i encoded = _mm256_i32gather_epi32 (linear_to_srgb,
+                          _mm256_cvtps_epi32 (_mm256_mul_ps (_mm256_mul_ps (linear,
+                                  alpha), steps)), 4);
+        __m256i packed;
+        encoded = _mm256_blend_epi32 (encoded, bytes, 0x88);
+        packed = _mm256_packus_epi16 (_mm256_packus_epi32 (encoded, encoded),
+                                      encoded);
+        _mm_storel_epi64 ((__m128i *) (row + i * 4),
+                          _mm_unpacklo_epi32 (_mm256_castsi256_si128 (packed),
+                                              _mm256_extracti128_si256 (packed, 1)));
+    }
+    premultiply_srgb_row_scalar (row + i * 4, n - i);
+}
+
+/** Average 2x2 blocks of pixels with AVX2, see downsample_row_scalar() */
+TARGET_AVX2 static void downsample_row_avx2 (const unsigned char *src0,
+        const unsigned char *src1, size_t src_width, unsigned char *dst,
+        size_t n)
+{
+    __m256i zero = _mm256_setzero_si256 ();
+    __m256i two = _mm256_set1_epi16 (2);
+    size_t x;
+    for (x = 0; x + 4 <= n; x += 4) {
+        __m256i a = _mm256_loadu_si256 ((const __m256i *) (src0 + x * 8));
+        __m256i b = _mm256_loadu_si256 ((const __m256i *) (src1 + x * 8));
+        __m256i lo = _mm256_add_epi16 (_mm256_unpacklo_epi8 (a, zero),
+                                       _mm256_unpacklo_epi8 (b, zero));
+        __m256i hi = _mm256_add_epi16 (_mm256_unpackhi_epi8 (a, zero),
+                                       _mm256_unpackhi_epi8 (b, zero));
+        __m256i sum = _mm256_add_epi16 (_mm256_unpacklo_epi64 (lo, hi),
+                                        _mm256_unpackhi_epi64 (lo, hi));
+        sum = _mm256_srli_epi16 (_mm256_add_epi16 (sum, two), 2);
+        /* Each lane holds two pixels, low halves of lanes are joined */
+        sum = _mm256_permute4x64_epi64 (_mm256_packus_epi16 (sum, sum), 0x08);
+        _mm_storeu_si128 ((__m128i *) (dst + x * 4),
+                          _mm256_castsi256_si128 (sum));
+    }
+    downsample_row_sse2 (src0 + x * 8, src1 + x * 8, src_width - x * 2,
+                         dst + x * 4, n - x);
+}
+
+/** Average 2x2 blocks of sRGB pixels in linear space with AVX2 gathers,
+ * see downsample_row_scalar() */
+TARGET_AVX2 static void downsample_srgb_row_avx2 (const unsigned char *src0,
+        const unsigned char *src1, size_t src_width, unsigned char *dst,
+        size_t n)
+{
+    __m128 quarter = _mm_set1_ps (0.25f);
+    __m128 steps = _mm_set1_ps ((float) (LINEAR_STEPS - 1));
+    __m128i two = _mm_set1_epi32 (2);
+    size_t x;
+    for (x = 0; (x < n) && (2 * x + 1 < src_width); x++) {
+        __m256i top = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 (
+                                                (const __m128i *) (src0 + x * 8)));
+        __m256i bottom = _mm256_cvtepu8_epi32 (_mm_loadl_epi64 (
+                (const __m128i *) (src1 + x * 8)));
+        __m256 sum = _mm256_add_ps (_mm256_i32gather_ps (srgb_to_linear, top,
+                                    4), _mm256_i32gather_ps (srgb_to_linear, bottom, 4));
+        __m256i raw = _mm256_add_epi32 (top, bottom);
+        __m128 linear = _mm_mul_ps (_mm_add_ps (_mm256_castps256_ps128 (sum),
+                                                _mm256_extractf128_ps (sum, 1)), quarter);
+        __m128i alpha = _mm_srli_epi32 (_mm_add_epi32 (_mm_add_epi32 (
+                                            _mm256_castsi256_si128 (raw),
+                                            _mm256_extracti128_si256 (raw, 1)), two), 2);
+        __m128i encoded = _mm_i32gather_epi32 (linear_to_srgb,
+                                               _mm_cvtps_epi32 (_mm_mul_ps (linear, steps)), 4);
+        int pixel;
+        encoded = _mm_blend_epi32 (encoded, alpha, 0x8);
+        pixel = _mm_cvtsi128_si32 (_mm_packus_epi16 (_mm_packus_epi32 (encoded,
+                                   encoded), encoded));
+        memcpy (dst + x * 4, &pixel, 4);
+    }
+    downsample_srgb_row_scalar (src0 + x * 8, src1 + x * 8, src_width - x * 2,
+                                dst + x * 4, n - x);
+}
+#endif
+
+/** Kernels used by decoding jobs */
+static image_kernels_t kernels = {
+    convert_row_scalar,
+    premultiply_row_scalar,
+    premultiply_srgb_row_scalar,
+    downsample_row_scalar,
+    downsample_srgb_row_scalar
+};
+
+/** Name of instruction set of selected kernels */
+static const char *isa = "scalar";
+
+/** Select the fastest kernels supported by CPU */
+static void select_kernels (void)
+{
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("sse2")) {
+        kernels.premultiply_row = premultiply_row_sse2;
+        kernels.downsample_row = downsample_row_sse2;
+        isa = "sse2";
+        if (__builtin_cpu_supports ("ssse3")) {
+            kernels.convert_row = convert_row_ssse3;
+            isa = "ssse3";
+        }
+        if (__builtin_cpu_supports ("avx2")) {
+            kernels.convert_row = convert_row_avx2;
+            kernels.premultiply_row = premultiply_row_avx2;
+            kernels.premultiply_srgb_row = premultiply_srgb_row_avx2;
+            kernels.downsample_row = downsample_row_avx2;
+            kernels.downsample_srgb_row = downsample_srgb_row_avx2;
+            isa = "avx2";
+        }
+    }
+#endif
+}
+
+/** Get size of mipmap level
+ * @param size size of level 0
+ * @param level mipmap level
+ * @returns size of level, at least 1
+ */
+static size_t level_extent (GLsizei size, unsigned int level)
+{
+    size >>= level;
+    return size > 0 ? (size_t)size : 1;
+}
+
+/** Get row of decoded level
+ * @param image decoded image
+ * @param level mipmap level
+ * @param row row counted from bottom
+ * @returns the first pixel of row
+ */
+static unsigned char *level_row (const decode_image_t *image,
+                                 unsigned int level, size_t row)
+{
+    return image->pixels + image->level_offsets[level]
+           + row * level_extent (image->source.width, level) * 4;
+}
+
+/** Describe pixel data of image and validate its size
+ * @param image image with data and data_size set
+ * @param width width in pixels
+ * @param height height in pixels
+ * @param stride distance between rows of data
+ * @param layout value of pixel_layout_t
+ * @returns 0 on success, -1 if image is too large or data is truncated
+ */
+static int set_layout (decode_image_t *image, unsigned long width,
+                       unsigned long height, size_t stride,
+                       pixel_layout_t layout)
+{
+    unsigned int p, c;
+    if ((width == 0) || (width > MAX_EXTENT) || (height == 0)
+            || (height > MAX_EXTENT)
+            || (!image->is_rle && (stride * height > image->data_size))) {
+        return -1;
+    }
+    image->source.width = (GLsizei)width;
+    image->source.height = (GLsizei)height;
+    image->stride = stride;
+    image->pixel_size = (layout == LAYOUT_RGB24) || (layout == LAYOUT_BGR24)
+                        ? 3 : 4;
+    image->is_opaque = layout_offsets[layout][3] < 0;
+    /* Red and blue are swapped by choosing their order in shuffle */
+    for (p = 0; p < 4; p++) {
+        for (c = 0; c < 4; c++) {
+            unsigned int component = (decode_flags & IMAGE_DECODE_BGRA) != 0
+                                     && (c < 3) ? 2 - c : c;
+            int offset = layout_offsets[layout][component];
+            image->shuffle[p * 4 + c] = offset < 0 ? 0x80 : (unsigned char) (p *
+                                        image->pixel_size + (unsigned int)offset);
+        }
+    }
+    return 0;
+}
+
+/** Parse header of binary PPM image
+ * @param image image receiving layout
+ * @param data contents of file
+ * @param size size of file
+ * @returns 0 on success, -1 if image is malformed or unsupported
+ */
+static int parse_ppm (decode_image_t *image, const unsigned char *data,
+                      size_t size)
+{
+    unsigned long fields[3];
+    size_t position = 2;
+    unsigned int i;
+    for (i = 0; i < 3; i++) {
+        /* Fields are separated by whitespace and comments */
+        while ((position < size) && (isspace (data[position])
+                                     || (data[position] == '#'))) {
+            if (data[position] == '#') {
+                while ((position < size) && (data[position] != '\n')) {
+                    position++;
+                }
+            } else {
+                position++;
+            }
+        }
+        if ((position == size) || !isdigit (data[position])) {
+            return -1;
+        }
+        fields[i] = 0;
+        while ((position < size) && isdigit (data[position])) {
+            fields[i] = fields[i] * 10 + (unsigned long) (data[position] - '0');
+            if (fields[i] > MAX_EXTENT) {
+                return -1;
+            }
+            position++;
+        }
+    }
+    /* Single whitespace separates maximum value from pixels */
+    if ((fields[2] != 255) || (position == size) || !isspace (data[position])) {
+        return -1;
+    }
+    position++;
+    image->data = data + position;
+    image->data_size = size - position;
+    image->is_top_down = 1;
+    return set_layout (image, fields[0], fields[1], fields[0] * 3,
+                       LAYOUT_RGB24);
+}
+
+/** Parse header of true-color TGA image, see parse_ppm() */
+static int parse_tga (decode_image_t *image, const unsigned char *data,
+                      size_t size)
+{
+    unsigned int type, bits, descriptor;
+    size_t offset;
+    pixel_layout_t layout;
+    if (size < TGA_HEADER_SIZE) {
+        return -1;
+    }
+    type = data[2];
+    bits = data[16];
+    descriptor = data[17];
+    offset = TGA_HEADER_SIZE + (size_t)data[0];
+    /* Color-mapped, grayscale and right-to-left images are not supported */
+    if ((data[1] != 0) || ((type != 2) && (type != 10))
+            || ((bits != 24) && (bits != 32)) || ((descriptor & 0x10) != 0)
+            || (offset > size)) {
+        return -1;
+    }
+    if (bits == 24) {
+        layout = LAYOUT_BGR24;
+    } else {
+        layout = (descriptor & 0x0F) == 8 ? LAYOUT_BGRA32 : LAYOUT_BGRX32;
+    }
+    image->data = data + offset;
+    image->data_size = size - offset;
+    image->is_top_down = (descriptor & 0x20) != 0;
+    image->is_rle = type == 10;
+    if (image->is_rle) {
+        /* Packets are expanded to 4 bytes per pixel before conversion */
+        layout = layout == LAYOUT_BGRA32 ? LAYOUT_BGRA32 : LAYOUT_BGRX32;
+    }
+    if (set_layout (image, read_u16 (data + 12), read_u16 (data + 14),
+                    read_u16 (data + 12) * (size_t) (bits / 8), layout) != 0) {
+        return -1;
+    }
+    /* Size of pixels in packets */
+    image->pixel_size = bits / 8;
+    return 0;
+}
+
+/** Parse header of uncompressed BMP image, see parse_ppm() */
+static int parse_bmp (decode_image_t *image, const unsigned char *data,
+                      size_t size)
+{
+    unsigned int offset, info_size, width, height, bits, compression;
+    pixel_layout_t layout;
+    if (size < BMP_HEADER_SIZE) {
+        return -1;
+    }
+    offset = read_u32 (data + 10);
+    info_size = read_u32 (data + 14);
+    width = read_u32 (data + 18);
+    height = read_u32 (data + 22);
+    bits = read_u16 (data + 28);
+    compression = read_u32 (data + 30);
+    if ((info_size < 40) || (read_u16 (data + 26) != 1)
+            || ((bits != 24) && (bits != 32)) || (offset > size)
+            || ((width & 0x80000000u) != 0)) {
+        return -1;
+    }
+    layout = bits == 24 ? LAYOUT_BGR24 : LAYOUT_BGRX32;
+    if ((compression == BMP_BITFIELDS) && (bits == 32)
+            && (size >= BMP_HEADER_SIZE + 12)) {
+        /* Only masks matching byte order of BI_RGB are supported, alpha
+         * mask is part of larger headers */
+        if ((read_u32 (data + 54) != 0x00FF0000u)
+                || (read_u32 (data + 58) != 0x0000FF00u)
+                || (read_u32 (data + 62) != 0x000000FFu)) {
+            return -1;
+        }
+        if ((info_size >= 56) && (size >= BMP_HEADER_SIZE + 16)
+                && (read_u32 (data + 66) == 0xFF000000u)) {
+            layout = LAYOUT_BGRA32;
+        }
+    } else if (compression != 0) {
+        return -1;
+    }
+    image->data = data + offset;
+    image->data_size = size - offset;
+    /* Negative height marks rows stored from top */
+    image->is_top_down = (height & 0x80000000u) != 0;
+    if (image->is_top_down) {
+        height = 0u - height;
+    }
+    return set_layout (image, width, height,
+                       ((size_t)width * (bits / 8) + 3) & ~(size_t)3, layout);
+}
+
+/** Store pixel of run-length encoded TGA image
+ * @param image image being expanded
+ * @param index index of pixel in order of file
+ * @param pixel pixel of file
+ */
+static void store_rle_pixel (decode_image_t *image, size_t index,
+                             const unsigned char *pixel)
+{
+    size_t width = (size_t)image->source.width;
+    size_t row = index / width;
+    if (image->is_top_down) {
+        row = (size_t)image->source.height - 1 - row;
+    }
+    memcpy (level_row (image, 0, row) + (index % width) * 4, pixel,
+            image->pixel_size);
+}
+
+/** Expand run-length encoded TGA image into level 0 of image
+ * @param image image with data of file
+ * @returns 0 on success, -1 if data is truncated
+ */
+static int expand_rle (decode_image_t *image)
+{
+    const unsigned char *data = image->data;
+    const unsigned char *end = image->data + image->data_size;
+    size_t n_pixels = (size_t)image->source.width *
+                      (size_t)image->source.height;
+    size_t size = image->pixel_size, i = 0, k;
+    while (i < n_pixels) {
+        size_t count;
+        int is_run;
+        if (data == end) {
+            return -1;
+        }
+        count = (size_t) (*data & 0x7F) + 1;
+        is_run = (*data & 0x80) != 0;
+        data++;
+        if ((count > n_pixels - i)
+                || ((size_t) (end - data) < (is_run ? size : count * size))) {
+            return -1;
+        }
+        for (k = 0; k < count; k++) {
+            store_rle_pixel (image, i + k, is_run ? data : data + k * size);
+        }
+        data += is_run ? size : count * size;
+        i += count;
+    }
+    return 0;
+}
+
+/** Build rows of mipmap level from the previous level
+ * @param image image being decoded
+ * @param level mipmap level, at least 1
+ * @param first the first row
+ * @param end row after the last one
+ */
+static void downsample_rows (const decode_image_t *image, unsigned int level,
+                             size_t first, size_t end)
+{
+    size_t src_width = level_extent (image->source.width, level - 1);
+    size_t src_height = level_extent (image->source.height, level - 1);
+    size_t width = level_extent (image->source.width, level);
+    size_t row;
+    for (row = first; row < end; row++) {
+        const unsigned char *src0 = level_row (image, level - 1, row * 2);
+        const unsigned char *src1 = level_row (image, level - 1,
+                                               row * 2 + 1 < src_height
+                                               ? row * 2 + 1 : src_height - 1);
+        if ((decode_flags & IMAGE_DECODE_SRGB) != 0) {
+            kernels.downsample_srgb_row (src0, src1, src_width,
+                                         level_row (image, level, row), width);
+        } else {
+            kernels.downsample_row (src0, src1, src_width,
+                                    level_row (image, level, row), width);
+        }
+    }
+}
+
+/** Decode band of image and build its mipmaps
+ *
+ * Band of BAND_ROWS rows aligned to BAND_ROWS covers whole rows of the
+ * first BAND_SHIFT levels. The last band of image to finish builds the
+ * rest.
+ * @param arg unused
+ * @param index index of job
+ */
+static void decode_band (void *arg, unsigned int index)
+{
+    const decode_job_t *job = &jobs[index];
+    decode_image_t *image = &images[job->image];
+    size_t width = (size_t)image->source.width;
+    size_t height = (size_t)image->source.height;
+    size_t first = job->first_row, end = first + job->n_rows, row;
+    unsigned int n_levels = image->source.n_levels;
+    unsigned int last_level = n_levels - 1, level;
+    (void)arg;
+    if (image->is_rle) {
+        if (expand_rle (image) != 0) {
+            image->status = -1;
+            return;
+        }
+        for (row = first; row < end; row++) {
+            kernels.convert_row (level_row (image, 0, row),
+                                 level_row (image, 0, row), width, 4,
+                                 image->shuffle, image->is_opaque);
+        }
+    } else {
+        for (row = first; row < end; row++) {
+            size_t src_row = image->is_top_down ? height - 1 - row : row;
+            kernels.convert_row (image->data + src_row * image->stride,
+                                 level_row (image, 0, row), width,
+                                 image->pixel_size, image->shuffle,
+                                 image->is_opaque);
+        }
+    }
+    if ((decode_flags & IMAGE_DECODE_PREMULTIPLY) != 0) {
+        for (row = first; row < end; row++) {
+            if ((decode_flags & IMAGE_DECODE_SRGB) != 0) {
+                kernels.premultiply_srgb_row (level_row (image, 0, row), width);
+            } else {
+                kernels.premultiply_row (level_row (image, 0, row), width);
+            }
+        }
+    }
+    if ((image->n_bands > 1) && (last_level > BAND_SHIFT)) {
+        last_level = BAND_SHIFT;
+    }
+    for (level = 1; level <= last_level; level++) {
+        downsample_rows (image, level, first >> level,
+                         end == height ? level_extent (image->source.height,
+                                 level) : end >> level);
+    }
+    if ((image->n_bands > 1)
+            && (__atomic_sub_fetch (&image->n_bands_left, 1, __ATOMIC_ACQ_REL)
+                == 0)) {
+        for (level = last_level + 1; level < n_levels; level++) {
+            downsample_rows (image, level, 0,
+                             level_extent (image->source.height, level));
+        }
+    }
+}
+
+/** Unmap file of image
+ * @param image image whose file is mapped or not
+ */
+static void unmap_image (decode_image_t *image)
+{
+    if (image->mapping != NULL) {
+        munmap (image->mapping, image->mapping_size);
+        image->mapping = NULL;
+    }
+}
+
+/** Map image file, parse its header and allocate its levels
+ * @param image image receiving file
+ * @param path path to file
+ * @returns 0 on success, -1 on failure
+ */
+static int open_image (decode_image_t *image, const char *path)
+{
+    struct stat status;
+    texture_source_t *source = &image->source;
+    const unsigned char *data;
+    size_t size, total = 0;
+    unsigned int level;
+    int err, fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if ((fstat (fd, &status) != 0) || (status.st_size <= 0)) {
+        close (fd);
+        return -1;
+    }
+    size = (size_t)status.st_size;
+    image->mapping = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    if (image->mapping == MAP_FAILED) {
+        image->mapping = NULL;
+        return -1;
+    }
+    image->mapping_size = size;
+    /* Read-ahead starts now and proceeds while EGL initializes */
+    madvise (image->mapping, size, MADV_WILLNEED);
+    data = (const unsigned char *)image->mapping;
+    if ((size >= 2) && (data[0] == 'P') && (data[1] == '6')) {
+        err = parse_ppm (image, data, size);
+    } else if ((size >= 2) && (data[0] == 'B') && (data[1] == 'M')) {
+        err = parse_bmp (image, data, size);
+    } else {
+        /* TGA has no signature */
+        err = parse_tga (image, data, size);
+    }
+    if (err != 0) {
+        unmap_image (image);
+        return -1;
+    }
+    source->n_levels = 1;
+    if ((decode_flags & IMAGE_DECODE_MIPMAPS) != 0) {
+        while ((source->width >> source->n_levels != 0)
+                || (source->height >> source->n_levels != 0)) {
+            source->n_levels++;
+        }
+    }
+    for (level = 0; level < source->n_levels; level++) {
+        image->level_offsets[level] = total;
+        total += level_extent (source->width, level) *
+                 level_extent (source->height, level) * 4;
+    }
+    image->pixels = (unsigned char *)malloc (total);
+    if (image->pixels == NULL) {
+        unmap_image (image);
+        return -1;
+    }
+    for (level = 0; level < source->n_levels; level++) {
+        source->levels[level] = image->pixels + image->level_offsets[level];
+    }
+    if ((decode_flags & IMAGE_DECODE_SRGB) != 0) {
+        source->internal_format = GL_SRGB8_ALPHA8;
+    } else {
+        source->internal_format = GL_RGBA8;
+    }
+    if ((decode_flags & IMAGE_DECODE_BGRA) != 0) {
+        source->format = GL_BGRA;
+        source->type = GL_UNSIGNED_INT_8_8_8_8_REV;
+    } else {
+        source->format = GL_RGBA;
+        source->type = GL_UNSIGNED_BYTE;
+    }
+    source->pixel_size = 4;
+    source->block_size = 0;
+    /* Packets of run-length encoded image are found only sequentially */
+    image->n_bands = image->is_rle ? 1 : ((unsigned int)source->height
+                                          + BAND_ROWS - 1) / BAND_ROWS;
+    image->n_bands_left = image->n_bands;
+    image->status = 0;
+    return 0;
+}
+
+int image_decode_start (const char *const *paths, unsigned int n_images,
+                        unsigned int flags)
+{
+    unsigned int i, n_jobs = 0, job = 0;
+    if (images != NULL) {
+        return -1;
+    }
+    images = (decode_image_t *)calloc (n_images != 0 ? n_images : 1,
+                                       sizeof (decode_image_t));
+    if (images == NULL) {
+        return -1;
+    }
+    select_kernels ();
+    if (((flags & IMAGE_DECODE_SRGB) != 0) && !has_srgb_tables) {
+        build_srgb_tables ();
+    }
+    n_image_count = n_images;
+    decode_flags = flags;
+    for (i = 0; i < n_images; i++) {
+        if (open_image (&images[i], paths[i]) == 0) {
+            n_jobs += images[i].n_bands;
+        } else {
+            images[i].status = -1;
+        }
+    }
+    jobs = (decode_job_t *)malloc ((n_jobs != 0 ? n_jobs : 1) *
+                                   sizeof (decode_job_t));
+    if (jobs == NULL) {
+        image_decode_shutdown ();
+        return -1;
+    }
+    for (i = 0; i < n_images; i++) {
+        unsigned int height = (unsigned int)images[i].source.height, band;
+        for (band = 0; band < images[i].n_bands; band++) {
+            jobs[job].image = i;
+            jobs[job].first_row = band * BAND_ROWS;
+            jobs[job].n_rows = images[i].is_rle ? height
+                               : height - band * BAND_ROWS < BAND_ROWS
+                               ? height - band * BAND_ROWS : BAND_ROWS;
+            job++;
+        }
+    }
+    workers_begin (&batch, decode_band, NULL, n_jobs);
+    is_decoding = 1;
+    return 0;
+}
+
+void image_decode_wait (void)
+{
+    unsigned int i;
+    if (!is_decoding) {
+        return;
+    }
+    workers_wait (&batch);
+    is_decoding = 0;
+    for (i = 0; i < n_image_count; i++) {
+        unmap_image (&images[i]);
+    }
+}
+
+const texture_source_t *image_decode_get (unsigned int index)
+{
+    if ((images == NULL) || is_decoding || (index >= n_image_count)
+            || (images[index].status != 0)) {
+        return NULL;
+    }
+    return &images[index].source;
+}
+
+void image_decode_shutdown (void)
+{
+    unsigned int i;
+    image_decode_wait ();
+    if (images == NULL) {
+        return;
+    }
+    for (i = 0; i < n_image_count; i++) {
+        unmap_image (&images[i]);
+        free (images[i].pixels);
+    }
+    free (images);
+    images = NULL;
+    free (jobs);
+    jobs = NULL;
+    n_image_count = 0;
+}
+
+const char *image_decode_isa (void)
+{
+    return isa;
+}
@@ -0,0 +1,312 @@
+/**
+ * @file ktx_file.c
+ * This module contains loading of KTX2 textures by mapping them into
+ * memory.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "gl_procs.h"
+#include "ktx_file.h"
+
+/** Size of file identifier */
+#define IDENTIFIER_SIZE 12
+
+/** Offset of vkFormat field */
+#define VK_FORMAT_OFFSET 12
+
+/** Offset of pixelWidth field, followed by pixelHeight, pixelDepth,
+ * layerCount, faceCount, levelCount and supercompressionScheme */
+#define PIXEL_WIDTH_OFFSET 20
+
+/** Offset of level index, which follows header and index of other data */
+#define LEVEL_INDEX_OFFSET 80
+
+/** Size of entry of level index: byteOffset, byteLength and
+ * uncompressedByteLength, 64 bits each */
+#define LEVEL_ENTRY_SIZE 24
+
+/** Largest accepted width or height */
+#define MAX_EXTENT 65536
+
+/** Extensions or versions that provide formats */
+typedef enum ktx_family_t {
+    FAMILY_PLAIN, /**< Uncompressed, always supported */
+    FAMILY_RGTC, /**< RGTC, core since OpenGL 3.0 */
+    FAMILY_BPTC, /**< BPTC, core since OpenGL 4.2 */
+    FAMILY_ETC2 /**< ETC2 and EAC, core since OpenGL 4.3 */
+} ktx_family_t;
+
+/** Format of KTX2 file and its OpenGL equivalent */
+typedef struct ktx_format_t {
+    const char *name; /**< Name for messages */
+    GLuint vk_format; /**< Value of VkFormat */
+    GLenum internal_format; /**< Internal format of storage */
+    GLenum format; /**< Format of pixels, GL_NONE if compressed */
+    GLenum type; /**< Type of pixel components, GL_NONE if compressed */
+    unsigned int pixel_size; /**< Size of pixel, 0 if compressed */
+    unsigned int block_size; /**< Size of 4x4 block, 0 if uncompressed */
+    int family; /**< Value of ktx_family_t */
+    char padding[4];
+} ktx_format_t;
+
+/** Supported formats */
+static const ktx_format_t formats[] = {
+    {"RGBA8", 37, GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, 0, FAMILY_PLAIN, ""},
+    {
+        "sRGB8 A8", 43, GL_SRGB8_ALPHA8, GL_RGBA, GL_UNSIGNED_BYTE, 4, 0,
+        FAMILY_PLAIN, ""
+    },
+    {
+        "BC4", 139, GL_COMPRESSED_RED_RGTC1, GL_NONE, GL_NONE, 0, 8,
+        FAMILY_RGTC, ""
+    },
+    {
+        "BC4 signed", 140, GL_COMPRESSED_SIGNED_RED_RGTC1, GL_NONE, GL_NONE,
+        0, 8, FAMILY_RGTC, ""
+    },
+    {
+        "BC5", 141, GL_COMPRESSED_RG_RGTC2, GL_NONE, GL_NONE, 0, 16,
+        FAMILY_RGTC, ""
+    },
+    {
+        "BC5 signed", 142, GL_COMPRESSED_SIGNED_RG_RGTC2, GL_NONE, GL_NONE, 0,
+        16, FAMILY_RGTC, ""
+    },
+    {
+        "BC6H", 143, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT, GL_NONE, GL_NONE,
+        0, 16, FAMILY_BPTC, ""
+    },
+    {
+        "BC6H signed", 144, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT, GL_NONE,
+        GL_NONE, 0, 16, FAMILY_BPTC, ""
+    },
+    {
+        "BC7", 145, GL_COMPRESSED_RGBA_BPTC_UNORM, GL_NONE, GL_NONE, 0, 16,
+        FAMILY_BPTC, ""
+    },
+    {
+        "BC7 sRGB", 146, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, GL_NONE, GL_NONE,
+        0, 16, FAMILY_BPTC, ""
+    },
+    {
+        "ETC2 RGB8", 147, GL_COMPRESSED_RGB8_ETC2, GL_NONE, GL_NONE, 0, 8,
+        FAMILY_ETC2, ""
+    },
+    {
+        "ETC2 sRGB8", 148, GL_COMPRESSED_SRGB8_ETC2, GL_NONE, GL_NONE, 0, 8,
+        FAMILY_ETC2, ""
+    },
+    {
+        "ETC2 RGB8 A1", 149, GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2,
+        GL_NONE, GL_NONE, 0, 8, FAMILY_ETC2, ""
+    },
+    {
+        "ETC2 sRGB8 A1", 150, GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2,
+        GL_NONE, GL_NONE, 0, 8, FAMILY_ETC2, ""
+    },
+    {
+        "ETC2 RGBA8", 151, GL_COMPRESSED_RGBA8_ETC2_EAC, GL_NONE, GL_NONE, 0,
+        16, FAMILY_ETC2, ""
+    },
+    {
+        "ETC2 sRGB8 A8", 152, GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC, GL_NONE,
+        GL_NONE, 0, 16, FAMILY_ETC2, ""
+    },
+    {
+        "EAC R11", 153, GL_COMPRESSED_R11_EAC, GL_NONE, GL_NONE, 0, 8,
+        FAMILY_ETC2, ""
+    },
+    {
+        "EAC R11 signed", 154, GL_COMPRESSED_SIGNED_R11_EAC, GL_NONE, GL_NONE,
+        0, 8, FAMILY_ETC2, ""
+    },
+    {
+        "EAC RG11", 155, GL_COMPRESSED_RG11_EAC, GL_NONE, GL_NONE, 0, 16,
+        FAMILY_ETC2, ""
+    },
+    {
+        "EAC RG11 signed", 156, GL_COMPRESSED_SIGNED_RG11_EAC, GL_NONE,
+        GL_NONE, 0, 16, FAMILY_ETC2, ""
+    }
+};
+
+/** Identifier at the start of every KTX2 file */
+static const unsigned char identifier[IDENTIFIER_SIZE] = {
+    0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+};
+
+/** Read little endian 32-bit value
+ * @param data first byte of value
+ * @returns value
+ */
+static GLuint read_u32 (const unsigned char *data)
+{
+    return (GLuint)data[0] | ((GLuint)data[1] << 8) | ((GLuint)data[2] << 16)
+           | ((GLuint)data[3] << 24);
+}
+
+/** Read little endian 64-bit value
+ * @param data first byte of value
+ * @returns value
+ */
+static GLuint64 read_u64 (const unsigned char *data)
+{
+    return (GLuint64)read_u32 (data) | ((GLuint64)read_u32 (data + 4) << 32);
+}
+
+/** Find format by its VkFormat value
+ * @param vk_format value of VkFormat
+ * @returns format, NULL if it isn't supported
+ */
+static const ktx_format_t *find_format (GLuint vk_format)
+{
+    size_t i;
+    for (i = 0; i < sizeof (formats) / sizeof (formats[0]); i++) {
+        if (formats[i].vk_format == vk_format) {
+            return &formats[i];
+        }
+    }
+    return NULL;
+}
+
+/** Get size of level in bytes as stored in file
+ * @param source texture with format and size of level 0 set
+ * @param level mipmap level
+ * @returns size of level in bytes
+ */
+static GLuint64 level_size (const texture_source_t *source,
+                            unsigned int level)
+{
+    GLuint64 width = (GLuint64) (source->width >> level);
+    GLuint64 height = (GLuint64) (source->height >> level);
+    width = width > 0 ? width : 1;
+    height = height > 0 ? height : 1;
+    if (source->block_size != 0) {
+        return ((width + 3) / 4) * ((height + 3) / 4) * source->block_size;
+    }
+    return width * height * source->pixel_size;
+}
+
+int ktx_file_from_memory (ktx_file_t *file, const void *data, size_t size)
+{
+    const unsigned char *bytes = (const unsigned char *)data;
+    const unsigned char *fields = bytes + PIXEL_WIDTH_OFFSET;
+    const ktx_format_t *format;
+    texture_source_t *source = &file->source;
+    GLuint width, height, n_levels;
+    unsigned int i;
+    if ((size < LEVEL_INDEX_OFFSET)
+            || (memcmp (bytes, identifier, IDENTIFIER_SIZE) != 0)) {
+        return -1;
+    }
+    format = find_format (read_u32 (bytes + VK_FORMAT_OFFSET));
+    width = read_u32 (fields);
+    height = read_u32 (fields + 4);
+    n_levels = read_u32 (fields + 20);
+    n_levels = n_levels != 0 ? n_levels : 1;
+    /* Only 2D textures: no depth, array layers, cube faces or
+     * supercompression */
+    if ((format == NULL) || (width == 0) || (width > MAX_EXTENT)
+            || (height == 0) || (height > MAX_EXTENT)
+            || (read_u32 (fields + 8) != 0) || (read_u32 (fields + 12) != 0)
+            || (read_u32 (fields + 16) != 1) || (read_u32 (fields + 24) != 0)
+            || (n_levels > TEXTURE_MAX_LEVELS)
+            || (((width > height ? width : height) >> (n_levels - 1)) == 0)
+            || (size - LEVEL_INDEX_OFFSET < n_levels * LEVEL_ENTRY_SIZE)) {
+        return -1;
+    }
+    memset (source, 0, sizeof (*source));
+    source->width = (GLsizei)width;
+    source->height = (GLsizei)height;
+    source->internal_format = format->internal_format;
+    source->format = format->format;
+    source->type = format->type;
+    source->n_levels = n_levels;
+    source->pixel_size = format->pixel_size;
+    source->block_size = format->block_size;
+    for (i = 0; i < n_levels; i++) {
+        const unsigned char *entry = bytes + LEVEL_INDEX_OFFSET
+                                     + i * LEVEL_ENTRY_SIZE;
+        GLuint64 offset = read_u64 (entry);
+        GLuint64 length = read_u64 (entry + 8);
+        if ((length != level_size (source, i)) || (offset > size)
+                || (length > size - offset)) {
+            return -1;
+        }
+        source->levels[i] = bytes + offset;
+    }
+    file->format_name = format->name;
+    file->mapping = NULL;
+    file->size = size;
+    return 0;
+}
+
+int ktx_file_open (ktx_file_t *file, const char *path)
+{
+    struct stat status;
+    void *mapping;
+    int fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if ((fstat (fd, &status) != 0) || (status.st_size <= 0)) {
+        close (fd);
+        return -1;
+    }
+    /* Not prefaulted, fine levels are paged in only once they are
+     * streamed */
+    mapping = mmap (NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, fd,
+                    0);
+    close (fd);
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+    if (ktx_file_from_memory (file, mapping, (size_t)status.st_size) != 0) {
+        munmap (mapping, (size_t)status.st_size);
+        return -1;
+    }
+    file->mapping = mapping;
+    return 0;
+}
+
+void ktx_file_close (ktx_file_t *file)
+{
+    if (file->mapping != NULL) {
+        munmap (file->mapping, file->size);
+    }
+    memset (file, 0, sizeof (*file));
+}
+
+int ktx_file_is_supported (const ktx_file_t *file)
+{
+    const ktx_format_t *format = NULL;
+    size_t i;
+    for (i = 0; i < sizeof (formats) / sizeof (formats[0]); i++) {
+        if (formats[i].internal_format == file->source.internal_format) {
+            format = &formats[i];
+        }
+    }
+    if (format == NULL) {
+        return 0;
+    }
+    switch ((ktx_family_t)format->family) {
+    case FAMILY_PLAIN:
+        return 1;
+    case FAMILY_RGTC:
+        return gl_version_at_least (3, 0);
+    case FAMILY_BPTC:
+        return gl_version_at_least (4, 2)
+               || gl_has_extension ("GL_ARB_texture_compression_bptc");
+    case FAMILY_ETC2:
+        return gl_version_at_least (4, 3)
+               || gl_has_extension ("GL_ARB_ES3_compatibility");
+    default:
+        return 0;
+    }
+}
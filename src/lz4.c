@@ -0,0 +1,200 @@
+/**
+ * @file lz4.c
+ * This module contains compression and decompression of raw LZ4 blocks.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <string.h>
+#include "lz4.h"
+
+/** Number of bits of index of match finder table */
+#define HASH_LOG 12
+
+/** Shortest match encoded by block format */
+#define MIN_MATCH 4
+
+/** Number of bytes at end of block that must be literals */
+#define LAST_LITERALS 5
+
+/** Distance from end of block where the last match may start */
+#define MATCH_FIND_LIMIT 12
+
+/** Largest distance of match */
+#define MAX_OFFSET 65535
+
+/** Value of length nibble that is continued by extra bytes */
+#define LENGTH_MASK 15
+
+/** Hash four bytes for lookup in match finder table
+ * @param p bytes to hash
+ * @returns index in match finder table
+ */
+static unsigned int hash4 (const unsigned char *p)
+{
+    unsigned long v = (unsigned long)p[0] | (unsigned long)p[1] << 8
+                      | (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+    return (unsigned int) (((v * 2654435761ul) & 0xFFFFFFFFul)
+                           >> (32 - HASH_LOG));
+}
+
+/** Write continuation bytes of length
+ * @param out output block
+ * @param op position in output block
+ * @param length length left after nibble of token
+ * @returns position after written bytes
+ */
+static size_t emit_length (unsigned char *out, size_t op, size_t length)
+{
+    while (length >= 255) {
+        out[op++] = 255;
+        length -= 255;
+    }
+    out[op++] = (unsigned char)length;
+    return op;
+}
+
+/** Write sequence of literals followed by match
+ * @param out output block
+ * @param op position in output block
+ * @param literals literals of sequence
+ * @param n_literals number of literals
+ * @param offset distance of match
+ * @param match_length length of match, 0 for the last sequence
+ * @returns position after written sequence
+ */
+static size_t emit_sequence (unsigned char *out, size_t op,
+                             const unsigned char *literals, size_t n_literals,
+                             size_t offset, size_t match_length)
+{
+    size_t token = op++;
+    size_t extra;
+    out[token] = (unsigned char) ((n_literals >= LENGTH_MASK ? LENGTH_MASK :
+                                   n_literals) << 4);
+    if (n_literals >= LENGTH_MASK) {
+        op = emit_length (out, op, n_literals - LENGTH_MASK);
+    }
+    memcpy (out + op, literals, n_literals);
+    op += n_literals;
+    if (match_length == 0) {
+        return op;
+    }
+    out[op++] = (unsigned char) (offset & 0xFF);
+    out[op++] = (unsigned char) (offset >> 8);
+    extra = match_length - MIN_MATCH;
+    out[token] = (unsigned char) (out[token]
+                                  | (extra >= LENGTH_MASK ? LENGTH_MASK : extra));
+    if (extra >= LENGTH_MASK) {
+        op = emit_length (out, op, extra - LENGTH_MASK);
+    }
+    return op;
+}
+
+size_t lz4_bound (size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t lz4_compress (const void *src, size_t src_size, void *dst,
+                     size_t dst_capacity)
+{
+    const unsigned char *in = (const unsigned char *)src;
+    unsigned char *out = (unsigned char *)dst;
+    size_t table[1 << HASH_LOG];
+    size_t anchor = 0, pos = 0, op = 0;
+    if (dst_capacity < lz4_bound (src_size)) {
+        return 0;
+    }
+    memset (table, 0, sizeof (table));
+    while (pos + MATCH_FIND_LIMIT <= src_size) {
+        unsigned int h = hash4 (in + pos);
+        size_t candidate = table[h];
+        table[h] = pos;
+        if ((candidate < pos) && (pos - candidate <= MAX_OFFSET)
+                && (memcmp (in + candidate, in + pos, MIN_MATCH) == 0)) {
+            size_t offset = pos - candidate;
+            size_t end = pos + MIN_MATCH;
+            while ((end < src_size - LAST_LITERALS)
+                    && (in[end] == in[end - offset])) {
+                end++;
+            }
+            op = emit_sequence (out, op, in + anchor, pos - anchor, offset,
+                                end - pos);
+            pos = end;
+            anchor = end;
+        } else {
+            pos++;
+        }
+    }
+    return emit_sequence (out, op, in + anchor, src_size - anchor, 0, 0);
+}
+
+/** Read continuation bytes of length
+ * @param in input block
+ * @param size size of input block
+ * @param ip position in input block, advanced past read bytes
+ * @param length nibble of token, receives full length
+ * @returns 0 on success, -1 if block ends inside length
+ */
+static int read_length (const unsigned char *in, size_t size, size_t *ip,
+                        size_t *length)
+{
+    unsigned int byte;
+    if (*length != LENGTH_MASK) {
+        return 0;
+    }
+    do {
+        if (*ip >= size) {
+            return -1;
+        }
+        byte = in[(*ip)++];
+        *length += byte;
+    } while (byte == 255);
+    return 0;
+}
+
+int lz4_decompress (const void *src, size_t src_size, void *dst,
+                    size_t dst_size)
+{
+    const unsigned char *in = (const unsigned char *)src;
+    unsigned char *out = (unsigned char *)dst;
+    size_t ip = 0, op = 0;
+    while (ip < src_size) {
+        unsigned int token = in[ip++];
+        size_t length = token >> 4;
+        size_t offset, i;
+        if ((read_length (in, src_size, &ip, &length) != 0)
+                || (length > src_size - ip) || (length > dst_size - op)) {
+            return -1;
+        }
+        memcpy (out + op, in + ip, length);
+        ip += length;
+        op += length;
+        if (ip == src_size) {
+            /* The last sequence has literals only */
+            break;
+        }
+        if (src_size - ip < 2) {
+            return -1;
+        }
+        offset = (size_t)in[ip] | (size_t)in[ip + 1] << 8;
+        ip += 2;
+        length = token & LENGTH_MASK;
+        if ((offset == 0) || (offset > op)
+                || (read_length (in, src_size, &ip, &length) != 0)
+                || (length + MIN_MATCH > dst_size - op)) {
+            return -1;
+        }
+        length += MIN_MATCH;
+        if (offset >= length) {
+            memcpy (out + op, out + op - offset, length);
+        } else {
+            /* Overlapping match repeats the last offset bytes */
+            for (i = 0; i < length; i++) {
+                out[op + i] = out[op + i - offset];
+            }
+        }
+        op += length;
+    }
+    return op == dst_size ? 0 : -1;
+}
@@ -10,10 +10,90 @@
 #include <stdio.h>
 #include <string.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
 #include <EGL/egl.h>
-#include <GL/gl.h>
+#include "gl_procs.h"
+#include "thread_policy.h"
+#include "workers.h"
+#include "frame_arena.h"
+#include "monotonic.h"
+#include "gpu_timer.h"
+#include "gl_debug.h"
+#include "gl_state.h"
+#include "draw_queue.h"
+#include "scene.h"
+#include "math3d.h"
+#include "mesh_file.h"
+#include "asset_pack.h"
+#include "texture_stream.h"
+#include "gl_loader.h"
+#include "texture_residency.h"
+#include "ktx_file.h"
+#include "image_decode.h"
+#include "gpu_memory.h"
+#ifdef HAVE_ALLOC_HOOKS
+#include "alloc_hooks.h"
+#endif
+
+/** Number of bytes each frame may allocate from frame arena */
+#define FRAME_ARENA_SIZE ((size_t)4 << 20)
+
+/** Maximum number of draws submitted in single frame */
+#define MAX_DRAWS 32768
+
+/** Default number of objects in built-in scene */
+#define DEFAULT_OBJECTS 10000
+
+/** Default number of frames that may allocate before steady state */
+#define DEFAULT_WARMUP_FRAMES 10
+
+/** Number of call sites printed by heap allocation report */
+#define ALLOC_REPORT_CALLSITES 20
+
+/** Interval between statistics reports in milliseconds */
+#define STATS_INTERVAL_MS 1000.0
+
+/** Default number of KiB of texture data uploaded per frame */
+#define DEFAULT_UPLOAD_BUDGET_KIB 4096
+
+/** Default time spent staging texture data per frame in milliseconds */
+#define DEFAULT_UPLOAD_BUDGET_MS 2.0
+
+/** Maximum number of texture images queued for upload */
+#define MAX_TEXTURE_UPLOADS 256
+
+/** Default budget of resident texture levels in MiB */
+#define DEFAULT_TEXTURE_BUDGET_MIB 256
+
+/** Maximum number of textures with streamed levels */
+#define MAX_TEXTURES 1024
+
+/** Maximum number of images given with --image */
+#define MAX_IMAGES 16
+
+/** Images are sRGB color with alpha, blended premultiplied and sampled
+ * with mipmaps */
+#define IMAGE_DECODE_FLAGS (IMAGE_DECODE_BGRA | IMAGE_DECODE_PREMULTIPLY \
+                            | IMAGE_DECODE_SRGB | IMAGE_DECODE_MIPMAPS)
+
+/** Maximum number of tracked buffer and texture allocations */
+#define MAX_GPU_ALLOCATIONS 4096
+
+/** Maximum number of jobs of GL loader thread in flight */
+#define MAX_GL_LOADER_JOBS 64
+
+/** Maximum number of reported phases of startup */
+#define MAX_STARTUP_PHASES 8
+
+#ifndef EGL_CONTEXT_FLAGS_KHR
+#define EGL_CONTEXT_FLAGS_KHR 0x30FC
+#endif
+#ifndef EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR
+#define EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR 0x00000001
+#endif
 
 /** Window type */
 typedef struct game_window_t {
@@ -26,6 +106,12 @@ typedef struct game_window_t {
     char padding[4];
 } game_window_t;
 
+/** Phase of startup and its duration */
+typedef struct startup_phase_t {
+    const char *name; /**< Name of phase */
+    double ms; /**< Duration of phase in milliseconds */
+} startup_phase_t;
+
 /** Single application's main window */
 static game_window_t *main_window = NULL;
 
@@ -35,6 +121,127 @@ static const char *program_name;
 /** Flag that indicates to be verbose as possible */
 static int verbose = 0;
 
+/** Number of worker threads, negative to use one less than online CPUs */
+static long n_workers = -1;
+
+/** CPUs the render thread is pinned to */
+static cpu_set_t render_cpus;
+
+/** Non-zero if render thread should be pinned to render_cpus */
+static int pin_render = 0;
+
+/** CPUs worker threads are pinned to */
+static cpu_set_t worker_cpus;
+
+/** Non-zero if worker threads should be pinned to worker_cpus */
+static int pin_workers = 0;
+
+/** Real-time scheduling policy of render thread, SCHED_OTHER if disabled */
+static int render_policy = SCHED_OTHER;
+
+/** Real-time priority of render thread, 0 to use the lowest one */
+static int render_priority = 0;
+
+/** Number of frames to render before exit, 0 to run until window closed */
+static long max_frames = 0;
+
+/** Non-zero if heap allocations in steady-state loop should fail the run */
+static int check_allocations = 0;
+
+/** Number of frames after which main loop is expected not to allocate */
+static long warmup_frames = DEFAULT_WARMUP_FRAMES;
+
+/** Non-zero if heap allocations should be attributed to call sites */
+static int track_allocations = 0;
+
+/** Non-zero if frame statistics should be printed periodically */
+static int show_stats = 0;
+
+/** Non-zero if debug context should be created and its messages printed */
+static int debug_context = 0;
+
+/** Name of built-in scene to render, NULL if none */
+static const char *scene_name = NULL;
+
+/** Number of objects in built-in scene */
+static long scene_objects = DEFAULT_OBJECTS;
+
+/** Path to mesh file drawn by static scene, NULL for built-in cube */
+static const char *mesh_path = NULL;
+
+/** Mesh of scene, kept until loader has uploaded it */
+static mesh_file_t scene_mesh = { NULL, NULL, NULL, NULL, 0 };
+
+/** Contents of mesh unpacked from asset pack, NULL if not needed */
+static void *scene_mesh_data = NULL;
+
+/** Path to KTX2 texture streamed by texture residency, NULL if none */
+static const char *texture_path = NULL;
+
+/** Texture opened from texture_path */
+static ktx_file_t texture_file;
+
+/** Contents of texture unpacked from asset pack, NULL if not needed */
+static void *texture_data = NULL;
+
+/** Paths to images decoded while EGL initializes */
+static const char *image_paths[MAX_IMAGES];
+
+/** Number of images */
+static unsigned int n_image_paths = 0;
+
+/** Handles of texture and images in texture residency, sampled by cubes
+ * of scene */
+static int texture_handles[MAX_IMAGES + 1];
+
+/** Number of texture handles */
+static unsigned int n_texture_handles = 0;
+
+/** Path to asset pack, NULL if none */
+static const char *assets_path = NULL;
+
+/** Asset pack opened during bootstrap */
+static asset_pack_t assets;
+
+/** Thread that opens asset pack while EGL initializes */
+static pthread_t assets_thread;
+
+/** Non-zero if assets_thread has to be joined */
+static int is_opening_assets = 0;
+
+/** Result of opening asset pack */
+static int assets_status = -1;
+
+/** Time spent opening asset pack */
+static double assets_ms = 0.0;
+
+/** Phases of startup completed so far */
+static startup_phase_t startup_phases[MAX_STARTUP_PHASES];
+
+/** Number of completed phases of startup */
+static unsigned int n_startup_phases = 0;
+
+/** Time when current phase of startup began */
+static double startup_phase_start = 0.0;
+
+/** Number of KiB of texture data uploaded per frame */
+static long upload_budget_kib = DEFAULT_UPLOAD_BUDGET_KIB;
+
+/** Time spent staging texture data per frame in milliseconds */
+static double upload_budget_ms = DEFAULT_UPLOAD_BUDGET_MS;
+
+/** Budget of resident texture levels in MiB */
+static long texture_budget_mib = DEFAULT_TEXTURE_BUDGET_MIB;
+
+/** Budget of all buffers and textures in MiB, 0 for unlimited */
+static long gpu_budget_mib = 0;
+
+/** Per-frame memory of game code */
+static frame_arena_t frame_memory;
+
+/** Draws of current frame */
+static draw_queue_t draw_queue;
+
 /** License text to show when application is runned with --version flag */
 static const char *version_text =
     PACKAGE_STRING "\n\n"
@@ -43,11 +250,51 @@ static const char *version_text =
     "terms of the Do What The Fuck You Want To Public License, Version 2,\n"
     "as published by Sam Hocevar. See http://www.wtfpl.net for more details.\n";
 
+/** Codes of long options that have no short equivalent */
+enum {
+    OPTION_WORKERS = 256,
+    OPTION_PIN_RENDER_CPU,
+    OPTION_PIN_WORKERS,
+    OPTION_REALTIME,
+    OPTION_FRAMES,
+    OPTION_CHECK_ALLOCS,
+    OPTION_TRACK_ALLOCS,
+    OPTION_STATS,
+    OPTION_GL_DEBUG,
+    OPTION_SCENE,
+    OPTION_OBJECTS,
+    OPTION_MESH,
+    OPTION_TEXTURE,
+    OPTION_IMAGE,
+    OPTION_ASSETS,
+    OPTION_UPLOAD_BUDGET,
+    OPTION_TEXTURE_BUDGET,
+    OPTION_GPU_BUDGET
+};
+
 /* Option flags and variables */
 static struct option const long_options[] = {
     {"help", no_argument, NULL, 'h'},
     {"version", no_argument, NULL, 'V'},
     {"verbose", no_argument, NULL, 'v'},
+    {"workers", required_argument, NULL, OPTION_WORKERS},
+    {"pin-render-cpu", required_argument, NULL, OPTION_PIN_RENDER_CPU},
+    {"pin-workers", required_argument, NULL, OPTION_PIN_WORKERS},
+    {"realtime", required_argument, NULL, OPTION_REALTIME},
+    {"frames", required_argument, NULL, OPTION_FRAMES},
+    {"check-allocs", optional_argument, NULL, OPTION_CHECK_ALLOCS},
+    {"track-allocs", no_argument, NULL, OPTION_TRACK_ALLOCS},
+    {"stats", no_argument, NULL, OPTION_STATS},
+    {"gl-debug", no_argument, NULL, OPTION_GL_DEBUG},
+    {"scene", required_argument, NULL, OPTION_SCENE},
+    {"objects", required_argument, NULL, OPTION_OBJECTS},
+    {"mesh", required_argument, NULL, OPTION_MESH},
+    {"texture", required_argument, NULL, OPTION_TEXTURE},
+    {"image", required_argument, NULL, OPTION_IMAGE},
+    {"assets", required_argument, NULL, OPTION_ASSETS},
+    {"upload-budget", required_argument, NULL, OPTION_UPLOAD_BUDGET},
+    {"texture-budget", required_argument, NULL, OPTION_TEXTURE_BUDGET},
+    {"gpu-budget", required_argument, NULL, OPTION_GPU_BUDGET},
     {NULL, 0, NULL, 0}
 };
 
@@ -57,10 +304,52 @@ static void print_usage (void)
     printf ("Usage: %s [OPTION]...\n"
             "Displays OpenGL animation in X11 window\n\n"
             "Options:\n"
-            "  -h, --help     display this help and exit\n"
-            "  -V, --version  output version information and exit\n"
-            "  --verbose      be verbose\n"
-            "\nReport bugs to: <" PACKAGE_BUGREPORT ">\n", program_name);
+            "  -h, --help                display this help and exit\n"
+            "  -V, --version             output version information and exit\n"
+            "  --verbose                 be verbose\n", program_name);
+    printf ("  --workers=N               number of worker threads\n"
+            "                            (default: number of CPUs - 1)\n"
+            "  --pin-render-cpu=CPUS     pin render thread to CPUS (e.g. 0,4-7)\n"
+            "  --pin-workers=CPUS        pin each worker thread to one of CPUS\n");
+    printf ("  --realtime=POLICY[:PRIO]  run render thread with real-time\n"
+            "                            POLICY (fifo or rr) and priority PRIO\n");
+    printf ("  --frames=N                exit after N frames\n"
+            "  --check-allocs[=WARMUP]   fail if main loop allocates heap memory\n"
+            "                            after WARMUP frames (default: %d)\n"
+            "  --track-allocs            report heap allocations by call site\n"
+            "                            and frame on exit\n",
+            DEFAULT_WARMUP_FRAMES);
+    printf ("  --stats                   print frame times and OpenGL statistics\n"
+            "                            every second\n"
+            "  --gl-debug                create debug context and print messages\n"
+            "                            of OpenGL driver\n");
+    printf ("  --scene=NAME              render built-in scene: cubes (animated\n"
+            "                            on CPU, instanced), static (culled\n"
+            "                            on GPU, multi-draw indirect),\n"
+            "                            hierarchy (transform graph),\n");
+    printf ("                            particles (simulated by compute\n"
+            "                            shaders) or particles-cpu (simulated\n"
+            "                            by worker threads)\n"
+            "  --objects=N               number of objects in scene\n"
+            "                            (default: %d)\n", DEFAULT_OBJECTS);
+    printf ("  --mesh=FILE               draw objects of static scene with mesh\n"
+            "                            mapped from FILE or asset FILE of pack\n"
+            "  --texture=FILE            texture cubes scene with KTX2 texture\n"
+            "                            FILE or asset FILE of pack\n"
+            "  --image=FILE              texture cubes scene with PPM, TGA or\n"
+            "                            BMP image FILE, may be repeated\n"
+            "  --assets=PACK             open asset pack PACK\n");
+    printf ("  --upload-budget=KIB[:MS]  upload at most KIB of texture data\n"
+            "                            and spend at most MS milliseconds\n"
+            "                            on it per frame (default: %d:%.1f)\n",
+            DEFAULT_UPLOAD_BUDGET_KIB, DEFAULT_UPLOAD_BUDGET_MS);
+    printf ("  --texture-budget=MIB      keep at most MIB of texture levels\n"
+            "                            resident (default: %d)\n",
+            DEFAULT_TEXTURE_BUDGET_MIB);
+    printf ("  --gpu-budget=MIB          keep buffers and textures within MIB,\n"
+            "                            evicting streamed textures\n"
+            "                            (default: unlimited)\n");
+    printf ("\nReport bugs to: <" PACKAGE_BUGREPORT ">\n");
 }
 
 /** Process all pending events
@@ -279,6 +568,354 @@ static void print_available_configurations (const EGLDisplay egl_display)
     }
 }
 
+/** Parse non-negative decimal number given as option argument
+ * @param arg option argument
+ * @returns parsed number, -1 if arg isn't a valid number
+ */
+static long parse_count (const char *arg)
+{
+    char *end = NULL;
+    long value;
+    if ((*arg < '0') || (*arg > '9')) {
+        return -1;
+    }
+    value = strtol (arg, &end, 10);
+    return (*end == '\0') ? value : -1;
+}
+
+/** Start worker threads, they get default policy whatever the calling
+ * thread has
+ */
+static void start_workers (void)
+{
+    if (n_workers < 0) {
+        n_workers = sysconf (_SC_NPROCESSORS_ONLN) - 1;
+    }
+    if ((n_workers > 0) && (workers_init ((unsigned int)n_workers,
+                            pin_workers ? &worker_cpus : NULL) != 0)) {
+        fprintf (stderr, "%s: can't start worker threads, "
+                 "running jobs on render thread\n", program_name);
+    }
+    if (verbose || pin_workers) {
+        printf ("%u worker threads%s\n", workers_count (),
+                pin_workers ? ", each pinned to single CPU" : "");
+    }
+}
+
+/** Apply scheduling options to the calling thread, which is the one
+ * running the swap loop
+ */
+static void setup_threads (void)
+{
+    int err;
+    if (pin_render) {
+        err = thread_policy_pin (pthread_self (), &render_cpus);
+        if (err != 0) {
+            fprintf (stderr, "%s: can't pin render thread: %s\n",
+                     program_name, strerror (err));
+        }
+    }
+    if (render_policy != SCHED_OTHER) {
+        err = thread_policy_set_realtime (render_policy, render_priority);
+        if (err < 0) {
+            fprintf (stderr, "%s: real-time scheduling is not permitted "
+                     "(needs CAP_SYS_NICE or RLIMIT_RTPRIO), "
+                     "keeping default policy\n", program_name);
+        } else if ((render_priority != 0) && (err != render_priority)) {
+            fprintf (stderr, "%s: real-time priority lowered to %d\n",
+                     program_name, err);
+        }
+    }
+    if (verbose || pin_render || (render_policy != SCHED_OTHER)) {
+        thread_policy_report ("render");
+    }
+}
+
+/** Parse budget of texture uploads in "KIB[:MS]" form
+ * @param arg argument to parse
+ * @returns 0 on success, -1 if argument is malformed
+ */
+static int parse_upload_budget (const char *arg)
+{
+    char *end = NULL;
+    if ((*arg < '0') || (*arg > '9')) {
+        return -1;
+    }
+    upload_budget_kib = strtol (arg, &end, 10);
+    if (*end == ':') {
+        arg = end + 1;
+        if ((*arg < '0') || (*arg > '9')) {
+            return -1;
+        }
+        upload_budget_ms = strtod (arg, &end);
+    }
+    return ((*end == '\0') && (upload_budget_kib > 0)) ? 0 : -1;
+}
+
+/** Print statistics of frames rendered since previous report
+ * @param n_frames number of frames rendered since previous report
+ * @param elapsed_ms time elapsed since previous report
+ */
+static void print_stats (long n_frames, double elapsed_ms)
+{
+    printf ("%ld frames in %.2f s: %.1f fps, %.2f ms/frame\n", n_frames,
+            elapsed_ms / 1000.0, (double)n_frames * 1000.0 / elapsed_ms,
+            elapsed_ms / (double)n_frames);
+    gpu_timer_print_stats ();
+    gl_state_print_stats ();
+    draw_queue_print_stats (&draw_queue);
+    scene_print_stats ();
+    texture_stream_print_stats ();
+    texture_residency_print_stats ();
+    gpu_memory_print_stats ();
+}
+
+/** Record duration of phase of startup that ends now
+ * @param name name of phase
+ */
+static void end_startup_phase (const char *name)
+{
+    double now = monotonic_ms ();
+    if (n_startup_phases < MAX_STARTUP_PHASES) {
+        startup_phases[n_startup_phases].name = name;
+        startup_phases[n_startup_phases].ms = now - startup_phase_start;
+        n_startup_phases++;
+    }
+    startup_phase_start = now;
+}
+
+/** Print durations of phases of startup */
+static void print_startup (void)
+{
+    double total = 0.0;
+    unsigned int i;
+    for (i = 0; i < n_startup_phases; i++) {
+        total += startup_phases[i].ms;
+    }
+    printf ("Startup: %.2f ms\n", total);
+    for (i = 0; i < n_startup_phases; i++) {
+        printf ("  %-12s %8.2f ms\n", startup_phases[i].name,
+                startup_phases[i].ms);
+    }
+}
+
+/** Open asset pack
+ * @param arg unused
+ * @returns NULL
+ */
+static void *open_assets (void *arg)
+{
+    double start = monotonic_ms ();
+    (void)arg;
+    assets_status = asset_pack_open (&assets, assets_path);
+    assets_ms = monotonic_ms () - start;
+    return NULL;
+}
+
+/** Start opening asset pack on helper thread
+ *
+ * Early exits of main() don't join the thread, process termination ends it.
+ */
+static void start_opening_assets (void)
+{
+    pthread_attr_t attr;
+    if (thread_policy_init_attr (&attr) == 0) {
+        is_opening_assets = pthread_create (&assets_thread, &attr, open_assets,
+                                            NULL) == 0;
+        pthread_attr_destroy (&attr);
+    }
+    if (!is_opening_assets) {
+        open_assets (NULL);
+    }
+}
+
+/** Wait until asset pack is opened
+ * @returns 0 if pack is open, -1 otherwise
+ */
+static int finish_opening_assets (void)
+{
+    if (is_opening_assets) {
+        pthread_join (assets_thread, NULL);
+        is_opening_assets = 0;
+    }
+    return assets_status;
+}
+
+/** Create scene, drawing mesh instead of cube if one is given
+ * @param mesh mesh of static scene, NULL for cube
+ * @returns 0 on success, -1 on failure with message printed
+ */
+static int create_scene (const mesh_file_t *mesh)
+{
+    int err = 0;
+    if ((mesh != NULL) && (scene_set_mesh (mesh) != 0)) {
+        fprintf (stderr, "%s: mesh '%s' has unsupported layout\n",
+                 program_name, mesh_path);
+        return -1;
+    }
+    if ((mesh != NULL) && verbose) {
+        printf ("Mesh: %u vertices, %u indices, %.2f MiB\n",
+                mesh->header->n_vertices, mesh->header->n_indices,
+                (double)mesh->size / (1024.0 * 1024.0));
+    }
+    scene_set_textures (texture_handles, n_texture_handles);
+    if ((scene_name != NULL)
+            && (scene_init (scene_name, (unsigned long)scene_objects) != 0)) {
+        fprintf (stderr, "%s: can't create scene '%s'\n", program_name,
+                 scene_name);
+        err = -1;
+    }
+    /* Upload of mesh is queued, scene_mesh stays until it's done */
+    scene_set_mesh (NULL);
+    return err;
+}
+
+/** Close mesh of scene once loader doesn't read it anymore */
+static void release_mesh (void)
+{
+    mesh_file_close (&scene_mesh);
+    free (scene_mesh_data);
+    scene_mesh_data = NULL;
+}
+
+/** Create scene, loading its mesh first if one is given
+ *
+ * Mesh found in asset pack is used in place, mesh file is mapped; both
+ * stay until release_mesh() as loader uploads from them.
+ * @returns 0 on success, -1 on failure with message printed
+ */
+static int start_scene (void)
+{
+    const asset_pack_entry_t *entry = NULL;
+    int err;
+    if (mesh_path == NULL) {
+        err = create_scene (NULL);
+        end_startup_phase ("scene");
+        return err;
+    }
+    if (assets_path != NULL) {
+        entry = asset_pack_find (&assets, mesh_path);
+    }
+    if (entry == NULL) {
+        err = mesh_file_open (&scene_mesh, mesh_path);
+    } else if (asset_pack_stored (&assets, entry) != NULL) {
+        err = mesh_file_from_memory (&scene_mesh,
+                                     asset_pack_stored (&assets, entry),
+                                     entry->size);
+    } else {
+        scene_mesh_data = malloc (entry->size);
+        if ((scene_mesh_data == NULL)
+                || (asset_pack_read (&assets, &entry, &scene_mesh_data, 1)
+                    != 0)) {
+            err = -1;
+        } else {
+            err = mesh_file_from_memory (&scene_mesh, scene_mesh_data,
+                                         entry->size);
+        }
+    }
+    end_startup_phase ("mesh");
+    if (err != 0) {
+        fprintf (stderr, "%s: can't load mesh '%s'\n", program_name,
+                 mesh_path);
+    } else {
+        err = create_scene (&scene_mesh);
+        end_startup_phase ("scene");
+    }
+    return err;
+}
+
+/** Open texture and add it to texture residency
+ *
+ * Texture found in asset pack is used in place, texture file is mapped,
+ * and in both cases its levels are uploaded as stored.
+ * @returns 0 on success, -1 on failure with message printed
+ */
+static int load_texture (void)
+{
+    const asset_pack_entry_t *entry = NULL;
+    int err;
+    if (texture_path == NULL) {
+        return 0;
+    }
+    if (assets_path != NULL) {
+        entry = asset_pack_find (&assets, texture_path);
+    }
+    if (entry == NULL) {
+        err = ktx_file_open (&texture_file, texture_path);
+    } else if (asset_pack_stored (&assets, entry) != NULL) {
+        err = ktx_file_from_memory (&texture_file,
+                                    asset_pack_stored (&assets, entry),
+                                    entry->size);
+    } else {
+        texture_data = malloc (entry->size);
+        if ((texture_data == NULL)
+                || (asset_pack_read (&assets, &entry, &texture_data, 1) != 0)) {
+            err = -1;
+        } else {
+            err = ktx_file_from_memory (&texture_file, texture_data,
+                                        entry->size);
+        }
+    }
+    end_startup_phase ("texture");
+    if (err != 0) {
+        fprintf (stderr, "%s: can't load texture '%s'\n", program_name,
+                 texture_path);
+        return -1;
+    }
+    if (!ktx_file_is_supported (&texture_file)) {
+        fprintf (stderr, "%s: format %s of texture '%s' is not supported\n",
+                 program_name, texture_file.format_name, texture_path);
+        return -1;
+    }
+    texture_handles[n_texture_handles] = texture_residency_add (
+            &texture_file.source);
+    if (texture_handles[n_texture_handles++] < 0) {
+        fprintf (stderr, "%s: can't stream texture '%s'\n", program_name,
+                 texture_path);
+        return -1;
+    }
+    if (verbose) {
+        printf ("Texture: %dx%d, %u levels, %s, %.2f MiB\n",
+                texture_file.source.width, texture_file.source.height,
+                texture_file.source.n_levels, texture_file.format_name,
+                (double)texture_file.size / (1024.0 * 1024.0));
+    }
+    return 0;
+}
+
+/** Add images decoded while EGL initialized to texture residency
+ * @returns 0 on success, -1 on failure with message printed
+ */
+static int load_images (void)
+{
+    unsigned int i;
+    if (n_image_paths == 0) {
+        return 0;
+    }
+    image_decode_wait ();
+    /* Only time not hidden behind EGL initialization is counted */
+    end_startup_phase ("images");
+    for (i = 0; i < n_image_paths; i++) {
+        const texture_source_t *source = image_decode_get (i);
+        if (source == NULL) {
+            fprintf (stderr, "%s: can't decode image '%s'\n", program_name,
+                     image_paths[i]);
+            return -1;
+        }
+        texture_handles[n_texture_handles] = texture_residency_add (source);
+        if (texture_handles[n_texture_handles++] < 0) {
+            fprintf (stderr, "%s: can't stream image '%s'\n", program_name,
+                     image_paths[i]);
+            return -1;
+        }
+        if (verbose) {
+            printf ("Image: %dx%d, %u levels\n", source->width,
+                    source->height, source->n_levels);
+        }
+    }
+    return 0;
+}
+
 /** Parse command-line arguments
  * @param argc number of arguments passed to main()
  * @param argv array of arguments passed to main()
@@ -298,6 +935,129 @@ static void parse_args (int argc, char *const *argv)
             case 'v':
                 verbose = 1;
                 break;
+            case OPTION_WORKERS:
+                n_workers = parse_count (optarg);
+                if (n_workers < 0) {
+                    fprintf (stderr, "%s: invalid number of workers '%s'\n",
+                             program_name, optarg);
+                    exit (EXIT_FAILURE);
+                }
+                break;
+            case OPTION_PIN_RENDER_CPU:
+                if (thread_policy_parse_cpus (optarg, &render_cpus) != 0) {
+                    fprintf (stderr, "%s: invalid CPU list '%s'\n",
+                             program_name, optarg);
+                    exit (EXIT_FAILURE);
+                }
+                pin_render = 1;
+                break;
+            case OPTION_PIN_WORKERS:
+                if (thread_policy_parse_cpus (optarg, &worker_cpus) != 0) {
+                    fprintf (stderr, "%s: invalid CPU list '%s'\n",
+                             program_name, optarg);
+                    exit (EXIT_FAILURE);
+                }
+                pin_workers = 1;
+                break;
+            case OPTION_REALTIME:
+                if (thread_policy_parse_realtime (optarg, &render_policy,
+                                                  &render_priority) != 0) {
+                    fprintf (stderr, "%s: invalid real-time policy '%s'\n",
+                             program_name, optarg);
+                    exit (EXIT_FAILURE);
+                }
+                break;
+            case OPTION_FRAMES:
+                max_frames = parse_count (optarg);
+                if (max_frames <= 0) {
+                    fprintf (stderr, "%s: invalid number of frames '%s'\n",
+                             program_name, optarg);
+                    exit (EXIT_FAILURE);
+                }
+                break;
+            case OPTION_CHECK_ALLOCS:
+#ifdef HAVE_ALLOC_HOOKS
+                check_allocations = 1;
+                if (optarg != NULL) {
+                    warmup_frames = parse_count (optarg);
+                    if (warmup_frames < 0) {
+                        fprintf (stderr, "%s: invalid number of frames '%s'\n",
+                                 program_name, optarg);
+                        exit (EXIT_FAILURE);
+                    }
+                }
+                break;
+#else
+                fprintf (stderr, "%s: allocation checking is not supported "
+                         "by this build\n", program_name);
+                exit (EXIT_FAILURE);
+#endif
+            case OPTION_STATS:
+                show_stats = 1;
+                break;
+            case OPTION_GL_DEBUG:
+                debug_context = 1;
+                break;
+            case OPTION_SCENE:
+                scene_name = optarg;
+                break;
+            case OPTION_OBJECTS:
+                scene_objects = parse_count (optarg);
+                if (scene_objects <= 0) {
+                    fprintf (stderr, "%s: invalid number of objects '%s'\n",
+                             program_name, optarg);
+                    exit (EXIT_FAILURE);
+                }
+                break;
+            case OPTION_MESH:
+                mesh_path = optarg;
+                break;
+            case OPTION_TEXTURE:
+                texture_path = optarg;
+                break;
+            case OPTION_IMAGE:
+                if (n_image_paths == MAX_IMAGES) {
+                    fprintf (stderr, "%s: too many images, at most %d are "
+                             "supported\n", program_name, MAX_IMAGES);
+                    exit (EXIT_FAILURE);
+                }
+                image_paths[n_image_paths++] = optarg;
+                break;
+            case OPTION_ASSETS:
+                assets_path = optarg;
+                break;
+            case OPTION_UPLOAD_BUDGET:
+                if (parse_upload_budget (optarg) != 0) {
+                    fprintf (stderr, "%s: invalid upload budget '%s'\n",
+                             program_name, optarg);
+                    exit (EXIT_FAILURE);
+                }
+                break;
+            case OPTION_TEXTURE_BUDGET:
+                texture_budget_mib = parse_count (optarg);
+                if (texture_budget_mib <= 0) {
+                    fprintf (stderr, "%s: invalid texture budget '%s'\n",
+                             program_name, optarg);
+                    exit (EXIT_FAILURE);
+                }
+                break;
+            case OPTION_GPU_BUDGET:
+                gpu_budget_mib = parse_count (optarg);
+                if (gpu_budget_mib < 0) {
+                    fprintf (stderr, "%s: invalid GPU memory budget '%s'\n",
+                             program_name, optarg);
+                    exit (EXIT_FAILURE);
+                }
+                break;
+            case OPTION_TRACK_ALLOCS:
+#ifdef HAVE_ALLOC_HOOKS
+                track_allocations = 1;
+                break;
+#else
+                fprintf (stderr, "%s: allocation tracking is not supported "
+                         "by this build\n", program_name);
+                exit (EXIT_FAILURE);
+#endif
             default:
                 print_usage ();
                 exit (EXIT_FAILURE);
@@ -319,6 +1079,10 @@ int main (int argc, char *const *argv)
         EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
         EGL_NONE
     };
+    static const EGLint debug_context_attributes[] = {
+        EGL_CONTEXT_FLAGS_KHR, EGL_CONTEXT_OPENGL_DEBUG_BIT_KHR,
+        EGL_NONE
+    };
     EGLDisplay egl_display;
     EGLint egl_major, egl_minor;
     EGLBoolean err;
@@ -328,8 +1092,39 @@ int main (int argc, char *const *argv)
     EGLSurface window_surface;
     VisualID visual_id = 0;
     Display *display = NULL;
+    long frame = 0, stats_frame = 0;
+    double frame_start, stats_start, animation_start;
+    int status = EXIT_SUCCESS;
 
     parse_args (argc, argv);
+    startup_phase_start = monotonic_ms ();
+#ifdef HAVE_ALLOC_HOOKS
+    if (track_allocations) {
+        alloc_hooks_start_tracking ();
+    }
+#endif
+    thread_policy_save_default ();
+    math3d_init ();
+    if (verbose) {
+        printf ("Math kernels: %s\n", math3d_isa ());
+    }
+    /* Pack is read from disk while EGL talks to X server and driver */
+    if (assets_path != NULL) {
+        start_opening_assets ();
+    }
+    /* Images are decoded by workers meanwhile too */
+    start_workers ();
+    if (n_image_paths != 0) {
+        if (image_decode_start (image_paths, n_image_paths, IMAGE_DECODE_FLAGS)
+                != 0) {
+            fprintf (stderr, "%s: can't allocate image decoding\n",
+                     program_name);
+            return EXIT_FAILURE;
+        }
+        if (verbose) {
+            printf ("Image kernels: %s\n", image_decode_isa ());
+        }
+    }
 
     display = XOpenDisplay (NULL);
     if (display == NULL) {
@@ -377,7 +1172,17 @@ int main (int argc, char *const *argv)
         return EXIT_FAILURE;
     }
 
-    context = eglCreateContext (egl_display, config, EGL_NO_CONTEXT, NULL);
+    if (debug_context) {
+        context = eglCreateContext (egl_display, config, EGL_NO_CONTEXT,
+                                    debug_context_attributes);
+        if (context == EGL_NO_CONTEXT) {
+            fprintf (stderr, "%s: can't create debug context, "
+                     "creating regular one\n", program_name);
+        }
+    }
+    if (!debug_context || (context == EGL_NO_CONTEXT)) {
+        context = eglCreateContext (egl_display, config, EGL_NO_CONTEXT, NULL);
+    }
     if (context == EGL_NO_CONTEXT) {
         fprintf (stderr, "%s: can't create OpenGL context\n", program_name);
         eglTerminate (egl_display);
@@ -424,17 +1229,211 @@ int main (int argc, char *const *argv)
         XCloseDisplay (display);
         return EXIT_FAILURE;
     }
-    printf ("OpenGL %s\n", glGetString (GL_VERSION));
-    while (window_is_exists (main_window)) {
+    if (gl_procs_load () != 0) {
+        fprintf (stderr, "%s: can't load OpenGL entry points\n",
+                 program_name);
+        eglMakeCurrent (egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        EGL_NO_CONTEXT);
+        eglDestroySurface (egl_display, window_surface);
+        window_destroy (main_window);
+        eglDestroyContext (egl_display, context);
+        eglTerminate (egl_display);
+        XCloseDisplay (display);
+        return EXIT_FAILURE;
+    }
+    end_startup_phase ("EGL");
+    if (assets_path != NULL) {
+        if (finish_opening_assets () != 0) {
+            fprintf (stderr, "%s: can't open asset pack '%s'\n", program_name,
+                     assets_path);
+            eglMakeCurrent (egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                            EGL_NO_CONTEXT);
+            eglDestroySurface (egl_display, window_surface);
+            window_destroy (main_window);
+            eglDestroyContext (egl_display, context);
+            eglTerminate (egl_display);
+            XCloseDisplay (display);
+            return EXIT_FAILURE;
+        }
+        /* Only time not hidden behind EGL initialization is counted */
+        end_startup_phase ("assets");
+        if (verbose) {
+            printf ("Assets: %u entries, opened in %.2f ms\n",
+                    assets.header->n_entries, assets_ms);
+        }
+    }
+    printf ("OpenGL %s\n", gl.GetString (GL_VERSION));
+    gl_state_reset ();
+    if (debug_context && (gl_debug_start (verbose) != 0)) {
+        fprintf (stderr, "%s: debug output is not supported\n",
+                 program_name);
+    }
+    if (show_stats && (gpu_timer_init () != 0)) {
+        fprintf (stderr, "%s: timer queries are not supported, "
+                 "GPU time won't be reported\n", program_name);
+    }
+    if (frame_arena_init (&frame_memory, FRAME_ARENA_SIZE) != 0) {
+        fprintf (stderr, "%s: can't allocate frame memory\n", program_name);
+        eglMakeCurrent (egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        EGL_NO_CONTEXT);
+        eglDestroySurface (egl_display, window_surface);
+        window_destroy (main_window);
+        eglDestroyContext (egl_display, context);
+        eglTerminate (egl_display);
+        XCloseDisplay (display);
+        return EXIT_FAILURE;
+    }
+    if (gpu_memory_init ((size_t)gpu_budget_mib << 20, MAX_GPU_ALLOCATIONS)
+            != 0) {
+        fprintf (stderr, "%s: can't allocate GPU memory tracking, "
+                 "usage won't be reported\n", program_name);
+    }
+    if (texture_stream_init ((size_t)upload_budget_kib * 1024,
+                             upload_budget_ms, MAX_TEXTURE_UPLOADS) != 0) {
+        fprintf (stderr, "%s: pixel buffers are not supported, "
+                 "textures can't be streamed\n", program_name);
+    }
+    if (texture_residency_init ((size_t)texture_budget_mib << 20, MAX_TEXTURES)
+            != 0) {
+        fprintf (stderr, "%s: immutable texture storage is not supported, "
+                 "mipmaps won't be streamed\n", program_name);
+    }
+    /* Loader context shares objects with render context */
+    gl_loader_init (egl_display, config, context, MAX_GL_LOADER_JOBS);
+    if (verbose) {
+        printf ("GL loader: objects are created on %s thread\n",
+                gl_loader_is_threaded () ? "loader" : "render");
+    }
+    /* Driver threads spawned above must not inherit render thread policy */
+    setup_threads ();
+    end_startup_phase ("setup");
+    /* Textures are added first, so that scene samples them */
+    if (load_texture () != 0) {
+        status = EXIT_FAILURE;
+    }
+    if ((status == EXIT_SUCCESS) && (load_images () != 0)) {
+        status = EXIT_FAILURE;
+    }
+    if ((status == EXIT_SUCCESS) && (start_scene () != 0)) {
+        status = EXIT_FAILURE;
+    }
+    if (status != EXIT_SUCCESS) {
+        workers_shutdown ();
+        frame_arena_destroy (&frame_memory);
+        gl_loader_shutdown ();
+        release_mesh ();
+        asset_pack_close (&assets);
+        texture_stream_shutdown ();
+        texture_residency_shutdown ();
+        ktx_file_close (&texture_file);
+        free (texture_data);
+        image_decode_shutdown ();
+        scene_shutdown ();
+        gpu_timer_shutdown ();
+        gpu_memory_shutdown ();
+        gl_debug_stop ();
+        eglMakeCurrent (egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                        EGL_NO_CONTEXT);
+        eglDestroySurface (egl_display, window_surface);
+        window_destroy (main_window);
+        eglDestroyContext (egl_display, context);
+        eglTerminate (egl_display);
+        XCloseDisplay (display);
+        return EXIT_FAILURE;
+    }
+    stats_start = monotonic_ms ();
+    animation_start = stats_start;
+    while (window_is_exists (main_window)
+            && ((max_frames == 0) || (frame < max_frames))) {
+        frame_start = monotonic_ms ();
+#ifdef HAVE_ALLOC_HOOKS
+        if (check_allocations && (frame == warmup_frames)) {
+            alloc_hooks_start ();
+        }
+        alloc_hooks_set_frame ((unsigned long)frame + 1);
+#endif
         window_process_events (main_window);
-        /*game_tick();*/
+        gl_loader_poll ();
+        if ((scene_mesh.header != NULL) && !scene_is_loading ()) {
+            release_mesh ();
+        }
+        /* Uploads are capped so they never take the whole frame */
+        texture_residency_update ();
+        texture_stream_update ();
+        gpu_timer_begin_frame ();
+        draw_queue_begin (&draw_queue, &frame_memory, MAX_DRAWS);
+        gpu_timer_begin_pass ("game");
+        scene_tick (frame_start - animation_start);
+        scene_update (&draw_queue, &frame_memory,
+                      frame_start - animation_start, main_window->width,
+                      main_window->height);
+        gpu_timer_end_pass ();
+        draw_queue_sort (&draw_queue);
+        gpu_timer_begin_pass ("draws");
+        draw_queue_execute (&draw_queue);
+        gpu_timer_end_pass ();
+        scene_end_frame ();
+        gpu_timer_end_frame (monotonic_ms () - frame_start);
         eglSwapBuffers (egl_display, window_surface);
+        frame_arena_swap (&frame_memory);
+        gpu_memory_end_frame ();
+        frame++;
+        if ((frame == 1) && (verbose || show_stats)) {
+            end_startup_phase ("first frame");
+            print_startup ();
+        }
+        if (show_stats && (monotonic_ms () - stats_start >= STATS_INTERVAL_MS)) {
+            double now = monotonic_ms ();
+            print_stats (frame - stats_frame, now - stats_start);
+            stats_frame = frame;
+            stats_start = now;
+        }
+    }
+#ifdef HAVE_ALLOC_HOOKS
+    if (check_allocations) {
+        alloc_hooks_stop ();
+        printf ("%lu heap allocations (%lu bytes) in %ld steady-state frames\n",
+                alloc_hooks_count (), alloc_hooks_bytes (),
+                frame > warmup_frames ? frame - warmup_frames : 0);
+        if (alloc_hooks_count () != 0) {
+            status = EXIT_FAILURE;
+        }
     }
+#endif
+    if (verbose) {
+        /* Reported while resources of scene are still allocated */
+        gpu_memory_print_stats ();
+    }
+    gl_loader_shutdown ();
+    release_mesh ();
+    texture_stream_shutdown ();
+    texture_residency_shutdown ();
+    ktx_file_close (&texture_file);
+    free (texture_data);
+    image_decode_shutdown ();
+    scene_shutdown ();
+    gpu_timer_shutdown ();
+    gpu_memory_shutdown ();
+    gl_debug_stop ();
+    if (verbose) {
+        printf ("Frame memory: peak %lu of %lu bytes, %lu failed allocations\n",
+                (unsigned long)frame_memory.peak,
+                (unsigned long)frame_memory.capacity,
+                (unsigned long)frame_memory.n_failed);
+    }
+    workers_shutdown ();
+    frame_arena_destroy (&frame_memory);
+    asset_pack_close (&assets);
+#ifdef HAVE_ALLOC_HOOKS
+    if (track_allocations) {
+        alloc_hooks_report (ALLOC_REPORT_CALLSITES);
+    }
+#endif
     eglMakeCurrent (egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
     eglDestroySurface (egl_display, window_surface);
     window_destroy (main_window);
     eglDestroyContext (egl_display, context);
     eglTerminate (egl_display);
     XCloseDisplay (display);
-    return EXIT_SUCCESS;
+    return status;
 }
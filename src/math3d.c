@@ -0,0 +1,541 @@
+/**
+ * @file math3d.c
+ * This module contains vector, matrix and quaternion math with SIMD
+ * kernels selected at run-time.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <math.h>
+#include <string.h>
+#include "math3d.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86_KERNELS
+#include <immintrin.h>
+/** Compile function for SSE2 regardless of target of the whole build */
+#define TARGET_SSE2 __attribute__ ((target ("sse2")))
+/** Compile function for AVX2 and FMA regardless of target of the build */
+#define TARGET_AVX2 __attribute__ ((target ("avx2,fma")))
+#endif
+
+/** Table of kernels of selected instruction set */
+typedef struct math3d_kernels_t {
+    void (*mat4_multiply) (const float *a, const float *b, float *result);
+    void (*aabb_transform) (const float *m, const float *mins,
+                            const float *maxs, float *out_mins,
+                            float *out_maxs, size_t n);
+    size_t (*cull_spheres) (const float *planes, const float *x,
+                            const float *y, const float *z,
+                            const float *radius, size_t first, size_t n,
+                            unsigned int *visible);
+    size_t (*cull_boxes) (const float *planes, const float *const *bounds,
+                          size_t first, size_t n, unsigned int *visible);
+} math3d_kernels_t;
+
+/** Multiply matrices with scalar code
+ * @param a left matrix
+ * @param b right matrix
+ * @param result receives a * b
+ */
+static void mat4_multiply_scalar (const float *a, const float *b,
+                                  float *result)
+{
+    float product[16];
+    unsigned int row, column, k;
+    for (column = 0; column < 4; column++) {
+        for (row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (k = 0; k < 4; k++) {
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            }
+            product[column * 4 + row] = sum;
+        }
+    }
+    memcpy (result, product, sizeof (product));
+}
+
+/** Transform bounding boxes with scalar code, see aabb_transform() */
+static void aabb_transform_scalar (const float *m, const float *mins,
+                                   const float *maxs, float *out_mins,
+                                   float *out_maxs, size_t n)
+{
+    size_t i;
+    unsigned int row, k;
+    for (i = 0; i < n; i++) {
+        const float *lower = mins + i * 3, *upper = maxs + i * 3;
+        for (row = 0; row < 3; row++) {
+            float center = m[12 + row], extent = 0.0f;
+            for (k = 0; k < 3; k++) {
+                center += m[k * 4 + row] * (lower[k] + upper[k]) * 0.5f;
+                extent += fabsf (m[k * 4 + row]) * (upper[k] - lower[k]) * 0.5f;
+            }
+            out_mins[i * 3 + row] = center - extent;
+            out_maxs[i * 3 + row] = center + extent;
+        }
+    }
+}
+
+/** Append indices of visible objects of group
+ * @param mask bit N is set if object N of group is visible
+ * @param width number of objects in group
+ * @param index index of the first object of group
+ * @param visible receives indices of visible objects
+ * @returns number of visible objects
+ */
+static size_t emit_visible (unsigned int mask, unsigned int width,
+                            size_t index, unsigned int *visible)
+{
+    size_t count = 0;
+    unsigned int k;
+    if (mask == 0) {
+        return 0;
+    }
+    /* Unconditional store avoids mispredicted branch per object */
+    for (k = 0; k < width; k++) {
+        visible[count] = (unsigned int) (index + k);
+        count += (mask >> k) & 1;
+    }
+    return count;
+}
+
+/** Cull spheres with scalar code, see frustum_cull_spheres() */
+static size_t cull_spheres_scalar (const float *planes, const float *x,
+                                   const float *y, const float *z,
+                                   const float *radius, size_t first,
+                                   size_t n, unsigned int *visible)
+{
+    size_t i, count = 0;
+    unsigned int p;
+    for (i = first; i < first + n; i++) {
+        int is_inside = 1;
+        for (p = 0; p < 6; p++) {
+            const float *plane = planes + p * 4;
+            float distance = plane[0] * x[i] + plane[1] * y[i] +
+                             plane[2] * z[i] + plane[3];
+            is_inside &= distance >= -radius[i];
+        }
+        visible[count] = (unsigned int)i;
+        count += (size_t)is_inside;
+    }
+    return count;
+}
+
+/** Cull boxes with scalar code, see frustum_cull_boxes() */
+static size_t cull_boxes_scalar (const float *planes,
+                                 const float *const *bounds, size_t first,
+                                 size_t n, unsigned int *visible)
+{
+    size_t i, count = 0;
+    unsigned int p;
+    for (i = first; i < first + n; i++) {
+        int is_inside = 1;
+        for (p = 0; p < 6; p++) {
+            const float *plane = planes + p * 4;
+            float distance = plane[0] * bounds[0][i] +
+                             plane[1] * bounds[1][i] +
+                             plane[2] * bounds[2][i] + plane[3];
+            float reach = fabsf (plane[0]) * bounds[3][i] +
+                          fabsf (plane[1]) * bounds[4][i] +
+                          fabsf (plane[2]) * bounds[5][i];
+            is_inside &= distance >= -reach;
+        }
+        visible[count] = (unsigned int)i;
+        count += (size_t)is_inside;
+    }
+    return count;
+}
+
+#ifdef HAVE_X86_KERNELS
+/** Compute linear combination of four vectors with SSE2
+ * @returns a * x + b * y + c * z + d * w
+ */
+TARGET_SSE2 static __m128 combine_sse2 (__m128 a, __m128 b, __m128 c,
+                                        __m128 d, __m128 x, __m128 y,
+                                        __m128 z, __m128 w)
+{
+    return _mm_add_ps (_mm_add_ps (_mm_mul_ps (a, x), _mm_mul_ps (b, y)),
+                       _mm_add_ps (_mm_mul_ps (c, z), _mm_mul_ps (d, w)));
+}
+
+/** Multiply matrices with SSE2, see mat4_multiply() */
+TARGET_SSE2 static void mat4_multiply_sse2 (const float *a, const float *b,
+        float *result)
+{
+    __m128 a0 = _mm_loadu_ps (a), a1 = _mm_loadu_ps (a + 4);
+    __m128 a2 = _mm_loadu_ps (a + 8), a3 = _mm_loadu_ps (a + 12);
+    __m128 columns[4];
+    unsigned int c;
+    for (c = 0; c < 4; c++) {
+        const float *bc = b + c * 4;
+        columns[c] = combine_sse2 (a0, a1, a2, a3, _mm_set1_ps (bc[0]),
+                                   _mm_set1_ps (bc[1]), _mm_set1_ps (bc[2]),
+                                   _mm_set1_ps (bc[3]));
+    }
+    for (c = 0; c < 4; c++) {
+        _mm_storeu_ps (result + c * 4, columns[c]);
+    }
+}
+
+/** Transform bounding boxes with SSE2, see aabb_transform() */
+TARGET_SSE2 static void aabb_transform_sse2 (const float *m,
+        const float *mins, const float *maxs, float *out_mins,
+        float *out_maxs, size_t n)
+{
+    __m128 col0 = _mm_loadu_ps (m), col1 = _mm_loadu_ps (m + 4);
+    __m128 col2 = _mm_loadu_ps (m + 8), col3 = _mm_loadu_ps (m + 12);
+    __m128 sign_bit = _mm_set1_ps (-0.0f), half = _mm_set1_ps (0.5f);
+    __m128 one = _mm_set1_ps (1.0f), zero = _mm_setzero_ps ();
+    __m128 abs0 = _mm_andnot_ps (sign_bit, col0);
+    __m128 abs1 = _mm_andnot_ps (sign_bit, col1);
+    __m128 abs2 = _mm_andnot_ps (sign_bit, col2);
+    float lower[4], upper[4];
+    size_t i;
+    for (i = 0; i < n; i++, mins += 3, maxs += 3) {
+        __m128 low = _mm_set_ps (0.0f, mins[2], mins[1], mins[0]);
+        __m128 high = _mm_set_ps (0.0f, maxs[2], maxs[1], maxs[0]);
+        __m128 center = _mm_mul_ps (_mm_add_ps (low, high), half);
+        __m128 extent = _mm_mul_ps (_mm_sub_ps (high, low), half);
+        /* Center is transformed, extent is projected on absolute axes */
+        __m128 new_center = combine_sse2 (col0, col1, col2, col3,
+                                          _mm_shuffle_ps (center, center, 0x00),
+                                          _mm_shuffle_ps (center, center, 0x55),
+                                          _mm_shuffle_ps (center, center, 0xAA),
+                                          one);
+        __m128 new_extent = combine_sse2 (abs0, abs1, abs2, zero,
+                                          _mm_shuffle_ps (extent, extent, 0x00),
+                                          _mm_shuffle_ps (extent, extent, 0x55),
+                                          _mm_shuffle_ps (extent, extent, 0xAA),
+                                          zero);
+        _mm_storeu_ps (lower, _mm_sub_ps (new_center, new_extent));
+        _mm_storeu_ps (upper, _mm_add_ps (new_center, new_extent));
+        memcpy (out_mins + i * 3, lower, 3 * sizeof (float));
+        memcpy (out_maxs + i * 3, upper, 3 * sizeof (float));
+    }
+}
+
+/** Cull spheres with SSE2, four at a time, see frustum_cull_spheres() */
+TARGET_SSE2 static size_t cull_spheres_sse2 (const float *planes,
+        const float *x, const float *y, const float *z, const float *radius,
+        size_t first, size_t n, unsigned int *visible)
+{
+    __m128 plane[24];
+    size_t i, count = 0;
+    unsigned int p;
+    for (p = 0; p < 24; p++) {
+        plane[p] = _mm_set1_ps (planes[p]);
+    }
+    for (i = first; i + 4 <= first + n; i += 4) {
+        __m128 px = _mm_loadu_ps (x + i);
+        __m128 py = _mm_loadu_ps (y + i);
+        __m128 pz = _mm_loadu_ps (z + i);
+        __m128 limit = _mm_sub_ps (_mm_setzero_ps (), _mm_loadu_ps (radius + i));
+        __m128 is_inside = _mm_castsi128_ps (_mm_set1_epi32 (-1));
+        for (p = 0; p < 24; p += 4) {
+            __m128 distance = _mm_add_ps (
+                                  _mm_add_ps (_mm_mul_ps (plane[p], px),
+                                              _mm_mul_ps (plane[p + 1], py)),
+                                  _mm_add_ps (_mm_mul_ps (plane[p + 2], pz),
+                                              plane[p + 3]));
+            is_inside = _mm_and_ps (is_inside, _mm_cmpge_ps (distance, limit));
+        }
+        count += emit_visible ((unsigned int)_mm_movemask_ps (is_inside), 4, i,
+                               visible + count);
+    }
+    return count + cull_spheres_scalar (planes, x, y, z, radius, i,
+                                        first + n - i, visible + count);
+}
+
+/** Cull boxes with SSE2, four at a time, see frustum_cull_boxes() */
+TARGET_SSE2 static size_t cull_boxes_sse2 (const float *planes,
+        const float *const *bounds, size_t first, size_t n,
+        unsigned int *visible)
+{
+    __m128 plane[24], reach[18];
+    __m128 sign_bit = _mm_set1_ps (-0.0f);
+    size_t i, count = 0;
+    unsigned int p, k;
+    for (p = 0; p < 6; p++) {
+        for (k = 0; k < 4; k++) {
+            plane[p * 4 + k] = _mm_set1_ps (planes[p * 4 + k]);
+        }
+        for (k = 0; k < 3; k++) {
+            reach[p * 3 + k] = _mm_andnot_ps (sign_bit, plane[p * 4 + k]);
+        }
+    }
+    for (i = first; i + 4 <= first + n; i += 4) {
+        __m128 cx = _mm_loadu_ps (bounds[0] + i);
+        __m128 cy = _mm_loadu_ps (bounds[1] + i);
+        __m128 cz = _mm_loadu_ps (bounds[2] + i);
+        __m128 ex = _mm_loadu_ps (bounds[3] + i);
+        __m128 ey = _mm_loadu_ps (bounds[4] + i);
+        __m128 ez = _mm_loadu_ps (bounds[5] + i);
+        __m128 is_inside = _mm_castsi128_ps (_mm_set1_epi32 (-1));
+        for (p = 0; p < 6; p++) {
+            const __m128 *n4 = plane + p * 4, *r3 = reach + p * 3;
+            __m128 distance = combine_sse2 (n4[0], n4[1], n4[2], n4[3],
+                                            cx, cy, cz, _mm_set1_ps (1.0f));
+            __m128 extent = combine_sse2 (r3[0], r3[1], r3[2],
+                                          _mm_setzero_ps (), ex, ey, ez,
+                                          _mm_setzero_ps ());
+            is_inside = _mm_and_ps (is_inside,
+                                    _mm_cmpge_ps (_mm_add_ps (distance, extent),
+                                                  _mm_setzero_ps ()));
+        }
+        count += emit_visible ((unsigned int)_mm_movemask_ps (is_inside), 4, i,
+                               visible + count);
+    }
+    return count + cull_boxes_scalar (planes, bounds, i, first + n - i,
+                                      visible + count);
+}
+
+/** Cull spheres with AVX2, eight at a time, see frustum_cull_spheres() */
+TARGET_AVX2 static size_t cull_spheres_avx2 (const float *planes,
+        const float *x, const float *y, const float *z, const float *radius,
+        size_t first, size_t n, unsigned int *visible)
+{
+    __m256 plane[24];
+    size_t i, count = 0;
+    unsigned int p;
+    for (p = 0; p < 24; p++) {
+        plane[p] = _mm256_set1_ps (planes[p]);
+    }
+    for (i = first; i + 8 <= first + n; i += 8) {
+        __m256 px = _mm256_loadu_ps (x + i);
+        __m256 py = _mm256_loadu_ps (y + i);
+        __m256 pz = _mm256_loadu_ps (z + i);
+        __m256 limit = _mm256_sub_ps (_mm256_setzero_ps (),
+                                      _mm256_loadu_ps (radius + i));
+        __m256 is_inside = _mm256_castsi256_ps (_mm256_set1_epi32 (-1));
+        for (p = 0; p < 24; p += 4) {
+            __m256 distance = _mm256_fmadd_ps (plane[p + 2], pz, plane[p + 3]);
+            distance = _mm256_fmadd_ps (plane[p + 1], py, distance);
+            distance = _mm256_fmadd_ps (plane[p], px, distance);
+            is_inside = _mm256_and_ps (is_inside, _mm256_cmp_ps (distance,
+                                       limit, _CMP_GE_OQ));
+        }
+        count += emit_visible ((unsigned int)_mm256_movemask_ps (is_inside), 8,
+                               i, visible + count);
+    }
+    return count + cull_spheres_sse2 (planes, x, y, z, radius, i,
+                                      first + n - i, visible + count);
+}
+
+/** Cull boxes with AVX2, eight at a time, see frustum_cull_boxes() */
+TARGET_AVX2 static size_t cull_boxes_avx2 (const float *planes,
+        const float *const *bounds, size_t first, size_t n,
+        unsigned int *visible)
+{
+    __m256 plane[24], reach[18];
+    __m256 sign_bit = _mm256_set1_ps (-0.0f);
+    size_t i, count = 0;
+    unsigned int p, k;
+    for (p = 0; p < 6; p++) {
+        for (k = 0; k < 4; k++) {
+            plane[p * 4 + k] = _mm256_set1_ps (planes[p * 4 + k]);
+        }
+        for (k = 0; k < 3; k++) {
+            reach[p * 3 + k] = _mm256_andnot_ps (sign_bit, plane[p * 4 + k]);
+        }
+    }
+    for (i = first; i + 8 <= first + n; i += 8) {
+        __m256 cx = _mm256_loadu_ps (bounds[0] + i);
+        __m256 cy = _mm256_loadu_ps (bounds[1] + i);
+        __m256 cz = _mm256_loadu_ps (bounds[2] + i);
+        __m256 ex = _mm256_loadu_ps (bounds[3] + i);
+        __m256 ey = _mm256_loadu_ps (bounds[4] + i);
+        __m256 ez = _mm256_loadu_ps (bounds[5] + i);
+        __m256 is_inside = _mm256_castsi256_ps (_mm256_set1_epi32 (-1));
+        for (p = 0; p < 6; p++) {
+            const __m256 *n4 = plane + p * 4, *r3 = reach + p * 3;
+            /* Signed distance of center plus reach of box along normal */
+            __m256 sum = _mm256_fmadd_ps (n4[2], cz, n4[3]);
+            sum = _mm256_fmadd_ps (n4[1], cy, sum);
+            sum = _mm256_fmadd_ps (n4[0], cx, sum);
+            sum = _mm256_fmadd_ps (r3[2], ez, sum);
+            sum = _mm256_fmadd_ps (r3[1], ey, sum);
+            sum = _mm256_fmadd_ps (r3[0], ex, sum);
+            is_inside = _mm256_and_ps (is_inside, _mm256_cmp_ps (sum,
+                                       _mm256_setzero_ps (), _CMP_GE_OQ));
+        }
+        count += emit_visible ((unsigned int)_mm256_movemask_ps (is_inside), 8,
+                               i, visible + count);
+    }
+    return count + cull_boxes_sse2 (planes, bounds, i, first + n - i,
+                                    visible + count);
+}
+#endif
+
+/** Kernels used by public functions */
+static math3d_kernels_t kernels = {
+    mat4_multiply_scalar,
+    aabb_transform_scalar,
+    cull_spheres_scalar,
+    cull_boxes_scalar
+};
+
+/** Name of instruction set of selected kernels */
+static const char *isa = "scalar";
+
+void math3d_init (void)
+{
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("sse2")) {
+        kernels.mat4_multiply = mat4_multiply_sse2;
+        kernels.aabb_transform = aabb_transform_sse2;
+        kernels.cull_spheres = cull_spheres_sse2;
+        kernels.cull_boxes = cull_boxes_sse2;
+        isa = "sse2";
+        if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("fma")) {
+            kernels.cull_spheres = cull_spheres_avx2;
+            kernels.cull_boxes = cull_boxes_avx2;
+            isa = "avx2";
+        }
+    }
+#endif
+}
+
+const char *math3d_isa (void)
+{
+    return isa;
+}
+
+void mat4_perspective (float fovy, float aspect, float near_plane,
+                       float far_plane, float *result)
+{
+    float focal = 1.0f / tanf (fovy * 0.5f);
+    memset (result, 0, 16 * sizeof (float));
+    result[0] = focal / aspect;
+    result[5] = focal;
+    result[10] = (far_plane + near_plane) / (near_plane - far_plane);
+    result[11] = -1.0f;
+    result[14] = 2.0f * far_plane * near_plane / (near_plane - far_plane);
+}
+
+/** Normalize 3-component vector in place
+ * @param v vector to normalize
+ */
+static void normalize3 (float *v)
+{
+    float length = sqrtf (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    if (length > 0.0f) {
+        v[0] /= length;
+        v[1] /= length;
+        v[2] /= length;
+    }
+}
+
+/** Compute cross product of 3-component vectors
+ * @param a the first vector
+ * @param b the second vector
+ * @param result receives a x b
+ */
+static void cross3 (const float *a, const float *b, float *result)
+{
+    result[0] = a[1] * b[2] - a[2] * b[1];
+    result[1] = a[2] * b[0] - a[0] * b[2];
+    result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+void mat4_look_at (const float *eye, const float *center, const float *up,
+                   float *result)
+{
+    float forward[3], side[3], camera_up[3];
+    unsigned int k;
+    for (k = 0; k < 3; k++) {
+        forward[k] = center[k] - eye[k];
+    }
+    normalize3 (forward);
+    cross3 (forward, up, side);
+    normalize3 (side);
+    cross3 (side, forward, camera_up);
+    for (k = 0; k < 3; k++) {
+        result[k * 4] = side[k];
+        result[k * 4 + 1] = camera_up[k];
+        result[k * 4 + 2] = -forward[k];
+        result[k * 4 + 3] = 0.0f;
+    }
+    result[12] = -(side[0] * eye[0] + side[1] * eye[1] + side[2] * eye[2]);
+    result[13] = -(camera_up[0] * eye[0] + camera_up[1] * eye[1] +
+                   camera_up[2] * eye[2]);
+    result[14] = forward[0] * eye[0] + forward[1] * eye[1] + forward[2] * eye[2];
+    result[15] = 1.0f;
+}
+
+void mat4_from_trs (const float *translation, const float *rotation,
+                    float scale, float *result)
+{
+    float x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+    result[0] = (1.0f - 2.0f * (y * y + z * z)) * scale;
+    result[1] = 2.0f * (x * y + w * z) * scale;
+    result[2] = 2.0f * (x * z - w * y) * scale;
+    result[3] = 0.0f;
+    result[4] = 2.0f * (x * y - w * z) * scale;
+    result[5] = (1.0f - 2.0f * (x * x + z * z)) * scale;
+    result[6] = 2.0f * (y * z + w * x) * scale;
+    result[7] = 0.0f;
+    result[8] = 2.0f * (x * z + w * y) * scale;
+    result[9] = 2.0f * (y * z - w * x) * scale;
+    result[10] = (1.0f - 2.0f * (x * x + y * y)) * scale;
+    result[11] = 0.0f;
+    result[12] = translation[0];
+    result[13] = translation[1];
+    result[14] = translation[2];
+    result[15] = 1.0f;
+}
+
+void mat4_multiply (const float *a, const float *b, float *result)
+{
+    kernels.mat4_multiply (a, b, result);
+}
+
+void quat_from_axis_angle (const float *axis, float angle, float *result)
+{
+    float sine = sinf (angle * 0.5f);
+    result[0] = axis[0] * sine;
+    result[1] = axis[1] * sine;
+    result[2] = axis[2] * sine;
+    result[3] = cosf (angle * 0.5f);
+}
+
+void aabb_transform (const float *m, const float *mins, const float *maxs,
+                     float *out_mins, float *out_maxs, size_t n)
+{
+    kernels.aabb_transform (m, mins, maxs, out_mins, out_maxs, n);
+}
+
+void frustum_from_matrix (const float *m, float *planes)
+{
+    unsigned int p, k;
+    for (p = 0; p < 6; p++) {
+        /* Plane is the last row plus or minus one of the first three */
+        float sign = (p & 1) ? -1.0f : 1.0f;
+        float *plane = planes + p * 4;
+        float length;
+        for (k = 0; k < 4; k++) {
+            plane[k] = m[k * 4 + 3] + sign * m[k * 4 + p / 2];
+        }
+        length = sqrtf (plane[0] * plane[0] + plane[1] * plane[1] +
+                        plane[2] * plane[2]);
+        if (length > 0.0f) {
+            for (k = 0; k < 4; k++) {
+                plane[k] /= length;
+            }
+        }
+    }
+}
+
+size_t frustum_cull_spheres (const float *planes, const float *x,
+                             const float *y, const float *z,
+                             const float *radius, size_t first, size_t n,
+                             unsigned int *visible)
+{
+    return kernels.cull_spheres (planes, x, y, z, radius, first, n, visible);
+}
+
+size_t frustum_cull_boxes (const float *planes, const float *const *bounds,
+                           size_t first, size_t n, unsigned int *visible)
+{
+    return kernels.cull_boxes (planes, bounds, first, n, visible);
+}
@@ -0,0 +1,189 @@
+/**
+ * @file mesh_file.c
+ * This module contains loading of binary mesh files by mapping them into
+ * memory.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mesh_file.h"
+
+#ifdef MAP_POPULATE
+/** Read whole file during mapping so upload doesn't stall on page faults */
+#define MAP_PREFAULT MAP_POPULATE
+#else
+#define MAP_PREFAULT 0
+#endif
+
+/** Check that payload lies inside file and is aligned
+ * @param offset offset of payload from start of file
+ * @param count number of elements
+ * @param element_size size of element in bytes
+ * @param file_size size of file in bytes
+ * @returns non-zero if payload is valid
+ */
+static int is_valid_payload (GLuint64 offset, GLuint count,
+                             GLuint element_size, size_t file_size)
+{
+    GLuint64 size = (GLuint64)count * element_size;
+    return (offset % MESH_FILE_ALIGNMENT == 0) && (offset <= file_size)
+           && (size <= file_size - offset);
+}
+
+/** Check that all indices refer to existing vertices
+ * @param header header of mesh with valid payloads
+ * @param indices indices of mesh
+ * @returns non-zero if indices are valid
+ */
+static int are_valid_indices (const mesh_file_header_t *header,
+                              const void *indices)
+{
+    GLuint i;
+    /* Out of range index would make GPU read past vertex buffer */
+    if (header->index_size == 2) {
+        const GLushort *short_indices = (const GLushort *)indices;
+        for (i = 0; i < header->n_indices; i++) {
+            if (short_indices[i] >= header->n_vertices) {
+                return 0;
+            }
+        }
+    } else {
+        const GLuint *long_indices = (const GLuint *)indices;
+        for (i = 0; i < header->n_indices; i++) {
+            if (long_indices[i] >= header->n_vertices) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+int mesh_file_from_memory (mesh_file_t *mesh, const void *data, size_t size)
+{
+    const mesh_file_header_t *header = (const mesh_file_header_t *)data;
+    if ((size < sizeof (mesh_file_header_t))
+            || (header->magic != MESH_FILE_MAGIC)
+            || (header->version != MESH_FILE_VERSION)
+            || (header->vertex_size == 0)
+            || ((header->index_size != 2) && (header->index_size != 4))
+            || !is_valid_payload (header->vertex_offset, header->n_vertices,
+                                  header->vertex_size, size)
+            || !is_valid_payload (header->index_offset, header->n_indices,
+                                  header->index_size, size)
+            || !are_valid_indices (header, (const unsigned char *)data
+                                   + header->index_offset)) {
+        return -1;
+    }
+    mesh->header = header;
+    mesh->vertices = (const unsigned char *)data + header->vertex_offset;
+    mesh->indices = (const unsigned char *)data + header->index_offset;
+    mesh->mapping = NULL;
+    mesh->size = size;
+    return 0;
+}
+
+int mesh_file_open (mesh_file_t *mesh, const char *path)
+{
+    struct stat status;
+    void *mapping;
+    int fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    if ((fstat (fd, &status) != 0) || (status.st_size <= 0)) {
+        close (fd);
+        return -1;
+    }
+    mapping = mmap (NULL, (size_t)status.st_size, PROT_READ,
+                    MAP_PRIVATE | MAP_PREFAULT, fd, 0);
+    /* Mapping keeps file referenced */
+    close (fd);
+    if (mapping == MAP_FAILED) {
+        return -1;
+    }
+    /* Payloads are read once front to back during upload */
+    madvise (mapping, (size_t)status.st_size, MADV_SEQUENTIAL);
+    if (mesh_file_from_memory (mesh, mapping, (size_t)status.st_size) != 0) {
+        munmap (mapping, (size_t)status.st_size);
+        return -1;
+    }
+    mesh->mapping = mapping;
+    return 0;
+}
+
+void mesh_file_close (mesh_file_t *mesh)
+{
+    if (mesh->mapping != NULL) {
+        munmap (mesh->mapping, mesh->size);
+    }
+    memset (mesh, 0, sizeof (*mesh));
+}
+
+/** Round offset up to alignment of payloads
+ * @param offset offset in bytes
+ * @returns aligned offset
+ */
+static GLuint64 align_payload (GLuint64 offset)
+{
+    return (offset + MESH_FILE_ALIGNMENT - 1) & ~(GLuint64) (MESH_FILE_ALIGNMENT
+            - 1);
+}
+
+/** Write zeros up to offset
+ * @param file target file
+ * @param position current offset in file
+ * @param offset offset to pad up to
+ * @returns 0 on success, -1 on I/O error
+ */
+static int pad (FILE *file, GLuint64 position, GLuint64 offset)
+{
+    static const unsigned char zeros[MESH_FILE_ALIGNMENT] = { 0 };
+    size_t size = (size_t) (offset - position);
+    return fwrite (zeros, 1, size, file) == size ? 0 : -1;
+}
+
+int mesh_file_write (const char *path, const void *vertices,
+                     GLuint vertex_size, GLuint n_vertices,
+                     const void *indices, GLuint index_size,
+                     GLuint n_indices)
+{
+    mesh_file_header_t header;
+    size_t vertices_size = (size_t)vertex_size * n_vertices;
+    size_t indices_size = (size_t)index_size * n_indices;
+    int err;
+    FILE *file = fopen (path, "wb");
+    if (file == NULL) {
+        return -1;
+    }
+    memset (&header, 0, sizeof (header));
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.vertex_size = vertex_size;
+    header.index_size = index_size;
+    header.n_vertices = n_vertices;
+    header.n_indices = n_indices;
+    header.vertex_offset = align_payload (sizeof (header));
+    header.index_offset = align_payload (header.vertex_offset +
+                                         vertices_size);
+    err = fwrite (&header, sizeof (header), 1, file) == 1 ? 0 : -1;
+    err = err != 0 ? err : pad (file, sizeof (header), header.vertex_offset);
+    if ((err == 0)
+            && (fwrite (vertices, 1, vertices_size, file) != vertices_size)) {
+        err = -1;
+    }
+    err = err != 0 ? err : pad (file, header.vertex_offset + vertices_size,
+                                header.index_offset);
+    if ((err == 0) && (fwrite (indices, 1, indices_size, file) != indices_size)) {
+        err = -1;
+    }
+    if (fclose (file) != 0) {
+        err = -1;
+    }
+    return err;
+}
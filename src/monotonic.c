@@ -0,0 +1,16 @@
+/**
+ * @file monotonic.c
+ * This module contains monotonic clock for measuring intervals.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <time.h>
+#include "monotonic.h"
+
+double monotonic_ms (void)
+{
+    struct timespec now;
+    clock_gettime (CLOCK_MONOTONIC, &now);
+    return (double)now.tv_sec * 1000.0 + (double)now.tv_nsec / 1000000.0;
+}
@@ -0,0 +1,664 @@
+/**
+ * @file particles.c
+ * This module contains particle fountain simulated by compute shaders or,
+ * without them, by worker threads.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "gl_procs.h"
+#include "gl_state.h"
+#include "shader.h"
+#include "workers.h"
+#include "stream_buffer.h"
+#include "gpu_memory.h"
+#include "particles.h"
+
+/** Number of particles simulated by single compute work group */
+#define GROUP_SIZE 256
+
+/** Maximum number of particles, limited by number of work groups */
+#define MAX_CAPACITY (65535u * GROUP_SIZE)
+
+/** Size of particle in shader storage buffer: position, life, velocity */
+#define PARTICLE_SIZE (8 * sizeof (GLfloat))
+
+/** Size of particle vertex streamed by CPU path: position and life */
+#define VERTEX_SIZE (4 * sizeof (GLfloat))
+
+/** Maximum number of slices of CPU path */
+#define MAX_SLICES 64
+
+/** Vertical acceleration in units per second squared */
+#define GRAVITY (-9.81f)
+
+/** Fraction of velocity lost per second */
+#define DRAG 0.1f
+
+/** Fraction of vertical velocity kept after bouncing off the ground */
+#define BOUNCE 0.5f
+
+/** Shortest life of particle in seconds */
+#define MIN_LIFE 2.5f
+
+/** Longest life of particle in seconds */
+#define MAX_LIFE 4.0f
+
+/** Fields of particles of CPU path, each stored as separate array */
+enum {
+    FIELD_X,
+    FIELD_Y,
+    FIELD_Z,
+    FIELD_VX,
+    FIELD_VY,
+    FIELD_VZ,
+    FIELD_LIFE,
+    N_FIELDS
+};
+
+/** Layout of DrawArraysIndirectCommand, count doubles as live counter */
+typedef struct indirect_command_t {
+    GLuint count; /**< Number of live particles */
+    GLuint instance_count; /**< Always 1 */
+    GLuint first; /**< Always 0 */
+    GLuint base_instance; /**< Always 0 */
+} indirect_command_t;
+
+/** Range of particles owned by single worker job of CPU path */
+typedef struct particle_slice_t {
+    unsigned long first; /**< Index of the first particle */
+    unsigned long capacity; /**< Maximum number of particles */
+    unsigned long n_alive; /**< Number of live particles */
+    unsigned int seed; /**< State of random generator */
+    char padding[4];
+} particle_slice_t;
+
+/** Simulation of all slices of CPU path in one frame */
+typedef struct simulate_job_t {
+    GLfloat *vertices; /**< Vertices of current frame */
+    unsigned long n_emitted; /**< Number of particles to spawn */
+    unsigned int n_slices; /**< Number of slices */
+    float dt; /**< Time step in seconds */
+} simulate_job_t;
+
+/** Common functions of shaders, pseudo-random spawning of particle */
+#define SPAWN_SOURCE \
+    "struct Particle { vec4 position; vec4 velocity; };\n" \
+    "uint hash (uint x) {\n" \
+    "    x ^= x >> 16; x *= 0x7feb352du;\n" \
+    "    x ^= x >> 15; x *= 0x846ca68bu;\n" \
+    "    return x ^ (x >> 16);\n" \
+    "}\n" \
+    "float random (inout uint state) {\n" \
+    "    state = hash (state);\n" \
+    "    return float (state >> 8) / 16777216.0;\n" \
+    "}\n"
+
+/** Simulation shader: integrates, spawns and compacts particles */
+static const char *const simulate_source[] = {
+    "#version 430\n"
+    "layout (local_size_x = 256) in;\n",
+    SPAWN_SOURCE,
+    "struct Command { uint count; uint instance_count; uint first;\n"
+    "    uint base_instance; };\n"
+    "layout (std430, binding = 0) readonly buffer Source\n"
+    "    { Particle source[]; };\n"
+    "layout (std430, binding = 1) writeonly buffer Destination\n"
+    "    { Particle destination[]; };\n"
+    "layout (std430, binding = 2) buffer Commands { Command commands[2]; };\n"
+    "uniform int source_command;\n"
+    "uniform int emit_count;\n"
+    "uniform int capacity;\n"
+    "uniform int seed;\n"
+    "uniform float dt;\n",
+    "Particle spawn (uint state) {\n"
+    "    float angle = random (state) * 6.2831853;\n"
+    "    float spread = random (state) * 2.0;\n"
+    "    Particle p;\n"
+    "    p.position = vec4 (0.0, 0.0, 0.0, mix (2.5, 4.0, random (state)));\n"
+    "    p.velocity = vec4 (cos (angle) * spread, 8.0 + random (state) * 4.0,\n"
+    "        sin (angle) * spread, 0.0);\n"
+    "    return p;\n"
+    "}\n",
+    "void main () {\n"
+    "    uint i = gl_GlobalInvocationID.x;\n"
+    "    uint alive = commands[source_command].count;\n"
+    "    Particle p;\n"
+    "    if (i >= uint (capacity)) return;\n"
+    "    if (i < alive) {\n"
+    "        p = source[i];\n"
+    "        p.velocity.y -= 9.81 * dt;\n"
+    "        p.velocity.xyz *= 1.0 - 0.1 * dt;\n"
+    "        p.position.xyz += p.velocity.xyz * dt;\n",
+    "        if (p.position.y < 0.0) {\n"
+    "            p.position.y = -p.position.y;\n"
+    "            p.velocity.y *= -0.5;\n"
+    "        }\n"
+    "        p.position.w -= dt;\n"
+    "        if (p.position.w <= 0.0) return;\n"
+    "    } else if (i < alive + uint (emit_count)) {\n"
+    "        p = spawn (hash (i ^ hash (uint (seed))));\n"
+    "    } else {\n"
+    "        return;\n"
+    "    }\n"
+    "    destination[atomicAdd (commands[1 - source_command].count, 1u)] = p;\n"
+    "}\n",
+    NULL
+};
+
+/** Vertex shader of GPU path, particle is fetched by vertex index */
+static const char *const storage_vertex_source[] = {
+    "#version 430\n"
+    "struct Particle { vec4 position; vec4 velocity; };\n"
+    "layout (std430, binding = 0) readonly buffer Particles\n"
+    "    { Particle particles[]; };\n"
+    "uniform mat4 view_projection;\n"
+    "out float life;\n"
+    "void main () {\n"
+    "    vec4 particle = particles[gl_VertexID].position;\n"
+    "    life = particle.w;\n"
+    "    gl_Position = view_projection * vec4 (particle.xyz, 1.0);\n"
+    "    gl_PointSize = clamp (60.0 / gl_Position.w, 1.0, 8.0);\n"
+    "}\n",
+    NULL
+};
+
+/** Vertex shader of CPU path, particle comes from vertex attribute */
+static const char *const attribute_vertex_source[] = {
+    "#version 330\n"
+    "layout (location = 0) in vec4 particle;\n"
+    "uniform mat4 view_projection;\n"
+    "out float life;\n"
+    "void main () {\n"
+    "    life = particle.w;\n"
+    "    gl_Position = view_projection * vec4 (particle.xyz, 1.0);\n"
+    "    gl_PointSize = clamp (60.0 / gl_Position.w, 1.0, 8.0);\n"
+    "}\n",
+    NULL
+};
+
+/** Fragment shader, round sprite fading out at the end of life */
+static const char *const fragment_source[] = {
+    "#version 330\n"
+    "in float life;\n"
+    "out vec4 color;\n"
+    "void main () {\n"
+    "    vec2 d = gl_PointCoord * 2.0 - 1.0;\n"
+    "    float alpha = max (1.0 - dot (d, d), 0.0) * min (life, 1.0);\n"
+    "    color = vec4 (mix (vec3 (1.0, 0.25, 0.05), vec3 (1.0, 0.85, 0.4),\n"
+    "        min (life / 4.0, 1.0)), alpha);\n"
+    "}\n",
+    NULL
+};
+
+/** Non-zero if particles are simulated by compute shaders */
+static int use_compute = 0;
+
+/** Maximum number of live particles */
+static GLuint particle_capacity = 0;
+
+/** Fractional number of particles to spawn carried to the next frame */
+static double emit_carry = 0.0;
+
+/** Number of simulated frames */
+static GLint n_updates = 0;
+
+/** Simulation program of GPU path */
+static GLuint simulate_program = 0;
+
+/** Drawing program */
+static GLuint draw_program = 0;
+
+/** Vertex array of particles */
+static GLuint vertex_array = 0;
+
+/** Pair of particle storage buffers of GPU path */
+static GLuint particle_buffers[2];
+
+/** Indirect commands of GPU path, one per particle buffer */
+static GLuint command_buffer = 0;
+
+/** Tracked storage of particle and command buffers */
+static int buffers_allocation = -1;
+
+/** Index of particle buffer holding live particles */
+static GLuint current = 0;
+
+/** Locations of uniforms of simulation program */
+static GLint source_location = -1, emit_location = -1,
+             capacity_location = -1, seed_location = -1, dt_location = -1;
+
+/** Location of view-projection uniform of drawing program */
+static GLint view_projection_location = -1;
+
+/** Arrays of particle fields of CPU path, one allocation */
+static float *fields[N_FIELDS];
+
+/** Slices of CPU path */
+static particle_slice_t slices[MAX_SLICES];
+
+/** Number of slices of CPU path */
+static unsigned int n_slices = 0;
+
+/** Vertices of CPU path */
+static stream_buffer_t stream;
+
+/** Non-zero if streaming buffer of CPU path is created */
+static int has_stream = 0;
+
+/** Check if context can simulate particles with compute shaders
+ * @returns non-zero if GPU path is supported
+ */
+static int is_compute_supported (void)
+{
+    return gl_version_at_least (4, 3) && (gl.DispatchCompute != NULL)
+           && (gl.MemoryBarrier != NULL) && (gl.DrawArraysIndirect != NULL);
+}
+
+/** Create buffers of GPU path
+ * @returns 0 on success, -1 on failure
+ */
+static int init_gpu (void)
+{
+    indirect_command_t commands[2];
+    simulate_program = shader_program_create_compute ("particle simulation",
+                       simulate_source);
+    draw_program = shader_program_create ("particles", storage_vertex_source,
+                                          fragment_source);
+    if ((simulate_program == 0) || (draw_program == 0)) {
+        return -1;
+    }
+    source_location = gl.GetUniformLocation (simulate_program,
+                      "source_command");
+    emit_location = gl.GetUniformLocation (simulate_program, "emit_count");
+    capacity_location = gl.GetUniformLocation (simulate_program, "capacity");
+    seed_location = gl.GetUniformLocation (simulate_program, "seed");
+    dt_location = gl.GetUniformLocation (simulate_program, "dt");
+    memset (commands, 0, sizeof (commands));
+    commands[0].instance_count = 1;
+    commands[1].instance_count = 1;
+    gl.GenBuffers (2, particle_buffers);
+    gl.GenBuffers (1, &command_buffer);
+    gl_state_bind_buffer (GL_SHADER_STORAGE_BUFFER, particle_buffers[0]);
+    gl.BufferData (GL_SHADER_STORAGE_BUFFER,
+                   (GLsizeiptr) (particle_capacity * PARTICLE_SIZE), NULL,
+                   GL_DYNAMIC_COPY);
+    gl_state_bind_buffer (GL_SHADER_STORAGE_BUFFER, particle_buffers[1]);
+    gl.BufferData (GL_SHADER_STORAGE_BUFFER,
+                   (GLsizeiptr) (particle_capacity * PARTICLE_SIZE), NULL,
+                   GL_DYNAMIC_COPY);
+    gl_state_bind_buffer (GL_DRAW_INDIRECT_BUFFER, command_buffer);
+    gl.BufferData (GL_DRAW_INDIRECT_BUFFER, (GLsizeiptr)sizeof (commands),
+                   commands, GL_DYNAMIC_COPY);
+    buffers_allocation = gpu_memory_track (GPU_MEMORY_BUFFER,
+                                           GL_SHADER_STORAGE_BUFFER,
+                                           2 * particle_capacity * PARTICLE_SIZE
+                                           + sizeof (commands), NULL, NULL);
+    /* Vertex shader fetches particles itself, but draws need vertex array */
+    gl.GenVertexArrays (1, &vertex_array);
+    current = 0;
+    return 0;
+}
+
+/** Create particle arrays and streaming buffer of CPU path
+ * @returns 0 on success, -1 on failure
+ */
+static int init_cpu (void)
+{
+    unsigned int s, f;
+    if (!gl_version_at_least (3, 3) || (gl.GenVertexArrays == NULL)) {
+        return -1;
+    }
+    fields[0] = (float *)malloc (particle_capacity * N_FIELDS *
+                                 sizeof (float));
+    if (fields[0] == NULL) {
+        return -1;
+    }
+    for (f = 1; f < N_FIELDS; f++) {
+        fields[f] = fields[0] + f * particle_capacity;
+    }
+    if (stream_buffer_init (&stream, particle_capacity * VERTEX_SIZE) != 0) {
+        return -1;
+    }
+    has_stream = 1;
+    draw_program = shader_program_create ("particles",
+                                          attribute_vertex_source,
+                                          fragment_source);
+    if (draw_program == 0) {
+        return -1;
+    }
+    n_slices = workers_count () + 1;
+    if (n_slices > MAX_SLICES) {
+        n_slices = MAX_SLICES;
+    }
+    for (s = 0; s < n_slices; s++) {
+        slices[s].first = (unsigned long)particle_capacity * s / n_slices;
+        slices[s].capacity = (unsigned long)particle_capacity * (s + 1) /
+                             n_slices - slices[s].first;
+        slices[s].n_alive = 0;
+        slices[s].seed = 2463534242u + s * 2654435761u;
+    }
+    gl.GenVertexArrays (1, &vertex_array);
+    gl_state_bind_vertex_array (vertex_array);
+    gl_state_bind_buffer (GL_ARRAY_BUFFER, stream.buffer);
+    gl.EnableVertexAttribArray (0);
+    gl.VertexAttribPointer (0, 4, GL_FLOAT, GL_FALSE, (GLsizei)VERTEX_SIZE,
+                            NULL);
+    return 0;
+}
+
+int particles_init (GLuint capacity, int allow_compute)
+{
+    int err;
+    particle_capacity = capacity < MAX_CAPACITY ? capacity : MAX_CAPACITY;
+    emit_carry = 0.0;
+    n_updates = 0;
+    use_compute = allow_compute && is_compute_supported ();
+    if (use_compute && (init_gpu () != 0)) {
+        /* Compute shaders can still fail to compile, drop what was created
+         * and simulate on CPU */
+        particles_shutdown ();
+        use_compute = 0;
+    }
+    err = use_compute ? 0 : init_cpu ();
+    if (err != 0) {
+        particles_shutdown ();
+        return -1;
+    }
+    view_projection_location = gl.GetUniformLocation (draw_program,
+                               "view_projection");
+    return 0;
+}
+
+void particles_shutdown (void)
+{
+    if (vertex_array != 0) {
+        gl_state_forget_vertex_array (vertex_array);
+        gl.DeleteVertexArrays (1, &vertex_array);
+        vertex_array = 0;
+    }
+    if (command_buffer != 0) {
+        gl_state_forget_buffer (particle_buffers[0]);
+        gl_state_forget_buffer (particle_buffers[1]);
+        gl_state_forget_buffer (command_buffer);
+        gl.DeleteBuffers (2, particle_buffers);
+        gl.DeleteBuffers (1, &command_buffer);
+        command_buffer = 0;
+        gpu_memory_release (buffers_allocation);
+        buffers_allocation = -1;
+    }
+    if (has_stream) {
+        stream_buffer_destroy (&stream);
+        has_stream = 0;
+    }
+    free (fields[0]);
+    memset (fields, 0, sizeof (fields));
+    shader_program_destroy (simulate_program);
+    shader_program_destroy (draw_program);
+    simulate_program = 0;
+    draw_program = 0;
+    n_slices = 0;
+}
+
+/** Get pseudo-random number
+ * @param state state of generator, updated
+ * @returns number from 0 to 1
+ */
+static float random_unit (unsigned int *state)
+{
+    unsigned int x = *state;
+    float value;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    value = (float) (x >> 8);
+    return value / 16777216.0f;
+}
+
+/** Spawn particle of CPU path at the fountain
+ * @param i index of particle
+ * @param state state of random generator
+ */
+static void spawn (unsigned long i, unsigned int *state)
+{
+    float angle = random_unit (state) * 6.2831853f;
+    float spread = random_unit (state) * 2.0f;
+    fields[FIELD_X][i] = 0.0f;
+    fields[FIELD_Y][i] = 0.0f;
+    fields[FIELD_Z][i] = 0.0f;
+    fields[FIELD_LIFE][i] = MIN_LIFE + (MAX_LIFE - MIN_LIFE) *
+                            random_unit (state);
+    fields[FIELD_VX][i] = cosf (angle) * spread;
+    fields[FIELD_VY][i] = 8.0f + random_unit (state) * 4.0f;
+    fields[FIELD_VZ][i] = sinf (angle) * spread;
+}
+
+/** Integrate motion of particles of CPU path
+ * @param first index of the first particle
+ * @param n number of particles
+ * @param dt time step in seconds
+ */
+static void integrate (unsigned long first, unsigned long n, float dt)
+{
+    float *x = fields[FIELD_X], *y = fields[FIELD_Y], *z = fields[FIELD_Z];
+    float *vx = fields[FIELD_VX], *vy = fields[FIELD_VY];
+    float *vz = fields[FIELD_VZ], *life = fields[FIELD_LIFE];
+    float drag = 1.0f - DRAG * dt;
+    unsigned long i = first;
+#ifdef __SSE2__
+    {
+        __m128 step = _mm_set1_ps (dt), fall = _mm_set1_ps (GRAVITY * dt);
+        __m128 keep = _mm_set1_ps (drag), bounce = _mm_set1_ps (-BOUNCE);
+        __m128 zero = _mm_setzero_ps ();
+        for (; i + 4 <= first + n; i += 4) {
+            __m128 px = _mm_loadu_ps (x + i), py = _mm_loadu_ps (y + i);
+            __m128 pz = _mm_loadu_ps (z + i);
+            __m128 qx = _mm_mul_ps (_mm_loadu_ps (vx + i), keep);
+            __m128 qy = _mm_mul_ps (_mm_add_ps (_mm_loadu_ps (vy + i), fall),
+                                    keep);
+            __m128 qz = _mm_mul_ps (_mm_loadu_ps (vz + i), keep);
+            __m128 below;
+            px = _mm_add_ps (px, _mm_mul_ps (qx, step));
+            py = _mm_add_ps (py, _mm_mul_ps (qy, step));
+            pz = _mm_add_ps (pz, _mm_mul_ps (qz, step));
+            /* Particles below the ground are reflected off it */
+            below = _mm_cmplt_ps (py, zero);
+            py = _mm_or_ps (_mm_and_ps (below, _mm_sub_ps (zero, py)),
+                            _mm_andnot_ps (below, py));
+            qy = _mm_or_ps (_mm_and_ps (below, _mm_mul_ps (qy, bounce)),
+                            _mm_andnot_ps (below, qy));
+            _mm_storeu_ps (x + i, px);
+            _mm_storeu_ps (y + i, py);
+            _mm_storeu_ps (z + i, pz);
+            _mm_storeu_ps (vx + i, qx);
+            _mm_storeu_ps (vy + i, qy);
+            _mm_storeu_ps (vz + i, qz);
+            _mm_storeu_ps (life + i, _mm_sub_ps (_mm_loadu_ps (life + i),
+                                                 step));
+        }
+    }
+#endif
+    for (; i < first + n; i++) {
+        vx[i] *= drag;
+        vy[i] = (vy[i] + GRAVITY * dt) * drag;
+        vz[i] *= drag;
+        x[i] += vx[i] * dt;
+        y[i] += vy[i] * dt;
+        z[i] += vz[i] * dt;
+        if (y[i] < 0.0f) {
+            y[i] = -y[i];
+            vy[i] *= -BOUNCE;
+        }
+        life[i] -= dt;
+    }
+}
+
+/** Simulate slice of particles of CPU path and write its vertices
+ * @param arg simulate_job_t of frame
+ * @param index index of slice
+ */
+static void simulate_slice (void *arg, unsigned int index)
+{
+    const simulate_job_t *job = (const simulate_job_t *)arg;
+    particle_slice_t *slice = &slices[index];
+    unsigned long first = slice->first, n_alive = 0, n_emitted, i;
+    unsigned int f;
+    integrate (first, slice->n_alive, job->dt);
+    /* Survivors are moved down over dead particles */
+    for (i = first; i < first + slice->n_alive; i++) {
+        if (fields[FIELD_LIFE][i] > 0.0f) {
+            if (i != first + n_alive) {
+                for (f = 0; f < N_FIELDS; f++) {
+                    fields[f][first + n_alive] = fields[f][i];
+                }
+            }
+            n_alive++;
+        }
+    }
+    n_emitted = job->n_emitted * (index + 1) / job->n_slices -
+                job->n_emitted * index / job->n_slices;
+    if (n_emitted > slice->capacity - n_alive) {
+        n_emitted = slice->capacity - n_alive;
+    }
+    for (i = 0; i < n_emitted; i++) {
+        spawn (first + n_alive + i, &slice->seed);
+    }
+    slice->n_alive = n_alive + n_emitted;
+    for (i = first; i < first + slice->n_alive; i++) {
+        GLfloat *vertex = job->vertices + i * 4;
+        vertex[0] = fields[FIELD_X][i];
+        vertex[1] = fields[FIELD_Y][i];
+        vertex[2] = fields[FIELD_Z][i];
+        vertex[3] = fields[FIELD_LIFE][i];
+    }
+}
+
+/** Simulate and draw particles with compute shaders
+ * @param dt time step in seconds
+ * @param n_emitted number of particles to spawn
+ * @param view_projection view-projection matrix of frame
+ */
+static void update_gpu (float dt, GLuint n_emitted,
+                        const GLfloat *view_projection)
+{
+    static const GLuint zero = 0;
+    GLuint destination = 1 - current;
+    /* Counter of survivors starts from zero in destination command */
+    gl_state_bind_buffer (GL_DRAW_INDIRECT_BUFFER, command_buffer);
+    gl.BufferSubData (GL_DRAW_INDIRECT_BUFFER,
+                      (GLintptr) (destination * sizeof (indirect_command_t)),
+                      (GLsizeiptr)sizeof (zero), &zero);
+    gl_state_use_program (simulate_program);
+    gl_state_uniform1i (source_location, (GLint)current);
+    gl_state_uniform1i (emit_location, (GLint)n_emitted);
+    gl_state_uniform1i (capacity_location, (GLint)particle_capacity);
+    gl_state_uniform1i (seed_location, n_updates);
+    gl_state_uniform1f (dt_location, dt);
+    gl_state_bind_buffer_base (GL_SHADER_STORAGE_BUFFER, 0,
+                               particle_buffers[current]);
+    gl_state_bind_buffer_base (GL_SHADER_STORAGE_BUFFER, 1,
+                               particle_buffers[destination]);
+    gl_state_bind_buffer_base (GL_SHADER_STORAGE_BUFFER, 2, command_buffer);
+    gl.DispatchCompute ((particle_capacity + GROUP_SIZE - 1) / GROUP_SIZE, 1,
+                        1);
+    gl.MemoryBarrier (GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT
+                      | GL_BUFFER_UPDATE_BARRIER_BIT);
+    gl_state_use_program (draw_program);
+    gl_state_uniform_matrix4fv (view_projection_location, view_projection);
+    gl_state_bind_buffer_base (GL_SHADER_STORAGE_BUFFER, 0,
+                               particle_buffers[destination]);
+    gl_state_bind_vertex_array (vertex_array);
+    gl_state_bind_buffer (GL_DRAW_INDIRECT_BUFFER, command_buffer);
+    gl.DrawArraysIndirect (GL_POINTS, (const void *) (destination *
+                           sizeof (indirect_command_t)));
+    current = destination;
+}
+
+/** Simulate particles on worker threads and draw them
+ * @param dt time step in seconds
+ * @param n_emitted number of particles to spawn
+ * @param view_projection view-projection matrix of frame
+ */
+static void update_cpu (float dt, GLuint n_emitted,
+                        const GLfloat *view_projection)
+{
+    simulate_job_t job;
+    GLuint offset;
+    unsigned int s;
+    stream_buffer_begin_frame (&stream);
+    job.vertices = (GLfloat *)stream_buffer_alloc (&stream,
+                   particle_capacity * VERTEX_SIZE, VERTEX_SIZE, &offset);
+    if (job.vertices == NULL) {
+        return;
+    }
+    job.n_emitted = n_emitted;
+    job.n_slices = n_slices;
+    job.dt = dt;
+    workers_run (simulate_slice, &job, n_slices);
+    stream_buffer_commit (&stream);
+    gl_state_use_program (draw_program);
+    gl_state_uniform_matrix4fv (view_projection_location, view_projection);
+    gl_state_bind_vertex_array (vertex_array);
+    for (s = 0; s < n_slices; s++) {
+        if (slices[s].n_alive != 0) {
+            gl.DrawArrays (GL_POINTS, (GLint) (offset / VERTEX_SIZE +
+                                               slices[s].first),
+                           (GLsizei)slices[s].n_alive);
+        }
+    }
+}
+
+void particles_update (float dt, const GLfloat *view_projection)
+{
+    double whole;
+    GLuint n_emitted;
+    if (draw_program == 0) {
+        return;
+    }
+    /* Rate of spawning keeps pool full when particles live longest */
+    emit_carry += (double)particle_capacity / MAX_LIFE * dt;
+    whole = floor (emit_carry);
+    emit_carry -= whole;
+    n_emitted = whole < (double)particle_capacity ? (GLuint)whole :
+                particle_capacity;
+    gl_state_set_enabled (GL_PROGRAM_POINT_SIZE, 1);
+    gl_state_set_enabled (GL_BLEND, 1);
+    gl_state_blend_func (GL_SRC_ALPHA, GL_ONE, GL_ONE, GL_ONE);
+    gl_state_set_enabled (GL_DEPTH_TEST, 1);
+    gl_state_depth_mask (0);
+    if (use_compute) {
+        update_gpu (dt, n_emitted, view_projection);
+    } else {
+        update_cpu (dt, n_emitted, view_projection);
+    }
+    n_updates++;
+}
+
+void particles_end_frame (void)
+{
+    if (has_stream) {
+        stream_buffer_end_frame (&stream);
+    }
+}
+
+int particles_use_compute (void)
+{
+    return use_compute;
+}
+
+unsigned long particles_count (void)
+{
+    unsigned long count = 0;
+    unsigned int s;
+    for (s = 0; s < n_slices; s++) {
+        count += slices[s].n_alive;
+    }
+    return count;
+}
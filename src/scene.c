@@ -0,0 +1,1369 @@
+/**
+ * @file scene.c
+ * This module contains built-in animated scenes used as scalable rendering
+ * workloads.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gl_procs.h"
+#include "gl_state.h"
+#include "shader.h"
+#include "workers.h"
+#include "monotonic.h"
+#include "stream_buffer.h"
+#include "gpu_memory.h"
+#include "gpu_scene.h"
+#include "math3d.h"
+#include "cull.h"
+#include "particles.h"
+#include "mesh_file.h"
+#include "transform_graph.h"
+#include "ecs.h"
+#include "texture_residency.h"
+#include "gl_loader.h"
+#include "scene.h"
+
+/** Number of vertices of cube */
+#define CUBE_VERTICES 24
+
+/** Number of indices of cube */
+#define CUBE_INDICES 36
+
+/** Distance between centers of neighbouring cubes */
+#define CUBE_SPACING 2.0f
+
+/** Radius of sphere enclosing spinning cube at any height of its bobbing */
+#define CUBE_RADIUS 1.37f
+
+/** Maximum number of instances drawn by single draw */
+#define CUBES_PER_DRAW 16384
+
+/** Size of per-instance data of cube: position xyz and rotation angle */
+#define INSTANCE_SIZE (4 * sizeof (GLfloat))
+
+/** Size of uniform block of frame: view-projection matrix */
+#define FRAME_UNIFORMS_SIZE (16 * sizeof (GLfloat))
+
+/** Room left in streaming buffer for alignment of uniform block */
+#define ALIGNMENT_SLACK 1024
+
+/** Vertical field of view of camera in radians */
+#define CAMERA_FOV 1.0f
+
+/** Nearest view depth of textured cube used to estimate its size */
+#define MIN_TEXTURE_DEPTH 0.1f
+
+/** Distance of camera from particle fountain */
+#define FOUNTAIN_CAMERA_RADIUS 20.0f
+
+/** Longest time step of simulation in seconds */
+#define MAX_TIME_STEP 0.1f
+
+/** Number of cubes of hierarchy scene orbiting each spinning root cube */
+#define SATELLITES 7
+
+/** Distance between centers of neighbouring root cubes of hierarchy */
+#define SYSTEM_SPACING 8.0f
+
+/** Time after which next group of satellites starts or stops bobbing */
+#define BOB_WAVE_SECONDS 1.0f
+
+/** Number of groups of satellites toggled by waves of bobbing */
+#define BOB_WAVE_GROUPS 4
+
+/** Time each row of static scene spins before the next row takes over */
+#define SPIN_ROW_SECONDS 2.0f
+
+/** Size of per-instance data of hierarchy: model matrix */
+#define MATRIX_SIZE (16 * sizeof (GLfloat))
+
+/** Kinds of built-in scenes */
+typedef enum scene_kind_t {
+    SCENE_NONE,
+    SCENE_CUBES,
+    SCENE_STATIC,
+    SCENE_PARTICLES,
+    SCENE_HIERARCHY
+} scene_kind_t;
+
+/** Animation of slice of cubes run by worker */
+typedef struct update_job_t {
+    GLfloat *instances; /**< Per-instance data of current frame */
+    const unsigned int *visible; /**< Indices of visible cubes */
+    unsigned long n_objects; /**< Number of visible cubes */
+    unsigned long side; /**< Number of cubes along side of grid */
+    const GLfloat *view_projection; /**< View-projection matrix of frame */
+    float *nearest; /**< Receives view depth of the nearest cube of each
+                      texture for each slice, NULL if cubes aren't
+                      textured */
+    unsigned int n_jobs; /**< Number of slices */
+    float time; /**< Animation time in seconds */
+} update_job_t;
+
+/** Work on slice of cubes of hierarchy run by worker */
+typedef struct hierarchy_job_t {
+    GLfloat *instances; /**< Per-instance matrices of current frame */
+    const unsigned int *visible; /**< Indices of visible cubes */
+    unsigned long n_objects; /**< Number of processed cubes */
+    unsigned int n_jobs; /**< Number of slices */
+    char padding[4];
+} hierarchy_job_t;
+
+/** Placement of entity of hierarchy relative to its parent */
+typedef struct placement_t {
+    float position[3]; /**< Translation */
+    float scale; /**< Uniform scale */
+} placement_t;
+
+/** Rotation of entity of hierarchy at constant speed */
+typedef struct spin_t {
+    float axis[3]; /**< Unit axis of rotation */
+    float speed; /**< Angular speed in radians per second */
+    float phase; /**< Angle at time 0 */
+    char padding[4];
+} spin_t;
+
+/** Bobbing of entity of hierarchy up and down */
+typedef struct bob_t {
+    float amplitude; /**< Largest offset from rest height */
+    float phase; /**< Phase at time 0 */
+} bob_t;
+
+/** Vertex shader of instanced cubes */
+static const char *const cubes_vertex_source[] = {
+    "#version 420\n"
+    "layout (location = 0) in vec3 position;\n"
+    "layout (location = 1) in vec3 normal;\n"
+    "layout (location = 2) in vec4 instance;\n"
+    "layout (std140, binding = 0) uniform Frame { mat4 view_projection; };\n"
+    "out vec3 world_normal;\n"
+    "out vec3 albedo;\n"
+    "out vec2 uv;\n",
+    "vec3 rotate (vec3 v, float c, float s) {\n"
+    "    return vec3 (c * v.x + s * v.z, v.y, c * v.z - s * v.x);\n"
+    "}\n",
+    "void main () {\n"
+    "    float c = cos (instance.w), s = sin (instance.w);\n"
+    "    vec3 side = abs (normal);\n"
+    "    uv = (side.x > 0.5 ? position.zy : side.y > 0.5 ? position.xz\n"
+    "        : position.xy) + 0.5;\n"
+    "    world_normal = rotate (normal, c, s);\n"
+    "    albedo = 0.55 + 0.45 * sin (instance.xzx * vec3 (0.11, 0.07, 0.05)\n"
+    "        + vec3 (0.0, 2.0, 4.0));\n"
+    "    gl_Position = view_projection\n"
+    "        * vec4 (rotate (position, c, s) + instance.xyz, 1.0);\n"
+    "}\n",
+    NULL
+};
+
+/** Vertex shader of hierarchy, model matrix is per-instance attribute */
+static const char *const hierarchy_vertex_source[] = {
+    "#version 420\n"
+    "layout (location = 0) in vec3 position;\n"
+    "layout (location = 1) in vec3 normal;\n"
+    "layout (location = 2) in mat4 transform;\n"
+    "layout (std140, binding = 0) uniform Frame { mat4 view_projection; };\n"
+    "out vec3 world_normal;\n"
+    "out vec3 albedo;\n",
+    "void main () {\n"
+    "    world_normal = mat3 (transform) * normal;\n"
+    "    albedo = 0.55 + 0.45 * sin (transform[3].xzx\n"
+    "        * vec3 (0.11, 0.07, 0.05) + vec3 (0.0, 2.0, 4.0));\n"
+    "    gl_Position = view_projection * transform * vec4 (position, 1.0);\n"
+    "}\n",
+    NULL
+};
+
+/** Fragment shader of instanced cubes */
+static const char *const cubes_fragment_source[] = {
+    "#version 420\n"
+    "in vec3 world_normal;\n"
+    "in vec3 albedo;\n"
+    "out vec4 color;\n"
+    "void main () {\n"
+    "    float light = max (dot (normalize (world_normal),\n"
+    "        vec3 (0.40, 0.80, 0.45)), 0.0);\n"
+    "    color = vec4 (albedo * (0.2 + 0.8 * light), 1.0);\n"
+    "}\n",
+    NULL
+};
+
+/** Fragment shader of instanced cubes with texture on each face */
+static const char *const textured_fragment_source[] = {
+    "#version 420\n"
+    "layout (binding = 0) uniform sampler2D albedo_map;\n"
+    "in vec3 world_normal;\n"
+    "in vec3 albedo;\n"
+    "in vec2 uv;\n"
+    "out vec4 color;\n"
+    "void main () {\n"
+    "    float light = max (dot (normalize (world_normal),\n"
+    "        vec3 (0.40, 0.80, 0.45)), 0.0);\n"
+    "    color = vec4 (texture (albedo_map, uv).rgb * albedo\n"
+    "        * (0.2 + 0.8 * light), 1.0);\n"
+    "}\n",
+    NULL
+};
+
+/** Kind of current scene */
+static scene_kind_t kind = SCENE_NONE;
+
+/** Number of objects in scene */
+static unsigned long object_count = 0;
+
+/** Number of cubes along side of grid */
+static unsigned long grid_side = 0;
+
+/** Per-frame data of instanced cubes */
+static stream_buffer_t stream;
+
+/** Program of instanced cubes */
+static GLuint cubes_program = 0;
+
+/** Vertex and index buffers of instanced cube */
+static GLuint cube_buffers[2];
+
+/** Tracked storage of cube buffers */
+static int cube_allocation = -1;
+
+/** Vertex array of instanced cubes, 0 until loader creates cube buffers */
+static GLuint cubes_vertex_array = 0;
+
+/** Cube read by loader when it creates buffers of instanced or static
+ * cubes */
+static GLfloat cube_vertices[CUBE_VERTICES * GPU_SCENE_VERTEX_FLOATS];
+
+/** Triangle list of cube */
+static GLuint cube_indices[CUBE_INDICES];
+
+/** Bounding spheres of cubes: arrays of x, y, z and radius */
+static float *cube_bounds = NULL;
+
+/** Indices of cubes that passed culling in current frame */
+static unsigned int *visible_cubes = NULL;
+
+/** Number of cubes drawn since previous report */
+static unsigned long n_visible_total = 0;
+
+/** Time spent culling since previous report */
+static double cull_total_ms = 0.0;
+
+/** Number of frames since previous report */
+static unsigned long n_frames = 0;
+
+/** Time spent animating since previous report */
+static double update_total_ms = 0.0;
+
+/** Animation time of previous update in seconds */
+static float previous_time = 0.0f;
+
+/** Mapped mesh drawn by static scene instead of cube, NULL for cube */
+static const mesh_file_t *static_mesh = NULL;
+
+/** Handles of textures in texture residency sampled by cubes */
+static const int *texture_handles = NULL;
+
+/** Number of textures sampled by cubes, each covers equal range of them */
+static unsigned int n_textures = 0;
+
+/** Transforms of hierarchy: root cubes with satellites as children */
+static transform_graph_t graph;
+
+/** Entities of hierarchy, one per node of graph */
+static ecs_world_t world;
+
+/** Identifiers of components of hierarchy: node of graph, placement_t,
+ * spin_t and bob_t */
+static unsigned int node_component = 0, placement_component = 0,
+                    spin_component = 0, bob_component = 0;
+
+/** Animation time of current tick in seconds, read by systems */
+static float tick_time = 0.0f;
+
+/** Satellites of hierarchy, whose bob_t comes and goes in waves */
+static ecs_entity_t *satellites = NULL;
+
+/** Number of satellites */
+static unsigned long n_satellites = 0;
+
+/** Index of the last wave of bobbing */
+static unsigned long bob_wave = 0;
+
+/** Bounding boxes of cubes of hierarchy: arrays of x, y and z of centers
+ * and x, y and z of half-extents */
+static float *hierarchy_bounds = NULL;
+
+/** Number of nodes whose world matrices were updated since previous
+ * report */
+static unsigned long n_transformed_total = 0;
+
+/** Time spent updating transforms since previous report */
+static double tick_total_ms = 0.0;
+
+/** Build cube of unit size centered at origin
+ * @param vertices receives CUBE_VERTICES vertices of position and normal
+ * @param indices receives CUBE_INDICES indices of triangle list
+ */
+static void build_cube (GLfloat *vertices, GLuint *indices)
+{
+    static const GLfloat corners[4][2] = {
+        { -0.5f, -0.5f }, { 0.5f, -0.5f }, { 0.5f, 0.5f }, { -0.5f, 0.5f }
+    };
+    static const GLuint quad[6] = { 0, 1, 2, 0, 2, 3 };
+    GLuint face, corner, i;
+    for (face = 0; face < 6; face++) {
+        GLuint axis = face / 2;
+        GLfloat sign = (face & 1) ? -0.5f : 0.5f;
+        for (corner = 0; corner < 4; corner++) {
+            /* Reversed order keeps faces of negative side counter-clockwise */
+            GLuint c = (face & 1) ? 3 - corner : corner;
+            GLfloat *vertex = vertices + (face * 4 + corner) *
+                              GPU_SCENE_VERTEX_FLOATS;
+            vertex[axis] = sign;
+            vertex[(axis + 1) % 3] = corners[c][0];
+            vertex[(axis + 2) % 3] = corners[c][1];
+            vertex[3] = 0.0f;
+            vertex[4] = 0.0f;
+            vertex[5] = 0.0f;
+            vertex[3 + axis] = sign * 2.0f;
+        }
+        for (i = 0; i < 6; i++) {
+            indices[face * 6 + i] = face * 4 + quad[i];
+        }
+    }
+}
+
+/** Build view-projection matrix of camera orbiting around scene
+ * @param time animation time in seconds
+ * @param radius distance of camera from center of scene
+ * @param aspect aspect ratio of window
+ * @param matrix receives view-projection matrix in column-major order
+ */
+static void orbit_camera (float time, float radius, float aspect,
+                          GLfloat *matrix)
+{
+    static const float center[3] = { 0.0f, 0.0f, 0.0f };
+    static const float up[3] = { 0.0f, 1.0f, 0.0f };
+    GLfloat view[16], projection[16];
+    float eye[3];
+    eye[0] = sinf (time * 0.1f) * radius;
+    eye[1] = radius * 0.5f;
+    eye[2] = cosf (time * 0.1f) * radius;
+    mat4_look_at (eye, center, up, view);
+    mat4_perspective (CAMERA_FOV, aspect, 0.1f, radius * 3.0f, projection);
+    mat4_multiply (projection, view, matrix);
+}
+
+/** Get the first cube of range sampling texture
+ * @param texture index of texture, n_textures for end of the last range
+ * @returns index of the first cube of range
+ */
+static unsigned long first_cube (unsigned int texture)
+{
+    return object_count * texture / n_textures;
+}
+
+/** Get texture sampled by cube, ranges of textures as in first_cube()
+ * @param cube index of cube
+ * @returns index of texture
+ */
+static unsigned int cube_texture (unsigned long cube)
+{
+    unsigned int texture = (unsigned int) (cube * n_textures / object_count);
+    while ((texture + 1 < n_textures) && (first_cube (texture + 1) <= cube)) {
+        texture++;
+    }
+    return texture;
+}
+
+/** Animate slice of cubes
+ * @param arg update_job_t of frame
+ * @param index index of slice
+ */
+static void update_cubes (void *arg, unsigned int index)
+{
+    const update_job_t *job = (const update_job_t *)arg;
+    unsigned long first = job->n_objects * index / job->n_jobs;
+    unsigned long last = job->n_objects * (index + 1) / job->n_jobs;
+    float half = (float)job->side * 0.5f;
+    float *nearest = job->nearest;
+    const GLfloat *m = job->view_projection;
+    unsigned long k;
+    for (k = first; k < last; k++) {
+        GLfloat *instance = job->instances + k * 4;
+        unsigned long i = job->visible[k];
+        float x = (float) (i % job->side) - half;
+        float z = (float) (i / job->side) - half;
+        float phase = (x + z) * 0.3f;
+        float y = sinf (job->time * 2.0f + phase) * 0.5f;
+        x *= CUBE_SPACING;
+        z *= CUBE_SPACING;
+        instance[0] = x;
+        instance[1] = y;
+        instance[2] = z;
+        instance[3] = job->time + phase;
+        if (nearest != NULL) {
+            /* Clip w is view depth */
+            float depth = m[3] * x + m[7] * y + m[11] * z + m[15];
+            unsigned long slot = index * n_textures + cube_texture (i);
+            if (depth < nearest[slot]) {
+                nearest[slot] = depth;
+            }
+        }
+    }
+}
+
+/** Free bounds of cubes and visibility list */
+static void free_cube_bounds (void)
+{
+    free (cube_bounds);
+    free (visible_cubes);
+    cube_bounds = NULL;
+    visible_cubes = NULL;
+}
+
+/** Allocate bounding spheres of cubes of grid
+ * @returns 0 on success, -1 if out of memory
+ */
+static int init_cube_bounds (void)
+{
+    float half = (float)grid_side * 0.5f;
+    unsigned long i;
+    cube_bounds = (float *)malloc (object_count * 4 * sizeof (float));
+    visible_cubes = (unsigned int *)malloc (object_count *
+                                            sizeof (unsigned int));
+    if ((cube_bounds == NULL) || (visible_cubes == NULL)) {
+        free_cube_bounds ();
+        return -1;
+    }
+    for (i = 0; i < object_count; i++) {
+        cube_bounds[i] = ((float) (i % grid_side) - half) * CUBE_SPACING;
+        cube_bounds[object_count + i] = 0.0f;
+        cube_bounds[object_count * 2 + i] = ((float) (i / grid_side) - half) *
+                                            CUBE_SPACING;
+        cube_bounds[object_count * 3 + i] = CUBE_RADIUS;
+    }
+    return 0;
+}
+
+/** Check if context can draw instanced cubes
+ * @returns non-zero if instanced cubes are supported
+ */
+static int is_instancing_supported (void)
+{
+    return (gl.DrawElementsInstancedBaseVertexBaseInstance != NULL)
+           && gl_version_at_least (4, 2) && (gl.GenVertexArrays != NULL);
+}
+
+/** Create buffers of cube, called by loader
+ * @param user unused
+ */
+static void create_cube_buffers (void *user)
+{
+    (void)user;
+    gl.GenBuffers (2, cube_buffers);
+    gl.BindBuffer (GL_COPY_WRITE_BUFFER, cube_buffers[0]);
+    gl.BufferData (GL_COPY_WRITE_BUFFER, (GLsizeiptr)sizeof (cube_vertices),
+                   cube_vertices, GL_STATIC_DRAW);
+    gl.BindBuffer (GL_COPY_WRITE_BUFFER, cube_buffers[1]);
+    gl.BufferData (GL_COPY_WRITE_BUFFER, (GLsizeiptr)sizeof (cube_indices),
+                   cube_indices, GL_STATIC_DRAW);
+    gl.BindBuffer (GL_COPY_WRITE_BUFFER, 0);
+}
+
+/** Create vertex array of cubes once loader has created their buffers,
+ * taking per-instance data of current scene from streaming buffer
+ * @param user unused
+ */
+static void finish_cube_buffers (void *user)
+{
+    GLsizei stride = (GLsizei) (GPU_SCENE_VERTEX_FLOATS * sizeof (GLfloat));
+    GLuint column;
+    (void)user;
+    gl.GenVertexArrays (1, &cubes_vertex_array);
+    gl_state_bind_vertex_array (cubes_vertex_array);
+    gl_state_bind_buffer (GL_ELEMENT_ARRAY_BUFFER, cube_buffers[1]);
+    gl_state_bind_buffer (GL_ARRAY_BUFFER, cube_buffers[0]);
+    gl.EnableVertexAttribArray (0);
+    gl.VertexAttribPointer (0, 3, GL_FLOAT, GL_FALSE, stride, NULL);
+    gl.EnableVertexAttribArray (1);
+    gl.VertexAttribPointer (1, 3, GL_FLOAT, GL_FALSE, stride,
+                            (const void *) (3 * sizeof (GLfloat)));
+    gl_state_bind_buffer (GL_ARRAY_BUFFER, stream.buffer);
+    if (kind == SCENE_HIERARCHY) {
+        for (column = 0; column < 4; column++) {
+            gl.EnableVertexAttribArray (2 + column);
+            gl.VertexAttribPointer (2 + column, 4, GL_FLOAT, GL_FALSE,
+                                    (GLsizei)MATRIX_SIZE, (const void *)
+                                    (column * 4 * sizeof (GLfloat)));
+            gl.VertexAttribDivisor (2 + column, 1);
+        }
+    } else {
+        gl.EnableVertexAttribArray (2);
+        gl.VertexAttribPointer (2, 4, GL_FLOAT, GL_FALSE,
+                                (GLsizei)INSTANCE_SIZE, NULL);
+        gl.VertexAttribDivisor (2, 1);
+    }
+}
+
+/** Create program and streaming buffer of instanced cubes
+ * @param name name of program for messages
+ * @param vertex_source vertex shader
+ * @param fragment_source fragment shader
+ * @param frame_size size of per-instance data of frame
+ * @returns 0 on success, -1 on failure
+ */
+static int init_instancing (const char *name,
+                            const char *const *vertex_source,
+                            const char *const *fragment_source,
+                            size_t frame_size)
+{
+    cubes_program = shader_program_create (name, vertex_source,
+                                           fragment_source);
+    if (cubes_program == 0) {
+        return -1;
+    }
+    if (stream_buffer_init (&stream, frame_size + FRAME_UNIFORMS_SIZE
+                            + ALIGNMENT_SLACK) != 0) {
+        shader_program_destroy (cubes_program);
+        cubes_program = 0;
+        return -1;
+    }
+    build_cube (cube_vertices, cube_indices);
+    if (gl_loader_submit (create_cube_buffers, finish_cube_buffers, NULL)
+            != 0) {
+        stream_buffer_destroy (&stream);
+        shader_program_destroy (cubes_program);
+        cubes_program = 0;
+        return -1;
+    }
+    cube_allocation = gpu_memory_track (GPU_MEMORY_BUFFER, GL_ARRAY_BUFFER,
+                                        sizeof (cube_vertices)
+                                        + sizeof (cube_indices), NULL, NULL);
+    return 0;
+}
+
+/** Create resources of instanced cubes
+ * @returns 0 on success, -1 on failure
+ */
+static int init_cubes (void)
+{
+    if (!is_instancing_supported () || (init_cube_bounds () != 0)) {
+        return -1;
+    }
+    if (init_instancing ("cubes", cubes_vertex_source,
+                         n_textures != 0 ? textured_fragment_source
+                         : cubes_fragment_source,
+                         object_count * INSTANCE_SIZE) != 0) {
+        free_cube_bounds ();
+        return -1;
+    }
+    return 0;
+}
+
+/** Free entities, transforms and bounds of hierarchy */
+static void free_hierarchy (void)
+{
+    ecs_destroy (&world);
+    transform_graph_destroy (&graph);
+    free (satellites);
+    satellites = NULL;
+    n_satellites = 0;
+    free (hierarchy_bounds);
+    hierarchy_bounds = NULL;
+}
+
+/** Create entity of hierarchy with its node of transform graph
+ * @param parent parent node or TRANSFORM_ROOT
+ * @param components components of entity besides node and placement
+ * @param placement placement relative to parent
+ * @returns entity, ECS_NULL_ENTITY if out of memory
+ */
+static ecs_entity_t add_entity (unsigned int parent, ecs_mask_t components,
+                                const placement_t *placement)
+{
+    ecs_entity_t entity = ecs_create (&world, components
+                                      | ECS_COMPONENT (node_component)
+                                      | ECS_COMPONENT (placement_component));
+    unsigned int *node;
+    if (entity != ECS_NULL_ENTITY) {
+        node = (unsigned int *)ecs_get (&world, entity, node_component);
+        *node = transform_graph_add (&graph, parent);
+        memcpy (ecs_get (&world, entity, placement_component), placement,
+                sizeof (placement_t));
+    }
+    return entity;
+}
+
+/** Create root cube of hierarchy
+ * @param index index of root in grid
+ * @returns 0 on success, -1 if out of memory
+ */
+static int add_root (unsigned long index)
+{
+    float half = (float)grid_side * 0.5f;
+    placement_t placement;
+    spin_t *spin;
+    bob_t *bob;
+    ecs_entity_t entity;
+    placement.position[0] = ((float) (index % grid_side) - half) *
+                            SYSTEM_SPACING;
+    placement.position[1] = 0.0f;
+    placement.position[2] = ((float) (index / grid_side) - half) *
+                            SYSTEM_SPACING;
+    placement.scale = 1.0f;
+    entity = add_entity (TRANSFORM_ROOT, ECS_COMPONENT (spin_component)
+                         | ECS_COMPONENT (bob_component), &placement);
+    if (entity == ECS_NULL_ENTITY) {
+        return -1;
+    }
+    spin = (spin_t *)ecs_get (&world, entity, spin_component);
+    spin->axis[1] = 1.0f;
+    spin->speed = 0.5f;
+    spin->phase = (float)index * 0.7f;
+    bob = (bob_t *)ecs_get (&world, entity, bob_component);
+    bob->amplitude = 0.5f;
+    bob->phase = (float)index * 0.37f;
+    return 0;
+}
+
+/** Create satellite of root cube
+ * @param root node of root
+ * @param k index of orbit of satellite
+ * @returns 0 on success, -1 if out of memory
+ */
+static int add_satellite (unsigned int root, unsigned int k)
+{
+    float angle = (float)k * (6.2831853f / (float)SATELLITES);
+    float radius = 1.6f + 0.35f * (float)k;
+    placement_t placement;
+    spin_t *spin;
+    ecs_entity_t entity;
+    placement.position[0] = cosf (angle) * radius;
+    placement.position[1] = (k & 1) ? 0.3f : -0.3f;
+    placement.position[2] = sinf (angle) * radius;
+    placement.scale = 0.35f;
+    entity = add_entity (root, ECS_COMPONENT (spin_component), &placement);
+    if (entity == ECS_NULL_ENTITY) {
+        return -1;
+    }
+    spin = (spin_t *)ecs_get (&world, entity, spin_component);
+    spin->axis[0] = 1.0f;
+    spin->speed = 2.0f + 0.3f * (float)k;
+    satellites[n_satellites++] = entity;
+    return 0;
+}
+
+/** Point nodes of chunk of entities to their places in sorted graph
+ * @param arg new index of each old node
+ * @param view entities with node
+ */
+static void remap_system (void *arg, const ecs_view_t *view)
+{
+    const unsigned int *remap = (const unsigned int *)arg;
+    unsigned int *nodes = (unsigned int *)ecs_view_column (view,
+                          node_component);
+    unsigned int i;
+    for (i = 0; i < view->n_entities; i++) {
+        nodes[i] = remap[nodes[i]];
+    }
+}
+
+/** Create roots of hierarchy, then their satellites orbit by orbit, and
+ * sort graph so that each root is followed by its satellites
+ * @param n_systems number of roots
+ * @returns 0 on success, -1 if out of memory
+ */
+static int add_systems (unsigned long n_systems)
+{
+    ecs_system_t remap;
+    unsigned int *new_index;
+    unsigned long i;
+    unsigned int k;
+    for (i = 0; i < n_systems; i++) {
+        if (add_root (i) != 0) {
+            return -1;
+        }
+    }
+    /* The last system gets what is left of object count */
+    for (k = 0; k < SATELLITES; k++) {
+        for (i = 0; (i < n_systems)
+                && (i * (SATELLITES + 1) + k + 1 < object_count); i++) {
+            if (add_satellite ((unsigned int)i, k) != 0) {
+                return -1;
+            }
+        }
+    }
+    new_index = (unsigned int *)malloc (graph.n_nodes * sizeof (unsigned int)
+                                        + 1);
+    if ((new_index == NULL)
+            || (transform_graph_sort (&graph, new_index) != 0)) {
+        free (new_index);
+        return -1;
+    }
+    remap.fn = remap_system;
+    remap.arg = new_index;
+    remap.reads = 0;
+    remap.writes = ECS_COMPONENT (node_component);
+    ecs_run (&world, &remap, 1);
+    free (new_index);
+    return 0;
+}
+
+/** Create root cubes of hierarchy in grid and satellites around them
+ * @returns 0 on success, -1 on failure
+ */
+static int init_hierarchy (void)
+{
+    unsigned long n_systems = (object_count + SATELLITES) / (SATELLITES + 1);
+    double side = ceil (sqrt ((double)n_systems));
+    if (!is_instancing_supported ()
+            || (transform_graph_init (&graph, (unsigned int)object_count) != 0)) {
+        return -1;
+    }
+    hierarchy_bounds = (float *)malloc (object_count * 6 * sizeof (float));
+    visible_cubes = (unsigned int *)malloc (object_count *
+                                            sizeof (unsigned int));
+    satellites = (ecs_entity_t *)malloc (object_count * sizeof (ecs_entity_t));
+    n_satellites = 0;
+    bob_wave = 0;
+    if ((ecs_init (&world, (unsigned int)object_count) != 0)
+            || (hierarchy_bounds == NULL) || (visible_cubes == NULL)
+            || (satellites == NULL)) {
+        free_cube_bounds ();
+        free_hierarchy ();
+        return -1;
+    }
+    /* Fresh world has room for all components */
+    node_component = (unsigned int)ecs_register_component (&world,
+                     sizeof (unsigned int));
+    placement_component = (unsigned int)ecs_register_component (&world,
+                          sizeof (placement_t));
+    spin_component = (unsigned int)ecs_register_component (&world,
+                     sizeof (spin_t));
+    bob_component = (unsigned int)ecs_register_component (&world,
+                    sizeof (bob_t));
+    grid_side = side >= 1.0 ? (unsigned long)side : 1;
+    if (add_systems (n_systems) != 0) {
+        free_cube_bounds ();
+        free_hierarchy ();
+        return -1;
+    }
+    if (init_instancing ("hierarchy", hierarchy_vertex_source,
+                         cubes_fragment_source,
+                         object_count * MATRIX_SIZE) != 0) {
+        free_cube_bounds ();
+        free_hierarchy ();
+        return -1;
+    }
+    return 0;
+}
+
+/** Compute model matrix of object of static scene
+ * @param i index of object
+ * @param angle rotation added to resting rotation of object
+ * @param transform receives model matrix
+ */
+static void place_static (unsigned long i, float angle, GLfloat *transform)
+{
+    static const float up[3] = { 0.0f, 1.0f, 0.0f };
+    float position[3], rotation[4];
+    float half = (float)grid_side * 0.5f;
+    position[0] = ((float) (i % grid_side) - half) * CUBE_SPACING;
+    position[1] = sinf ((float)i * 0.37f) * 0.5f;
+    position[2] = ((float) (i / grid_side) - half) * CUBE_SPACING;
+    quat_from_axis_angle (up, (float)i * 0.7f + angle, rotation);
+    mat4_from_trs (position, rotation, 1.0f, transform);
+}
+
+/** Create cubes of static scene
+ * @returns 0 on success, -1 on failure
+ */
+static int init_static (void)
+{
+    const GLfloat *vertices = cube_vertices;
+    const GLuint *indices = cube_indices;
+    GLuint n_vertices = CUBE_VERTICES, n_indices = CUBE_INDICES;
+    GLfloat transform[16];
+    unsigned long i;
+    if (static_mesh != NULL) {
+        /* Loader uploads payloads straight from the mapping */
+        vertices = (const GLfloat *)static_mesh->vertices;
+        indices = (const GLuint *)static_mesh->indices;
+        n_vertices = static_mesh->header->n_vertices;
+        n_indices = static_mesh->header->n_indices;
+    } else {
+        build_cube (cube_vertices, cube_indices);
+    }
+    if (gpu_scene_init (n_vertices, n_indices, 1,
+                        (GLuint)object_count) != 0) {
+        return -1;
+    }
+    if (gpu_scene_add_mesh (vertices, n_vertices, indices, n_indices) != 0) {
+        gpu_scene_shutdown ();
+        return -1;
+    }
+    for (i = 0; i < object_count; i++) {
+        place_static (i, 0.0f, transform);
+        gpu_scene_add_object (0, transform);
+    }
+    return 0;
+}
+
+int scene_set_mesh (const mesh_file_t *mesh)
+{
+    if ((mesh != NULL)
+            && ((mesh->header->vertex_size != GPU_SCENE_VERTEX_FLOATS
+                 * sizeof (GLfloat))
+                || (mesh->header->index_size != sizeof (GLuint))
+                || (mesh->header->n_indices % 3 != 0))) {
+        return -1;
+    }
+    static_mesh = mesh;
+    return 0;
+}
+
+void scene_set_textures (const int *handles, unsigned int n)
+{
+    texture_handles = handles;
+    n_textures = handles != NULL ? n : 0;
+}
+
+int scene_init (const char *name, unsigned long n_objects)
+{
+    double side = ceil (sqrt ((double)n_objects));
+    int err;
+    object_count = n_objects;
+    grid_side = side >= 1.0 ? (unsigned long)side : 1;
+    previous_time = 0.0f;
+    if (strcmp (name, "cubes") == 0) {
+        err = init_cubes ();
+        kind = SCENE_CUBES;
+    } else if (strcmp (name, "static") == 0) {
+        err = init_static ();
+        kind = SCENE_STATIC;
+    } else if (strcmp (name, "hierarchy") == 0) {
+        err = init_hierarchy ();
+        kind = SCENE_HIERARCHY;
+    } else if ((strcmp (name, "particles") == 0)
+               || (strcmp (name, "particles-cpu") == 0)) {
+        err = particles_init ((GLuint)n_objects,
+                              strcmp (name, "particles") == 0);
+        kind = SCENE_PARTICLES;
+    } else {
+        err = -1;
+    }
+    if (err != 0) {
+        kind = SCENE_NONE;
+    }
+    return err;
+}
+
+void scene_shutdown (void)
+{
+    if ((kind == SCENE_CUBES) || (kind == SCENE_HIERARCHY)) {
+        gl_state_forget_vertex_array (cubes_vertex_array);
+        gl.DeleteVertexArrays (1, &cubes_vertex_array);
+        gl_state_forget_buffer (cube_buffers[0]);
+        gl_state_forget_buffer (cube_buffers[1]);
+        gl.DeleteBuffers (2, cube_buffers);
+        gpu_memory_release (cube_allocation);
+        cube_allocation = -1;
+        stream_buffer_destroy (&stream);
+        shader_program_destroy (cubes_program);
+        cubes_program = 0;
+        free_cube_bounds ();
+        free_hierarchy ();
+    } else if (kind == SCENE_STATIC) {
+        gpu_scene_shutdown ();
+    } else if (kind == SCENE_PARTICLES) {
+        particles_shutdown ();
+    }
+    kind = SCENE_NONE;
+}
+
+/** Submit draws of instanced cubes
+ * @param queue queue of draws of current frame
+ * @param arena arena of current frame
+ * @param n_instances number of instances in streaming buffer
+ * @param base_instance index of the first instance in streaming buffer
+ * @param uniforms_offset offset of frame uniforms in streaming buffer
+ * @param material material identifier of sort key
+ * @param texture texture sampled by cubes, 0 if none
+ */
+static void submit_cubes (draw_queue_t *queue, frame_arena_t *arena,
+                          unsigned long n_instances, GLuint base_instance,
+                          GLuint uniforms_offset, unsigned int material,
+                          GLuint texture)
+{
+    unsigned long first;
+    for (first = 0; first < n_instances; first += CUBES_PER_DRAW) {
+        draw_t *draw = (draw_t *)frame_arena_alloc (arena, sizeof (draw_t));
+        if (draw == NULL) {
+            return;
+        }
+        memset (draw, 0, sizeof (draw_t));
+        draw->program = cubes_program;
+        draw->vertex_array = cubes_vertex_array;
+        draw->texture = texture;
+        draw->uniform_buffer = stream.buffer;
+        draw->uniform_offset = uniforms_offset;
+        draw->uniform_size = FRAME_UNIFORMS_SIZE;
+        draw->mode = GL_TRIANGLES;
+        draw->index_type = GL_UNSIGNED_INT;
+        draw->count = CUBE_INDICES;
+        draw->instances = (GLsizei) (n_instances - first < CUBES_PER_DRAW ?
+                                     n_instances - first : CUBES_PER_DRAW);
+        draw->base_instance = base_instance + (GLuint)first;
+        draw_queue_submit (queue, draw_key_opaque (0, 0, 1, material, 0.0f),
+                           draw);
+    }
+}
+
+/** Find the first of sorted indices that isn't below value
+ * @param sorted indices in ascending order
+ * @param first index to start search from
+ * @param n number of indices
+ * @param value searched value
+ * @returns position of the first index not below value, n if none
+ */
+static unsigned long lower_bound (const unsigned int *sorted,
+                                  unsigned long first, unsigned long n,
+                                  unsigned long value)
+{
+    while (first < n) {
+        unsigned long middle = first + (n - first) / 2;
+        if (sorted[middle] < value) {
+            first = middle + 1;
+        } else {
+            n = middle;
+        }
+    }
+    return first;
+}
+
+/** Submit draws of textured cubes, one per range of cubes sharing texture,
+ * and report size of the nearest cube of each drawn texture to texture
+ * residency
+ * @param queue queue of draws of current frame
+ * @param arena arena of current frame
+ * @param job finished animation of frame
+ * @param base_instance index of the first visible cube in streaming buffer
+ * @param uniforms_offset offset of frame uniforms in streaming buffer
+ * @param height height of window
+ */
+static void submit_textured (draw_queue_t *queue, frame_arena_t *arena,
+                             const update_job_t *job, GLuint base_instance,
+                             GLuint uniforms_offset, int height)
+{
+    float scale = (float)height * 0.5f / tanf (CAMERA_FOV * 0.5f);
+    unsigned long first = 0, last;
+    unsigned int texture, slice;
+    for (texture = 0; texture < n_textures; texture++) {
+        float depth = FLT_MAX;
+        last = lower_bound (job->visible, first, job->n_objects,
+                            first_cube (texture + 1));
+        if (last == first) {
+            continue;
+        }
+        for (slice = 0; slice < job->n_jobs; slice++) {
+            float nearest = job->nearest[slice * n_textures + texture];
+            depth = nearest < depth ? nearest : depth;
+        }
+        depth = depth > MIN_TEXTURE_DEPTH ? depth : MIN_TEXTURE_DEPTH;
+        /* Face of unit cube shows the whole texture */
+        texture_residency_use (texture_handles[texture], scale / depth);
+        submit_cubes (queue, arena, last - first, base_instance + (GLuint)first,
+                      uniforms_offset, texture + 1,
+                      texture_residency_get (texture_handles[texture]));
+        first = last;
+    }
+}
+
+/** Cull cubes, animate visible ones and submit their draws
+ * @param queue queue of draws of current frame
+ * @param arena arena of current frame
+ * @param view_projection view-projection matrix of frame
+ * @param time animation time in seconds
+ * @param height height of window
+ */
+static void update_instanced (draw_queue_t *queue, frame_arena_t *arena,
+                              const GLfloat *view_projection, float time,
+                              int height)
+{
+    update_job_t job;
+    GLuint instances_offset, uniforms_offset;
+    void *uniforms;
+    double start = monotonic_ms ();
+    unsigned int i;
+    job.n_objects = cull_spheres (view_projection, cube_bounds,
+                                  cube_bounds + object_count,
+                                  cube_bounds + object_count * 2,
+                                  cube_bounds + object_count * 3,
+                                  object_count, visible_cubes);
+    cull_total_ms += monotonic_ms () - start;
+    n_visible_total += job.n_objects;
+    stream_buffer_begin_frame (&stream);
+    if ((job.n_objects == 0) || (cubes_vertex_array == 0)) {
+        return;
+    }
+    job.instances = (GLfloat *)stream_buffer_alloc (&stream,
+                    job.n_objects * INSTANCE_SIZE, INSTANCE_SIZE,
+                    &instances_offset);
+    uniforms = stream_buffer_alloc (&stream, FRAME_UNIFORMS_SIZE,
+                                    stream.uniform_alignment, &uniforms_offset);
+    if ((job.instances == NULL) || (uniforms == NULL)) {
+        return;
+    }
+    memcpy (uniforms, view_projection, FRAME_UNIFORMS_SIZE);
+    job.visible = visible_cubes;
+    job.side = grid_side;
+    job.n_jobs = workers_count () + 1;
+    job.time = time;
+    job.view_projection = view_projection;
+    job.nearest = NULL;
+    if (n_textures != 0) {
+        job.nearest = (float *)frame_arena_alloc (arena, job.n_jobs
+                      * n_textures * sizeof (float));
+        if (job.nearest == NULL) {
+            return;
+        }
+        for (i = 0; i < job.n_jobs * n_textures; i++) {
+            job.nearest[i] = FLT_MAX;
+        }
+    }
+    workers_run (update_cubes, &job, job.n_jobs);
+    stream_buffer_commit (&stream);
+    if (n_textures != 0) {
+        submit_textured (queue, arena, &job,
+                         instances_offset / (GLuint)INSTANCE_SIZE,
+                         uniforms_offset, height);
+    } else {
+        submit_cubes (queue, arena, job.n_objects,
+                      instances_offset / (GLuint)INSTANCE_SIZE,
+                      uniforms_offset, 0, 0);
+    }
+}
+
+/** Move entities of chunk up and down
+ * @param arg unused
+ * @param view entities with placement_t and bob_t
+ */
+static void bob_system (void *arg, const ecs_view_t *view)
+{
+    placement_t *placements = (placement_t *)ecs_view_column (view,
+                              placement_component);
+    const bob_t *bobs = (const bob_t *)ecs_view_column (view, bob_component);
+    unsigned int i;
+    (void)arg;
+    for (i = 0; i < view->n_entities; i++) {
+        placements[i].position[1] = sinf (tick_time * 2.0f + bobs[i].phase)
+                                    * bobs[i].amplitude;
+    }
+}
+
+/** Rotate entities of chunk and pass their local transforms to graph
+ * @param arg unused
+ * @param view entities with node, placement_t and spin_t
+ */
+static void spin_system (void *arg, const ecs_view_t *view)
+{
+    const unsigned int *nodes;
+    const placement_t *placements;
+    const spin_t *spins;
+    float rotation[4];
+    unsigned int i;
+    (void)arg;
+    nodes = (const unsigned int *)ecs_view_column (view, node_component);
+    placements = (const placement_t *)ecs_view_column (view,
+                 placement_component);
+    spins = (const spin_t *)ecs_view_column (view, spin_component);
+    for (i = 0; i < view->n_entities; i++) {
+        quat_from_axis_angle (spins[i].axis, tick_time * spins[i].speed
+                              + spins[i].phase, rotation);
+        transform_graph_set_local (&graph, nodes[i], placements[i].position,
+                                   rotation, placements[i].scale);
+    }
+}
+
+/** Start or stop bobbing of every BOB_WAVE_GROUPS-th satellite, moving
+ * them between archetypes
+ * @param group index of the first satellite
+ */
+static void toggle_bobbing (unsigned long group)
+{
+    ecs_mask_t components = ECS_COMPONENT (node_component)
+                            | ECS_COMPONENT (placement_component)
+                            | ECS_COMPONENT (spin_component);
+    unsigned long i;
+    for (i = group; i < n_satellites; i += BOB_WAVE_GROUPS) {
+        bob_t *bob;
+        if (ecs_get (&world, satellites[i], bob_component) != NULL) {
+            ecs_set_components (&world, satellites[i], components);
+        } else if (ecs_set_components (&world, satellites[i], components
+                                       | ECS_COMPONENT (bob_component)) == 0) {
+            bob = (bob_t *)ecs_get (&world, satellites[i], bob_component);
+            bob->amplitude = 0.4f;
+            bob->phase = (float)i * 0.9f;
+        }
+    }
+}
+
+/** Run systems of hierarchy and update world matrices of all cubes
+ * @param time animation time in seconds
+ */
+static void tick_hierarchy (float time)
+{
+    ecs_system_t systems[2];
+    double start = monotonic_ms ();
+    unsigned long wave = (unsigned long) (time / BOB_WAVE_SECONDS);
+    tick_time = time;
+    /* Systems can't change entities, so waves are applied before them */
+    if (wave != bob_wave) {
+        bob_wave = wave;
+        toggle_bobbing (wave % BOB_WAVE_GROUPS);
+    }
+    /* Spinning reads placements, so it runs after bobbing writes them */
+    systems[0].fn = bob_system;
+    systems[0].arg = NULL;
+    systems[0].reads = ECS_COMPONENT (bob_component);
+    systems[0].writes = ECS_COMPONENT (placement_component);
+    systems[1].fn = spin_system;
+    systems[1].arg = NULL;
+    systems[1].reads = ECS_COMPONENT (node_component)
+                       | ECS_COMPONENT (placement_component)
+                       | ECS_COMPONENT (spin_component);
+    systems[1].writes = 0;
+    ecs_run (&world, systems, 2);
+    transform_graph_update (&graph);
+    n_transformed_total += graph.n_updated;
+    tick_total_ms += monotonic_ms () - start;
+}
+
+/** Spin one row of static scene, rows take turns so that only a short
+ * range of objects is uploaded each frame
+ * @param time animation time in seconds
+ */
+static void spin_static_row (float time)
+{
+    unsigned long rows = (object_count + grid_side - 1) / grid_side;
+    unsigned long row, i, last;
+    GLfloat transform[16];
+    if (rows == 0) {
+        return;
+    }
+    row = (unsigned long) (time / SPIN_ROW_SECONDS) % rows;
+    last = (row + 1) * grid_side;
+    last = last < object_count ? last : object_count;
+    for (i = row * grid_side; i < last; i++) {
+        place_static (i, time, transform);
+        gpu_scene_set_transform ((GLuint)i, transform);
+    }
+}
+
+/** Compute world bounding boxes of slice of cubes of hierarchy
+ * @param arg hierarchy_job_t of frame
+ * @param index index of slice
+ */
+static void bound_cubes (void *arg, unsigned int index)
+{
+    const hierarchy_job_t *job = (const hierarchy_job_t *)arg;
+    unsigned long first = job->n_objects * index / job->n_jobs;
+    unsigned long last = job->n_objects * (index + 1) / job->n_jobs;
+    static const float unit_min[3] = { -0.5f, -0.5f, -0.5f };
+    static const float unit_max[3] = { 0.5f, 0.5f, 0.5f };
+    unsigned long i;
+    unsigned int axis;
+    for (i = first; i < last; i++) {
+        float low[3], high[3];
+        aabb_transform (graph.world + i * 16, unit_min, unit_max, low, high,
+                        1);
+        for (axis = 0; axis < 3; axis++) {
+            hierarchy_bounds[axis * job->n_objects + i] =
+                0.5f * (low[axis] + high[axis]);
+            hierarchy_bounds[(axis + 3) * job->n_objects + i] =
+                0.5f * (high[axis] - low[axis]);
+        }
+    }
+}
+
+/** Copy world matrices of slice of visible cubes of hierarchy
+ * @param arg hierarchy_job_t of frame
+ * @param index index of slice
+ */
+static void gather_cubes (void *arg, unsigned int index)
+{
+    const hierarchy_job_t *job = (const hierarchy_job_t *)arg;
+    unsigned long first = job->n_objects * index / job->n_jobs;
+    unsigned long last = job->n_objects * (index + 1) / job->n_jobs;
+    unsigned long k;
+    for (k = first; k < last; k++) {
+        memcpy (job->instances + k * 16, graph.world + job->visible[k] * 16,
+                MATRIX_SIZE);
+    }
+}
+
+/** Cull cubes of hierarchy, stream world matrices of visible ones and
+ * submit their draws
+ * @param queue queue of draws of current frame
+ * @param arena arena of current frame
+ * @param view_projection view-projection matrix of frame
+ */
+static void update_hierarchy (draw_queue_t *queue, frame_arena_t *arena,
+                              const GLfloat *view_projection)
+{
+    const float *bounds[6];
+    hierarchy_job_t job;
+    GLuint instances_offset, uniforms_offset;
+    void *uniforms;
+    double start = monotonic_ms ();
+    unsigned int axis;
+    job.n_objects = graph.n_nodes;
+    job.n_jobs = workers_count () + 1;
+    workers_run (bound_cubes, &job, job.n_jobs);
+    for (axis = 0; axis < 6; axis++) {
+        bounds[axis] = hierarchy_bounds + axis * job.n_objects;
+    }
+    job.n_objects = cull_boxes (view_projection, bounds, job.n_objects,
+                                visible_cubes);
+    cull_total_ms += monotonic_ms () - start;
+    n_visible_total += job.n_objects;
+    stream_buffer_begin_frame (&stream);
+    if ((job.n_objects == 0) || (cubes_vertex_array == 0)) {
+        return;
+    }
+    job.instances = (GLfloat *)stream_buffer_alloc (&stream,
+                    job.n_objects * MATRIX_SIZE, MATRIX_SIZE,
+                    &instances_offset);
+    uniforms = stream_buffer_alloc (&stream, FRAME_UNIFORMS_SIZE,
+                                    stream.uniform_alignment, &uniforms_offset);
+    if ((job.instances == NULL) || (uniforms == NULL)) {
+        return;
+    }
+    memcpy (uniforms, view_projection, FRAME_UNIFORMS_SIZE);
+    job.visible = visible_cubes;
+    workers_run (gather_cubes, &job, job.n_jobs);
+    stream_buffer_commit (&stream);
+    submit_cubes (queue, arena, job.n_objects,
+                  instances_offset / (GLuint)MATRIX_SIZE, uniforms_offset, 0,
+                  0);
+}
+
+int scene_is_loading (void)
+{
+    if (kind == SCENE_STATIC) {
+        return gpu_scene_is_loading ();
+    }
+    if ((kind == SCENE_CUBES) || (kind == SCENE_HIERARCHY)) {
+        return cubes_vertex_array == 0;
+    }
+    return 0;
+}
+
+void scene_tick (double time_ms)
+{
+    if (kind == SCENE_HIERARCHY) {
+        tick_hierarchy ((float) (time_ms / 1000.0));
+    }
+}
+
+void scene_update (draw_queue_t *queue, frame_arena_t *arena, double time_ms,
+                   int width, int height)
+{
+    GLfloat view_projection[16];
+    double start = monotonic_ms ();
+    float time = (float) (time_ms / 1000.0);
+    float aspect = (width > 0) && (height > 0) ?
+                   (float)width / (float)height : 4.0f / 3.0f;
+    float dt = time - previous_time;
+    if (kind == SCENE_NONE) {
+        return;
+    }
+    previous_time = time;
+    if ((width > 0) && (height > 0)) {
+        gl_state_viewport (0, 0, width, height);
+    }
+    gl_state_set_enabled (GL_DEPTH_TEST, 1);
+    gl_state_depth_func (GL_LESS);
+    gl_state_depth_mask (1);
+    gl_state_set_enabled (GL_CULL_FACE, 1);
+    gl_state_cull_face (GL_BACK);
+    gl.ClearColor (0.1f, 0.1f, 0.12f, 1.0f);
+    gl.Clear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (kind == SCENE_PARTICLES) {
+        orbit_camera (time, FOUNTAIN_CAMERA_RADIUS, aspect, view_projection);
+        particles_update (dt < MAX_TIME_STEP ? dt : MAX_TIME_STEP,
+                          view_projection);
+    } else if (kind == SCENE_HIERARCHY) {
+        orbit_camera (time, (float)grid_side * SYSTEM_SPACING * 0.6f + 6.0f,
+                      aspect, view_projection);
+        update_hierarchy (queue, arena, view_projection);
+    } else {
+        orbit_camera (time, (float)grid_side * CUBE_SPACING * 0.6f + 6.0f,
+                      aspect, view_projection);
+        if (kind == SCENE_CUBES) {
+            update_instanced (queue, arena, view_projection, time, height);
+        } else {
+            spin_static_row (time);
+            gpu_scene_draw (view_projection);
+        }
+    }
+    n_frames++;
+    update_total_ms += monotonic_ms () - start;
+}
+
+void scene_end_frame (void)
+{
+    if ((kind == SCENE_CUBES) || (kind == SCENE_HIERARCHY)) {
+        stream_buffer_end_frame (&stream);
+    } else if (kind == SCENE_PARTICLES) {
+        particles_end_frame ();
+    }
+}
+
+void scene_print_stats (void)
+{
+    if ((kind == SCENE_NONE) || (n_frames == 0)) {
+        return;
+    }
+    printf ("Scene: %lu objects, updated in %.3f ms/frame", object_count,
+            update_total_ms / (double)n_frames);
+    if (kind == SCENE_CUBES) {
+        printf (", %.1f%% visible, culled in %.3f ms/frame, "
+                "%lu stalls on streaming buffer", 100.0 *
+                (double)n_visible_total / ((double)object_count *
+                                           (double)n_frames),
+                cull_total_ms / (double)n_frames, stream.n_stalls);
+        stream.n_stalls = 0;
+        n_visible_total = 0;
+        cull_total_ms = 0.0;
+    } else if (kind == SCENE_HIERARCHY) {
+        printf (", %.0f transforms updated in %.3f ms/frame, %.1f%% visible, "
+                "culled in %.3f ms/frame, %lu stalls on streaming buffer",
+                (double)n_transformed_total / (double)n_frames,
+                tick_total_ms / (double)n_frames, 100.0 *
+                (double)n_visible_total / ((double)object_count *
+                                           (double)n_frames),
+                cull_total_ms / (double)n_frames, stream.n_stalls);
+        stream.n_stalls = 0;
+        n_transformed_total = 0;
+        tick_total_ms = 0.0;
+        n_visible_total = 0;
+        cull_total_ms = 0.0;
+    } else if (kind == SCENE_PARTICLES) {
+        if (particles_use_compute ()) {
+            printf (", simulated by compute shaders");
+        } else {
+            printf (", %lu simulated on CPU", particles_count ());
+        }
+    }
+    printf ("\n");
+    n_frames = 0;
+    update_total_ms = 0.0;
+}
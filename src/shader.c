@@ -0,0 +1,115 @@
+/**
+ * @file shader.c
+ * This module contains compilation and linking of GLSL programs.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include "gl_procs.h"
+#include "gl_state.h"
+#include "shader.h"
+
+/** Maximum length of printed info log */
+#define MAX_LOG_LENGTH 1024
+
+/** Compile shader
+ * @param name name of program used in error messages
+ * @param type type of shader
+ * @param source NULL-terminated list of pieces of source
+ * @returns shader object, 0 on failure
+ */
+static GLuint compile_shader (const char *name, GLenum type,
+                              const char *const *source)
+{
+    GLuint shader = gl.CreateShader (type);
+    GLint is_compiled = GL_FALSE;
+    GLsizei n_pieces = 0;
+    if (shader == 0) {
+        return 0;
+    }
+    while (source[n_pieces] != NULL) {
+        n_pieces++;
+    }
+    gl.ShaderSource (shader, n_pieces, source, NULL);
+    gl.CompileShader (shader);
+    gl.GetShaderiv (shader, GL_COMPILE_STATUS, &is_compiled);
+    if (is_compiled != GL_TRUE) {
+        char info_log[MAX_LOG_LENGTH];
+        info_log[0] = '\0';
+        gl.GetShaderInfoLog (shader, MAX_LOG_LENGTH, NULL, info_log);
+        fprintf (stderr, "%s: can't compile shader:\n%s\n", name, info_log);
+        gl.DeleteShader (shader);
+        return 0;
+    }
+    return shader;
+}
+
+/** Link program of compiled shaders
+ * @param name name of program used in error messages
+ * @param shaders shader objects, deleted by this function
+ * @param n_shaders number of shaders
+ * @returns program object, 0 on failure
+ */
+static GLuint link_program (const char *name, const GLuint *shaders,
+                            unsigned int n_shaders)
+{
+    GLuint program = 0;
+    GLint is_linked = GL_FALSE;
+    unsigned int i;
+    for (i = 0; i < n_shaders; i++) {
+        if (shaders[i] == 0) {
+            break;
+        }
+    }
+    if (i == n_shaders) {
+        program = gl.CreateProgram ();
+    }
+    if (program != 0) {
+        for (i = 0; i < n_shaders; i++) {
+            gl.AttachShader (program, shaders[i]);
+        }
+        gl.LinkProgram (program);
+        gl.GetProgramiv (program, GL_LINK_STATUS, &is_linked);
+        if (is_linked != GL_TRUE) {
+            char info_log[MAX_LOG_LENGTH];
+            info_log[0] = '\0';
+            gl.GetProgramInfoLog (program, MAX_LOG_LENGTH, NULL, info_log);
+            fprintf (stderr, "%s: can't link program:\n%s\n", name, info_log);
+            gl.DeleteProgram (program);
+            program = 0;
+        }
+    }
+    for (i = 0; i < n_shaders; i++) {
+        if (shaders[i] != 0) {
+            gl.DeleteShader (shaders[i]);
+        }
+    }
+    return program;
+}
+
+GLuint shader_program_create (const char *name,
+                              const char *const *vertex_source,
+                              const char *const *fragment_source)
+{
+    GLuint shaders[2];
+    shaders[0] = compile_shader (name, GL_VERTEX_SHADER, vertex_source);
+    shaders[1] = compile_shader (name, GL_FRAGMENT_SHADER, fragment_source);
+    return link_program (name, shaders, 2);
+}
+
+GLuint shader_program_create_compute (const char *name,
+                                      const char *const *compute_source)
+{
+    GLuint shader = compile_shader (name, GL_COMPUTE_SHADER, compute_source);
+    return link_program (name, &shader, 1);
+}
+
+void shader_program_destroy (GLuint program)
+{
+    if (program == 0) {
+        return;
+    }
+    gl_state_forget_program (program);
+    gl.DeleteProgram (program);
+}
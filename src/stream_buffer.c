@@ -0,0 +1,217 @@
+/**
+ * @file stream_buffer.c
+ * This module contains ring of buffer memory for data that is written by
+ * CPU once per frame.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include "gl_procs.h"
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "stream_buffer.h"
+
+/** Binding point used to create and update buffer object */
+#define STREAM_TARGET GL_COPY_WRITE_BUFFER
+
+/** Granularity of region size in bytes */
+#define REGION_ALIGNMENT ((size_t)256)
+
+/** Flags of persistent storage and its mapping */
+#define PERSISTENT_FLAGS \
+    (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+/** Timeout of single wait for fence in nanoseconds */
+#define FENCE_TIMEOUT_NS 1000000000ul
+
+/** Check if persistent mapping is available in current context
+ * @returns non-zero if ARB_buffer_storage and sync objects are available
+ */
+static int has_buffer_storage (void)
+{
+    return (gl.BufferStorage != NULL) && (gl.MapBufferRange != NULL)
+           && (gl.FenceSync != NULL) && (gl.ClientWaitSync != NULL)
+           && (gl.DeleteSync != NULL)
+           && (gl_version_at_least (4, 4)
+               || gl_has_extension ("GL_ARB_buffer_storage"));
+}
+
+/** Create persistently mapped storage of all regions
+ * @param stream streaming buffer with created buffer object
+ * @returns 0 on success, -1 if storage can't be mapped
+ */
+static int create_persistent (stream_buffer_t *stream)
+{
+    GLsizeiptr size = (GLsizeiptr) (stream->frame_size * STREAM_BUFFER_FRAMES);
+    gl.BufferStorage (STREAM_TARGET, size, NULL, PERSISTENT_FLAGS);
+    stream->memory = (unsigned char *)gl.MapBufferRange (STREAM_TARGET, 0,
+                     size, PERSISTENT_FLAGS);
+    if (stream->memory == NULL) {
+        return -1;
+    }
+    stream->is_persistent = 1;
+    stream->allocation = gpu_memory_track (GPU_MEMORY_BUFFER, STREAM_TARGET,
+                                           (size_t)size, NULL, NULL);
+    return 0;
+}
+
+/** Create staging memory and orphanable storage of single region
+ * @param stream streaming buffer with created buffer object
+ * @returns 0 on success, -1 if out of memory
+ */
+static int create_staging (stream_buffer_t *stream)
+{
+    stream->memory = (unsigned char *)malloc (stream->frame_size);
+    if (stream->memory == NULL) {
+        return -1;
+    }
+    gl.BufferData (STREAM_TARGET, (GLsizeiptr)stream->frame_size, NULL,
+                   GL_STREAM_DRAW);
+    stream->is_persistent = 0;
+    stream->allocation = gpu_memory_track (GPU_MEMORY_BUFFER, STREAM_TARGET,
+                                           stream->frame_size, NULL, NULL);
+    return 0;
+}
+
+/** Create buffer object and bind it for update
+ * @param stream streaming buffer
+ */
+static void create_buffer (stream_buffer_t *stream)
+{
+    gl.GenBuffers (1, &stream->buffer);
+    gl_state_bind_buffer (STREAM_TARGET, stream->buffer);
+}
+
+/** Delete buffer object
+ * @param stream streaming buffer
+ */
+static void delete_buffer (stream_buffer_t *stream)
+{
+    gl_state_forget_buffer (stream->buffer);
+    gl.DeleteBuffers (1, &stream->buffer);
+    stream->buffer = 0;
+}
+
+int stream_buffer_init (stream_buffer_t *stream, size_t frame_size)
+{
+    GLint alignment = 0;
+    unsigned int i;
+    if ((gl.GenBuffers == NULL) || (gl.DeleteBuffers == NULL)
+            || (gl.BufferData == NULL) || (gl.BufferSubData == NULL)) {
+        return -1;
+    }
+    for (i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+        stream->fences[i] = NULL;
+    }
+    stream->frame_size = (frame_size + REGION_ALIGNMENT - 1) &
+                         ~(REGION_ALIGNMENT - 1);
+    stream->region = 0;
+    stream->offset = 0;
+    stream->peak = 0;
+    stream->n_failed = 0;
+    stream->n_stalls = 0;
+    stream->current = 0;
+    stream->allocation = -1;
+    gl.GetIntegerv (GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    stream->uniform_alignment = alignment > 0 ? (GLuint)alignment : 256;
+    create_buffer (stream);
+    if (has_buffer_storage ()) {
+        if (create_persistent (stream) == 0) {
+            return 0;
+        }
+        /* Storage is immutable, staging needs a fresh buffer object */
+        delete_buffer (stream);
+        create_buffer (stream);
+    }
+    if (create_staging (stream) != 0) {
+        delete_buffer (stream);
+        return -1;
+    }
+    return 0;
+}
+
+void stream_buffer_destroy (stream_buffer_t *stream)
+{
+    unsigned int i;
+    for (i = 0; i < STREAM_BUFFER_FRAMES; i++) {
+        if (stream->fences[i] != NULL) {
+            gl.DeleteSync (stream->fences[i]);
+            stream->fences[i] = NULL;
+        }
+    }
+    if (stream->buffer != 0) {
+        delete_buffer (stream);
+    }
+    gpu_memory_release (stream->allocation);
+    stream->allocation = -1;
+    if (!stream->is_persistent) {
+        free (stream->memory);
+    }
+    stream->memory = NULL;
+}
+
+void stream_buffer_begin_frame (stream_buffer_t *stream)
+{
+    GLsync fence = stream->fences[stream->current];
+    GLenum status;
+    if (fence == NULL) {
+        return;
+    }
+    status = gl.ClientWaitSync (fence, 0, 0);
+    if (status == GL_TIMEOUT_EXPIRED) {
+        stream->n_stalls++;
+        do {
+            status = gl.ClientWaitSync (fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                        FENCE_TIMEOUT_NS);
+        } while (status == GL_TIMEOUT_EXPIRED);
+    }
+    gl.DeleteSync (fence);
+    stream->fences[stream->current] = NULL;
+}
+
+void *stream_buffer_alloc (stream_buffer_t *stream, size_t size,
+                           size_t alignment, GLuint *offset)
+{
+    size_t used = __atomic_load_n (&stream->offset, __ATOMIC_RELAXED);
+    size_t start;
+    do {
+        start = (used + alignment - 1) & ~(alignment - 1);
+        if ((start > stream->frame_size)
+                || (size > stream->frame_size - start)) {
+            __atomic_fetch_add (&stream->n_failed, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    } while (!__atomic_compare_exchange_n (&stream->offset, &used,
+                                           start + size, 1, __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED));
+    *offset = (GLuint) (stream->region + start);
+    return stream->memory + stream->region + start;
+}
+
+void stream_buffer_commit (stream_buffer_t *stream)
+{
+    if (stream->is_persistent || (stream->offset == 0)) {
+        return;
+    }
+    /* Orphan storage still read by GPU instead of waiting for it */
+    gl_state_bind_buffer (STREAM_TARGET, stream->buffer);
+    gl.BufferData (STREAM_TARGET, (GLsizeiptr)stream->frame_size, NULL,
+                   GL_STREAM_DRAW);
+    gl.BufferSubData (STREAM_TARGET, 0, (GLsizeiptr)stream->offset,
+                      stream->memory);
+}
+
+void stream_buffer_end_frame (stream_buffer_t *stream)
+{
+    if (stream->offset > stream->peak) {
+        stream->peak = stream->offset;
+    }
+    if (stream->is_persistent) {
+        stream->fences[stream->current] =
+            gl.FenceSync (GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stream->current = (stream->current + 1) % STREAM_BUFFER_FRAMES;
+        stream->region = stream->current * stream->frame_size;
+    }
+    stream->offset = 0;
+}
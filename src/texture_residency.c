@@ -0,0 +1,536 @@
+/**
+ * @file texture_residency.c
+ * This module contains streaming of mipmap levels of textures on demand
+ * within memory budget.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include "gl_procs.h"
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "gl_loader.h"
+#include "texture_stream.h"
+#include "texture_residency.h"
+
+/** Maximum number of textures whose finer levels start streaming per frame,
+ * bounds allocations of storage on render thread */
+#define MAX_TRANSITIONS 4
+
+/** Default alignment of rows of unpacked pixels */
+#define DEFAULT_UNPACK_ALIGNMENT 4
+
+/** Texture managed by residency */
+typedef struct resident_texture_t {
+    const texture_source_t *source; /**< Levels of texture */
+    size_t size; /**< Size of storage of texture in bytes */
+    size_t pending_size; /**< Size of storage of pending texture in bytes */
+    unsigned long last_used; /**< Frame when texture was drawn last time */
+    GLuint texture; /**< Texture holding resident levels */
+    GLuint pending; /**< Texture receiving finer levels, 0 if none; set by
+                      loader, read once its job is finished */
+    unsigned int resident_level; /**< Finest level of texture */
+    unsigned int pending_level; /**< Finest level of pending texture */
+    unsigned int min_level; /**< Finest level that is always resident */
+    unsigned int wanted_level; /**< Finest level needed in last frame */
+    unsigned int n_uploads_left; /**< Levels of pending texture not staged,
+                                   0 unless texture is streaming */
+    int allocation; /**< Tracked storage of texture */
+    int pending_allocation; /**< Tracked storage of pending texture */
+    char padding[4];
+} resident_texture_t;
+
+/** Managed textures */
+static resident_texture_t *textures = NULL;
+
+/** Capacity of textures */
+static unsigned int max_texture_count = 0;
+
+/** Number of managed textures */
+static unsigned int n_textures = 0;
+
+/** Maximum size of storage of all textures */
+static size_t budget = 0;
+
+/** Size of storage of all textures, including pending ones */
+static size_t n_bytes_resident = 0;
+
+/** Current frame, textures used in it have it as last_used */
+static unsigned long frame = 1;
+
+/** Non-zero if resident levels can be copied between textures on GPU */
+static int is_copy_supported = 0;
+
+/** Number of textures with pending storage */
+static unsigned int n_transitions = 0;
+
+/** Number of levels made resident since previous report */
+static unsigned long n_levels_streamed = 0;
+
+/** Number of evicted textures since previous report */
+static unsigned long n_evictions = 0;
+
+/** Get size of mipmap level along one side
+ * @param size size of level 0
+ * @param level mipmap level
+ * @returns size of level, at least 1
+ */
+static GLsizei level_extent (GLsizei size, unsigned int level)
+{
+    size >>= level;
+    return size > 0 ? size : 1;
+}
+
+/** Get size of mipmap level of texture
+ * @param source levels of texture
+ * @param level mipmap level
+ * @returns size of level in bytes
+ */
+static size_t level_size (const texture_source_t *source, unsigned int level)
+{
+    size_t width = (size_t)level_extent (source->width, level);
+    size_t height = (size_t)level_extent (source->height, level);
+    if (source->block_size != 0) {
+        return ((width + 3) / 4) * ((height + 3) / 4) * source->block_size;
+    }
+    return width * height * source->pixel_size;
+}
+
+/** Get size of levels of texture from given one to the coarsest
+ * @param source levels of texture
+ * @param level finest level
+ * @returns size of levels in bytes
+ */
+static size_t chain_size (const texture_source_t *source, unsigned int level)
+{
+    size_t size = 0;
+    for (; level < source->n_levels; level++) {
+        size += level_size (source, level);
+    }
+    return size;
+}
+
+/** Allocate storage of bound texture for levels from given one to the
+ * coarsest
+ * @param source levels of texture
+ * @param level finest level, becomes level 0 of storage
+ */
+static void allocate_storage (const texture_source_t *source,
+                              unsigned int level)
+{
+    gl.TexStorage2D (GL_TEXTURE_2D, (GLsizei) (source->n_levels - level),
+                     source->internal_format,
+                     level_extent (source->width, level),
+                     level_extent (source->height, level));
+    gl.TexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                      GL_LINEAR_MIPMAP_LINEAR);
+}
+
+/** Create texture storage for levels from given one to the coarsest
+ * @param source levels of texture
+ * @param level finest level, becomes level 0 of storage
+ * @returns created texture
+ */
+static GLuint create_storage (const texture_source_t *source,
+                              unsigned int level)
+{
+    GLuint texture = 0;
+    gl.GenTextures (1, &texture);
+    gl_state_bind_texture (0, GL_TEXTURE_2D, texture);
+    allocate_storage (source, level);
+    return texture;
+}
+
+/** Create storage of pending texture, called by loader
+ * @param user managed texture
+ */
+static void create_pending (void *user)
+{
+    resident_texture_t *entry = (resident_texture_t *)user;
+    GLuint texture = 0;
+    gl.GenTextures (1, &texture);
+    gl.BindTexture (GL_TEXTURE_2D, texture);
+    allocate_storage (entry->source, entry->pending_level);
+    gl.BindTexture (GL_TEXTURE_2D, 0);
+    entry->pending = texture;
+}
+
+/** Upload levels from client memory immediately
+ * @param texture texture created by create_storage()
+ * @param source levels of texture
+ * @param base level that is level 0 of storage
+ * @param level the first level to upload
+ * @param end level after the last one to upload
+ */
+static void upload_now (GLuint texture, const texture_source_t *source,
+                        unsigned int base, unsigned int level,
+                        unsigned int end)
+{
+    gl_state_bind_texture (0, GL_TEXTURE_2D, texture);
+    gl.PixelStorei (GL_UNPACK_ALIGNMENT, 1);
+    for (; level < end; level++) {
+        if (source->block_size != 0) {
+            gl.CompressedTexSubImage2D (GL_TEXTURE_2D, (GLint) (level - base),
+                                        0, 0, level_extent (source->width, level),
+                                        level_extent (source->height, level),
+                                        source->internal_format,
+                                        (GLsizei)level_size (source, level),
+                                        source->levels[level]);
+        } else {
+            gl.TexSubImage2D (GL_TEXTURE_2D, (GLint) (level - base), 0, 0,
+                              level_extent (source->width, level),
+                              level_extent (source->height, level),
+                              source->format, source->type,
+                              source->levels[level]);
+        }
+    }
+    gl.PixelStorei (GL_UNPACK_ALIGNMENT, DEFAULT_UNPACK_ALIGNMENT);
+}
+
+/** Replace texture of entry and release storage of previous one
+ * @param entry managed texture
+ * @param texture new texture
+ * @param size size of storage of new texture, already counted as resident
+ * @param level finest level of new texture
+ */
+static void replace_texture (resident_texture_t *entry, GLuint texture,
+                             size_t size, unsigned int level)
+{
+    if (entry->texture != 0) {
+        gl_state_forget_texture (entry->texture);
+        gl.DeleteTextures (1, &entry->texture);
+    }
+    n_bytes_resident -= entry->size;
+    gpu_memory_resize (entry->allocation, size);
+    entry->texture = texture;
+    entry->size = size;
+    entry->resident_level = level;
+}
+
+/** Swap in pending texture once all of its levels are staged
+ * @param user entry whose level is staged
+ */
+static void level_staged (void *user)
+{
+    resident_texture_t *entry = (resident_texture_t *)user;
+    entry->n_uploads_left--;
+    if (entry->n_uploads_left == 0) {
+        gpu_memory_release (entry->pending_allocation);
+        entry->pending_allocation = -1;
+        replace_texture (entry, entry->pending, entry->pending_size,
+                         entry->pending_level);
+        entry->pending = 0;
+        entry->pending_size = 0;
+        n_transitions--;
+    }
+}
+
+/** Copy resident levels of texture into new storage on GPU
+ * @param entry managed texture
+ * @param texture texture created by create_storage()
+ * @param base level that is level 0 of texture
+ * @param level the first level to copy, resident along with all coarser
+ * ones
+ */
+static void copy_resident (const resident_texture_t *entry, GLuint texture,
+                           unsigned int base, unsigned int level)
+{
+    const texture_source_t *source = entry->source;
+    for (; level < source->n_levels; level++) {
+        gl.CopyImageSubData (entry->texture, GL_TEXTURE_2D,
+                             (GLint) (level - entry->resident_level), 0, 0, 0,
+                             texture, GL_TEXTURE_2D, (GLint) (level - base),
+                             0, 0, 0, level_extent (source->width, level),
+                             level_extent (source->height, level), 1);
+    }
+}
+
+/** Stream levels into pending texture once loader has created it
+ *
+ * Levels that are already resident are copied from current storage where
+ * supported, so only finer ones are read from source.
+ * @param user managed texture
+ */
+static void stream_pending (void *user)
+{
+    resident_texture_t *entry = (resident_texture_t *)user;
+    const texture_source_t *source = entry->source;
+    unsigned int level = entry->pending_level;
+    unsigned int i, end = level + entry->n_uploads_left;
+    if (end < source->n_levels) {
+        copy_resident (entry, entry->pending, level, end);
+    }
+    /* Finest level goes first, so if queue fills up midway only coarse
+     * levels are left to upload immediately */
+    for (i = level; i < end; i++) {
+        GLsizei width = level_extent (source->width, i);
+        GLsizei height = level_extent (source->height, i);
+        int err;
+        if (source->block_size != 0) {
+            err = texture_stream_upload_compressed (entry->pending,
+                                                    (GLint) (i - level),
+                                                    width, height,
+                                                    source->internal_format,
+                                                    source->block_size,
+                                                    source->levels[i],
+                                                    level_staged, entry);
+        } else {
+            err = texture_stream_upload (entry->pending, (GLint) (i - level),
+                                         width, height, source->format,
+                                         source->type, source->pixel_size,
+                                         source->levels[i], level_staged,
+                                         entry);
+        }
+        if (err != 0) {
+            upload_now (entry->pending, source, level, i, end);
+            entry->n_uploads_left = i - level + 1;
+            level_staged (entry);
+            return;
+        }
+    }
+}
+
+/** Start making finer levels of texture resident in new storage, created
+ * by loader
+ * @param entry managed texture that isn't streaming
+ * @param level finest level to make resident
+ * @returns 0 on success, -1 if loader has too many jobs in flight
+ */
+static int start_transition (resident_texture_t *entry, unsigned int level)
+{
+    const texture_source_t *source = entry->source;
+    entry->pending_level = level;
+    if (gl_loader_submit (create_pending, stream_pending, entry) != 0) {
+        return -1;
+    }
+    entry->pending_size = chain_size (source, level);
+    entry->pending_allocation = gpu_memory_track (GPU_MEMORY_TEXTURE,
+                                source->internal_format, entry->pending_size,
+                                NULL, NULL);
+    /* Levels that stay resident are copied rather than streamed */
+    entry->n_uploads_left = (is_copy_supported ? entry->resident_level
+                             : source->n_levels) - level;
+    n_bytes_resident += entry->pending_size;
+    n_levels_streamed += entry->resident_level - level;
+    n_transitions++;
+    return 0;
+}
+
+/** Drop texture to levels that are always resident
+ * @param entry managed texture without pending storage
+ */
+static void evict (resident_texture_t *entry)
+{
+    const texture_source_t *source = entry->source;
+    GLuint texture = create_storage (source, entry->min_level);
+    size_t size = chain_size (source, entry->min_level);
+    /* Kept levels are resident already */
+    if (is_copy_supported) {
+        copy_resident (entry, texture, entry->min_level, entry->min_level);
+    } else {
+        upload_now (texture, source, entry->min_level, entry->min_level,
+                    source->n_levels);
+    }
+    n_bytes_resident += size;
+    replace_texture (entry, texture, size, entry->min_level);
+    n_evictions++;
+}
+
+/** Evict texture to free GPU memory for other allocations
+ * @param user managed texture
+ * @returns 0 if texture was evicted, -1 if it holds only coarse levels or
+ * is streaming
+ */
+static int evict_for_gpu_memory (void *user)
+{
+    resident_texture_t *entry = (resident_texture_t *)user;
+    if ((entry->n_uploads_left != 0)
+            || (entry->resident_level >= entry->min_level)) {
+        return -1;
+    }
+    evict (entry);
+    return 0;
+}
+
+/** Evict least recently used textures until storage of given size fits
+ * into budget
+ * @param size size of storage to fit
+ * @returns non-zero if storage fits
+ */
+static int make_room (size_t size)
+{
+    while (n_bytes_resident + size > budget) {
+        resident_texture_t *victim = NULL;
+        unsigned int i;
+        for (i = 0; i < n_textures; i++) {
+            resident_texture_t *entry = &textures[i];
+            if ((entry->last_used != frame) && (entry->n_uploads_left == 0)
+                    && (entry->resident_level < entry->min_level)
+                    && ((victim == NULL)
+                        || (entry->last_used < victim->last_used))) {
+                victim = entry;
+            }
+        }
+        if (victim == NULL) {
+            return 0;
+        }
+        evict (victim);
+    }
+    return 1;
+}
+
+int texture_residency_init (size_t budget_bytes, unsigned int max_textures)
+{
+    if ((gl.GenTextures == NULL) || (gl.DeleteTextures == NULL)
+            || (gl.TexParameteri == NULL) || (gl.TexStorage2D == NULL)
+            || (gl.PixelStorei == NULL) || (gl.TexSubImage2D == NULL)
+            || (gl.CompressedTexSubImage2D == NULL)
+            || (!gl_version_at_least (4, 2)
+                && !gl_has_extension ("GL_ARB_texture_storage"))) {
+        return -1;
+    }
+    textures = (resident_texture_t *)calloc (max_textures,
+               sizeof (resident_texture_t));
+    if (textures == NULL) {
+        return -1;
+    }
+    is_copy_supported = (gl.CopyImageSubData != NULL)
+                        && (gl_version_at_least (4, 3)
+                            || gl_has_extension ("GL_ARB_copy_image"));
+    max_texture_count = max_textures;
+    n_textures = 0;
+    budget = budget_bytes;
+    n_bytes_resident = 0;
+    n_transitions = 0;
+    frame = 1;
+    return 0;
+}
+
+void texture_residency_shutdown (void)
+{
+    unsigned int i;
+    if (textures == NULL) {
+        return;
+    }
+    for (i = 0; i < n_textures; i++) {
+        resident_texture_t *entry = &textures[i];
+        gl_state_forget_texture (entry->texture);
+        gl.DeleteTextures (1, &entry->texture);
+        gpu_memory_release (entry->allocation);
+        /* Loader is stopped, so pending texture may be created without
+         * its job being finished */
+        if (entry->pending != 0) {
+            gl_state_forget_texture (entry->pending);
+            gl.DeleteTextures (1, &entry->pending);
+        }
+        gpu_memory_release (entry->pending_allocation);
+    }
+    free (textures);
+    textures = NULL;
+    max_texture_count = 0;
+    n_textures = 0;
+    n_bytes_resident = 0;
+    n_transitions = 0;
+}
+
+int texture_residency_add (const texture_source_t *source)
+{
+    resident_texture_t *entry;
+    GLuint texture;
+    size_t size;
+    unsigned int level = 0;
+    if ((n_textures == max_texture_count) || (source->n_levels == 0)
+            || (source->n_levels > TEXTURE_MAX_LEVELS)) {
+        return -1;
+    }
+    while ((level + 1 < source->n_levels)
+            && ((source->width >> level > TEXTURE_MIN_RESIDENT_SIZE)
+                || (source->height >> level > TEXTURE_MIN_RESIDENT_SIZE))) {
+        level++;
+    }
+    entry = &textures[n_textures];
+    entry->source = source;
+    entry->size = 0;
+    entry->pending_size = 0;
+    entry->last_used = 0;
+    entry->texture = 0;
+    entry->pending = 0;
+    entry->allocation = -1;
+    entry->pending_allocation = -1;
+    entry->min_level = level;
+    entry->wanted_level = level;
+    texture = create_storage (source, level);
+    size = chain_size (source, level);
+    upload_now (texture, source, level, level, source->n_levels);
+    n_bytes_resident += size;
+    replace_texture (entry, texture, size, level);
+    entry->allocation = gpu_memory_track (GPU_MEMORY_TEXTURE,
+                                          source->internal_format, size,
+                                          evict_for_gpu_memory, entry);
+    return (int)n_textures++;
+}
+
+void texture_residency_use (int handle, float screen_size)
+{
+    resident_texture_t *entry = &textures[handle];
+    const texture_source_t *source = entry->source;
+    unsigned int level = 0;
+    /* The coarsest level still covering all pixels on screen */
+    while (level + 1 < source->n_levels) {
+        GLsizei width = level_extent (source->width, level + 1);
+        GLsizei height = level_extent (source->height, level + 1);
+        if ((float) (width > height ? width : height) < screen_size) {
+            break;
+        }
+        level++;
+    }
+    gpu_memory_use (entry->allocation);
+    if (entry->last_used != frame) {
+        entry->last_used = frame;
+        entry->wanted_level = level;
+    } else if (level < entry->wanted_level) {
+        entry->wanted_level = level;
+    }
+}
+
+GLuint texture_residency_get (int handle)
+{
+    return textures[handle].texture;
+}
+
+void texture_residency_update (void)
+{
+    unsigned int i, n_started = 0;
+    size_t size;
+    for (i = 0; (i < n_textures) && (n_started < MAX_TRANSITIONS); i++) {
+        resident_texture_t *entry = &textures[i];
+        if ((entry->last_used != frame) || (entry->n_uploads_left != 0)
+                || (entry->wanted_level >= entry->resident_level)) {
+            continue;
+        }
+        /* Textures used every frame aren't evicted, levels they need wait
+         * until others fall out of use */
+        size = chain_size (entry->source, entry->wanted_level);
+        if (make_room (size) && (gpu_memory_reserve (size) == 0)
+                && (start_transition (entry, entry->wanted_level) == 0)) {
+            n_started++;
+        }
+    }
+    frame++;
+}
+
+void texture_residency_print_stats (void)
+{
+    if (textures == NULL) {
+        return;
+    }
+    printf ("Texture residency: %.2f of %.2f MiB, %lu levels streamed, "
+            "%lu evictions, %u textures streaming\n",
+            (double)n_bytes_resident / (1024.0 * 1024.0),
+            (double)budget / (1024.0 * 1024.0), n_levels_streamed,
+            n_evictions, n_transitions);
+    n_levels_streamed = 0;
+    n_evictions = 0;
+}
@@ -0,0 +1,321 @@
+/**
+ * @file texture_stream.c
+ * This module contains uploads of texture images through pixel unpack
+ * buffers limited by per-frame budget.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gl_procs.h"
+#include "gl_state.h"
+#include "monotonic.h"
+#include "stream_buffer.h"
+#include "texture_stream.h"
+
+/** Maximum number of slices issued in single frame */
+#define MAX_SLICES 64
+
+/** Alignment of slices in staging buffer, enough for any pixel type */
+#define SLICE_ALIGNMENT 16
+
+/** Default alignment of rows of unpacked pixels */
+#define DEFAULT_UNPACK_ALIGNMENT 4
+
+/** Width and height of block of compressed formats in texels */
+#define BLOCK_EXTENT 4
+
+/** Image waiting for upload */
+typedef struct texture_upload_t {
+    const unsigned char *pixels; /**< Source rows */
+    texture_stream_done_fn done; /**< Callback of staged image */
+    void *user; /**< User data of callback */
+    size_t row_size; /**< Size of row in bytes */
+    GLuint texture; /**< Destination texture */
+    GLint level; /**< Destination mipmap level */
+    GLsizei width; /**< Width of level */
+    GLsizei height; /**< Height of level */
+    GLsizei n_rows; /**< Number of rows of pixels or blocks */
+    GLsizei next_row; /**< The first row that isn't staged yet */
+    GLenum format; /**< Format of pixels or internal compressed format */
+    GLenum type; /**< Type of pixel components */
+    unsigned int block_size; /**< Size of block, 0 if uncompressed */
+    char padding[4];
+} texture_upload_t;
+
+/** Rows of image staged in current frame */
+typedef struct texture_slice_t {
+    texture_stream_done_fn done; /**< Callback if slice ends image */
+    void *user; /**< User data of callback */
+    GLuint offset; /**< Offset of rows in staging buffer */
+    GLuint texture; /**< Destination texture */
+    GLint level; /**< Destination mipmap level */
+    GLsizei width; /**< Width of level */
+    GLsizei y; /**< The first row of texels of slice */
+    GLsizei n_rows; /**< Number of rows of texels of slice */
+    GLsizei image_size; /**< Size of compressed data, 0 if uncompressed */
+    GLenum format; /**< Format of pixels or internal compressed format */
+    GLenum type; /**< Type of pixel components */
+    char padding[4];
+} texture_slice_t;
+
+/** Staging buffer bound as pixel unpack buffer */
+static stream_buffer_t stream;
+
+/** Non-zero if staging buffer is created */
+static int is_initialized = 0;
+
+/** Time budget of single frame in milliseconds */
+static double frame_budget_ms = 0.0;
+
+/** Ring of queued images */
+static texture_upload_t *queue = NULL;
+
+/** Capacity of queue */
+static unsigned int queue_size = 0;
+
+/** Index of the oldest queued image */
+static unsigned int queue_head = 0;
+
+/** Number of queued images */
+static unsigned int n_queued = 0;
+
+/** Slices of current frame */
+static texture_slice_t slices[MAX_SLICES];
+
+/** Number of bytes uploaded since previous report */
+static size_t n_bytes_total = 0;
+
+/** Number of slices uploaded since previous report */
+static unsigned long n_slices_total = 0;
+
+/** Time spent staging since previous report */
+static double update_total_ms = 0.0;
+
+/** Number of frames since previous report */
+static unsigned long n_frames = 0;
+
+int texture_stream_init (size_t budget_bytes, double budget_ms,
+                         unsigned int max_uploads)
+{
+    if ((gl.PixelStorei == NULL) || (gl.TexSubImage2D == NULL)
+            || !gl_version_at_least (2, 1)) {
+        return -1;
+    }
+    queue = (texture_upload_t *)calloc (max_uploads,
+                                        sizeof (texture_upload_t));
+    if (queue == NULL) {
+        return -1;
+    }
+    if (stream_buffer_init (&stream, budget_bytes) != 0) {
+        free (queue);
+        queue = NULL;
+        return -1;
+    }
+    queue_size = max_uploads;
+    queue_head = 0;
+    n_queued = 0;
+    frame_budget_ms = budget_ms;
+    is_initialized = 1;
+    return 0;
+}
+
+void texture_stream_shutdown (void)
+{
+    if (!is_initialized) {
+        return;
+    }
+    stream_buffer_destroy (&stream);
+    free (queue);
+    queue = NULL;
+    queue_size = 0;
+    n_queued = 0;
+    is_initialized = 0;
+}
+
+/** Append image to queue
+ * @param upload image with all fields but row_size, n_rows and next_row set
+ * @param row_size size of row of pixels or blocks in bytes
+ * @param n_rows number of rows of pixels or blocks
+ * @returns 0 on success, -1 if queue is full or single row exceeds budget
+ */
+static int queue_upload (const texture_upload_t *upload, size_t row_size,
+                         GLsizei n_rows)
+{
+    texture_upload_t *queued;
+    if (!is_initialized || (n_queued == queue_size) || (upload->width <= 0)
+            || (upload->height <= 0)
+            || (row_size > stream.frame_size - SLICE_ALIGNMENT)) {
+        return -1;
+    }
+    queued = &queue[(queue_head + n_queued) % queue_size];
+    *queued = *upload;
+    queued->row_size = row_size;
+    queued->n_rows = n_rows;
+    queued->next_row = 0;
+    n_queued++;
+    return 0;
+}
+
+int texture_stream_upload (GLuint texture, GLint level, GLsizei width,
+                           GLsizei height, GLenum format, GLenum type,
+                           size_t pixel_size, const void *pixels,
+                           texture_stream_done_fn done, void *user)
+{
+    texture_upload_t upload;
+    upload.pixels = (const unsigned char *)pixels;
+    upload.done = done;
+    upload.user = user;
+    upload.texture = texture;
+    upload.level = level;
+    upload.width = width;
+    upload.height = height;
+    upload.format = format;
+    upload.type = type;
+    upload.block_size = 0;
+    return queue_upload (&upload, (size_t)width * pixel_size, height);
+}
+
+int texture_stream_upload_compressed (GLuint texture, GLint level,
+                                      GLsizei width, GLsizei height,
+                                      GLenum internal_format,
+                                      unsigned int block_size,
+                                      const void *data,
+                                      texture_stream_done_fn done, void *user)
+{
+    texture_upload_t upload;
+    if (gl.CompressedTexSubImage2D == NULL) {
+        return -1;
+    }
+    upload.pixels = (const unsigned char *)data;
+    upload.done = done;
+    upload.user = user;
+    upload.texture = texture;
+    upload.level = level;
+    upload.width = width;
+    upload.height = height;
+    upload.format = internal_format;
+    upload.type = GL_NONE;
+    upload.block_size = block_size;
+    return queue_upload (&upload, (size_t) ((width + BLOCK_EXTENT - 1)
+                                            / BLOCK_EXTENT) * block_size,
+                         (height + BLOCK_EXTENT - 1) / BLOCK_EXTENT);
+}
+
+/** Copy as many rows of the oldest image as fit into staging buffer
+ * @param slice receives staged rows
+ * @returns non-zero if some rows were staged
+ */
+static int stage_slice (texture_slice_t *slice)
+{
+    texture_upload_t *upload = &queue[queue_head];
+    size_t used = (stream.offset + SLICE_ALIGNMENT - 1)
+                  & ~(size_t) (SLICE_ALIGNMENT - 1);
+    size_t n_rows = used < stream.frame_size ?
+                    (stream.frame_size - used) / upload->row_size : 0;
+    size_t rows_left = (size_t) (upload->n_rows - upload->next_row);
+    void *memory;
+    if (n_rows == 0) {
+        return 0;
+    }
+    n_rows = n_rows < rows_left ? n_rows : rows_left;
+    memory = stream_buffer_alloc (&stream, n_rows * upload->row_size,
+                                  SLICE_ALIGNMENT, &slice->offset);
+    memcpy (memory, upload->pixels + (size_t)upload->next_row
+            * upload->row_size, n_rows * upload->row_size);
+    slice->texture = upload->texture;
+    slice->level = upload->level;
+    slice->width = upload->width;
+    slice->y = upload->next_row;
+    slice->n_rows = (GLsizei)n_rows;
+    slice->image_size = 0;
+    if (upload->block_size != 0) {
+        /* Slices of compressed image are whole rows of blocks, only the
+         * last one may end inside a block */
+        slice->y *= BLOCK_EXTENT;
+        slice->n_rows *= BLOCK_EXTENT;
+        if (slice->n_rows > upload->height - slice->y) {
+            slice->n_rows = upload->height - slice->y;
+        }
+        slice->image_size = (GLsizei) (n_rows * upload->row_size);
+    }
+    slice->format = upload->format;
+    slice->type = upload->type;
+    slice->done = NULL;
+    slice->user = NULL;
+    upload->next_row += (GLsizei)n_rows;
+    if (upload->next_row == upload->n_rows) {
+        slice->done = upload->done;
+        slice->user = upload->user;
+        queue_head = (queue_head + 1) % queue_size;
+        n_queued--;
+    }
+    n_bytes_total += n_rows * upload->row_size;
+    return 1;
+}
+
+void texture_stream_update (void)
+{
+    double start;
+    unsigned int i, n_slices = 0;
+    if (!is_initialized) {
+        return;
+    }
+    n_frames++;
+    if (n_queued == 0) {
+        return;
+    }
+    start = monotonic_ms ();
+    stream_buffer_begin_frame (&stream);
+    while ((n_queued != 0) && (n_slices < MAX_SLICES)
+            && (monotonic_ms () - start < frame_budget_ms)
+            && stage_slice (&slices[n_slices])) {
+        n_slices++;
+    }
+    stream_buffer_commit (&stream);
+    gl_state_bind_buffer (GL_PIXEL_UNPACK_BUFFER, stream.buffer);
+    gl.PixelStorei (GL_UNPACK_ALIGNMENT, 1);
+    for (i = 0; i < n_slices; i++) {
+        const texture_slice_t *slice = &slices[i];
+        gl_state_bind_texture (0, GL_TEXTURE_2D, slice->texture);
+        if (slice->image_size != 0) {
+            gl.CompressedTexSubImage2D (GL_TEXTURE_2D, slice->level, 0,
+                                        slice->y, slice->width, slice->n_rows,
+                                        slice->format, slice->image_size,
+                                        (const void *) (size_t)slice->offset);
+        } else {
+            gl.TexSubImage2D (GL_TEXTURE_2D, slice->level, 0, slice->y,
+                              slice->width, slice->n_rows, slice->format,
+                              slice->type, (const void *) (size_t)slice->offset);
+        }
+    }
+    gl.PixelStorei (GL_UNPACK_ALIGNMENT, DEFAULT_UNPACK_ALIGNMENT);
+    /* Client memory uploads elsewhere must not be read from buffer */
+    gl_state_bind_buffer (GL_PIXEL_UNPACK_BUFFER, 0);
+    stream_buffer_end_frame (&stream);
+    for (i = 0; i < n_slices; i++) {
+        if (slices[i].done != NULL) {
+            slices[i].done (slices[i].user);
+        }
+    }
+    n_slices_total += n_slices;
+    update_total_ms += monotonic_ms () - start;
+}
+
+void texture_stream_print_stats (void)
+{
+    if (!is_initialized) {
+        return;
+    }
+    printf ("Texture uploads: %.2f MiB in %lu slices, %.3f ms/frame, "
+            "%u images pending\n",
+            (double)n_bytes_total / (1024.0 * 1024.0), n_slices_total,
+            n_frames != 0 ? update_total_ms / (double)n_frames : 0.0,
+            n_queued);
+    n_bytes_total = 0;
+    n_slices_total = 0;
+    update_total_ms = 0.0;
+    n_frames = 0;
+}
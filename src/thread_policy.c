@@ -0,0 +1,206 @@
+/**
+ * @file thread_policy.c
+ * This module contains CPU affinity and scheduling policy control for
+ * application threads.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/resource.h>
+#include "thread_policy.h"
+
+/** Affinity of the process before any thread was pinned */
+static cpu_set_t default_cpus;
+
+/** Non-zero if default_cpus holds valid set */
+static int has_default_cpus = 0;
+
+/** Parse non-negative decimal number
+ * @param str string to parse
+ * @param end receives pointer to the first character after the number
+ * @returns parsed number, -1 if str doesn't start with a digit
+ */
+static long parse_number (const char *str, const char **end)
+{
+    char *tail = NULL;
+    long value;
+    if ((*str < '0') || (*str > '9')) {
+        return -1;
+    }
+    value = strtol (str, &tail, 10);
+    *end = tail;
+    return value;
+}
+
+int thread_policy_parse_cpus (const char *list, cpu_set_t *set)
+{
+    const char *cursor = list;
+    CPU_ZERO (set);
+    while (*cursor != '\0') {
+        long first, last;
+        first = parse_number (cursor, &cursor);
+        if ((first < 0) || (first >= CPU_SETSIZE)) {
+            return -1;
+        }
+        last = first;
+        if (*cursor == '-') {
+            last = parse_number (cursor + 1, &cursor);
+            if ((last < first) || (last >= CPU_SETSIZE)) {
+                return -1;
+            }
+        }
+        while (first <= last) {
+            CPU_SET ((size_t)first, set);
+            first++;
+        }
+        if (*cursor == ',') {
+            cursor++;
+        } else if (*cursor != '\0') {
+            return -1;
+        }
+    }
+    return CPU_COUNT (set) > 0 ? 0 : -1;
+}
+
+int thread_policy_parse_realtime (const char *spec, int *policy,
+                                  int *priority)
+{
+    const char *cursor = NULL;
+    long value = 0;
+    if (strncmp (spec, "fifo", 4) == 0) {
+        *policy = SCHED_FIFO;
+        cursor = spec + 4;
+    } else if (strncmp (spec, "rr", 2) == 0) {
+        *policy = SCHED_RR;
+        cursor = spec + 2;
+    } else {
+        return -1;
+    }
+    if (*cursor == ':') {
+        value = parse_number (cursor + 1, &cursor);
+        if ((value < 1) || (value > 99)) {
+            return -1;
+        }
+    }
+    if (*cursor != '\0') {
+        return -1;
+    }
+    *priority = (int)value;
+    return 0;
+}
+
+void thread_policy_save_default (void)
+{
+    CPU_ZERO (&default_cpus);
+    has_default_cpus = sched_getaffinity (0, sizeof (default_cpus),
+                                          &default_cpus) == 0;
+}
+
+int thread_policy_init_attr (pthread_attr_t *attr)
+{
+    struct sched_param param;
+    int err = pthread_attr_init (attr);
+    if (err != 0) {
+        return err;
+    }
+    memset (&param, 0, sizeof (param));
+    err = pthread_attr_setinheritsched (attr, PTHREAD_EXPLICIT_SCHED);
+    if (err == 0) {
+        err = pthread_attr_setschedpolicy (attr, SCHED_OTHER);
+    }
+    if (err == 0) {
+        err = pthread_attr_setschedparam (attr, &param);
+    }
+    if ((err == 0) && has_default_cpus) {
+        err = pthread_attr_setaffinity_np (attr, sizeof (default_cpus),
+                                           &default_cpus);
+    }
+    if (err != 0) {
+        pthread_attr_destroy (attr);
+    }
+    return err;
+}
+
+int thread_policy_pin (pthread_t thread, const cpu_set_t *set)
+{
+    return pthread_setaffinity_np (thread, sizeof (*set), set);
+}
+
+int thread_policy_set_realtime (int policy, int priority)
+{
+    struct sched_param param;
+    struct rlimit limit;
+    int min_priority = sched_get_priority_min (policy);
+    int max_priority = sched_get_priority_max (policy);
+    int err;
+    if ((min_priority < 0) || (max_priority < 0)) {
+        return -1;
+    }
+    if (priority < min_priority) {
+        priority = min_priority;
+    } else if (priority > max_priority) {
+        priority = max_priority;
+    }
+    memset (&param, 0, sizeof (param));
+    param.sched_priority = priority;
+    err = pthread_setschedparam (pthread_self (), policy, &param);
+    if ((err == EPERM) && (getrlimit (RLIMIT_RTPRIO, &limit) == 0)
+            && (limit.rlim_cur != RLIM_INFINITY)
+            && (limit.rlim_cur >= (rlim_t)min_priority)
+            && (limit.rlim_cur < (rlim_t)priority)) {
+        /* Unprivileged user may be allowed lower priorities only */
+        param.sched_priority = (int)limit.rlim_cur;
+        err = pthread_setschedparam (pthread_self (), policy, &param);
+    }
+    return err == 0 ? param.sched_priority : -1;
+}
+
+/** Get name of scheduling policy
+ * @param policy scheduling policy
+ * @returns name of policy
+ */
+static const char *policy_name (int policy)
+{
+    switch (policy) {
+        case SCHED_OTHER:
+            return "SCHED_OTHER";
+        case SCHED_FIFO:
+            return "SCHED_FIFO";
+        case SCHED_RR:
+            return "SCHED_RR";
+        case SCHED_BATCH:
+            return "SCHED_BATCH";
+        case SCHED_IDLE:
+            return "SCHED_IDLE";
+        default:
+            return "unknown";
+    }
+}
+
+void thread_policy_report (const char *name)
+{
+    struct sched_param param;
+    cpu_set_t cpus;
+    int policy = SCHED_OTHER;
+    int cpu, first = 1;
+    memset (&param, 0, sizeof (param));
+    pthread_getschedparam (pthread_self (), &policy, &param);
+    printf ("%s thread: %s priority %d, cpus ", name, policy_name (policy),
+            param.sched_priority);
+    CPU_ZERO (&cpus);
+    if (pthread_getaffinity_np (pthread_self (), sizeof (cpus), &cpus) != 0) {
+        printf ("unknown\n");
+        return;
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET ((size_t)cpu, &cpus)) {
+            printf (first ? "%d" : ",%d", cpu);
+            first = 0;
+        }
+    }
+    printf ("\n");
+}
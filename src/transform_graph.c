@@ -0,0 +1,319 @@
+/**
+ * @file transform_graph.c
+ * This module contains hierarchy of transforms stored as structure of
+ * arrays.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include "math3d.h"
+#include "workers.h"
+#include "transform_graph.h"
+
+/** Parallel update of graph */
+typedef struct update_job_t {
+    transform_graph_t *graph; /**< Graph to update */
+    unsigned int n_jobs; /**< Number of jobs */
+    unsigned int n_updated; /**< Number of updated nodes */
+} update_job_t;
+
+int transform_graph_init (transform_graph_t *graph, unsigned int capacity)
+{
+    size_t n = capacity;
+    graph->parents = (unsigned int *)malloc (n * sizeof (unsigned int));
+    graph->root_of = (unsigned int *)malloc (n * sizeof (unsigned int));
+    graph->roots = (unsigned int *)malloc (n * sizeof (unsigned int));
+    graph->dirty = (unsigned char *)calloc (n, 1);
+    graph->subtree_dirty = (unsigned char *)calloc (n, 1);
+    graph->positions = (float *)malloc (n * 3 * sizeof (float));
+    graph->rotations = (float *)malloc (n * 4 * sizeof (float));
+    graph->scales = (float *)malloc (n * sizeof (float));
+    graph->world = (float *)malloc (n * 16 * sizeof (float));
+    graph->capacity = capacity;
+    graph->n_nodes = 0;
+    graph->n_roots = 0;
+    graph->n_updated = 0;
+    graph->is_sorted = 1;
+    if ((graph->parents == NULL) || (graph->root_of == NULL)
+            || (graph->roots == NULL) || (graph->dirty == NULL)
+            || (graph->subtree_dirty == NULL) || (graph->positions == NULL)
+            || (graph->rotations == NULL) || (graph->scales == NULL)
+            || (graph->world == NULL)) {
+        transform_graph_destroy (graph);
+        return -1;
+    }
+    return 0;
+}
+
+void transform_graph_destroy (transform_graph_t *graph)
+{
+    free (graph->parents);
+    free (graph->root_of);
+    free (graph->roots);
+    free (graph->dirty);
+    free (graph->subtree_dirty);
+    free (graph->positions);
+    free (graph->rotations);
+    free (graph->scales);
+    free (graph->world);
+    memset (graph, 0, sizeof (transform_graph_t));
+}
+
+unsigned int transform_graph_add (transform_graph_t *graph,
+                                  unsigned int parent)
+{
+    unsigned int node = graph->n_nodes;
+    if ((node >= graph->capacity)
+            || ((parent != TRANSFORM_ROOT) && (parent >= node))) {
+        return TRANSFORM_ROOT;
+    }
+    graph->n_nodes++;
+    graph->parents[node] = parent;
+    memset (graph->positions + node * 3, 0, 3 * sizeof (float));
+    memset (graph->rotations + node * 4, 0, 3 * sizeof (float));
+    graph->rotations[node * 4 + 3] = 1.0f;
+    graph->scales[node] = 1.0f;
+    graph->dirty[node] = 1;
+    if (parent == TRANSFORM_ROOT) {
+        graph->roots[graph->n_roots] = node;
+        graph->root_of[node] = graph->n_roots++;
+    } else {
+        graph->root_of[node] = graph->root_of[parent];
+        /* Appending to any but the last subtree breaks contiguity */
+        if (graph->root_of[node] + 1 != graph->n_roots) {
+            graph->is_sorted = 0;
+        }
+    }
+    graph->subtree_dirty[graph->root_of[node]] = 1;
+    return node;
+}
+
+/** Reorder elements of array
+ * @param array array to reorder
+ * @param size size of element in bytes
+ * @param order old index of each new index
+ * @param n number of elements
+ * @param scratch memory for n elements
+ */
+static void permute (void *array, size_t size, const unsigned int *order,
+                     unsigned int n, void *scratch)
+{
+    unsigned char *src = (unsigned char *)array;
+    unsigned char *dst = (unsigned char *)scratch;
+    unsigned int i;
+    for (i = 0; i < n; i++) {
+        memcpy (dst + i * size, src + order[i] * size, size);
+    }
+    memcpy (array, scratch, n * size);
+}
+
+/** Compute depth-first order of nodes
+ * @param graph graph to walk
+ * @param first_child memory for first child of each node
+ * @param next_sibling memory for next sibling of each node
+ * @param order receives old index of each new index
+ */
+static void depth_first_order (const transform_graph_t *graph,
+                               unsigned int *first_child,
+                               unsigned int *next_sibling,
+                               unsigned int *order)
+{
+    unsigned int n = graph->n_nodes;
+    unsigned int i, n_ordered = 0;
+    for (i = 0; i < n; i++) {
+        first_child[i] = TRANSFORM_ROOT;
+    }
+    /* Walk backwards so that children keep their relative order */
+    for (i = n; i-- > 0;) {
+        unsigned int parent = graph->parents[i];
+        next_sibling[i] = TRANSFORM_ROOT;
+        if (parent != TRANSFORM_ROOT) {
+            next_sibling[i] = first_child[parent];
+            first_child[parent] = i;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        unsigned int node = i;
+        if (graph->parents[i] != TRANSFORM_ROOT) {
+            continue;
+        }
+        for (;;) {
+            order[n_ordered++] = node;
+            if (first_child[node] != TRANSFORM_ROOT) {
+                node = first_child[node];
+                continue;
+            }
+            while ((node != i) && (next_sibling[node] == TRANSFORM_ROOT)) {
+                node = graph->parents[node];
+            }
+            if (node == i) {
+                break;
+            }
+            node = next_sibling[node];
+        }
+    }
+}
+
+int transform_graph_sort (transform_graph_t *graph, unsigned int *remap)
+{
+    unsigned int n = graph->n_nodes;
+    unsigned int *order, *new_index;
+    void *scratch;
+    unsigned int i;
+    /* Old index of each new one, new index of each old one, child lists */
+    order = (unsigned int *)malloc (n * 3 * sizeof (unsigned int) + 1);
+    scratch = malloc (n * 16 * sizeof (float) + 1);
+    if ((order == NULL) || (scratch == NULL)) {
+        free (order);
+        free (scratch);
+        return -1;
+    }
+    new_index = order + n;
+    depth_first_order (graph, order + n, order + 2 * n, order);
+    for (i = 0; i < n; i++) {
+        new_index[order[i]] = i;
+    }
+    for (i = 0; i < n; i++) {
+        unsigned int parent = graph->parents[i];
+        graph->parents[i] = parent == TRANSFORM_ROOT ? parent :
+                            new_index[parent];
+    }
+    permute (graph->parents, sizeof (unsigned int), order, n, scratch);
+    permute (graph->dirty, 1, order, n, scratch);
+    permute (graph->positions, 3 * sizeof (float), order, n, scratch);
+    permute (graph->rotations, 4 * sizeof (float), order, n, scratch);
+    permute (graph->scales, sizeof (float), order, n, scratch);
+    permute (graph->world, 16 * sizeof (float), order, n, scratch);
+    if (remap != NULL) {
+        memcpy (remap, new_index, n * sizeof (unsigned int));
+    }
+    graph->n_roots = 0;
+    for (i = 0; i < n; i++) {
+        if (graph->parents[i] == TRANSFORM_ROOT) {
+            graph->roots[graph->n_roots] = i;
+            graph->subtree_dirty[graph->n_roots] = 1;
+            graph->root_of[i] = graph->n_roots++;
+        } else {
+            graph->root_of[i] = graph->root_of[graph->parents[i]];
+        }
+    }
+    graph->is_sorted = 1;
+    free (order);
+    free (scratch);
+    return 0;
+}
+
+void transform_graph_set_local (transform_graph_t *graph, unsigned int node,
+                                const float *position, const float *rotation,
+                                float scale)
+{
+    memcpy (graph->positions + node * 3, position, 3 * sizeof (float));
+    memcpy (graph->rotations + node * 4, rotation, 4 * sizeof (float));
+    graph->scales[node] = scale;
+    graph->dirty[node] = 1;
+    /* Nodes of the same subtree may be changed by several threads */
+    __atomic_store_n (&graph->subtree_dirty[graph->root_of[node]], 1,
+                      __ATOMIC_RELAXED);
+}
+
+/** Update world matrices of range of nodes whose parents precede them
+ * @param graph graph to update
+ * @param first the first node of range
+ * @param end node after the last one of range
+ * @returns number of updated nodes
+ */
+static unsigned int update_range (transform_graph_t *graph,
+                                  unsigned int first, unsigned int end)
+{
+    unsigned int n_updated = 0;
+    unsigned int i;
+    for (i = first; i < end; i++) {
+        unsigned int parent = graph->parents[i];
+        float local[16];
+        if ((parent != TRANSFORM_ROOT) && graph->dirty[parent]) {
+            graph->dirty[i] = 1;
+        }
+        if (!graph->dirty[i]) {
+            continue;
+        }
+        if (parent == TRANSFORM_ROOT) {
+            mat4_from_trs (graph->positions + i * 3, graph->rotations + i * 4,
+                           graph->scales[i], graph->world + i * 16);
+        } else {
+            mat4_from_trs (graph->positions + i * 3, graph->rotations + i * 4,
+                           graph->scales[i], local);
+            mat4_multiply (graph->world + parent * 16, local,
+                           graph->world + i * 16);
+        }
+        n_updated++;
+    }
+    /* Flags are cleared after the pass, children read them of parents */
+    memset (graph->dirty + first, 0, end - first);
+    return n_updated;
+}
+
+/** Find the first root subtree starting at or after node
+ * @param graph sorted graph
+ * @param node index of node
+ * @returns index in roots, n_roots if there is none
+ */
+static unsigned int find_root (const transform_graph_t *graph,
+                               unsigned int node)
+{
+    unsigned int low = 0, high = graph->n_roots;
+    while (low < high) {
+        unsigned int middle = low + (high - low) / 2;
+        if (graph->roots[middle] < node) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/** Update root subtrees of slice with similar number of nodes
+ * @param arg update_job_t of graph
+ * @param index index of slice
+ */
+static void update_subtrees (void *arg, unsigned int index)
+{
+    update_job_t *job = (update_job_t *)arg;
+    transform_graph_t *graph = job->graph;
+    unsigned long n_nodes = graph->n_nodes;
+    unsigned int first = find_root (graph, (unsigned int) (n_nodes * index /
+                                    job->n_jobs));
+    unsigned int last = find_root (graph, (unsigned int) (n_nodes *
+                                   (index + 1) / job->n_jobs));
+    unsigned int n_updated = 0;
+    unsigned int root;
+    for (root = first; root < last; root++) {
+        if (graph->subtree_dirty[root]) {
+            n_updated += update_range (graph, graph->roots[root],
+                                       root + 1 < graph->n_roots ?
+                                       graph->roots[root + 1] : graph->n_nodes);
+            graph->subtree_dirty[root] = 0;
+        }
+    }
+    __atomic_fetch_add (&job->n_updated, n_updated, __ATOMIC_RELAXED);
+}
+
+void transform_graph_update (transform_graph_t *graph)
+{
+    update_job_t job;
+    if (!graph->is_sorted) {
+        graph->n_updated = update_range (graph, 0, graph->n_nodes);
+        memset (graph->subtree_dirty, 0, graph->n_roots);
+        return;
+    }
+    job.graph = graph;
+    job.n_jobs = workers_count () + 1;
+    job.n_updated = 0;
+    if (job.n_jobs > graph->n_roots) {
+        job.n_jobs = graph->n_roots > 0 ? graph->n_roots : 1;
+    }
+    workers_run (update_subtrees, &job, job.n_jobs);
+    graph->n_updated = job.n_updated;
+}
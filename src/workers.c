@@ -0,0 +1,220 @@
+/**
+ * @file workers.c
+ * This module contains pool of worker threads executing batches of
+ * independent jobs.
+ */
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+#include <stdlib.h>
+#include <pthread.h>
+#include "thread_policy.h"
+#include "workers.h"
+
+/** Guards queue and counters of all queued batches */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Signaled when new batch is queued or pool is shutting down */
+static pthread_cond_t work_available = PTHREAD_COND_INITIALIZER;
+
+/** Signaled when some batch is completed */
+static pthread_cond_t batch_done = PTHREAD_COND_INITIALIZER;
+
+/** First batch with unclaimed jobs */
+static workers_batch_t *queue_head = NULL;
+
+/** Last batch with unclaimed jobs */
+static workers_batch_t *queue_tail = NULL;
+
+/** Worker threads */
+static pthread_t *threads = NULL;
+
+/** Number of running worker threads */
+static unsigned int n_threads = 0;
+
+/** Non-zero if workers should exit when queue is empty */
+static int is_quitting = 0;
+
+/** Claim next job of batch, must be called with queue_lock held
+ * @param batch batch with unclaimed jobs
+ * @returns index of claimed job
+ */
+static unsigned int claim_job (workers_batch_t *batch)
+{
+    unsigned int index = batch->n_claimed++;
+    if ((batch->n_claimed == batch->n_jobs) && (queue_head == batch)) {
+        queue_head = batch->next;
+        if (queue_head == NULL) {
+            queue_tail = NULL;
+        }
+    }
+    return index;
+}
+
+/** Execute claimed job and account its completion
+ * @param batch batch that job belongs to
+ * @param index index of claimed job
+ */
+static void execute_job (workers_batch_t *batch, unsigned int index)
+{
+    batch->fn (batch->arg, index);
+    pthread_mutex_lock (&queue_lock);
+    batch->n_done++;
+    if (batch->n_done == batch->n_jobs) {
+        pthread_cond_broadcast (&batch_done);
+    }
+    pthread_mutex_unlock (&queue_lock);
+}
+
+/** Entry point of worker thread
+ * @param arg unused
+ * @returns NULL
+ */
+static void *worker_main (void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock (&queue_lock);
+    for (;;) {
+        workers_batch_t *batch;
+        unsigned int index;
+        while ((queue_head == NULL) && !is_quitting) {
+            pthread_cond_wait (&work_available, &queue_lock);
+        }
+        if (queue_head == NULL) {
+            break;
+        }
+        batch = queue_head;
+        index = claim_job (batch);
+        pthread_mutex_unlock (&queue_lock);
+        execute_job (batch, index);
+        pthread_mutex_lock (&queue_lock);
+    }
+    pthread_mutex_unlock (&queue_lock);
+    return NULL;
+}
+
+int workers_init (unsigned int n_workers, const cpu_set_t *cpus)
+{
+    pthread_attr_t attr;
+    unsigned int i;
+    int err, cpu = -1;
+    if (n_workers == 0) {
+        return 0;
+    }
+    threads = (pthread_t *)calloc (n_workers, sizeof (pthread_t));
+    if (threads == NULL) {
+        return -1;
+    }
+    err = thread_policy_init_attr (&attr);
+    if (err != 0) {
+        free (threads);
+        threads = NULL;
+        return err;
+    }
+    is_quitting = 0;
+    for (i = 0; i < n_workers; i++) {
+        err = pthread_create (&threads[i], &attr, worker_main, NULL);
+        if (err != 0) {
+            break;
+        }
+        n_threads++;
+        if (cpus != NULL) {
+            cpu_set_t single;
+            do {
+                cpu = (cpu + 1) % CPU_SETSIZE;
+            } while (!CPU_ISSET ((size_t)cpu, cpus));
+            CPU_ZERO (&single);
+            CPU_SET ((size_t)cpu, &single);
+            thread_policy_pin (threads[i], &single);
+        }
+    }
+    pthread_attr_destroy (&attr);
+    if (err != 0) {
+        workers_shutdown ();
+    }
+    return err;
+}
+
+void workers_shutdown (void)
+{
+    unsigned int i;
+    pthread_mutex_lock (&queue_lock);
+    is_quitting = 1;
+    pthread_cond_broadcast (&work_available);
+    pthread_mutex_unlock (&queue_lock);
+    for (i = 0; i < n_threads; i++) {
+        pthread_join (threads[i], NULL);
+    }
+    free (threads);
+    threads = NULL;
+    n_threads = 0;
+}
+
+unsigned int workers_count (void)
+{
+    return n_threads;
+}
+
+void workers_begin (workers_batch_t *batch, workers_job_fn fn, void *arg,
+                    unsigned int n_jobs)
+{
+    batch->fn = fn;
+    batch->arg = arg;
+    batch->next = NULL;
+    batch->n_jobs = n_jobs;
+    batch->n_claimed = 0;
+    batch->n_done = 0;
+    if (n_jobs == 0) {
+        return;
+    }
+    pthread_mutex_lock (&queue_lock);
+    if (queue_tail != NULL) {
+        queue_tail->next = batch;
+    } else {
+        queue_head = batch;
+    }
+    queue_tail = batch;
+    if (n_jobs == 1) {
+        pthread_cond_signal (&work_available);
+    } else {
+        pthread_cond_broadcast (&work_available);
+    }
+    pthread_mutex_unlock (&queue_lock);
+}
+
+void workers_wait (workers_batch_t *batch)
+{
+    pthread_mutex_lock (&queue_lock);
+    while (batch->n_done < batch->n_jobs) {
+        if (batch->n_claimed < batch->n_jobs) {
+            unsigned int index;
+            if (queue_head != batch) {
+                /* Help with this batch even if it isn't first in queue */
+                workers_batch_t *prev = queue_head;
+                while (prev->next != batch) {
+                    prev = prev->next;
+                }
+                if (batch->n_claimed + 1 == batch->n_jobs) {
+                    prev->next = batch->next;
+                    if (queue_tail == batch) {
+                        queue_tail = prev;
+                    }
+                }
+            }
+            index = claim_job (batch);
+            pthread_mutex_unlock (&queue_lock);
+            execute_job (batch, index);
+            pthread_mutex_lock (&queue_lock);
+        } else {
+            pthread_cond_wait (&batch_done, &queue_lock);
+        }
+    }
+    pthread_mutex_unlock (&queue_lock);
+}
+
+void workers_run (workers_job_fn fn, void *arg, unsigned int n_jobs)
+{
+    workers_batch_t batch;
+    workers_begin (&batch, fn, arg, n_jobs);
+    workers_wait (&batch);
+}